@@ -0,0 +1,605 @@
+/** Microbenchmarks of the direct optimization kernels and the memoized TCM, on the characters and
+ *  TCMs of bench/strings, for tracking across commits.
+ *
+ *  Each benchmark is a kernel on characters of one alphabet and TCM, of a length and divergence:
+ *
+ *    align2d, align2dAffine, align3d  the _ws alignments of lib/core, as the Haskell binding calls
+ *                                     them, on nucleotides. A prefix of the longest unambiguous
+ *                                     sequence is aligned with copies of it with 1%, 10% or 30% of
+ *                                     its elements substituted, deleted or inserted, or, for
+ *                                     "ambiguous", with a prefix of the longest ambiguous sequence.
+ *    alignPair2D                      the memoized aligner of large alphabets, on proteins.
+ *    setUp2dCostMtx, setUp3dCostMtx   building, and freeing, the cost matrices of a TCM.
+ *    getSetCostMedian                 a lookup of each column of an unambiguous and an ambiguous
+ *                                     prefix, in a fresh matrix ("cold", the cost of building it
+ *                                     included) or one that has seen them before ("warm").
+ *
+ *  After a call to warm up, each is called until it has run for --min-time seconds, and at least
+ *  three times. Reported per call are the median and least time, the cells (of the whole
+ *  alignment plane or cube, however few the band fills; entries of the cost matrices; or lookups)
+ *  and cells per second at the median time, and the allocations made and bytes they requested,
+ *  counted by wrapping malloc(), calloc() and realloc() and replacing operator new.
+ *
+ *  Usage: bench_kernels [--data DIR] [--json FILE] [--filter TEXT] [--min-time SECONDS] [--label TEXT]
+ *  where DIR holds dna/ and protein/ (by default ../strings), and only benchmarks whose names
+ *  contain TEXT are run.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../lib/tcm-memo/ffi/memoized-tcm/costMatrix_2d.hpp"
+#include "../../lib/tcm-memo/ffi/memoized-tcm/dynamicCharacterOperations.h"
+#include "../../lib/tcm-memo/ffi/memoized-tcm/pairwiseAlignment.hpp"
+#include "kernels.h"
+
+
+/******************************************** Allocation counts ********************************************/
+
+static std::atomic<size_t> allocations{0}, allocatedBytes{0};
+
+static void countAllocation( size_t bytes )
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    allocatedBytes.fetch_add( bytes, std::memory_order_relaxed );
+}
+
+extern "C" {
+
+void* __real_malloc( size_t size );
+void* __real_calloc( size_t count, size_t size );
+void* __real_realloc( void* ptr, size_t size );
+void  __real_free( void* ptr );
+
+void* __wrap_malloc( size_t size )
+{
+    countAllocation( size );
+    return __real_malloc( size );
+}
+
+void* __wrap_calloc( size_t count, size_t size )
+{
+    countAllocation( count * size );
+    return __real_calloc( count, size );
+}
+
+void* __wrap_realloc( void* ptr, size_t size )
+{
+    countAllocation( size );
+    return __real_realloc( ptr, size );
+}
+
+void __wrap_free( void* ptr )
+{
+    __real_free( ptr );
+}
+
+}
+
+void* operator new( size_t size )
+{
+    countAllocation( size );
+    if (void* ptr = __real_malloc( size ? size : 1 )) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete( void* ptr ) noexcept
+{
+    __real_free( ptr );
+}
+
+void operator delete( void* ptr, size_t ) noexcept
+{
+    __real_free( ptr );
+}
+
+
+/********************************************** The data **********************************************/
+
+struct tcm_t {
+    std::vector<std::string>  symbols;   // Not the gap, which is last.
+    std::vector<unsigned int> costs;     // (symbols + 1) squared.
+
+    size_t alphabetSize() const { return symbols.size() + 1; }
+    unsigned int gap() const { return 1u << symbols.size(); }
+};
+
+
+/** Characters of an alphabet of at most 32 symbols, each element a bit set of them. */
+typedef std::vector<unsigned int> character_t;
+
+
+static std::string readFile( const std::string& path )
+{
+    std::ifstream file( path );
+    if (!file) {
+        fprintf( stderr, "Cannot read %s\n", path.c_str() );
+        exit(1);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+
+/** A line of the symbols, then the matrix of costs, the gap last. */
+static tcm_t readTCM( const std::string& path )
+{
+    std::istringstream lines( readFile( path ) );
+    std::string header;
+    std::getline( lines, header );
+
+    tcm_t tcm;
+    std::istringstream symbols( header );
+    for (std::string symbol; symbols >> symbol; ) tcm.symbols.push_back( symbol );
+    for (unsigned int cost; lines >> cost; ) tcm.costs.push_back( cost );
+
+    if (tcm.costs.size() != tcm.alphabetSize() * tcm.alphabetSize()) {
+        fprintf( stderr, "%s is not a square matrix of its symbols and a gap\n", path.c_str() );
+        exit(1);
+    }
+    return tcm;
+}
+
+
+/** The sets of nucleotides of the IUPAC codes; a lower case code is its set and a gap. */
+static unsigned int nucleotideElement( char code, const tcm_t& tcm )
+{
+    static const std::map<char, std::string> codes =
+        { { 'A', "A"    }, { 'C', "C"    }, { 'G', "G"    }, { 'T', "T"    }, { 'U', "T"    }
+        , { 'R', "AG"   }, { 'Y', "CT"   }, { 'S', "CG"   }, { 'W', "AT"   }, { 'K', "GT"   }, { 'M', "AC" }
+        , { 'B', "CGT"  }, { 'D', "AGT"  }, { 'H', "ACT"  }, { 'V', "ACG"  }, { 'N', "ACGT" }
+        };
+    if (code == '-') return tcm.gap();
+    if (code == '?') return (tcm.gap() << 1) - 1;
+
+    const auto set = codes.find( (char) toupper( code ) );
+    if (set == codes.end()) {
+        fprintf( stderr, "Unknown nucleotide %c\n", code );
+        exit(1);
+    }
+    unsigned int element = islower( code ) ? tcm.gap() : 0;
+    for (const char nucleotide : set->second) {
+        const auto symbol = std::find( tcm.symbols.begin(), tcm.symbols.end(), std::string( 1, nucleotide ) );
+        element |= 1u << (symbol - tcm.symbols.begin());
+    }
+    return element;
+}
+
+
+static unsigned int symbolElement( const std::string& token, const tcm_t& tcm )
+{
+    if (token == "-") return tcm.gap();
+    const auto symbol = std::find( tcm.symbols.begin(), tcm.symbols.end(), token );
+    if (symbol == tcm.symbols.end()) {
+        fprintf( stderr, "Unknown symbol %s\n", token.c_str() );
+        exit(1);
+    }
+    return 1u << (symbol - tcm.symbols.begin());
+}
+
+
+/** The characters of a FASTA file of IUPAC codes, or, if @isFastc, of a FASTC file of
+ *  space-separated symbols with ambiguity groups in square brackets, by name.
+ */
+static std::map<std::string, character_t> readCharacters( const std::string& path, const tcm_t& tcm, bool isFastc )
+{
+    std::map<std::string, character_t> characters;
+    std::istringstream lines( readFile( path ) );
+    character_t* current = nullptr;
+
+    for (std::string line; std::getline( lines, line ); ) {
+        if (line.empty()) continue;
+        if (line[0] == '>') {
+            std::istringstream name( line.substr( 1 ) );
+            std::string        first;
+            name >> first;
+            current = &characters[first];
+            continue;
+        }
+        if (!isFastc) {
+            for (const char code : line) if (!isspace( code )) current->push_back( nucleotideElement( code, tcm ) );
+            continue;
+        }
+        std::istringstream tokens( line );
+        unsigned int group   = 0;
+        bool         inGroup = false;
+        for (std::string token; tokens >> token; ) {
+            if      (token == "[") { inGroup = true; group = 0; }
+            else if (token == "]") { inGroup = false; current->push_back( group ); }
+            else if (inGroup)      group |= symbolElement( token, tcm );
+            else                   current->push_back( symbolElement( token, tcm ) );
+        }
+    }
+    return characters;
+}
+
+
+/** The longest character whose name starts with @prefix. */
+static const character_t& longest( const std::map<std::string, character_t>& characters, char prefix )
+{
+    const character_t* result = nullptr;
+    for (const auto& named : characters) {
+        if (named.first[0] == prefix && (!result || named.second.size() > result->size())) result = &named.second;
+    }
+    return *result;
+}
+
+
+/** A copy of @elements with about @percent in every hundred substituted, deleted or preceded by an insertion. */
+static character_t mutate( const character_t& elements, size_t percent, const tcm_t& tcm, std::mt19937& rng )
+{
+    auto symbol = std::uniform_int_distribution<size_t>( 0, tcm.symbols.size() - 1 );
+    character_t result;
+    for (const unsigned int element : elements) {
+        if (rng() % 100 >= percent) {
+            result.push_back( element );
+            continue;
+        }
+        switch (rng() % 3) {
+            case 0:                                                                     break;
+            case 1:  result.push_back( 1u << symbol(rng) );                             break;
+            default: result.push_back( 1u << symbol(rng) ); result.push_back( element );
+        }
+    }
+    return result;
+}
+
+
+static character_t prefix( const character_t& elements, size_t length )
+{
+    return character_t( elements.begin(), elements.begin() + std::min( length, elements.size() ) );
+}
+
+
+/** A character in dynChar_t's bit-packed form. */
+static std::vector<packedChar> pack( const character_t& elements, size_t alphabetSize )
+{
+    std::vector<packedChar> packed( dynCharSize( alphabetSize, elements.size() ) + 1, 0 );
+    for (size_t i = 0; i < elements.size(); ++i) {
+        for (size_t b = 0; b < alphabetSize; ++b) {
+            if (elements[i] >> b & 1) SetBit( packed.data(), i * alphabetSize + b );
+        }
+    }
+    return packed;
+}
+
+
+/** Elements of dcElemSize(alphabetSize) words each, one after another. */
+static std::vector<packedChar> unpack( const character_t& elements, size_t alphabetSize )
+{
+    const size_t elementSize = dcElemSize( alphabetSize );
+    std::vector<packedChar> result( elements.size() * elementSize, 0 );
+    for (size_t i = 0; i < elements.size(); ++i) {
+        for (size_t b = 0; b < alphabetSize; ++b) {
+            if (elements[i] >> b & 1) SetBit( result.data() + i * elementSize, b );
+        }
+    }
+    return result;
+}
+
+
+struct alphabet_t {
+    std::string                        name;
+    std::vector<std::string>           tcmNames;
+    std::vector<tcm_t>                 tcms;
+    std::map<std::string, character_t> characters;
+};
+
+
+static alphabet_t readAlphabet( const std::string& directory, const std::string& name, const std::string& extension )
+{
+    alphabet_t alphabet;
+    alphabet.name = name;
+    for (const std::string tcmName : { "L1-norm", "discrete", "pref-gap", "pref-sub" }) {
+        alphabet.tcmNames.push_back( tcmName );
+        alphabet.tcms.push_back( readTCM( directory + "/" + name + "/" + name + "-" + tcmName + ".tcm" ) );
+    }
+    alphabet.characters = readCharacters( directory + "/" + name + "/" + name + "-sequences." + extension
+                                        , alphabet.tcms.front(), extension == "fastc" );
+    return alphabet;
+}
+
+
+/** The @count characters to align: an unambiguous prefix of @length, then mutations of it, or a
+ *  prefix of the ambiguous character if @divergence is 0.
+ */
+static std::vector<character_t> makeCharacters( const alphabet_t& alphabet, size_t count, size_t length, size_t divergence )
+{
+    std::mt19937 rng( (unsigned int) (length * 131 + divergence) );
+    const auto   tcm      = alphabet.tcms.front();
+    const auto   ancestor = prefix( longest( alphabet.characters, 'a' ), length );
+
+    std::vector<character_t> result{ ancestor };
+    if (divergence == 0) result.push_back( prefix( longest( alphabet.characters, 'r' ), length ) );
+    while (result.size() < count) result.push_back( mutate( ancestor, divergence ? divergence : 10, tcm, rng ) );
+    return result;
+}
+
+
+static std::string divergenceName( size_t divergence )
+{
+    return divergence ? std::to_string( divergence ) + "%" : "ambiguous";
+}
+
+
+/********************************************** Benchmarks **********************************************/
+
+struct benchmark_t {
+    std::string kernel, alphabet, tcm, divergence;
+    size_t      length;
+    double      cells;                                    // Per call.
+    std::function<std::function<unsigned int()>()> prepare;   // Makes the call, only if it is run.
+
+    std::string name() const
+    {
+        std::string result = kernel + "/" + alphabet + "-" + tcm;
+        if (!divergence.empty()) result += "/" + divergence;
+        if (length)              result += "/" + std::to_string( length );
+        return result;
+    }
+};
+
+
+struct result_t {
+    const benchmark_t* benchmark;
+    size_t             iterations;
+    double             medianSeconds, minSeconds, allocations, allocatedBytes;
+};
+
+
+static const size_t divergences[] = { 1, 10, 30, 0 };
+
+
+static void addAlignments( std::vector<benchmark_t>& benchmarks, const alphabet_t& dna )
+{
+    for (size_t t = 0; t < dna.tcms.size(); ++t) {
+        const auto tcm = dna.tcms[t];
+        for (const size_t divergence : divergences) {
+            for (const size_t length : { 100, 400, 1600 }) {
+                const auto   characters = makeCharacters( dna, 2, length, divergence );
+                const double cells      = (double) (characters[0].size() + 1) * (characters[1].size() + 1);
+
+                for (const unsigned int gapOpen : { 0, 3 }) {
+                    benchmarks.push_back( { gapOpen ? "align2dAffine" : "align2d", dna.name, dna.tcmNames[t]
+                                          , divergenceName( divergence ), length, cells, [=]() {
+                        const unsigned int* values[]  = { characters[0].data(), characters[1].data() };
+                        const size_t        lengths[] = { characters[0].size(), characters[1].size() };
+                        std::shared_ptr<bench_alignment_t> alignment( bench_alloc_alignment( 2, values, lengths ), bench_free_alignment );
+                        std::shared_ptr<void> costMtx( bench_alloc_matrix_2d( tcm.costs.data(), tcm.alphabetSize(), gapOpen )
+                                                     , []( void* matrix ) { bench_free_matrix( matrix, 1 ); } );
+                        return std::function<unsigned int()>( [=]() {
+                            return (unsigned int) (gapOpen ? bench_align2dAffine( alignment.get(), costMtx.get() )
+                                                           : bench_align2d( alignment.get(), costMtx.get() ));
+                        } );
+                    } } );
+                }
+            }
+
+            for (const size_t length : { 25, 50, 100 }) {
+                const auto   characters = makeCharacters( dna, 3, length, divergence );
+                const double cells      = (double) (characters[0].size() + 1) * (characters[1].size() + 1) * (characters[2].size() + 1);
+
+                benchmarks.push_back( { "align3d", dna.name, dna.tcmNames[t], divergenceName( divergence ), length, cells, [=]() {
+                    const unsigned int* values[]  = { characters[0].data(), characters[1].data(), characters[2].data() };
+                    const size_t        lengths[] = { characters[0].size(), characters[1].size(), characters[2].size() };
+                    std::shared_ptr<bench_alignment_t> alignment( bench_alloc_alignment( 3, values, lengths ), bench_free_alignment );
+                    std::shared_ptr<void> costMtx( bench_alloc_matrix_3d( tcm.costs.data(), tcm.alphabetSize(), 0 )
+                                                 , []( void* matrix ) { bench_free_matrix( matrix, 0 ); } );
+                    return std::function<unsigned int()>( [=]() {
+                        return (unsigned int) bench_align3d( alignment.get(), costMtx.get(), 0 );
+                    } );
+                } } );
+            }
+        }
+    }
+}
+
+
+static void addMatrixSetUps( std::vector<benchmark_t>& benchmarks, const alphabet_t& dna )
+{
+    for (size_t t = 0; t < dna.tcms.size(); ++t) {
+        const auto   tcm      = dna.tcms[t];
+        const double elements = (double) (1u << tcm.alphabetSize());
+
+        benchmarks.push_back( { "setUp2dCostMtx", dna.name, dna.tcmNames[t], "", 0, elements * elements, [=]() {
+            return std::function<unsigned int()>( [=]() {
+                bench_free_matrix( bench_alloc_matrix_2d( tcm.costs.data(), tcm.alphabetSize(), 0 ), 1 );
+                return 0u;
+            } );
+        } } );
+        benchmarks.push_back( { "setUp3dCostMtx", dna.name, dna.tcmNames[t], "", 0, elements * elements * elements, [=]() {
+            return std::function<unsigned int()>( [=]() {
+                bench_free_matrix( bench_alloc_matrix_3d( tcm.costs.data(), tcm.alphabetSize(), 0 ), 0 );
+                return 0u;
+            } );
+        } } );
+    }
+}
+
+
+static void addMemoized( std::vector<benchmark_t>& benchmarks, const alphabet_t& alphabet, bool withAlignments )
+{
+    const size_t lookups = 1024;
+
+    for (size_t t = 0; t < alphabet.tcms.size(); ++t) {
+        const auto   tcm          = alphabet.tcms[t];
+        const size_t alphabetSize = tcm.alphabetSize(),
+                     elementSize  = dcElemSize( alphabetSize );
+        const auto   characters   = makeCharacters( alphabet, 2, lookups, 0 );
+        const size_t count        = std::min( characters[0].size(), characters[1].size() );
+        const auto   left         = unpack( characters[0], alphabetSize ),
+                     right        = unpack( characters[1], alphabetSize );
+
+        const auto lookUp = [=]( CostMatrix_2d& matrix, std::vector<packedChar>& median ) {
+            unsigned int total = 0;
+            for (size_t i = 0; i < count; ++i) {
+                total += matrix.getSetCostMedian( left.data() + i * elementSize, right.data() + i * elementSize, median.data() );
+            }
+            return total;
+        };
+
+        benchmarks.push_back( { "getSetCostMedian", alphabet.name, alphabet.tcmNames[t], "cold", 0, (double) count, [=]() {
+            auto median = std::make_shared<std::vector<packedChar>>( elementSize );
+            return std::function<unsigned int()>( [=]() {
+                CostMatrix_2d matrix( alphabetSize, const_cast<unsigned int*>( tcm.costs.data() ) );
+                return lookUp( matrix, *median );
+            } );
+        } } );
+        benchmarks.push_back( { "getSetCostMedian", alphabet.name, alphabet.tcmNames[t], "warm", 0, (double) count, [=]() {
+            auto median = std::make_shared<std::vector<packedChar>>( elementSize );
+            auto matrix = std::make_shared<CostMatrix_2d>( alphabetSize, const_cast<unsigned int*>( tcm.costs.data() ) );
+            lookUp( *matrix, *median );
+            return std::function<unsigned int()>( [=]() { return lookUp( *matrix, *median ); } );
+        } } );
+
+        if (!withAlignments) continue;
+        for (const size_t divergence : divergences) {
+            for (const size_t length : { 100, 400, 1600 }) {
+                const auto   pair  = makeCharacters( alphabet, 2, length, divergence );
+                const double cells = (double) (pair[0].size() + 1) * (pair[1].size() + 1);
+
+                benchmarks.push_back( { "alignPair2D", alphabet.name, alphabet.tcmNames[t], divergenceName( divergence ), length, cells, [=]() {
+                    auto matrix  = std::make_shared<CostMatrix_2d>( alphabetSize, const_cast<unsigned int*>( tcm.costs.data() ) );
+                    auto first   = std::make_shared<std::vector<packedChar>>( pack( pair[0], alphabetSize ) ),
+                         second  = std::make_shared<std::vector<packedChar>>( pack( pair[1], alphabetSize ) ),
+                         medians = std::make_shared<std::vector<packedChar>>( dynCharSize( alphabetSize, pair[0].size() + pair[1].size() ) + 1 );
+                    auto columns = std::make_shared<std::vector<unsigned char>>( pair[0].size() + pair[1].size() + 1 );
+                    return std::function<unsigned int()>( [=]() {
+                        size_t length = 0;
+                        return alignPair2D( *matrix, pair[0].size(), first->data(), pair[1].size(), second->data()
+                                          , medians->data(), columns->data(), &length );
+                    } );
+                } } );
+            }
+        }
+    }
+}
+
+
+static double secondsSince( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+
+/** Where results go, so that no call is optimized away. */
+static volatile unsigned int sink;
+
+static result_t run( const benchmark_t& benchmark, double minTime )
+{
+    const auto call = benchmark.prepare();
+    sink = call();
+
+    std::vector<double> times;
+    times.reserve( 1 << 16 );
+    const size_t allocationsBefore = allocations.load(), bytesBefore = allocatedBytes.load();
+
+    double total = 0;
+    while ((total < minTime || times.size() < 3) && times.size() < times.capacity()) {
+        const auto start = std::chrono::steady_clock::now();
+        sink = call();
+        times.push_back( secondsSince( start ) );
+        total += times.back();
+    }
+
+    const double iterations = (double) times.size();
+    result_t result{ &benchmark, times.size(), 0, 0
+                   , (double) (allocations.load()    - allocationsBefore) / iterations
+                   , (double) (allocatedBytes.load() - bytesBefore)       / iterations };
+    std::sort( times.begin(), times.end() );
+    result.medianSeconds = times[times.size() / 2];
+    result.minSeconds    = times.front();
+    return result;
+}
+
+
+static std::string quoted( const std::string& text )
+{
+    std::string result = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+
+static void writeJSON( const std::string& path, const std::string& label, double minTime, const std::vector<result_t>& results )
+{
+    FILE* file = fopen( path.c_str(), "w" );
+    if (!file) {
+        fprintf( stderr, "Cannot write %s\n", path.c_str() );
+        exit(1);
+    }
+    fprintf( file, "{\n  \"label\": %s,\n  \"min_time\": %g,\n  \"benchmarks\": [\n", quoted( label ).c_str(), minTime );
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        const auto& b = *r.benchmark;
+        fprintf( file, "    { \"name\": %s, \"kernel\": %s, \"alphabet\": %s, \"tcm\": %s, \"divergence\": %s, \"length\": %zu"
+                       ", \"iterations\": %zu, \"median_seconds\": %.9g, \"min_seconds\": %.9g, \"cells\": %.0f"
+                       ", \"cells_per_second\": %.6g, \"allocations\": %.6g, \"allocated_bytes\": %.6g }%s\n"
+               , quoted( b.name() ).c_str(), quoted( b.kernel ).c_str(), quoted( b.alphabet ).c_str(), quoted( b.tcm ).c_str()
+               , quoted( b.divergence ).c_str(), b.length, r.iterations, r.medianSeconds, r.minSeconds, b.cells
+               , b.cells / r.medianSeconds, r.allocations, r.allocatedBytes, i + 1 < results.size() ? "," : "" );
+    }
+    fprintf( file, "  ]\n}\n" );
+    fclose( file );
+}
+
+
+int main( int argc, char* argv[] )
+{
+    std::string data = "../strings", json, filter, label;
+    double      minTime = 0.1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if      (option == "--data")     data    = argv[i + 1];
+        else if (option == "--json")     json    = argv[i + 1];
+        else if (option == "--filter")   filter  = argv[i + 1];
+        else if (option == "--min-time") minTime = atof( argv[i + 1] );
+        else if (option == "--label")    label   = argv[i + 1];
+        else {
+            fprintf( stderr, "Unknown option %s\n", option.c_str() );
+            return 1;
+        }
+    }
+
+    const auto dna     = readAlphabet( data, "dna",     "fasta" ),
+               protein = readAlphabet( data, "protein", "fastc" );
+
+    std::vector<benchmark_t> benchmarks;
+    addAlignments  ( benchmarks, dna );
+    addMatrixSetUps( benchmarks, dna );
+    addMemoized    ( benchmarks, dna,     false );
+    addMemoized    ( benchmarks, protein, true  );
+
+    printf( "%-46s %10s %12s %12s %14s %12s %14s\n"
+          , "benchmark", "calls", "median s", "min s", "cells/s", "allocs/call", "bytes/call" );
+    std::vector<result_t> results;
+    for (const auto& benchmark : benchmarks) {
+        if (benchmark.name().find( filter ) == std::string::npos) continue;
+        results.push_back( run( benchmark, minTime ) );
+        const auto& r = results.back();
+        printf( "%-46s %10zu %12.3e %12.3e %14.4e %12.1f %14.1f\n"
+              , benchmark.name().c_str(), r.iterations, r.medianSeconds, r.minSeconds
+              , benchmark.cells / r.medianSeconds, r.allocations, r.allocatedBytes );
+        fflush( stdout );
+    }
+
+    if (!json.empty()) writeJSON( json, label, minTime, results );
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../lib/core/ffi/external-direct-optimization/c_alignment_interface.h"
+#include "../../lib/core/ffi/external-direct-optimization/c_code_alloc_setup.h"
+#include "../../lib/core/ffi/external-direct-optimization/costMatrix.h"
+#include "kernels.h"
+
+
+struct bench_alignment_t {
+    size_t                 count;
+    elem_t                *vals[3];
+    size_t                 lengths[3];
+    size_t                 room;
+    alignIO_t             *io[8];        // the inputs, then the outputs
+    alignment_workspace_t *workspace;
+};
+
+
+void *bench_alloc_matrix_2d( const unsigned int *tcm, size_t alphSize, unsigned int gapOpen )
+{
+    cost_matrices_2d_t *costMtx = malloc( sizeof(cost_matrices_2d_t) );
+    setUp2dCostMtx( costMtx, (unsigned int *) tcm, alphSize, gapOpen );
+    return costMtx;
+}
+
+
+void *bench_alloc_matrix_3d( const unsigned int *tcm, size_t alphSize, unsigned int gapOpen )
+{
+    cost_matrices_3d_t *costMtx = malloc( sizeof(cost_matrices_3d_t) );
+    setUp3dCostMtx( costMtx, (unsigned int *) tcm, alphSize, gapOpen );
+    return costMtx;
+}
+
+
+void bench_free_matrix( void *costMtx, int is2d )
+{
+    freeCostMtx( costMtx, is2d );
+}
+
+
+bench_alignment_t *bench_alloc_alignment( size_t count, const unsigned int *const *characters, const size_t *lengths )
+{
+    bench_alignment_t *alignment = calloc( 1, sizeof(bench_alignment_t) );
+    alignment->count = count;
+    alignment->room  = 2;
+    for (size_t i = 0; i < count; i++) {
+        alignment->lengths[i] = lengths[i];
+        alignment->vals[i]    = malloc( (lengths[i] + 1) * sizeof(elem_t) );
+        memcpy( alignment->vals[i], characters[i], lengths[i] * sizeof(elem_t) );
+        alignment->room      += lengths[i];
+    }
+    for (size_t i = 0; i < 8; i++) alignment->io[i] = allocAlignIO( alignment->room );
+    alignment->workspace = allocAlignmentWorkspace();
+    return alignment;
+}
+
+
+void bench_free_alignment( bench_alignment_t *alignment )
+{
+    for (size_t i = 0; i < alignment->count; i++) free( alignment->vals[i] );
+    for (size_t i = 0; i < 8; i++) {
+        freeAlignIO( alignment->io[i] );
+        free( alignment->io[i] );
+    }
+    freeAlignmentWorkspace( alignment->workspace );
+    free( alignment );
+}
+
+
+/** Put the characters back into the inputs, which an alignment may leave changed, and empty the outputs. */
+static void reset_alignment( bench_alignment_t *alignment )
+{
+    for (size_t i = 0; i < 8; i++) {
+        alignIO_t *io = alignment->io[i];
+        io->length = i < alignment->count ? alignment->lengths[i] : 0;
+        if (io->length) {
+            memcpy( io->character + io->capacity - io->length, alignment->vals[i], io->length * sizeof(elem_t) );
+        }
+    }
+}
+
+
+int bench_align2d( bench_alignment_t *alignment, void *costMtx2d )
+{
+    reset_alignment( alignment );
+    alignIO_t **io = alignment->io;
+    return align2d_ws( io[0], io[1], io[2], io[3], costMtx2d, 1, 1, 1, UINT_MAX, alignment->workspace );
+}
+
+
+int bench_align2dAffine( bench_alignment_t *alignment, void *costMtx2d )
+{
+    reset_alignment( alignment );
+    alignIO_t **io = alignment->io;
+    return align2dAffine_ws( io[0], io[1], io[2], io[3], costMtx2d, 1, UINT_MAX, alignment->workspace );
+}
+
+
+int bench_align3d( bench_alignment_t *alignment, void *costMtx3d, unsigned int gapOpen )
+{
+    reset_alignment( alignment );
+    alignIO_t **io = alignment->io;
+    return align3d_ws( io[0], io[1], io[2], io[3], io[4], io[5], io[6], io[7]
+                     , costMtx3d, gapOpen, UINT_MAX, alignment->workspace );
+}
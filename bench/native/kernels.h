@@ -0,0 +1,50 @@
+/** The direct optimization kernels of lib/core, behind an interface C++ can include.
+ *
+ *  The C headers of the alignment code are not valid C++, so bench_kernels.cpp reaches the
+ *  kernels through these wrappers, compiled as C. Characters are arrays of elements, each a
+ *  bit set of the symbols of an alphabet of at most 8, the gap the last.
+ */
+
+#ifndef BENCH_KERNELS_H
+#define BENCH_KERNELS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Two or three characters to align, the alignIOs to align them in, and a workspace. */
+typedef struct bench_alignment_t bench_alignment_t;
+
+
+/** A 2D cost matrix of a TCM of alphSize * alphSize costs, affine if gapOpen is not 0. */
+void *bench_alloc_matrix_2d( const unsigned int *tcm, size_t alphSize, unsigned int gapOpen );
+
+/** A 3D cost matrix of a TCM of alphSize * alphSize costs. */
+void *bench_alloc_matrix_3d( const unsigned int *tcm, size_t alphSize, unsigned int gapOpen );
+
+void bench_free_matrix( void *costMtx, int is2d );
+
+
+/** Copies the count characters, two or three, and allocates room for their alignment. */
+bench_alignment_t *bench_alloc_alignment( size_t count, const unsigned int *const *characters, const size_t *lengths );
+
+void bench_free_alignment( bench_alignment_t *alignment );
+
+
+/** Align the characters with align2d_ws(), align2dAffine_ws() or align3d_ws(), with no cost
+ *  ceiling, getting every output. Each call starts again from the characters as copied, and
+ *  returns the cost.
+ */
+int bench_align2d( bench_alignment_t *alignment, void *costMtx2d );
+
+int bench_align2dAffine( bench_alignment_t *alignment, void *costMtx2d );
+
+int bench_align3d( bench_alignment_t *alignment, void *costMtx3d, unsigned int gapOpen );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BENCH_KERNELS_H
@@ -25,10 +25,12 @@ module Analysis.Distance
   ) where
 
 import           Analysis.Parsimony.Dynamic.DirectOptimization
+import           Analysis.Parsimony.Dynamic.DirectOptimization.Pairwise  (foreignAllPairsDistances)
 import           Bio.Character
 import           Bio.Character.Decoration.Continuous
 import           Bio.Character.Decoration.Discrete
 import           Bio.Character.Decoration.Dynamic
+import           Bio.Metadata.Dynamic                          (DynamicCharacterMetadataDec)
 import           Bio.Metadata.Metric
 import           Bio.Sequence
 import qualified Bio.Sequence.Block                            as Blk
@@ -39,10 +41,15 @@ import           Control.Parallel.Strategies                   (rpar)
 import           Data.Foldable
 import           Data.Matrix.Unboxed                           (Matrix)
 import qualified Data.Matrix.Unboxed                           as Matrix
+import           Data.Maybe                                    (isJust)
 import           Data.MonoTraversable
 import           Data.Monoid
 import           Data.TCM.Dense
-import           Data.Vector                                   hiding (foldMap, length)
+import           Data.TCM.Memoized                             (MemoizedCostMatrix)
+import           Data.Vector                                   (Vector, (!))
+import qualified Data.Vector                                   as V
+import qualified Data.Vector.Storable                          as SV
+import qualified Data.Vector.Unboxed                           as U
 import           Numeric.Extended.Real
 
 
@@ -64,6 +71,12 @@ characterSequenceDistance
 characterSequenceDistance = foldZipWithMeta blockDistance
 
 
+-- |
+-- The distance between each pair of leaves.
+--
+-- Dynamic characters with a dense TCM are aligned in C, all leaves at once; see
+-- 'foreignAllPairsDistances'. The other characters are compared a row of the
+-- matrix to a spark.
 characterDistanceMatrix
   :: forall f u v w x y z m .
   ( (HasIntervalCharacter u ContinuousCharacter )
@@ -79,11 +92,45 @@ characterDistanceMatrix
   -> MetadataSequence m
   -> Matrix Double
 characterDistanceMatrix leaves meta =
-  let numLeaves = length leaves
-      distFn (i,j)  =  getSum $ characterSequenceDistance meta (leaves ! i) (leaves ! j)
-      matrixEntries :: [Double]
-      matrixEntries = parmap rpar distFn [(i,j) | i <- [0..(numLeaves - 1)], j <- [0..(numLeaves - 1)]]
-  in  Matrix.fromList (numLeaves, numLeaves) matrixEntries
+    Matrix.fromVector (numLeaves, numLeaves) $ U.zipWith (+) nativeDistances otherDistances
+  where
+    numLeaves = length leaves
+
+    otherDistances :: U.Vector Double
+    otherDistances = U.concat $ parmap rpar row [0 .. numLeaves - 1]
+      where
+        row i = U.generate numLeaves $ \j ->
+            getSum $ foldZipWithMeta (blockDistanceWith skipNative) meta (leaves ! i) (leaves ! j)
+        skipNative m c1 c2
+          | isNative m = mempty
+          | otherwise  = dynamicCharacterDistance m c1 c2
+
+    nativeDistances :: U.Vector Double
+    nativeDistances = foldl' (U.zipWith (+)) (U.replicate (numLeaves * numLeaves) 0) $ do
+        (b, blockMeta) <- zip [0..] $ otoList meta
+        (c, charMeta)  <- zip [0..] . toList $ blockMeta ^. dynamicBin
+        dense          <- toList $ charMeta ^. denseTransitionCostMatrix
+        pure . U.map ((charMeta ^. characterWeight) *) $ nativeCharacterDistances dense b c
+
+    isNative = isJust . (^. denseTransitionCostMatrix)
+
+    -- A leaf may have several decorations of a character, and its distance to
+    -- another leaf is the sum of the distances of every pair of them, so each
+    -- decoration of each leaf is aligned against every other at once.
+    nativeCharacterDistances :: DenseTransitionCostMatrix -> Int -> Int -> U.Vector Double
+    nativeCharacterDistances dense b c = U.generate (numLeaves * numLeaves) cell
+      where
+        decorations = V.map (\leaf -> toList $ ((otoList leaf !! b) ^. dynamicBin) ! c) leaves
+        counts      = V.map length decorations
+        offsets     = V.prescanl' (+) 0 counts
+        itemCount   = V.sum counts
+        costs       = foreignAllPairsDistances dense . fmap (^. encoded) . fold $ toList decorations
+
+        cell k =
+            let (i, j) = k `divMod` numLeaves
+            in  sum [ fromIntegral $ costs SV.! (p * itemCount + q) | p <- items i, q <- items j ]
+
+        items i = [ offsets ! i .. offsets ! i + counts ! i - 1 ]
 
 
 blockDistance
@@ -101,7 +148,27 @@ blockDistance
   -> CharacterBlock (f u) (f v) (f w) (f x) (f y) (f z)
   -> CharacterBlock (f u) (f v) (f w) (f x) (f y) (f z)
   -> Sum Double
-blockDistance meta block1 block2
+blockDistance = blockDistanceWith dynamicCharacterDistance
+
+
+-- |
+-- As 'blockDistance', with the distance of the dynamic characters given.
+blockDistanceWith
+  :: forall u v w x y z m f .
+     ( Applicative f
+     , HasIntervalCharacter u ContinuousCharacter
+     , HasDiscreteCharacter v StaticCharacter
+     , HasDiscreteCharacter w StaticCharacter
+     , HasDiscreteCharacter x StaticCharacter
+     , HasDiscreteCharacter y StaticCharacter
+     , Foldable f
+     )
+  => (DynamicCharacterMetadataDec (Subcomponent (Element DynamicCharacter)) -> f z -> f z -> Sum Double)
+  -> MetadataBlock m
+  -> CharacterBlock (f u) (f v) (f w) (f x) (f y) (f z)
+  -> CharacterBlock (f u) (f v) (f w) (f x) (f y) (f z)
+  -> Sum Double
+blockDistanceWith dynamicDistance meta block1 block2
   = hexFold $
     Blk.hexZipWithMeta
       (characterDistance @ExtendedReal (^.   intervalCharacter @u))
@@ -109,7 +176,7 @@ blockDistance meta block1 block2
       (characterDistance @Word         (^.   discreteCharacter))
       (characterDistance @Word         (^.   discreteCharacter))
       (characterDistance @Word         (^.   discreteCharacter))
-      dynamicCharacterDistance
+      dynamicDistance
       meta
       block1
       block2
@@ -132,10 +199,12 @@ dynamicCharacterDistance
   :: forall m d c f .
      ( Applicative f
      , DirectOptimizationPostorderDecoration d c
+     , ExportableBuffer c
      , ExportableElements c
      , Foldable f
      , GetDenseTransitionCostMatrix m (Maybe DenseTransitionCostMatrix)
      , GetPairwiseTransitionCostMatrix m (Subcomponent (Element c)) Word
+     , GetSparseTransitionCostMatrix m (Maybe MemoizedCostMatrix)
      , HasCharacterWeight m Double
      , Ord (Subcomponent (Element c))
      , Show c
@@ -150,9 +219,11 @@ dynamicCharacterDistance meta c1 c2 = foldMap (Sum . (weight *) . fromIntegral)
 dynamicCharacterDistance'
   :: forall m d c
    . ( DirectOptimizationPostorderDecoration d c
+     , ExportableBuffer c
      , ExportableElements c
      , GetDenseTransitionCostMatrix m (Maybe DenseTransitionCostMatrix)
      , GetPairwiseTransitionCostMatrix m (Subcomponent (Element c)) Word
+     , GetSparseTransitionCostMatrix m (Maybe MemoizedCostMatrix)
      , Ord (Subcomponent (Element c))
      , Show c
      )
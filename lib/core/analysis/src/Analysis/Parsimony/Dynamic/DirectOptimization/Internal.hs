@@ -43,6 +43,7 @@ import qualified Data.List.NonEmpty                                     as NE
 import           Data.MonoTraversable
 import           Data.Semigroup
 import           Data.TCM.Dense
+import           Data.TCM.Memoized                                      (MemoizedCostMatrix)
 import           Data.Word
 import           Prelude                                                hiding (zipWith)
 
@@ -66,9 +67,11 @@ type PairwiseAlignment s = s -> s -> (Word, s)
 -- Select the most appropriate direct optimization metric implementation.
 selectDynamicMetric
   :: ( EncodableDynamicCharacter c
+     , ExportableBuffer c
      , ExportableElements c
      , GetDenseTransitionCostMatrix dec (Maybe DenseTransitionCostMatrix)
      , GetPairwiseTransitionCostMatrix dec (Subcomponent (Element c)) Word
+     , GetSparseTransitionCostMatrix dec (Maybe MemoizedCostMatrix)
      , Ord (Subcomponent (Element c))
      , Show c
      )
@@ -80,7 +83,9 @@ selectDynamicMetric meta =
     case {-# SCC getDense #-} meta ^. denseTransitionCostMatrix of
       Just dm -> {-# SCC foreignPairwiseDO #-} foreignPairwiseDO dm
       Nothing -> let !pTCM = meta ^. pairwiseTransitionCostMatrix
-                 in  {-# SCC unboxedUkkonen #-} unboxedUkkonenFullSpaceDO pTCM
+                 in  case meta ^. sparseTransitionCostMatrix of
+                       Just memo -> {-# SCC foreignMemoized #-} foreignMemoizedPairwiseDO memo pTCM
+                       Nothing   -> {-# SCC unboxedUkkonen  #-} unboxedUkkonenFullSpaceDO pTCM
 
 
 -- |
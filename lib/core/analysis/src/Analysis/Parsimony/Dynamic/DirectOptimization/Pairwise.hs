@@ -13,8 +13,13 @@
 -----------------------------------------------------------------------------
 
 module Analysis.Parsimony.Dynamic.DirectOptimization.Pairwise
-  ( OverlapFunction
+  ( AlignmentWorkspaceStats(..)
+  , OverlapFunction
+  , foreignAlignmentWorkspaceStats
+  , foreignAllPairsDistances
   , foreignPairwiseDO
+  , foreignPairwiseDOWithCeiling
+  , foreignMemoizedPairwiseDO
 --  , foreignThreeWayDO
   , naiveDO
   , naiveDOMemo
@@ -28,6 +28,7 @@ import           Data.List.NonEmpty                                     (NonEmpt
 import           Data.MonoTraversable
 import           Data.TCM.Dense
 import           Data.TCM.Memoized
+import qualified Data.Vector.Storable                                   as SV
 import           Test.Custom.NucleotideSequence
 import           Test.QuickCheck
 import           Test.Tasty
@@ -43,11 +44,14 @@ testSuite = testGroup "Pairwise alignment tests"
     , testSuiteMemoizedDO
     , testSuiteUkkonnenDO
     , testSuiteForeignDO
+    , testSuiteForeignMemoizedDO
+    , testSuiteForeignAllPairs
     , testSuiteUnboxedFullMatrixDO
     , testSuiteUnboxedFullSwappingDO
     , testSuiteUnboxedUkkonenSwapDO
     , testSuiteUnboxedUkkonenFullDO
     , constistentImplementation
+    , consistentForeignMemoized
     ]
 
 
@@ -85,6 +89,24 @@ consistentResults testLabel metric = SC.testProperty testLabel $ SC.forAll check
                    ]
 
 
+consistentForeignMemoized :: TestTree
+consistentForeignMemoized = testGroup "Foreign C++ memoized DO returns the same as Unboxed Ukkonen (Full Space) DO"
+    [ sameAlignment "Consistenty over discrete metric" discreteMetric
+    , sameAlignment "Consistenty over L1 norm" l1Norm
+    , sameAlignment "Consistenty over prefer substitution metric (1:2)" preferSubMetric
+    , sameAlignment "Consistenty over prefer insertion/deletion metric (2:1)" preferGapMetric
+    ]
+  where
+    sameAlignment testLabel metric = testProperty testLabel f
+      where
+        memo    = genMemoMatrix metric
+        overlap = getMedianAndCost2D memo
+
+        f :: (NucleotideSequence, NucleotideSequence) -> Property
+        f (NS lhs, NS rhs) =
+            foreignMemoizedPairwiseDO memo overlap lhs rhs === unboxedUkkonenFullSpaceDO overlap lhs rhs
+
+
 showResult
   :: (AmbiguityGroup -> AmbiguityGroup -> AmbiguityGroup)
   -> (Word, DynamicCharacter)
@@ -199,6 +221,50 @@ testSuiteForeignDO = testGroup "Foreign C DO"
     ]
 
 
+testSuiteForeignAllPairs :: TestTree
+testSuiteForeignAllPairs = testGroup "Foreign C all-pairs distances"
+    [ sameCosts "Foreign C all-pairs distances over discrete metric" discreteMetric
+    , sameCosts "Foreign C all-pairs distances over L1 norm" l1Norm
+    , sameCosts "Foreign C all-pairs distances over prefer substitution metric (1:2)" preferSubMetric
+    , sameCosts "Foreign C all-pairs distances over prefer insertion/deletion metric (2:1)" preferGapMetric
+    ]
+  where
+    sameCosts testLabel metric = testProperty testLabel f
+      where
+        dense = genDenseMatrix metric
+
+        -- Every entry, the diagonal included, is the cost of the pair from 'foreignPairwiseDO'.
+        f :: [NucleotideSequence] -> Property
+        f input = counterexample (show costs) $
+            SV.length costs === n * n .&&. conjoin
+              [ counterexample (show (i, j)) $
+                  fromIntegral (costs SV.! (i * n + j)) === fst (foreignPairwiseDO dense x y)
+              | (i, x) <- zip [0..] chars
+              , (j, y) <- zip [0..] chars
+              ]
+          where
+            chars = take 6 $ (\(NS c) -> c) <$> input
+            n     = length chars
+            costs = foreignAllPairsDistances dense chars
+
+
+testSuiteForeignMemoizedDO :: TestTree
+testSuiteForeignMemoizedDO = testGroup "Foreign C++ memoized DO"
+    [ isValidPairwiseAlignment "Foreign C++ memoized DO over discrete metric"
+       $ foreignMemoizedDO discreteMetric
+    , isValidPairwiseAlignment "Foreign C++ memoized DO over L1 norm"
+       $ foreignMemoizedDO l1Norm
+    , isValidPairwiseAlignment "Foreign C++ memoized DO over prefer substitution metric (1:2)"
+       $ foreignMemoizedDO preferSubMetric
+    , isValidPairwiseAlignment "Foreign C++ memoized DO over prefer insertion/deletion metric (2:1)"
+       $ foreignMemoizedDO preferGapMetric
+    ]
+  where
+    foreignMemoizedDO metric =
+        let memo = genMemoMatrix metric
+        in  foreignMemoizedPairwiseDO memo (getMedianAndCost2D memo)
+
+
 {-
 isValidPairwiseAlignment
   :: DOCharConstraint s
@@ -46,7 +46,6 @@ import           Bio.Character.Exportable
 import           Control.DeepSeq
 import           Control.Lens                                   ((^.))
 import           Control.Monad                                  (when)
-import           Control.Monad.Loops                            (whileM)
 import           Control.Monad.ST
 import           Data.Alphabet
 import           Data.Binary
@@ -54,11 +53,10 @@ import           Data.BitMatrix
 import           Data.BitVector.LittleEndian
 import           Data.BitVector.LittleEndian.Instances          ()
 import           Data.Bits
-import           Data.Coerce
 import           Data.Foldable
 import           Data.Hashable
 import qualified Data.IntMap                                    as IM
-import           Data.Key
+import           Data.List                                      (foldl1')
 import qualified Data.List.NonEmpty                             as NE
 import           Data.List.Utility                              (invariantTransformation, occurrences)
 import           Data.MonoTraversable
@@ -66,10 +64,13 @@ import           Data.STRef
 import           Data.Semigroup
 import           Data.Semigroup.Foldable
 import qualified Data.Vector                                    as EV
-import qualified Data.Vector.Mutable                            as MV
-import           Data.Vector.NonEmpty                           (Vector)
-import qualified Data.Vector.NonEmpty                           as V
+import           Data.Vector.Binary                             ()
+import qualified Data.Vector.NonEmpty                           as NEV
+import qualified Data.Vector.Storable                           as SV
+import qualified Data.Vector.Storable.Mutable                   as SMV
+import qualified Data.Vector.Unboxed                            as UV
 import qualified Data.Vector.Unboxed.Mutable                    as MUV
+import           Foreign.C.Types                                (CUInt)
 import           GHC.Generics
 import           Test.QuickCheck
 import           Test.QuickCheck.Arbitrary.Instances            ()
@@ -83,11 +84,18 @@ import           TextShow                                       (TextShow (showb
 -- character states of the dynamic character. The dynamic character relies on
 -- the encoding of the individual static characters to define the encoding of
 -- the entire dynamic character.
+--
+-- A character that is not missing is stored as a structure of arrays: the
+-- width of its elements, then its median, left and right contexts, each in a
+-- pinned storable vector. An element of an alphabet no wider than a 'CUInt' is
+-- one word, the @elem_t@ of the C aligners, so the contexts are handed to them,
+-- and their results taken back, without copying. An element of a wider
+-- alphabet takes as many words as it needs, least significant first.
 data  DynamicCharacter
     = Missing {-# UNPACK #-} !Word
-    | DC      {-# UNPACK #-} !(Vector (BitVector, BitVector, BitVector))
-    deriving stock    (Eq, Generic, Ord, Show)
-    deriving anyclass (Binary, NFData)
+    | DC      {-# UNPACK #-} !Word !(SV.Vector CUInt) !(SV.Vector CUInt) !(SV.Vector CUInt)
+    deriving stock    (Eq, Generic, Show)
+    deriving anyclass (NFData)
 
 
 type instance Element DynamicCharacter = DynamicCharacterElement
@@ -107,21 +115,19 @@ instance CoArbitrary DynamicCharacter where
     coarbitrary v = coarbitrary $
         case v of
          Missing w -> Left w
-         DC    bvs -> Right $ toList bvs
+         DC{}      -> Right $ splitElement <$> elementList v
 
 
 instance EncodedAmbiguityGroupContainer DynamicCharacter where
 
     {-# INLINE symbolCount #-}
-    symbolCount (Missing n) = n
-    symbolCount (DC bvs)    =
-        let (x,_,_) = bvs ! 0
-        in  dimension x
+    symbolCount (Missing n)  = n
+    symbolCount (DC w _ _ _) = w
 
 
 instance EncodableDynamicCharacter DynamicCharacter where
 
-    constructDynamic = DC . force . V.fromNonEmpty . fmap (\(DCE x) -> x) . toNonEmpty
+    constructDynamic = fromElements . fmap splitElement . toNonEmpty
 
     destructDynamic = NE.nonEmpty . otoList
 
@@ -133,30 +139,22 @@ instance EncodableDynamicCharacter DynamicCharacter where
     -- If the character contains /only/ gaps, a missing character is returned.
     {-# INLINEABLE deleteGaps #-}
     deleteGaps c@Missing{} = (mempty, c)
-    deleteGaps c@(DC    bvs)
+    deleteGaps c@(DC w ms ls rs)
       | null gaps   = (gaps,            c)
       | newLen == 0 = (gaps, toMissing  c)
-      | otherwise   = (gaps, force $ DC newVector)
+      | otherwise   = (gaps, DC w (kept ms) (kept ls) (kept rs))
       where
-        newVector = runST $ do
-            j <- newSTRef 0
-            let isGapAtJ = do
-                  j' <- readSTRef j
-                  pure $ j' < charLen && getMedian (c `indexStream` j') == gap
-
-            let g = do
-                  whileM isGapAtJ (modifySTRef j succ)
-                  j' <- readSTRef j
-                  modifySTRef j succ
-                  pure $ bvs ! j'
-
-            V.generateM newLen $ const g
-
-        gapCount = fromEnum . getSum $ foldMap Sum gaps
-        charLen  = length bvs
-        newLen   = charLen - gapCount
-        gapElem  = gapOfStream c
-        gap      = getMedian gapElem
+        -- The indices of the elements kept, in order.
+        keptIndices = UV.filter (not . isGapAt) $ UV.enumFromN 0 charLen
+        kept v      = SV.generate (newLen * k) $ \j ->
+                        let (i, q) = j `quotRem` k
+                        in  v `SV.unsafeIndex` (keptIndices `UV.unsafeIndex` i * k + q)
+
+        k        = wordsPerElement w
+        charLen  = olength c
+        newLen   = UV.length keptIndices
+        gapMed   = gapWords w
+        isGapAt i = SV.unsafeSlice (i * k) k ms == gapMed
 
         gaps = IM.fromDistinctAscList $ reverse refs
         refs = runST $ do
@@ -174,7 +172,7 @@ instance EncodableDynamicCharacter DynamicCharacter where
                       op
 
             for_ [0 .. charLen - 1] $ \i ->
-              if getMedian (c `indexStream` i)  == gap
+              if isGapAt i
               then modifySTRef gapLen succ *> writeSTRef prevGap True
               else do handleGapBefore $ do
                         writeSTRef  gapLen 0
@@ -203,17 +201,20 @@ instance EncodableDynamicCharacter DynamicCharacter where
     -- Adds gaps elements to the supplied character.
     insertGaps lGaps rGaps _ _ meds
       | null lGaps && null rGaps = meds -- No work needed
-      | otherwise                = force . DC . coerce $ newVector
+      | otherwise                = DC w newMedians newLefts newRights
       where
-        gap       = getMedian $ gapOfStream meds
+        w         = symbolCount meds
+        k         = wordsPerElement w
         totalGaps = fromEnum . getSum . foldMap Sum
         gapVecLen = maybe 0 (succ . fst) . IM.lookupMax
         lGapCount = totalGaps lGaps
         rGapCount = totalGaps rGaps
         newLength = lGapCount + rGapCount + olength meds
 
-        newVector = EV.create $ do
-          mVec <- MV.unsafeNew newLength
+        -- Where each element of the new character comes from: the index of an
+        -- element of meds, or one of the two gap elements.
+        sources = UV.create $ do
+          sVec <- MUV.unsafeNew newLength
           lVec <- MUV.replicate (gapVecLen lGaps) 0
           rVec <- MUV.replicate (gapVecLen rGaps) 0
           lGap <- newSTRef 0
@@ -227,8 +228,7 @@ instance EncodableDynamicCharacter DynamicCharacter where
           let align i = do
                     m <- readSTRef mPtr
                     let e = meds `indexStream` m
-                    let v = coerce e
-                    MV.unsafeWrite mVec i v
+                    MUV.unsafeWrite sVec i m
                     modifySTRef mPtr succ
                     when (isAlign e || isDelete e) $ do
                       modifySTRef lGap succ
@@ -241,7 +241,7 @@ instance EncodableDynamicCharacter DynamicCharacter where
                 if   v == 0
                 then do -- when (k + o + fromEnum v <= p) $ modifySTRef lOff (+ fromEnum v)
                         align i
-                else do MV.unsafeWrite mVec i . splitElement $ insertElement gap gap
+                else do MUV.unsafeWrite sVec i insertedGap
                         MUV.unsafeWrite rVec rg $ v - 1
 
           for_ [0 .. newLength - 1] $ \i -> do
@@ -250,16 +250,37 @@ instance EncodableDynamicCharacter DynamicCharacter where
             v  <- if lg >= MUV.length lVec then pure 0 else MUV.unsafeRead lVec lg
             if   v == 0
             then do checkRightGapReinsertion i
-            else do MV.unsafeWrite mVec i . splitElement $ deleteElement gap gap
+            else do MUV.unsafeWrite sVec i deletedGap
                     MUV.unsafeWrite lVec lg $ v - 1
 
-          pure mVec
+          pure sVec
+
+        -- As 'deleteElement' and 'insertElement' make them from two gaps.
+        deletedGap  = -1
+        insertedGap = -2
+
+        (medianWords, leftWords, rightWords) =
+            case meds of
+              DC _ m l r -> (m, l, r)
+              Missing{}  -> (SV.empty, SV.empty, SV.empty)
+
+        newContext v forDeleted forInserted = SV.generate (newLength * k) $ \j ->
+            let (i, q) = j `quotRem` k
+                s      = sources `UV.unsafeIndex` i
+            in  if      s == deletedGap  then forDeleted  q
+                else if s == insertedGap then forInserted q
+                else    v `SV.unsafeIndex` (s * k + q)
+
+        gapWord    = SV.unsafeIndex $ gapWords w
+        newMedians = newContext medianWords gapWord   gapWord
+        newLefts   = newContext leftWords   (const 0) gapWord
+        newRights  = newContext rightWords  gapWord   (const 0)
 
 
 instance EncodableStream DynamicCharacter where
 
 
-    encodeStream alphabet = DC . force . V.fromNonEmpty . fmap f . toNonEmpty
+    encodeStream alphabet = fromElements . fmap f . toNonEmpty
       where
         f x = let v = packAmbiguityGroup $ encodeElement alphabet x
               in  (v,v,v)
@@ -271,13 +292,13 @@ instance EncodableStream DynamicCharacter where
             z = fromNumber w (0 :: Word)
         in  DCE (v,z,z)
 
-    indexStream (DC v)    i = DCE $ v ! i
-    indexStream Missing{} i = error $ "Tried to index an missing character with index " <> show i
+    indexStream (DC w ms ls rs) i = DCE (readElement w ms i, readElement w ls i, readElement w rs i)
+    indexStream Missing{}       i = error $ "Tried to index an missing character with index " <> show i
 
     lookupStream Missing{} _ = Nothing
-    lookupStream (DC v) i
-      | 0 > i     = Nothing
-      | otherwise = Just . DCE $ v ! i
+    lookupStream c i
+      | 0 > i || i >= olength c = Nothing
+      | otherwise               = Just $ indexStream c i
 
 
 instance ExportableElements DynamicCharacter where
@@ -296,7 +317,7 @@ instance ExportableElements DynamicCharacter where
       where
         toNumber = toUnsignedNumber . packAmbiguityGroup
 
-    fromExportableElements riCharElems = {-# SCC fromExportableElements #-} DC . force $ V.fromNonEmpty bvs
+    fromExportableElements riCharElems = {-# SCC fromExportableElements #-} fromElements bvs
       where
         bvs = {-# SCC bvs #-} f <$> NE.fromList inputElems
         fromValue  = fromNumber charWidth . (toEnum :: Int -> Word) . fromEnum
@@ -308,83 +329,147 @@ instance ExportableElements DynamicCharacter where
                 z' = fromValue z
             in  (x', y', z')
 
+    -- The contexts are the character's own buffers, so exporting it copies
+    -- nothing. An alphabet wider than a 'CUInt', which the C code does not
+    -- align, exports the low word of each element.
+    toExportableSequence Missing{} = Nothing
+    toExportableSequence dc@(DC w ms ls rs) = Just ExportableCharacterSequence
+        { exportedElementCountSequence = toEnum n
+        , exportedElementWidthSequence = w
+        , exportedMedianContexts       = lowWords ms
+        , exportedLeftContexts         = lowWords ls
+        , exportedRightContexts        = lowWords rs
+        }
+      where
+        n = olength dc
+        k = wordsPerElement w
+        lowWords v
+          | k == 1    = v
+          | otherwise = SV.generate n $ \i -> v SV.! (i * k)
+
+    -- The character keeps the buffers it is given, sliced to its length.
+    fromExportableSequence ecs
+      | n == 0    = Missing w
+      | k == 1    = DC w (context exportedMedianContexts) (context exportedLeftContexts) (context exportedRightContexts)
+      | otherwise = DC w (widened exportedMedianContexts) (widened exportedLeftContexts) (widened exportedRightContexts)
+      where
+        n = fromEnum $ ecs ^. exportedElementCount
+        w = ecs ^. exportedElementWidth
+        k = wordsPerElement w
+        context f = SV.take n $ f ecs
+        widened f = SV.generate (n * k) $ \j ->
+            let (i, q) = j `quotRem` k
+            in  if q == 0 then f ecs SV.! i else 0
+
 
 instance ExportableBuffer DynamicCharacter where
 
     toExportableBuffer Missing {} = error "Attempted to 'Export' a missing dynamic character to foreign functions."
-    toExportableBuffer dc@(DC v) = ExportableCharacterBuffer r c . bitVectorToBufferChunks r c . expandRows . fromRows $ (\(x,_,_) -> x) <$> v
+    toExportableBuffer dc@DC{} = ExportableCharacterBuffer r c . bitVectorToBufferChunks r c . expandRows . fromRows $ (\(DCE (x,_,_)) -> x) <$> elementList dc
       where
-        r = toEnum $ length v
+        r = toEnum $ olength dc
         c = symbolCount dc
 
-    fromExportableBuffer ecs = DC . force . V.fromNonEmpty . NE.fromList . fmap (\v -> (v,v,v)) . otoList $ factorRows elemWidth newBitVec
+    fromExportableBuffer ecs = fromElements . NE.fromList . fmap (\v -> (v,v,v)) . otoList $ factorRows elemWidth newBitVec
       where
         newBitVec = bufferChunksToBitVector elemCount elemWidth $ exportedBufferChunks ecs
         elemCount = ecs ^. exportedElementCount
         elemWidth = ecs ^. exportedElementWidth
 
 
+-- |
+-- The first byte is a tag. A missing character, tag 0, is as it always was.
+-- Tag 1 is the layout of the earlier boxed vector of 'BitVector' triples,
+-- which is still read, so that saved characters load. Tag 2 is the layout of
+-- the contexts, which is what is written.
+instance Binary DynamicCharacter where
+
+    put (Missing w)     = putWord8 0 *> put w
+    put (DC w ms ls rs) = putWord8 2 *> put w *> put (asWord32 ms) *> put (asWord32 ls) *> put (asWord32 rs)
+      where
+        asWord32 = SV.unsafeCast :: SV.Vector CUInt -> SV.Vector Word32
+
+    get = do
+        tag <- getWord8
+        case tag of
+          0 -> Missing <$> get
+          1 -> fromElements <$> (get :: Get (NEV.Vector (BitVector, BitVector, BitVector)))
+          2 -> DC <$> get <*> context <*> context <*> context
+          _ -> fail $ "Unknown DynamicCharacter layout: " <> show tag
+      where
+        context = (SV.unsafeCast :: SV.Vector Word32 -> SV.Vector CUInt) <$> get
+
+
+-- |
+-- Ordered as the boxed vector of triples it replaced was: missing characters
+-- first, by width, then element by element, each by its median, then its left
+-- and right contexts, so that code sorting or keyed on characters is unchanged.
+instance Ord DynamicCharacter where
+
+    compare (Missing v) (Missing w) = compare v w
+    compare  Missing{}   DC{}       = LT
+    compare  DC{}        Missing{}  = GT
+    compare  lhs         rhs        = compare (elementList lhs) (elementList rhs)
+
+
 instance Hashable DynamicCharacter where
 
-    hashWithSalt salt (Missing n) = salt `xor` fromEnum n
-    hashWithSalt salt (DC      v) = salt `xor` hashWithSalt salt v
+    hashWithSalt salt (Missing n)     = salt `xor` fromEnum n
+    hashWithSalt salt (DC w ms ls rs) = foldl' (SV.foldl' hashWithSalt) (salt `hashWithSalt` w) [ms, ls, rs]
 
 
 instance MonoFoldable DynamicCharacter where
 
     {-# INLINE ofoldMap #-}
-    ofoldMap _ Missing{} = mempty
-    ofoldMap f (DC c)    = foldMap (f . DCE) $ toList c
+    ofoldMap f = foldMap f . elementList
 
     {-# INLINE ofoldr #-}
-    ofoldr _ e Missing{} = e
-    ofoldr f e (DC c)    = foldr (f . DCE) e $ toList c
+    ofoldr f e = foldr f e . elementList
 
     {-# INLINE ofoldl' #-}
-    ofoldl' _ e Missing{} = e
-    ofoldl' f e (DC c)    = foldl' (\acc x -> f acc (DCE x)) e $ toList c
+    ofoldl' f e = foldl' f e . elementList
 
     {-# INLINE ofoldr1Ex #-}
     ofoldr1Ex _ Missing{} = error "Trying to mono-morphically fold over an empty structure without supplying an initial accumulator!"
-    ofoldr1Ex f (DC c)    = DCE . ofoldr1Ex (\x y -> splitElement $ f (DCE x) (DCE y)) $ toList c
+    ofoldr1Ex f dc        = foldr1 f $ elementList dc
 
     {-# INLINE ofoldl1Ex' #-}
     ofoldl1Ex' _ Missing{} = error "Trying to mono-morphically fold over an empty structure without supplying an initial accumulator!"
-    ofoldl1Ex' f (DC c)    = DCE . ofoldl1Ex' (\x y -> splitElement $ f (DCE x) (DCE y)) $ toList c
+    ofoldl1Ex' f dc        = foldl1' f $ elementList dc
 
     {-# INLINE onull #-}
     onull Missing{} = True
     onull _         = False
 
     {-# INLINE olength #-}
-    olength Missing{} = 0
-    olength (DC c)    = length c
+    olength Missing{}      = 0
+    olength (DC w ms _ _) = SV.length ms `quot` wordsPerElement w
 
     {-# INLINE headEx #-}
     headEx dc =
       case dc of
-        (DC c) | (not . null) c -> DCE . headEx $ toList c
-        _                       -> error $ "call to DynamicCharacter.headEx with: " <> show dc
+        DC{} | olength dc > 0 -> indexStream dc 0
+        _                     -> error $ "call to DynamicCharacter.headEx with: " <> show dc
 
     {-# INLINE lastEx #-}
     lastEx dc =
       case dc of
-        (DC c) | (not . null) c -> DCE . lastEx $ toList c
-        _                       -> error $ "call to DynamicCharacter.lastEx with: " <> show dc
+        DC{} | olength dc > 0 -> indexStream dc $ olength dc - 1
+        _                     -> error $ "call to DynamicCharacter.lastEx with: " <> show dc
 
 
 instance MonoFunctor DynamicCharacter where
 
     omap _ dc@Missing{} = dc
-    omap f dc@(DC      v) =
-      let dces = splitElement . f . DCE <$> v
+    omap f dc =
+      let dces = EV.generate (olength dc) $ splitElement . f . indexStream dc
           bits (m,_,_) = finiteBitSize m
-      in  case invariantTransformation bits v of
-            Just _  -> DC dces
+      in  case invariantTransformation bits dces of
+            Just w  -> generateCharacter (toEnum w) (EV.length dces) (dces EV.!)
             Nothing -> error $ unlines
                [ "The mapping function over the Dynamic Character did not return *all* all elements of equal length."
-               , show . occurrences $ bits <$> v
-               , unlines $ foldMap (\x -> if x then "1" else "0") . toBits . (\(x,_,_) -> x) <$> toList v
+               , show . occurrences $ bits <$> dces
+               , unlines $ foldMap (\x -> if x then "1" else "0") . toBits . (\(x,_,_) -> x) <$> toList dces
                , show dc
                ]
 
@@ -402,7 +487,7 @@ instance PossiblyMissingCharacter DynamicCharacter where
 instance TextShow DynamicCharacter where
 
     showb (Missing w)  = "Missing " <> showb w
-    showb (DC      bm) = "DC "      <> showb bm
+    showb dc@DC{}      = "DC "      <> showb (elementList dc)
 
 
 instance ToXML DynamicCharacter where
@@ -424,7 +509,7 @@ arbitraryDynamicCharacterOfWidth alphabetLen = do
     characterLen <- arbitrary `suchThat` (> 0) :: Gen Int
     let randVal   = arbitraryOfSize alphabetLen :: Gen DynamicCharacterElement
     bitRows      <- vectorOf characterLen randVal
-    pure . DC . force . V.fromNonEmpty . NE.fromList . force $ splitElement <$> bitRows
+    pure . fromElements . NE.fromList $ splitElement <$> bitRows
 
 
 renderDynamicCharacter
@@ -440,3 +525,71 @@ renderDynamicCharacter alphabet _transiton char
         then unwords shownElems
         -- All elements were rendered as a single character.
         else fold shownElems
+
+
+-- |
+-- The elements of a character, in order.
+elementList :: DynamicCharacter -> [DynamicCharacterElement]
+elementList c = indexStream c <$> [0 .. olength c - 1]
+
+
+-- |
+-- A character of the elements, all as wide as the first.
+fromElements :: Foldable1 f => f (BitVector, BitVector, BitVector) -> DynamicCharacter
+fromElements xs = generateCharacter (dimension m) (EV.length v) (v EV.!)
+  where
+    v       = EV.fromList $ toList xs
+    (m,_,_) = NE.head $ toNonEmpty xs
+
+
+-- |
+-- A character of @n@ elements of width @w@, the /i/-th of which is @f i@.
+generateCharacter :: Word -> Int -> (Int -> (BitVector, BitVector, BitVector)) -> DynamicCharacter
+generateCharacter w n f = DC w (context (\(m,_,_) -> m)) (context (\(_,l,_) -> l)) (context (\(_,_,r) -> r))
+  where
+    k = wordsPerElement w
+    context g = SV.create $ do
+        v <- SMV.unsafeNew $ n * k
+        for_ [0 .. n - 1] $ \i -> writeElement k v (i * k) . g $ f i
+        pure v
+
+
+-- |
+-- Write the @k@ words of an element at an offset of a context.
+{-# INLINE writeElement #-}
+writeElement :: Int -> SMV.MVector s CUInt -> Int -> BitVector -> ST s ()
+writeElement k v o b
+  | k == 1    = SMV.unsafeWrite v o $ toUnsignedNumber b
+  | otherwise = for_ [0 .. k - 1] $ \q -> SMV.unsafeWrite v (o + q) . fromInteger $ x `shiftR` (q * wordBits)
+  where
+    x = toUnsignedNumber b :: Integer
+
+
+-- |
+-- The /i/-th element of width @w@ of a context.
+{-# INLINE readElement #-}
+readElement :: Word -> SV.Vector CUInt -> Int -> BitVector
+readElement w v i
+  | k == 1    = fromNumber w $ v SV.! i
+  | otherwise = fromNumber w . SV.foldr (\x a -> a `shiftL` wordBits .|. toInteger x) (0 :: Integer) $ SV.slice (i * k) k v
+  where
+    k = wordsPerElement w
+
+
+-- |
+-- The words of the gap of an alphabet of width @w@, its last symbol.
+gapWords :: Word -> SV.Vector CUInt
+gapWords w = SV.generate (wordsPerElement w) $ \q -> if q == gapWord then bit gapBit else 0
+  where
+    (gapWord, gapBit) = fromEnum (pred w) `quotRem` wordBits
+
+
+-- |
+-- The words each element of a context of width @w@ takes.
+{-# INLINE wordsPerElement #-}
+wordsPerElement :: Word -> Int
+wordsPerElement w = max 1 $ (fromEnum w + wordBits - 1) `quot` wordBits
+
+
+wordBits :: Int
+wordBits = finiteBitSize (0 :: CUInt)
@@ -1,4 +1,6 @@
 {-# LANGUAGE AllowAmbiguousTypes #-}
+{-# LANGUAGE DeriveAnyClass      #-}
+{-# LANGUAGE DeriveGeneric       #-}
 {-# LANGUAGE DerivingStrategies  #-}
 {-# LANGUAGE FlexibleContexts    #-}
 {-# LANGUAGE FlexibleInstances   #-}
@@ -10,13 +12,23 @@ module Bio.Character.Encodable.Dynamic.Test
   ( testSuite
   ) where
 
-import Bio.Character
-import Data.Bits
-import Data.MonoTraversable
-import Data.Semigroup
-import Test.Tasty
-import Test.Tasty.HUnit
-import Test.Tasty.QuickCheck hiding ((.&.))
+import           Bio.Character
+import           Bio.Character.Exportable
+import           Data.Binary                           (Binary, decode, encode)
+import           Data.Bits
+import           Data.BitVector.LittleEndian           (BitVector, dimension, fromNumber, toUnsignedNumber)
+import           Data.BitVector.LittleEndian.Instances ()
+import           Data.Foldable                         (toList)
+import           Data.List.NonEmpty                    (NonEmpty)
+import qualified Data.List.NonEmpty                    as NE
+import           Data.MonoTraversable
+import           Data.Semigroup
+import qualified Data.Vector.NonEmpty                  as NEV
+import qualified Data.Vector.Storable                  as SV
+import           GHC.Generics                          (Generic)
+import           Test.Tasty
+import           Test.Tasty.HUnit
+import           Test.Tasty.QuickCheck                 hiding ((.&.))
 
 
 testSuite :: TestTree
@@ -32,10 +44,71 @@ dynamicCharacterTests = testGroup "Dynamic Character tests"
     [ monoFunctorPropertiesGen  @DynamicCharacter
     , monoFoldablePropertiesGen @DynamicCharacter
     , orderingLaws              @AmbiguityGroup
+    , orderingLaws              @DynamicCharacter
+    , structureOfArraysProperties
 --    , datastructureTests
     ]
 
 
+-- |
+-- The layout of a 'DynamicCharacter' before it held its contexts as words: a
+-- boxed vector of element triples, as the generic 'Binary' instance wrote it.
+data  OldDynamicCharacter
+    = OldMissing Word
+    | OldDC (NEV.Vector (BitVector, BitVector, BitVector))
+    deriving stock    (Generic, Show)
+    deriving anyclass (Binary)
+
+
+structureOfArraysProperties :: TestTree
+structureOfArraysProperties = testGroup "Properties of the structure of arrays"
+    [ testProperty "constructDynamic <$> destructDynamic c === Just c" constructDestruct
+    , testProperty "fromExportableSequence <$> toExportableSequence c === Just c, for a word or less" exportImport
+    , testProperty "decode . encode === id" encodeDecode
+    , testProperty "a character saved in the earlier layout loads" oldLayout
+    , testProperty "a missing character saved in the earlier layout loads" oldMissing
+    , testProperty "ordered element by element, as the earlier layout was" elementOrder
+    ]
+  where
+    constructDestruct :: DynamicCharacter -> Property
+    constructDestruct dc =
+        (constructDynamic <$> destructDynamic dc) === Just dc
+
+    exportImport :: DynamicCharacter -> Property
+    exportImport dc =
+        symbolCount dc <= 32 ==> (fromExportableSequence <$> toExportableSequence dc) === Just dc
+
+    encodeDecode :: DynamicCharacter -> Property
+    encodeDecode dc =
+        decode (encode dc) === dc
+
+    oldLayout :: Property
+    oldLayout = forAll oldElements $ \triples ->
+        let dc       = decode . encode . OldDC $ NEV.fromNonEmpty triples :: DynamicCharacter
+            words' f = SV.fromList $ fromIntegral . (toUnsignedNumber :: BitVector -> Word) . f <$> toList triples
+            contexts ecs = (exportedMedianContexts ecs, exportedLeftContexts ecs, exportedRightContexts ecs)
+            (m,_,_)  = NE.head triples
+        in  symbolCount dc === dimension m .&&.
+            (contexts <$> toExportableSequence dc) === Just (words' (\(x,_,_) -> x), words' (\(_,y,_) -> y), words' (\(_,_,z) -> z))
+
+    oldMissing :: Property
+    oldMissing = forAll (choose (2, 62)) $ \w ->
+        let dc = decode . encode $ OldMissing w :: DynamicCharacter
+        in  isMissing dc .&&. symbolCount dc === w
+
+    elementOrder :: DynamicCharacter -> DynamicCharacter -> Property
+    elementOrder lhs rhs =
+        not (isMissing lhs || isMissing rhs) ==> compare lhs rhs === compare (otoList lhs) (otoList rhs)
+
+    -- Elements of an alphabet of at most 32 symbols, each of the three contexts nonempty.
+    oldElements :: Gen (NonEmpty (BitVector, BitVector, BitVector))
+    oldElements = do
+        w <- choose (2, 32) :: Gen Word
+        n <- choose (1, 50)
+        let element = fromNumber w <$> (choose (1, 2 ^ w - 1) :: Gen Word)
+        NE.fromList <$> vectorOf n ((,,) <$> element <*> element <*> element)
+
+
 ambiguityGroupTests :: TestTree
 ambiguityGroupTests = testGroup "Ambiguity Group tests"
     [ bitsProperties            @AmbiguityGroup
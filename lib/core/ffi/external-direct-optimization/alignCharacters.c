@@ -63,12 +63,14 @@
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wchar.h>
 
 
 #include "alignCharacters.h"
 #include "costMatrix.h"
 #include "debug_constants.h"
+#include "fillRowKernel.h"
 #include "ukkCommon.h"
 //#include "matrices.h"
 //#include "dyn_character.h"
@@ -91,6 +93,8 @@
 
 #define LOR_WITH_DIR_MTX_ARROW_t(mask, direction_matrix) direction_matrix |= mask
 
+#define BAND_INITIAL_BARRIER 8   /** Cells either side of the diagonals that a non-affine 2D band starts with. */
+
 
 #ifdef DEBUG_ALL_ASSERTIONS
 int *_algn_max_matrix = NULL;
@@ -98,355 +102,38 @@ DIR_MTX_ARROW_t *_algn_max_direction = NULL;
 #endif
 
 
-#if ( __GNUC__ && __MMX__ )
+/** Fill cells startIndex through finalIndex of a row, with the fastest kernel
+ *  this CPU supports (see fillRowKernel.h).
+ *
+ *  The indices are ints, so that a finalIndex computed as one less than
+ *  startIndex by the band functions below fills nothing.
+ */
 static inline void
-algn_fill_row (       unsigned int    *curRow
+algn_fill_row (       unsigned int    *currRow
               , const unsigned int    *prevRow
               , const unsigned int    *gap_row
               , const unsigned int    *align_row
-              ,       DIR_MTX_ARROW_t *dirMtx
+              ,       DIR_MTX_ARROW_t *dirVect
               ,       int              c
-              ,       int              i
-              ,       int              end
+              ,       int              startIndex
+              ,       int              finalIndex
               )
 {
+    if (finalIndex < startIndex) return;
 
-    register int aa, bb, cc;
-    register const int TWO  = 0x200;
-    register const int ZERO = 0;
-
-    bb = curRow[i - 1];
-
-    for (; i <= end - 7; i+=8) {
-
-        aa  = prevRow[i - 1] + align_row[i]; // aka tmp3
-        bb += gap_row[i];                    // aka tmp2
-        cc  = prevRow[i] + c;                // aka tmp1
-
-        /**
-         *  The algorithm has not changed. Only the conditional branches been eliminated for
-         *  better performance.
-         *
-         *  Since gcc (4.0.3 at least) didn't generate cmov's, we changed the code manually.
-         *  Things that have been done to optimize this function:
-         *      - assembly code for determining min(aa, bb, cc) and getting the bit pattern
-         *        loop unrolling with a factor of 8, to still keep this function inlined
-         *      - rearrangement of expressions => better register usage and (probably)
-         *        fewer cache misses
-
-         *  Restrictions:
-         *  ALIGN is bound to the value 4, INSERT to 2 and DELETE to 1
-         *  If these constants change, there will be problems with the assembler code,
-         *  since it is really optimized for this purpose
-
-         *  Furthermore, this code only works with the gnu compiler (but shouldn't be
-         *  hard to switch to icc), so add
-         *  #ifdef __GNUC__ as a macro for this section. I also suppose that cmov's
-         *  can be handled by most of the computers used today
-         *  (of those using this program at least).
-
-         *  I have also removed the debug sections. These can of course be added if
-         *  a debug is needed.
-         *  I recommend that debugging is only used with the original function,
-         *  since this one generates exactly same results.
-         */
-
-
-        __asm__(
-            "cmp %0, %1\n\t"    // compare aa with bb (the needed cmp flag remains even if registers are switched)
-            "cmovg %0, %1\n\t"  // if bb > aa was flagged, put aa into bb's register. Now we know that bb is always the smallest value
-            "mov $0x0, %0\n\t"  // aa is now trash and will not be used anymore. Clean the register (set it to 0x0)
-            "cmovle %4, %0\n\t" // if bb <= aa was flagged in the first instruction, then put TWO (0x200) into register 0 (aa)
-            "setge %b0\n\t"     // if bb >= aa was flagged in the first instruction, then set the lowest byte in register 0 to 1 (0x01)
-            "cmp %1, %2\n\t"    // compare reg.1 (the lowest of aa and bb) with cc.
-            "cmovl %2, %1\n\t"  // if cc < bb was flagged in the 2nd comparison, then move cc into bb. min(aa, bb, cc) is now stored in bb.
-            "mov $0x4, %2\n\t"  // put a 4 (ALIGN) in register 2 (cc) since cc is trash.
-            "cmovl %3, %0\n\t"  // if cc < bb was flagged in the 2nd comparison, then clear register 0.
-            "cmovg %3, %2\n\t"  // if cc > bb was flagged, then clean the register. (Note that you can only move register->register with a cmov.)
-            "add %b0, %h0\n\t"  // finally, add low byte and high byte of register 0 into register 0's low byte.
-            "add %h0, %b2\n\t"  // add high byte from reg.0 to low byte in reg.2 (cc) and we are done. cc contains now the bitpattern.
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)   // registers: aa = %0, bb = %1, cc = %2
-            : "r" (ZERO), "r" (TWO)         // ZERO = %3, TWO = %4
-        );
-
-        curRow[i] = bb; // bb is min(aa, bb, cc)
-        dirMtx[i] = cc; // cc is the bitpattern
-
-
-        aa = prevRow[i] + align_row[i + 1];
-        bb += gap_row[i + 1]; // bb is already assigned the minimum value of the three to be compared, so loading bb from memory would be waste.
-        cc = prevRow[i + 1] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 1] = bb;
-        dirMtx[i + 1] = cc;
-
-        aa = prevRow[i + 1] + align_row[i + 2];
-        bb += gap_row[i + 2];
-        cc = prevRow[i + 2] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 2] = bb;
-        dirMtx[i + 2] = cc;
-
-        aa = prevRow[i + 2] + align_row[i + 3];
-        bb += gap_row[i + 3];
-        cc = prevRow[i + 3] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 3] = bb;
-        dirMtx[i + 3] = cc;
-
-
-
-        aa = prevRow[i + 3] + align_row[i + 4];
-        bb += gap_row[i + 4];
-        cc = prevRow[i + 4] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 4] = bb;
-        dirMtx[i + 4] = cc;
-
-
-        aa = prevRow[i + 4] + align_row[i + 5];
-        bb += gap_row[i + 5];
-        cc = prevRow[i + 5] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 5] = bb;
-        dirMtx[i + 5] = cc;
-
-        aa = prevRow[i + 5] + align_row[i + 6];
-        bb += gap_row[i + 6];
-        cc = prevRow[i + 6] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 6] = bb;
-        dirMtx[i + 6] = cc;
-
-        aa = prevRow[i + 6] + align_row[i + 7];
-        bb += gap_row[i + 7];
-        cc = prevRow[i + 7] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i + 7] = bb;
-        dirMtx[i + 7] = cc;
-    }
-
-
-
-    for (; i <= end; i++) {
-
-        aa = prevRow[i - 1] + align_row[i];
-        bb += gap_row[i];
-        cc = prevRow[i] + c;
-
-
-        __asm__(
-            "cmp %0, %1\n\t"
-            "cmovg %0, %1\n\t"
-            "mov $0x0, %0\n\t"
-            "cmovle %4, %0\n\t"
-            "setge %b0\n\t"
-            "cmp %1, %2\n\t"
-            "cmovl %2, %1\n\t"
-            "mov $0x4, %2\n\t"
-            "cmovl %3, %0\n\t"
-            "cmovg %3, %2\n\t"
-            "add %b0, %h0\n\t"
-            "add %h0, %b2\n\t"
-            : "+Q" (aa), "+r" (bb), "+Q" (cc)
-            : "r" (ZERO), "r" (TWO)
-        );
-
-        curRow[i] = bb;
-        dirMtx[i] = cc;
-    }
-}
-#else // __GNUC__
-
+    algn_fill_row_kernel()->fill( currRow
+                                , prevRow
+                                , gap_row
+                                , align_row
+                                , dirVect
+                                , c
+                                , startIndex
+                                , finalIndex
+                                );
 
-static inline void
-algn_fill_row (       unsigned int    *currRow
-              , const unsigned int    *prevRow
-              , const unsigned int    *gap_row
-              , const unsigned int    *align_row
-              ,       DIR_MTX_ARROW_t *dirVect
-              ,       int               c
-              ,       size_t            startIndex
-              ,       size_t            finalIndex
-              )
-{
-    unsigned int upwardCost,
-                 leftwardCost,
-                 diagonalCost;
-
-    for (size_t i = startIndex; i <= finalIndex; i++) {
-        // try align with substitution
-        upwardCost   = prevRow[i    ] + c;
-        leftwardCost = currRow[i - 1] + gap_row[i];
-        diagonalCost = prevRow[i - 1] + align_row[i];
-        /* check whether insertion is better */
-        /* This option will allow all the possible optimal paths to be stored
-         * concurrently on the same backtrace matrix. This is important for the
-         * characters being able to choose the appropriate direction while
-         * keeping the algorithm that assumes that char2 is at most as long as char1.
-         * */
-        if (upwardCost < diagonalCost) {
-            if (upwardCost < leftwardCost) {
-                currRow[i] = upwardCost;
-                dirVect[i] = DELETE;
-            } else if (leftwardCost < upwardCost) {
-                currRow[i] = leftwardCost;
-                dirVect[i] = INSERT;
-            } else {
-                currRow[i] = leftwardCost;
-                dirVect[i] = INSERT | DELETE;
-            }
-        } else if (diagonalCost < upwardCost) {
-            if (diagonalCost < leftwardCost) {
-                currRow[i] = diagonalCost;
-                dirVect[i] = ALIGN;
-            } else if (leftwardCost < diagonalCost) {
-                currRow[i] = leftwardCost;
-                dirVect[i] = INSERT;
-            } else {
-                currRow[i] = leftwardCost;
-                dirVect[i] = ALIGN | INSERT;
-            }
-        } else { // diagonalCost == upwardCost
-            if (diagonalCost < leftwardCost) {
-                currRow[i] = diagonalCost;
-                dirVect[i] = ALIGN | DELETE;
-            } else if (leftwardCost < diagonalCost) {
-                currRow[i] = leftwardCost;
-                dirVect[i] = INSERT;
-            } else {
-                currRow[i] = leftwardCost;
-                dirVect[i] = DELETE | INSERT | ALIGN;
-            }
-        }
-        if (DEBUG_DIR_M) {
+    if (DEBUG_DIR_M) {
         // Print the alignment matrix
+        for (int i = startIndex; i <= finalIndex; i++) {
             if (INSERT & dirVect[i])
                 printf ("I");
             if (DELETE & dirVect[i])
@@ -455,14 +142,26 @@ algn_fill_row (       unsigned int    *currRow
                 printf ("A");
             printf ("\t");
         }
-    }
-    if (DEBUG_DIR_M)  {
         printf ("\n");
         fflush (stdout);
     }
+}
+
+
+/** Pack cells first through last of dirs->row into row i of dirs, with the same
+ *  kernel as algn_fill_row(). The row then holds the cells from the even column
+ *  at or before first.
+ */
+static inline void
+algn_pack_dir_row( const packed_dir_mtx_t *dirs, size_t i, size_t first, size_t last )
+{
+    const size_t start = first & ~(size_t) 1;
+
+    assert( last - start < 2 * dirs->rowBytes && "Band row wider than its packed direction row." );
 
+    dirs->rowStart[i] = start;
+    algn_fill_row_kernel()->pack( dirs->cells + i * dirs->rowBytes - start / 2, dirs->row, first, last );
 }
-#endif // __GNUC__
 
 
 static inline void
@@ -657,6 +356,59 @@ algn_fill_first_cell ( unsigned int    *curRow
     }
 }
 
+/** The least of cells first through last of row. */
+static inline unsigned int
+algn_least_cost ( const unsigned int *row
+                ,       size_t        first
+                ,       size_t        last
+                )
+{
+    unsigned int least = row[first];
+    for (size_t j = first + 1; j <= last; j++) {
+        if (row[j] < least) least = row[j];
+    }
+    return least;
+}
+
+/** A cost ceiling, and what the non-affine band functions have found of it, and filled. */
+typedef struct cost_ceiling_t {
+    unsigned int cost;          // UINT_MAX for none
+    unsigned int least;         // once exceeded, the least cost of the row that exceeded it
+    size_t       cheapCell;     // a cell of the last row checked that cost no more than it
+    size_t       cells;         // of the rows checked, for alignment_stats_t
+} cost_ceiling_t;
+
+/** Whether every cell first through last of row costs more than the ceiling.
+ *  The cheapest paths run mostly diagonally, so this looks first by the last
+ *  cheap cell found, and scans the whole row only if neither it nor the next
+ *  is cheap.
+ */
+static inline int
+algn_row_exceeds ( const unsigned int   *row
+                 ,       size_t          first
+                 ,       size_t          last
+                 ,       cost_ceiling_t *ceiling
+                 )
+{
+    ceiling->cells += last - first + 1;
+    if (ceiling->cost == UINT_MAX) return 0;
+
+    for (size_t j = ceiling->cheapCell; j <= ceiling->cheapCell + 1; j++) {
+        if (first <= j && j <= last && row[j] <= ceiling->cost) {
+            ceiling->cheapCell = j;
+            return 0;
+        }
+    }
+    for (size_t j = first; j <= last; j++) {
+        if (row[j] <= ceiling->cost) {
+            ceiling->cheapCell = j;
+            return 0;
+        }
+    }
+    ceiling->least = algn_least_cost( row, first, last );
+    return 1;
+}
+
 /* In the following three functions, we maintain the following invariants in
  * each loop:
  * 1. curRow is a row that has not been filled and is the next to be.
@@ -669,6 +421,9 @@ algn_fill_first_cell ( unsigned int    *curRow
  * 6. cur_char1 is the i'th base of char1
  * 7. const_val is the cost of cur_char1 aligned with a gap
  * 8. align_row is the vector of costs of aligning char2 with cur_char1
+ *
+ * Each also stops after a row all of whose cells cost more than the ceiling,
+ * and returns NULL.
  */
 
 static inline unsigned int *
@@ -678,13 +433,15 @@ algn_fill_extending_right ( const dyn_character_t   *char1
                           ,       size_t              char2_len
                           ,       unsigned int       *curRow
                           ,       unsigned int       *prevRow
-                          ,       DIR_MTX_ARROW_t    *dirMtx
+                          , const packed_dir_mtx_t   *dirs
                           , const cost_matrices_2d_t *costMatrix
                           ,       size_t              start_row
                           ,       size_t              end_row
                           ,       size_t              len
+                          ,       cost_ceiling_t     *ceiling
                           )
 {
+    DIR_MTX_ARROW_t *dirMtx = dirs->row;
     // printf("algn_fill_extending_right\n");
     size_t i = start_row;
     unsigned int *tmp, const_val;
@@ -733,12 +490,13 @@ algn_fill_extending_right ( const dyn_character_t   *char1
                                // , const_val
                                 , len - 1
                                 );
+        if (algn_row_exceeds( curRow, 0, len - 1, ceiling )) return NULL;
         /** Invariants block */
         tmp     = curRow;
         curRow  = prevRow;
         prevRow = tmp;
+        algn_pack_dir_row( dirs, i, 0, len - 1 );
         i++;
-        dirMtx += char2_len;
         len++;
     }
 
@@ -752,14 +510,16 @@ algn_fill_extending_left_right ( const dyn_character_t    *char1
                                ,       size_t              char2_len
                                ,       unsigned int       *curRow
                                ,       unsigned int       *prevRow
-                               ,       DIR_MTX_ARROW_t    *dirMtx
+                               , const packed_dir_mtx_t   *dirs
                                , const cost_matrices_2d_t *costMtx
                                ,       size_t              start_row
                                ,       size_t              end_row
                                ,       size_t              start_column
                                ,       size_t              len
+                               ,       cost_ceiling_t     *ceiling
                                )
 {
+    DIR_MTX_ARROW_t *dirMtx = dirs->row;
     // printf("algn_fill_extending_left_right\n");
     size_t i;
     unsigned int *tmpRow, const_val;
@@ -812,12 +572,13 @@ algn_fill_extending_left_right ( const dyn_character_t    *char1
                                // , const_val
                                 , start_column + len - 1
                                 );
+        if (algn_row_exceeds( curRow, start_column, start_column + len - 1, ceiling )) return NULL;
         /** Invariants block */
         tmpRow  = curRow;
         curRow  = prevRow;
         prevRow = tmpRow;
+        algn_pack_dir_row( dirs, i, start_column, start_column + len - 1 );
         i++;
-        dirMtx += char2_len;
         start_column++;
     }
     return (curRow);
@@ -830,14 +591,16 @@ algn_fill_extending_left ( const dyn_character_t    *char1
                          ,       size_t              char2_len
                          ,       unsigned int       *curRow
                          ,       unsigned int       *prevRow
-                         ,       DIR_MTX_ARROW_t    *dirMtx
+                         , const packed_dir_mtx_t   *dirs
                          , const cost_matrices_2d_t *costMatrix
                          ,       size_t              start_row
                          ,       size_t              end_row
                          ,       size_t              start_column     // the first cell to fill in the row
                          ,       size_t              len              // len is the number of cells to fill in the current row minus 1
+                         ,       cost_ceiling_t     *ceiling
                          )
 {
+    DIR_MTX_ARROW_t *dirMtx = dirs->row;
     if (DEBUG_CALL_ORDER) printf("algn_fill_extending_left\n");
     size_t i = start_row;
     unsigned int *tmpRow,
@@ -895,12 +658,14 @@ algn_fill_extending_left ( const dyn_character_t    *char1
                               , dirMtx
                               );
 
+        if (algn_row_exceeds( curRow, start_column, start_column + len - 1, ceiling )) return NULL;
+
         /** Invariants block */
         tmpRow  = curRow;
         curRow  = prevRow;
         prevRow = tmpRow;
+        algn_pack_dir_row( dirs, i, start_column, start_column + len - 1 );
         i++;
-        dirMtx += char2_len;
         start_column++;
         len--;
     }
@@ -926,12 +691,14 @@ algn_fill_no_extending ( const dyn_character_t    *char1
                        ,       unsigned int        char2_len
                        ,       unsigned int       *curRow
                        ,       unsigned int       *prevRow
-                       ,       DIR_MTX_ARROW_t    *dirMtx
+                       , const packed_dir_mtx_t   *dirs
                        , const cost_matrices_2d_t *costMatrix
                        ,       size_t              start_row
                        ,       size_t              end_row
+                       ,       cost_ceiling_t     *ceiling
                        )
 {
+    DIR_MTX_ARROW_t *dirMtx = dirs->row;
     // printf("algn_fill_no_extending\n");
     size_t i;
     unsigned int *tmpRow,
@@ -989,18 +756,22 @@ algn_fill_no_extending ( const dyn_character_t    *char1
                               , dirMtx
                               );
 
+        if (algn_row_exceeds( curRow, 0, char2_len - 1, ceiling )) return NULL;
+
         /** Invariants block */
         tmpRow  = curRow;
         curRow  = prevRow;
         prevRow = tmpRow;
-        dirMtx += char2_len;
+        algn_pack_dir_row( dirs, i, 0, char2_len - 1 );
         i++;
     }
 
     return curRow;
 }
 
-/* Similar to the previous but when no barriers are set */
+/* Similar to the previous but when no barriers are set. Stops likewise after a
+ * row that costs more than the ceiling, returning that row's least cost.
+ */
 static inline unsigned int
 algn_fill_plane ( const dyn_character_t    *longerCharacter
                 ,       unsigned int       *algn_precalcMtx
@@ -1008,8 +779,9 @@ algn_fill_plane ( const dyn_character_t    *longerCharacter
                 ,       size_t              longerCharacterLength // larger, horizontal dimension
                 ,       size_t              lesserCharacterLength // smaller, vertical dimension
                 ,       unsigned int       *curRow
-                ,       DIR_MTX_ARROW_t    *dirMtx
+                , const packed_dir_mtx_t   *dirs
                 , const cost_matrices_2d_t *costMatrix
+                ,       cost_ceiling_t     *ceiling
                 )
 {
     // printf("algn_fill_plane\n");
@@ -1017,6 +789,7 @@ algn_fill_plane ( const dyn_character_t    *longerCharacter
     // printf("longerCharacterLength: %d\n", longerCharacterLength);
 
     size_t i, j;
+    DIR_MTX_ARROW_t *dirMtx = dirs->row;
     const unsigned int *align_row,
                        *gap_row,
                        *first_gap_row;
@@ -1061,6 +834,7 @@ algn_fill_plane ( const dyn_character_t    *longerCharacter
     if (DEBUG_DIR_M) {
         printf ("\n");
     }
+    algn_pack_dir_row( dirs, 0, 0, lesserCharacterLength - 1 );
 
     if (LOCAL_DEBUG_COST_M) {
         for (i = 0; i < lesserCharacterLength; i++) {
@@ -1072,10 +846,7 @@ algn_fill_plane ( const dyn_character_t    *longerCharacter
 
 
     /* Now we fill the rest of the matrix */
-    for ( i = 1, dirMtx += lesserCharacterLength
-        ; i < longerCharacterLength
-        ; i++, dirMtx += lesserCharacterLength
-        ) {
+    for (i = 1; i < longerCharacterLength; i++) {
 
         curChar1_elem  = longerCharacter->char_begin[i];
         const_val_tail = costMatrix->tail_cost[curChar1_elem]; // get tail cost in costMatrix for value at
@@ -1102,6 +873,12 @@ algn_fill_plane ( const dyn_character_t    *longerCharacter
                            , lesserCharacterLength
                            );
 
+        if (algn_row_exceeds( curRow, 0, lesserCharacterLength - 1, ceiling )) {
+            free(debugCostMatrixBuffer);
+            return ceiling->least;
+        }
+        algn_pack_dir_row( dirs, i, 0, lesserCharacterLength - 1 );
+
         if (LOCAL_DEBUG_COST_M) {
             for (j = 0; j < lesserCharacterLength; j++) {
                 debugCostMatrixBuffer[(lesserCharacterLength * i) + j] = curRow[j];
@@ -1159,21 +936,23 @@ choose_other ( unsigned int *compare
     }
 }
 
-static inline int
-algn_fill_plane_2 ( const dyn_character_t    *longerChar
-                  ,       unsigned int       *algn_precalcMtx
-                  ,       size_t              longerChar_len
-                  ,       size_t              len_lesserChar
-                  ,       unsigned int       *curRow
-                  ,       DIR_MTX_ARROW_t    *dirMtx
-                  , const cost_matrices_2d_t *costMatrix
-                  ,       size_t              width
-                  ,       size_t              height
-                  ,       size_t              deltawh
-                  )
+/** Fill a band of the plane that holds the cells (i, j) with j - i < width and
+ *  i - j < height, and only a few more. It must not cover nearly the whole
+ *  plane; see algn_band_is_full().
+ */
+static inline unsigned int
+algn_fill_band_2 ( const dyn_character_t    *longerChar
+                 ,       unsigned int       *algn_precalcMtx
+                 ,       size_t              longerChar_len
+                 ,       size_t              len_lesserChar
+                 ,       unsigned int       *curRow
+                 , const packed_dir_mtx_t   *dirs
+                 , const cost_matrices_2d_t *costMatrix
+                 ,       size_t              width
+                 ,       size_t              height
+                 ,       cost_ceiling_t     *ceiling
+                 )
 {
-    // printf("algn_fill_plane_2 %d", iteration);
-    //fflush(stdout);
     unsigned int *next_row,
                  *next_prevRow,
                  *prevRow,
@@ -1184,52 +963,26 @@ algn_fill_plane_2 ( const dyn_character_t    *longerChar
 
     unsigned int const *gap_row;
 
-    DIR_MTX_ARROW_t *to_go_dirMtx;
-    width = width + deltawh;
-
-    if (width > len_lesserChar) {
-        width = len_lesserChar; // width is at most len_lesserChar
-    }
-
-    height = height + deltawh;
-
-    if (height > longerChar_len) {
-        height = longerChar_len; // likewise, height is at most longerChar_len
-    }
-
     prevRow = curRow + len_lesserChar;
     gap_row = algnMtx_get_precal_row( algn_precalcMtx
                                , 0
                                , len_lesserChar // We want the first horizontal row
                                );
 
-    /* We have to consider three cases in this new alignment procedure (much
+    /* We have to consider two cases in this new alignment procedure (much
      * cleaner than the previous):
      *
      * Case 1:
-     * If longerChar_len >= 1.5 * char2_len, there is no point in using the
-     * barriers. Rather, we fill the full matrix in one shot */
-    if (longerChar_len >= 1.5 * len_lesserChar) { // deleted a bunch of casts here
-        return algn_fill_plane ( longerChar
-                               , algn_precalcMtx
-                               , longerChar_len
-                               , len_lesserChar
-                               , curRow
-                               , dirMtx
-                               , costMatrix
-                               );
-    }
-    /* Case 2:
      * There are no full rows to be filled, therefore we have to break the
      * procedure into two different subsets */
     // subset 1:
-    else if (2 * height < longerChar_len) {
-        algn_fill_first_row (curRow, dirMtx, width, gap_row);
+    if (2 * height < longerChar_len) {
+        algn_fill_first_row (curRow, dirs->row, width, gap_row);
+        algn_pack_dir_row(dirs, 0, 0, width - 1);
         start_row    = 1;
         final_row    = height;
         start_column = 0;
         length       = width + 1;
-        to_go_dirMtx = dirMtx + (start_row * len_lesserChar);
 
         /* Now we fill that space */
         next_row = algn_fill_extending_right ( longerChar
@@ -1238,20 +991,22 @@ algn_fill_plane_2 ( const dyn_character_t    *longerChar
                                              , len_lesserChar
                                              , prevRow
                                              , curRow
-                                             , to_go_dirMtx
+                                             , dirs
                                              , costMatrix
                                              , start_row
                                              , final_row
                                              , length
+                                             , ceiling
                                              );
 
+        if (next_row == NULL) return ceiling->least;
+
         next_prevRow = choose_other (next_row, curRow, prevRow);
         /* Next group */
         start_row    = final_row;
         final_row    = longerChar_len - (height - 1);
         start_column = 1;
         length       = width  + height;
-        to_go_dirMtx = dirMtx + (start_row * len_lesserChar);
 
         next_row     = algn_fill_extending_left_right ( longerChar
                                                       , algn_precalcMtx
@@ -1259,21 +1014,23 @@ algn_fill_plane_2 ( const dyn_character_t    *longerChar
                                                       , len_lesserChar
                                                       , next_row
                                                       , next_prevRow
-                                                      , to_go_dirMtx
+                                                      , dirs
                                                       , costMatrix
                                                       , start_row
                                                       , final_row
                                                       , start_column
                                                       , length
+                                                      , ceiling
                                                       );
 
+        if (next_row == NULL) return ceiling->least;
+
         next_prevRow = choose_other (next_row, curRow, prevRow);
         /* The final group */
         start_row    = final_row;
         final_row    = longerChar_len;
         length       = length - 2;
         start_column = len_lesserChar - length;
-        to_go_dirMtx = dirMtx + (start_row * len_lesserChar);
 
         next_row = algn_fill_extending_left ( longerChar
                                             , algn_precalcMtx
@@ -1281,97 +1038,260 @@ algn_fill_plane_2 ( const dyn_character_t    *longerChar
                                             , len_lesserChar
                                             , next_row
                                             , next_prevRow
-                                            , to_go_dirMtx
+                                            , dirs
                                             , costMatrix
                                             , start_row
                                             , final_row
                                             , start_column
                                             , length
+                                            , ceiling
                                             );
 
+        if (next_row == NULL) return ceiling->least;
+
         next_prevRow = choose_other (next_row, curRow, prevRow);
     }
-    /* Case 3: (final case)
+    /* Case 2: (final case)
      * There is a block in the middle with full rows that have to be filled
      */
     else {
-        /* We will simplify this case even further: If the size of the leftover
-         * is too small, don't use the barriers at all, just fill it all up
-         */
-        // subset 2:
-        if (8 >= (longerChar_len - height)) {
-            return (algn_fill_plane ( longerChar
-                                    , algn_precalcMtx
-                                    , longerChar_len
-                                    , len_lesserChar
-                                    , curRow
-                                    , dirMtx
-                                    , costMatrix
-                                    )
-                    );
-        // subset 3:
-        } else {
-            algn_fill_first_row (curRow, dirMtx, width, gap_row);
-            start_row    = 1;
-            final_row    = (len_lesserChar - width) + 1;
-            start_column = 0;
-            length       = width + 1;
-            to_go_dirMtx = dirMtx + (len_lesserChar * start_row);
-            next_row     = algn_fill_extending_right ( longerChar
-                                                     , algn_precalcMtx
-                                                    // , longerChar_len
-                                                     , len_lesserChar
-                                                     , prevRow
-                                                     , curRow
-                                                     , to_go_dirMtx
-                                                     , costMatrix
-                                                     , start_row
-                                                     , final_row
-                                                     , length
-                                                     );
-
-            next_prevRow = choose_other (next_row, curRow, prevRow);
-            start_row    = final_row;
-            final_row    = longerChar_len - (len_lesserChar - width) + 1;
-            length       = len_lesserChar;
-            to_go_dirMtx = dirMtx + (len_lesserChar * start_row);
-            next_row     = algn_fill_no_extending ( longerChar
-                                                  , algn_precalcMtx
-                                                 // , longerChar_len
-                                                  , len_lesserChar
-                                                  , next_row
-                                                  , next_prevRow
-                                                  , to_go_dirMtx
-                                                  , costMatrix
-                                                  , start_row
-                                                  , final_row
-                                                  );
+        algn_fill_first_row (curRow, dirs->row, width, gap_row);
+        algn_pack_dir_row(dirs, 0, 0, width - 1);
+        start_row    = 1;
+        final_row    = (len_lesserChar - width) + 1;
+        start_column = 0;
+        length       = width + 1;
+        next_row     = algn_fill_extending_right ( longerChar
+                                                 , algn_precalcMtx
+                                                // , longerChar_len
+                                                 , len_lesserChar
+                                                 , prevRow
+                                                 , curRow
+                                                 , dirs
+                                                 , costMatrix
+                                                 , start_row
+                                                 , final_row
+                                                 , length
+                                                 , ceiling
+                                                 );
+
+        if (next_row == NULL) return ceiling->least;
 
-            next_prevRow = choose_other (next_row, curRow, prevRow);
-            start_row    = final_row;
-            final_row    = longerChar_len;
-            start_column = 1;
-            length       = len_lesserChar - 1;
-            to_go_dirMtx = dirMtx + (len_lesserChar * start_row);
-            next_row     = algn_fill_extending_left ( longerChar
-                                                    , algn_precalcMtx
-                                                   // , longerChar_len
-                                                    , len_lesserChar
-                                                    , next_row
-                                                    , next_prevRow
-                                                    , to_go_dirMtx
-                                                    , costMatrix
-                                                    , start_row
-                                                    , final_row
-                                                    , start_column
-                                                    , length
-                                                    );
-
-            next_prevRow = choose_other (next_row, curRow, prevRow);
-        }
+        next_prevRow = choose_other (next_row, curRow, prevRow);
+        start_row    = final_row;
+        final_row    = longerChar_len - (len_lesserChar - width) + 1;
+        length       = len_lesserChar;
+        next_row     = algn_fill_no_extending ( longerChar
+                                              , algn_precalcMtx
+                                             // , longerChar_len
+                                              , len_lesserChar
+                                              , next_row
+                                              , next_prevRow
+                                              , dirs
+                                              , costMatrix
+                                              , start_row
+                                              , final_row
+                                              , ceiling
+                                              );
+
+        if (next_row == NULL) return ceiling->least;
+
+        next_prevRow = choose_other (next_row, curRow, prevRow);
+        start_row    = final_row;
+        final_row    = longerChar_len;
+        start_column = 1;
+        length       = len_lesserChar - 1;
+        next_row     = algn_fill_extending_left ( longerChar
+                                                , algn_precalcMtx
+                                               // , longerChar_len
+                                                , len_lesserChar
+                                                , next_row
+                                                , next_prevRow
+                                                , dirs
+                                                , costMatrix
+                                                , start_row
+                                                , final_row
+                                                , start_column
+                                                , length
+                                                , ceiling
+                                                );
+
+        if (next_row == NULL) return ceiling->least;
+
+        next_prevRow = choose_other (next_row, curRow, prevRow);
     }
     return next_prevRow[len_lesserChar - 1];
 }
+
+/** Whether a band of the given height covers so much of the plane that it is as
+ *  well to fill all of it.
+ */
+static inline int
+algn_band_is_full ( size_t longerChar_len
+                  , size_t height
+                  )
+{
+    return 2 * height >= longerChar_len && 8 >= longerChar_len - height;
+}
+
+/** The least costs of inserting an element of the lesser character, and of
+ *  deleting one of the longer, leading gaps aside. Insertions in the first row
+ *  cost the prepend cost, and deletions in the last column the tail cost.
+ */
+static inline void
+algn_least_indel_costs ( const dyn_character_t    *longerChar
+                       , const unsigned int       *algn_precalcMtx
+                       ,       size_t              longerChar_len
+                       ,       size_t              len_lesserChar
+                       , const cost_matrices_2d_t *costMatrix
+                       ,       unsigned int       *leastInsert
+                       ,       unsigned int       *leastDelete
+                       )
+{
+    const unsigned int *prepend_row = algn_precalcMtx,
+                       *gap_row     = algn_precalcMtx + (costMatrix->gap_char * len_lesserChar);
+
+    *leastInsert = *leastDelete = UINT_MAX;
+    for (size_t j = 1; j < len_lesserChar; j++) {
+        if (prepend_row[j] < *leastInsert) *leastInsert = prepend_row[j];
+        if (gap_row[j]     < *leastInsert) *leastInsert = gap_row[j];
+    }
+    for (size_t i = 1; i < longerChar_len; i++) {
+        const elem_t       elem = longerChar->char_begin[i];
+        const unsigned int gap  = cm_calc_cost_2d( costMatrix->cost, elem, costMatrix->gap_char, costMatrix->alphSize ),
+                           tail = costMatrix->tail_cost[elem];
+        if (gap  < *leastDelete) *leastDelete = gap;
+        if (tail < *leastDelete) *leastDelete = tail;
+    }
+}
+
+/** The least cost of a path that leaves a band of the given barriers. A path
+ *  past its right edge has made width more insertions than deletions, so has in
+ *  all at least width insertions and width + lengthDiff deletions. One past its
+ *  lower edge has likewise at least height deletions and height - lengthDiff
+ *  insertions.
+ */
+static inline unsigned int
+algn_band_exit_bound ( size_t       width
+                     , size_t       height
+                     , size_t       lengthDiff
+                     , unsigned int leastInsert
+                     , unsigned int leastDelete
+                     )
+{
+    const unsigned long long right = (unsigned long long) width * leastInsert
+                                   + (unsigned long long) (width + lengthDiff) * leastDelete,
+                             below = (unsigned long long) height * leastDelete
+                                   + (unsigned long long) (height - lengthDiff) * leastInsert,
+                             least = right < below ? right : below;
+
+    return least < UINT_MAX ? (unsigned int) least : UINT_MAX;
+}
+
+/** Record in stats, if there are any, a band of barrier cells either side of the
+ *  diagonals, or the whole plane, of which a first row of firstRow cells and then
+ *  the rows checked against ceiling were filled.
+ */
+static inline void
+algn_record_band (       alignment_stats_t *stats
+                 ,       size_t             barrier
+                 ,       size_t             longerChar_len
+                 ,       int                fullPlane
+                 ,       size_t             firstRow
+                 , const cost_ceiling_t    *ceiling
+                 )
+{
+    if (stats == NULL) return;
+
+    stats->cells          += firstRow + ceiling->cells;
+    stats->bandWidth       = fullPlane ? longerChar_len : barrier;
+    stats->bandPasses++;
+    stats->fullPlaneFills += fullPlane;
+}
+
+/** Ukkonen's doubling: fill a band of barrier cells either side of the diagonals
+ *  an alignment must cross, and accept its cost only if it is less than that of
+ *  any path that leaves the band. Otherwise double the barrier and fill again,
+ *  until the band would cover nearly the whole plane, which is then filled.
+ *
+ *  A band cost under the bound is that of the full plane, and every path of that
+ *  cost lies in the band, so the direction matrix gives the alignment the full
+ *  plane would. A band stops as soon as it is sure to cost the bound or more, or
+ *  more than the ceiling; if every path outside it costs more than the ceiling
+ *  as well, so does the alignment.
+ *
+ *  Each pass keeps only the directions of its band, so that memory as well as
+ *  time is O(d·n) for a band of width d, until the whole plane is filled.
+ */
+static inline int
+algn_fill_plane_2 ( const dyn_character_t    *longerChar
+                  ,       unsigned int       *algn_precalcMtx
+                  ,       size_t              longerChar_len
+                  ,       size_t              len_lesserChar
+                  ,       unsigned int       *curRow
+                  ,       alignment_matrices_t *algnMats
+                  , const cost_matrices_2d_t *costMatrix
+                  ,       size_t              barrier
+                  ,       unsigned int        costCeiling
+                  ,       alignment_stats_t  *stats
+                  )
+{
+    const size_t lengthDiff = longerChar_len - len_lesserChar;
+    unsigned int leastInsert,
+                 leastDelete;
+
+    algn_least_indel_costs( longerChar, algn_precalcMtx, longerChar_len, len_lesserChar, costMatrix, &leastInsert, &leastDelete );
+
+    for (;; barrier *= 2) {
+        const size_t width  = barrier < len_lesserChar ? barrier : len_lesserChar,
+                     height = lengthDiff + barrier < longerChar_len ? lengthDiff + barrier : longerChar_len;
+
+        const unsigned int exitBound = algn_band_exit_bound( width, height, lengthDiff, leastInsert, leastDelete );
+        const int          fullPlane = exitBound == 0 || algn_band_is_full( longerChar_len, height );
+
+        // No row of a band is wider than width + height - 1 cells, nor than the plane.
+        const size_t rowCells = fullPlane || width + height > len_lesserChar ? len_lesserChar : width + height;
+
+        const packed_dir_mtx_t dirs = algnMtx_packed_band( algnMats, longerChar_len, rowCells );
+
+        cost_ceiling_t ceiling = { costCeiling, 0, 0, 0 };
+
+        if (stats != NULL) stats->directionBytes = longerChar_len * dirs.rowBytes;
+
+        if (fullPlane) {
+            const unsigned int cost = algn_fill_plane ( longerChar
+                                                      , algn_precalcMtx
+                                                      , longerChar_len
+                                                      , len_lesserChar
+                                                      , curRow
+                                                      , &dirs
+                                                      , costMatrix
+                                                      , &ceiling
+                                                      );
+
+            algn_record_band( stats, barrier, longerChar_len, 1, len_lesserChar, &ceiling );
+            return cost;
+        }
+        if (exitBound - 1 < ceiling.cost) ceiling.cost = exitBound - 1;
+
+        const unsigned int cost = algn_fill_band_2 ( longerChar
+                                                   , algn_precalcMtx
+                                                   , longerChar_len
+                                                   , len_lesserChar
+                                                   , curRow
+                                                   , &dirs
+                                                   , costMatrix
+                                                   , width
+                                                   , height
+                                                   , &ceiling
+                                                   );
+
+        algn_record_band( stats, barrier, longerChar_len, 0, width, &ceiling );
+
+        if (cost < exitBound && cost <= costCeiling) return cost;
+        if (exitBound > costCeiling) return cost;
+    }
+}
 /******************************************************************************/
 
 /******************************************************************************/
@@ -3255,6 +3175,27 @@ ASSIGN_MINIMUM (unsigned int    *final_cost_matrix,
     return (direction_matrix);
 }
 
+/** The least cost, in any of the four states, of cells first through last of a row. */
+static inline unsigned int
+algn_least_affine_cost ( const unsigned int *extend_horizontal
+                       , const unsigned int *extend_vertical
+                       , const unsigned int *extend_block_diagonal
+                       , const unsigned int *close_block_diagonal
+                       ,       size_t        first
+                       ,       size_t        last
+                       )
+{
+    unsigned int least = UINT_MAX;
+    for (size_t j = first; j <= last; j++) {
+        if (extend_horizontal[j]     < least) least = extend_horizontal[j];
+        if (extend_vertical[j]       < least) least = extend_vertical[j];
+        if (extend_block_diagonal[j] < least) least = extend_block_diagonal[j];
+        if (close_block_diagonal[j]  < least) least = close_block_diagonal[j];
+    }
+    return least;
+}
+
+
 unsigned int
 algn_fill_plane_2d_affine_nobt ( const dyn_character_t    *shortChar
                                , const dyn_character_t    *longerChar
@@ -3268,6 +3209,7 @@ algn_fill_plane_2d_affine_nobt ( const dyn_character_t    *shortChar
                                ,       unsigned int       *algn_precalcMtx
                                ,       unsigned int       *gap_open_prec
                                ,       unsigned int       *longerChar_horizontal_extension
+                               ,       unsigned int        upperBound
                                )
 {
     size_t start_pos = 1,
@@ -3400,7 +3342,7 @@ algn_fill_plane_2d_affine_nobt ( const dyn_character_t    *shortChar
         longerCharElem                       = longerCharBegin[start_pos - 1];
         close_block_diagonal [start_pos - 1] = VERY_LARGE_NUMBER;
 
-        shortChar_no_gap_vector = costMatrix->cost + (shortChar_no_gap << costMatrix->costMatrixDimension);
+        shortChar_no_gap_vector = cm_get_row( costMatrix->cost, shortChar_no_gap, costMatrix->alphSize );
 
         for (j=start_pos; j <= end_pos; j++) {
 //            longerCharPrevElem       = longerCharElem;
@@ -3453,6 +3395,17 @@ algn_fill_plane_2d_affine_nobt ( const dyn_character_t    *shortChar
                                           , prev_extend_block_diagonal
                                           );
         }
+        // Every path to the last cell passes through this row, in one of its four states.
+        if (upperBound != UINT_MAX) {
+            const unsigned int least = algn_least_affine_cost( extend_horizontal
+                                                             , extend_vertical
+                                                             , extend_block_diagonal
+                                                             , close_block_diagonal
+                                                             , start_pos - 1
+                                                             , end_pos
+                                                             );
+            if (least > upperBound) return least;
+        }
         if (end_pos < longerChar_len) {
             end_pos++;
             extend_vertical[end_pos]       = VERY_LARGE_NUMBER;
@@ -3494,6 +3447,7 @@ algn_fill_plane_2d_affine ( const dyn_character_t    *shortChar
                           ,       unsigned int       *algn_precalcMtx
                           ,       unsigned int       *gap_open_prec
                           ,       unsigned int       *longerChar_horizontal_extension
+                          ,       unsigned int        costCeiling
                           )
 {
     if (DEBUG_AFFINE) {
@@ -3633,7 +3587,7 @@ algn_fill_plane_2d_affine ( const dyn_character_t    *shortChar
         direction_matrix        [start_pos - 1] = DO_VERTICAL | END_VERTICAL;
         longerCharElem                          = longerCharBegin[start_pos - 1];
         close_block_diagonal    [start_pos - 1] = VERY_LARGE_NUMBER;
-        shortChar_no_gap_vector                 = costMatrix->cost + (shortChar_no_gap << costMatrix->costMatrixDimension);
+        shortChar_no_gap_vector                 = cm_get_row( costMatrix->cost, shortChar_no_gap, costMatrix->alphSize );
 
         for (longerCharIdx = start_pos; longerCharIdx <= end_pos; longerCharIdx++) {
 //            longerCharPrevElem       = longerCharElem;
@@ -3702,6 +3656,16 @@ algn_fill_plane_2d_affine ( const dyn_character_t    *shortChar
 
             direction_matrix[longerCharIdx]  = tmp_direction_matrix;
         }
+        if (costCeiling != UINT_MAX) {
+            const unsigned int least = algn_least_affine_cost( extend_horizontal
+                                                             , extend_vertical
+                                                             , extend_block_diagonal
+                                                             , close_block_diagonal
+                                                             , start_pos - 1
+                                                             , end_pos
+                                                             );
+            if (least > costCeiling) return least;
+        }
         if (end_pos < longerChar_len) {
             end_pos++;
             direction_matrix[end_pos]      = DO_HORIZONTAL | END_HORIZONTAL;
@@ -4001,6 +3965,7 @@ algn_fill_plane_2_affine ( const dyn_character_t    *longerChar
  *  alignment of the subcharacters of char1 and char2 starting in position st_char1
  *  and st_char2, respectively, with length len_char1 and len_char2 using the
  *  transformation cost matrix cstMtx and the alignment matrices algnMats.
+ *  costCeiling bounds only the non-affine alignment.
  */
 static inline int
 algn_nw_limit_2d ( const dyn_character_t      *shorterChar
@@ -4010,6 +3975,8 @@ algn_nw_limit_2d ( const dyn_character_t      *shorterChar
                  ,       size_t                deltawh
                  ,       size_t                len_shorterChar
                  ,       size_t                longerChar_len
+                 ,       unsigned int          costCeiling
+                 ,       alignment_stats_t    *stats
                  )
 {
     // printf("algn_nw_limit_2d %d\n", deltawh);
@@ -4062,11 +4029,11 @@ algn_nw_limit_2d ( const dyn_character_t      *shorterChar
                                  , longerChar_len
                                  , len_shorterChar
                                  , curRow
-                                 , dirMtx
+                                 , algnMats
                                  , costMatrix
-                                 , 50
-                                 , (longerChar_len - len_shorterChar) + 50
-                                 , deltawh
+                                 , BAND_INITIAL_BARRIER + deltawh
+                                 , costCeiling
+                                 , stats
                                  );
     }
 }
@@ -4081,6 +4048,8 @@ algn_nw_2d ( const dyn_character_t      *shorterChar
            , const cost_matrices_2d_t   *costMatrix
            ,       alignment_matrices_t *algnMats
            ,       int                   deltawh
+           ,       unsigned int          costCeiling
+           ,       alignment_stats_t    *stats
            )
 {
     // deltawh is the size of the direction matrix, and was determined by the following algorithm:
@@ -4119,10 +4088,357 @@ algn_nw_2d ( const dyn_character_t      *shorterChar
                             , deltawh
                             , shorterChar_len
                             , longerChar_len
+                            , costCeiling
+                            , stats
                             );
 }
 
 
+/******************************************************************************/
+/*                    Cost-only pairwise non-affine alignment                 */
+/******************************************************************************/
+/*
+ * algn_nw_2d_cost() fills the bands of algn_fill_plane_2() a row at a time, into
+ * two rows that it swaps. Each row is a span of cells [first, last]. Its first
+ * cell is either column 0, reached only from above, or the left edge of the
+ * band, reached only from above or diagonally. Its last cell is either the
+ * right edge of the band, reached only from the left or diagonally, or the last
+ * column, which also may be reached from above at the tail cost.
+ */
+
+typedef struct cost_band_t {
+    const dyn_character_t    *longerChar;
+    const cost_matrices_2d_t *costMatrix;
+    const unsigned int       *precalcMtx;
+          size_t              len_lesserChar;
+          unsigned int       *rows[2];
+} cost_band_t;
+
+
+#define BAND_FROM_COLUMN_ZERO 0   /** First cell is in column 0. */
+#define BAND_FROM_EDGE        1   /** First cell is on the band's left edge. */
+#define BAND_TO_EDGE          0   /** Last cell is on the band's right edge. */
+#define BAND_TO_LAST_COLUMN   1   /** Last cell is in the last column. */
+
+
+/** Fill cells first through last of the row of element i of the longer character.
+ *  In column 0 a full-plane row adds the cost of the element against a gap, and
+ *  a banded row its tail cost, as algn_fill_full_row() and algn_fill_first_cell() do.
+ */
+static inline void
+algn_fill_cost_row ( const cost_band_t *band
+                   ,       size_t       i
+                   ,       size_t       first
+                   ,       size_t       last
+                   ,       int          firstCell
+                   ,       int          lastCell
+                   ,       int          fullPlane
+                   )
+{
+    const cost_matrices_2d_t *costMatrix = band->costMatrix;
+    const size_t              len        = band->len_lesserChar;
+    const elem_t              elem       = band->longerChar->char_begin[i];
+    const unsigned int       *gap_row    = band->precalcMtx + costMatrix->gap_char * len,
+                             *align_row  = band->precalcMtx + elem * len,
+                             *prevRow    = band->rows[(i - 1) % 2];
+          unsigned int       *curRow     = band->rows[i % 2];
+    const unsigned int        c          = cm_calc_cost_2d( costMatrix->cost, elem, costMatrix->gap_char, costMatrix->alphSize );
+
+    if (firstCell == BAND_FROM_COLUMN_ZERO) {
+        curRow[0] = prevRow[0] + (fullPlane ? c : align_row[0]);
+    } else {
+        const unsigned int upward   = prevRow[first]     + c,
+                           diagonal = prevRow[first - 1] + align_row[first];
+        curRow[first] = diagonal < upward ? diagonal : upward;
+    }
+
+    const size_t fillTo = lastCell == BAND_TO_EDGE ? last - 1 : last;
+    if (first + 1 <= fillTo) {
+        algn_fill_row_kernel()->fill( curRow, prevRow, gap_row, align_row, NULL, c, first + 1, fillTo );
+    }
+
+    if (lastCell == BAND_TO_EDGE) {
+        const unsigned int leftward = curRow[last - 1]  + gap_row[last],
+                           diagonal = prevRow[last - 1] + align_row[last];
+        curRow[last] = diagonal < leftward ? diagonal : leftward;
+    } else if (last > 0) {
+        const unsigned int upward = prevRow[last] + costMatrix->tail_cost[elem];
+        if (upward < curRow[last]) curRow[last] = upward;
+    }
+}
+
+
+/** Fill the rows from *row up to, but not including, endRow: the first has cells first through
+ *  last, and each next one starts firstStep and ends lastStep cells further right, as in the
+ *  band functions of algn_fill_plane_2(). Afterwards *row is endRow.
+ *
+ *  Returns 1, with ceiling->least the least cost of the row, if every cell of a row costs
+ *  more than the ceiling.
+ */
+static inline int
+algn_fill_cost_rows ( const cost_band_t    *band
+                    ,       size_t         *row
+                    ,       size_t          endRow
+                    ,       size_t          first
+                    ,       size_t          last
+                    ,       size_t          firstStep
+                    ,       size_t          lastStep
+                    ,       int             firstCell
+                    ,       int             lastCell
+                    ,       int             fullPlane
+                    ,       cost_ceiling_t *ceiling
+                    )
+{
+    for (; *row < endRow; (*row)++, first += firstStep, last += lastStep) {
+        algn_fill_cost_row( band, *row, first, last, firstCell, lastCell, fullPlane );
+        if (algn_row_exceeds( band->rows[*row % 2], first, last, ceiling )) return 1;
+    }
+    return 0;
+}
+
+
+/** Fill the band of the given barriers, or the full plane, of algn_fill_band_2()
+ *  or algn_fill_plane(), and record it in stats, if there are any. Returns its
+ *  cost, or, if every cell of a row costs more than the ceiling, that row's least
+ *  cost.
+ */
+static inline unsigned int
+algn_fill_cost_plane ( const cost_band_t       *band
+                     ,       size_t             longerChar_len
+                     ,       size_t             width
+                     ,       size_t             height
+                     ,       size_t             barrier
+                     ,       int                fullPlane
+                     ,       unsigned int       costCeiling
+                     ,       alignment_stats_t *stats
+                     )
+{
+    const size_t        len_lesserChar = band->len_lesserChar;
+    const unsigned int *first_gap_row  = band->precalcMtx;
+    const size_t        firstRowLen    = fullPlane ? len_lesserChar : width;
+          unsigned int *rows           = band->rows[0];
+
+    rows[0] = 0;
+    for (size_t j = 1; j < firstRowLen; j++) {
+        rows[j] = rows[j - 1] + first_gap_row[j];
+    }
+
+    const size_t last_column = len_lesserChar - 1;
+    size_t       row         = 1;
+    int          exceeded;
+
+    cost_ceiling_t ceiling = { costCeiling, 0, 0, 0 };
+
+    if (fullPlane) {
+        exceeded = algn_fill_cost_rows( band, &row, longerChar_len, 0, last_column, 0, 0
+                                      , BAND_FROM_COLUMN_ZERO, BAND_TO_LAST_COLUMN, fullPlane, &ceiling );
+
+    } else if (2 * height < longerChar_len) {
+        // algn_fill_extending_right(), algn_fill_extending_left_right(), then algn_fill_extending_left().
+        const size_t middleWidth = width + height - 1;
+
+        exceeded =  algn_fill_cost_rows( band, &row, height, 0, width, 0, 1
+                                       , BAND_FROM_COLUMN_ZERO, BAND_TO_EDGE, fullPlane, &ceiling )
+                 || algn_fill_cost_rows( band, &row, longerChar_len - (height - 1), 1, middleWidth, 1, 1
+                                       , BAND_FROM_EDGE, BAND_TO_EDGE, fullPlane, &ceiling )
+                 || algn_fill_cost_rows( band, &row, longerChar_len, len_lesserChar - (middleWidth - 1), last_column, 1, 0
+                                       , BAND_FROM_EDGE, BAND_TO_LAST_COLUMN, fullPlane, &ceiling );
+
+    } else {
+        // algn_fill_extending_right(), algn_fill_no_extending(), then algn_fill_extending_left().
+        const size_t overhang = len_lesserChar - width;
+
+        exceeded =  algn_fill_cost_rows( band, &row, overhang + 1, 0, width, 0, 1
+                                       , BAND_FROM_COLUMN_ZERO, BAND_TO_EDGE, fullPlane, &ceiling )
+                 || algn_fill_cost_rows( band, &row, longerChar_len - overhang + 1, 0, last_column, 0, 0
+                                       , BAND_FROM_COLUMN_ZERO, BAND_TO_LAST_COLUMN, fullPlane, &ceiling )
+                 || algn_fill_cost_rows( band, &row, longerChar_len, 1, last_column, 1, 0
+                                       , BAND_FROM_EDGE, BAND_TO_LAST_COLUMN, fullPlane, &ceiling );
+    }
+
+    algn_record_band( stats, barrier, longerChar_len, fullPlane, firstRowLen, &ceiling );
+
+    return exceeded ? ceiling.least : band->rows[(longerChar_len - 1) % 2][last_column];
+}
+
+
+unsigned int
+algn_nw_2d_cost ( const dyn_character_t      *shorterChar
+                , const dyn_character_t      *longerChar
+                , const cost_matrices_2d_t   *costMatrix
+                , const unsigned int         *precalcMtx
+                ,       unsigned int         *rows
+                ,       int                   deltawh
+                ,       unsigned int          upperBound
+                ,       alignment_stats_t    *stats
+                )
+{
+    const size_t longerChar_len = longerChar->len,
+                 len_lesserChar = shorterChar->len,
+                 lengthDiff     = longerChar_len - len_lesserChar;
+
+    assert (longerChar_len >= len_lesserChar);
+
+    const cost_band_t band = { longerChar
+                             , costMatrix
+                             , precalcMtx
+                             , len_lesserChar
+                             , { rows, rows + len_lesserChar }
+                             };
+
+    unsigned int leastInsert,
+                 leastDelete;
+
+    algn_least_indel_costs( longerChar, precalcMtx, longerChar_len, len_lesserChar, costMatrix, &leastInsert, &leastDelete );
+
+    // The bands of algn_fill_plane_2(), doubled and accepted exactly as there.
+    for (size_t barrier = BAND_INITIAL_BARRIER + deltawh;; barrier *= 2) {
+        const size_t width  = barrier < len_lesserChar ? barrier : len_lesserChar,
+                     height = lengthDiff + barrier < longerChar_len ? lengthDiff + barrier : longerChar_len;
+
+        const unsigned int exitBound = algn_band_exit_bound( width, height, lengthDiff, leastInsert, leastDelete );
+
+        if (exitBound == 0 || algn_band_is_full( longerChar_len, height )) {
+            return algn_fill_cost_plane( &band, longerChar_len, width, height, barrier, 1, upperBound, stats );
+        }
+
+        const unsigned int bandBound = exitBound - 1 < upperBound ? exitBound - 1 : upperBound,
+                           cost      = algn_fill_cost_plane( &band, longerChar_len, width, height, barrier, 0, bandBound, stats );
+
+        if (cost < exitBound && cost <= upperBound) return cost;
+        if (exitBound > upperBound) return cost;
+    }
+}
+
+
+/******************************************************************************/
+/*             Cost-only pairwise alignment for discrete characters           */
+/******************************************************************************/
+/*
+ * Where every indel and every mismatch costs the same, the cost is a multiple of
+ * the edit distance, and a column of the matrix is held as two bit vectors: the
+ * rows at which the cost rises by one from the row above (pv), and those at which
+ * it falls by one (mv). A column follows from the one to its left, and the rows
+ * whose element shares a state with the column's, in a few word operations.
+ */
+
+int
+algn_discrete_applies ( const dyn_character_t    *shorterChar
+                      , const dyn_character_t    *longerChar
+                      , const cost_matrices_2d_t *costMatrix
+                      )
+{
+    if (costMatrix->cost_model_type || costMatrix->tcm_structure != TCM_NON_ADDITIVE) return 0;
+
+    const elem_t gap_char = costMatrix->gap_char;
+    for (size_t i = 1; i < shorterChar->len; i++) {
+        if (!shorterChar->char_begin[i] || shorterChar->char_begin[i] & gap_char) return 0;
+    }
+    for (size_t i = 1; i < longerChar->len; i++) {
+        if (!longerChar->char_begin[i] || longerChar->char_begin[i] & gap_char) return 0;
+    }
+    return 1;
+}
+
+
+/** Advance a block of 64 rows by one column, given eq, its rows that match the
+ *  column's element, and the change in cost, -1, 0 or 1, along the column at the
+ *  row above the block. Returns the change in cost along the column at the row of
+ *  lastRow, the block's last one or that of the shorter character.
+ */
+static inline int
+algn_advance_discrete_block ( uint64_t *pv
+                            , uint64_t *mv
+                            , uint64_t  eq
+                            , int       carry
+                            , uint64_t  lastRow
+                            )
+{
+    const uint64_t carryNeg = carry < 0,
+                   carryPos = carry > 0,
+                   xv       = eq | *mv;
+
+    eq |= carryNeg;
+
+    const uint64_t xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+          uint64_t ph = *mv | ~(xh | *pv),
+                   mh = *pv & xh;
+
+    const int carryOut = (ph & lastRow) ? 1 : (mh & lastRow) ? -1 : 0;
+
+    ph = (ph << 1) | carryPos;
+    mh = (mh << 1) | carryNeg;
+
+    *pv = mh | ~(xv | ph);
+    *mv = ph & xv;
+
+    return carryOut;
+}
+
+
+unsigned int
+algn_nw_2d_cost_discrete ( const dyn_character_t    *shorterChar
+                         , const dyn_character_t    *longerChar
+                         , const cost_matrices_2d_t *costMatrix
+                         ,       uint64_t           *words
+                         )
+{
+    // Rows and columns are those of the elements after the leading gaps.
+    const size_t  rowCount  = shorterChar->len - 1,
+                  colCount  = longerChar->len  - 1,
+                  blocks    = (rowCount + 63) / 64,
+                  alphSize  = costMatrix->alphSize;
+    const elem_t *rowElems  = shorterChar->char_begin + 1,
+                 *colElems  = longerChar->char_begin  + 1;
+
+    if (rowCount == 0) return colCount * costMatrix->tcm_factor;
+
+    // The rows holding each state, for each block, then the block's two vectors, then the rows matching
+    // an ambiguous column.
+    uint64_t *stateRows = words,
+             *pv        = stateRows + alphSize * blocks,
+             *mv        = pv        + blocks,
+             *ambigRows = mv        + blocks;
+
+    memset( stateRows, 0, alphSize * blocks * sizeof(uint64_t) );
+    for (size_t i = 0; i < rowCount; i++) {
+        for (elem_t states = rowElems[i]; states; states &= states - 1) {
+            stateRows[__builtin_ctz(states) * blocks + i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        pv[b] = ~(uint64_t) 0;   // The first column is 0, 1, 2, ...
+        mv[b] = 0;
+    }
+
+    const uint64_t highRow = (uint64_t) 1 << 63,
+                   lastRow = (uint64_t) 1 << ((rowCount - 1) % 64);
+
+    size_t distance = rowCount;   // The cost at the last row, in units of tcm_factor.
+    for (size_t j = 0; j < colCount; j++) {
+        const elem_t    elem    = colElems[j];
+        const uint64_t *matches = stateRows + __builtin_ctz(elem) * blocks;
+              int       carry   = 1;   // The first row is 0, 1, 2, ...
+
+        if (elem & (elem - 1)) {
+            memcpy( ambigRows, matches, blocks * sizeof(uint64_t) );
+            for (elem_t states = elem & (elem - 1); states; states &= states - 1) {
+                const uint64_t *stateRow = stateRows + __builtin_ctz(states) * blocks;
+                for (size_t b = 0; b < blocks; b++) ambigRows[b] |= stateRow[b];
+            }
+            matches = ambigRows;
+        }
+
+        for (size_t b = 0; b + 1 < blocks; b++) {
+            carry = algn_advance_discrete_block( pv + b, mv + b, matches[b], carry, highRow );
+        }
+        distance += algn_advance_discrete_block( pv + blocks - 1, mv + blocks - 1, matches[blocks - 1], carry, lastRow );
+    }
+
+    return distance * costMatrix->tcm_factor;
+}
+
+
 int
 algn_calculate_from_2_aligned ( dyn_character_t    *char1
                               , dyn_character_t    *char2
@@ -4242,14 +4558,14 @@ void
 algn_print_bcktrck_2d (const dyn_character_t *char1, const dyn_character_t *char2,
               const alignment_matrices_t *alignmentMatrices) {
     size_t i, j;
-    DIR_MTX_ARROW_t *direction_matrix = alignmentMatrices->algn_dirMtx;
+    const packed_dir_mtx_t dirs = algnMtx_packed_dirs( alignmentMatrices );
     printf ("\n");
     for (i = 0; i < char1->len; i++) {
         for (j = 0; j < char2->len; j++) {
-            printf ("%d", (int) direction_matrix[j]);
+            if (algnMtx_packed_keeps( &dirs, i, j )) printf ("%d", (int) algnMtx_packed_dir( &dirs, i, j ));
+            else                                     printf (" ");
             fflush (stdout);
         }
-        direction_matrix += j;
         printf ("\n");
         fflush (stdout);
     }
@@ -4282,13 +4598,13 @@ algn_print_dynmtrx_2d ( const dyn_character_t      *char1
 //  int *algn_costMatrix;
 //  algn_costMatrix = alignment_matrices->algn_costMtx;
 
-  DIR_MTX_ARROW_t *algn_dirMtx  = alignment_matrices->algn_dirMtx;
+  const packed_dir_mtx_t dirs = algnMtx_packed_dirs( alignment_matrices );
 
   printf ("Character 1 length: %d\n", charLen1);
   printf ("Character 2 length: %d\n", charLen2);
   printf ("Length    Product: %d\n", charLen1 * charLen2);
   printf ("Length +1 Product: %d\n", n * m);
-  printf ("Allocated space  : %zu\n\n", alignment_matrices->cap_nw);
+  printf ("Allocated space  : %zu\n\n", alignment_matrices->cap_packed);
 
   /*
   printf("Cost matrix:\n");
@@ -4365,7 +4681,8 @@ algn_print_dynmtrx_2d ( const dyn_character_t      *char1
     else        printf (" %2d | ", lesserChar->char_begin[i]);
 
     for (j = 0; j < longerCharLen; j++) {
-      DIR_MTX_ARROW_t dirToken = algn_dirMtx[lesserCharLen * j + i];
+      // A cell outside the band is not kept, and prints blank.
+      DIR_MTX_ARROW_t dirToken = algnMtx_packed_keeps( &dirs, j, i ) ? algnMtx_packed_dir( &dirs, j, i ) : 0;
       /*
       printf("    "); // leading pad
 
@@ -4445,9 +4762,14 @@ algn_backtrace_2d ( const dyn_character_t *shorterChar
             beg_debug = beg;
 
             printf ("Printing a two dimensional direction matrix.\n");
+            const packed_dir_mtx_t dirs = algnMtx_packed_dirs( alignMatrix );
             for (i = 0; i < idx_longerChar; i++, beg_debug += idx_shorterChar) {
                 for (j  = 0; j < idx_shorterChar; j++) {
-                    algn_string_of_2d_direction (beg_debug[j]);
+                    if (costMatrix->cost_model_type) {
+                        algn_string_of_2d_direction( beg_debug[j] );
+                    } else if (algnMtx_packed_keeps( &dirs, i, j + st_shorterChar )) {
+                        algn_string_of_2d_direction( algnMtx_packed_dir( &dirs, i, j + st_shorterChar ) );
+                    }
                     fprintf (stdout, "\t");
                     fflush (stdout);
                     end = beg_debug + j;
@@ -4466,32 +4788,40 @@ algn_backtrace_2d ( const dyn_character_t *shorterChar
     idx_shorterChar += st_shorterChar;
 
     if (!(costMatrix->cost_model_type)) { // not affine
-        while (end >= beg) {
-            if (*end & ALIGN) {
+        // The packed matrix is walked by row and column, from the same cell as end, and moving as it would.
+        const packed_dir_mtx_t dirs   = algnMtx_packed_dirs( alignMatrix );
+              long             row    = longerChar->len - 1,
+                               column = l - 1;
+
+        while (row * l + column >= 0) {
+            const DIR_MTX_ARROW_t direction = algnMtx_packed_dir( &dirs, row, column + st_shorterChar );
+
+            if (direction & ALIGN) {
                 idx_longerChar--;
                 new_item_for_ret_longerChar = get_elem(longerChar, idx_longerChar);
                 prepend_an_element(ret_longerChar, new_item_for_ret_longerChar);
                 idx_shorterChar--;
                 new_item_for_ret_shorterChar = get_elem(shorterChar, idx_shorterChar);
                 prepend_an_element(ret_shorterChar, new_item_for_ret_shorterChar);
-                end -= l + 1;
+                row--;
+                column--;
             }
-            else if (*end & DELETE) {
+            else if (direction & DELETE) {
                 idx_longerChar--;
                 new_item_for_ret_longerChar = get_elem(longerChar, idx_longerChar);
                 prepend_an_element(ret_longerChar, new_item_for_ret_longerChar);
                 new_item_for_ret_shorterChar = INDEL_GAP;
                 prepend_an_element(ret_shorterChar, new_item_for_ret_shorterChar);
-                end -= l;
+                row--;
             }
             else {
-                assert (*end & INSERT);
+                assert (direction & INSERT);
                 new_item_for_ret_longerChar = INDEL_GAP;
                 prepend_an_element(ret_longerChar, new_item_for_ret_longerChar);
                 idx_shorterChar--;
                 new_item_for_ret_shorterChar = get_elem(shorterChar, idx_shorterChar);
                 prepend_an_element(ret_shorterChar, new_item_for_ret_shorterChar);
-                end -= 1;
+                column--;
             }
         }
     }
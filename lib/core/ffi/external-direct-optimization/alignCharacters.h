@@ -56,6 +56,7 @@
 #ifndef ALIGN_CHARACTERS_H
 #define ALIGN_CHARACTERS_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -63,6 +64,7 @@
 #include "costMatrix.h"
 #include "debug_constants.h"
 #include "alignmentMatrices.h"
+#include "alignmentStats.h"
 #include "dyn_character.h"
 #include "ukkCommon.h"
 
@@ -141,15 +143,86 @@ algn_fill_3dMtx ( const dyn_character_t *lChar
                 );
 
 
+/** A non-affine alignment fills a Ukkonen band about the diagonals, starting
+ *  a few more than uk cells wide either side and doubling until a lower bound on the cost of
+ *  any path that leaves the band shows that its cost is that of the whole
+ *  plane; so it is, and the alignment is one the whole plane would give.
+ *
+ *  If every cell of a row of the band costs more than costCeiling, the
+ *  alignment must too, so a non-affine alignment stops there and returns that
+ *  row's least cost, which is greater than costCeiling but not the cost, and
+ *  leaves the direction matrix unfinished. Pass UINT_MAX for no ceiling.
+ *
+ *  The bands filled are added to stats, unless it is NULL.
+ */
 unsigned int
 algn_nw_2d ( const dyn_character_t      *char1
            , const dyn_character_t      *char2
            , const cost_matrices_2d_t   *c
            ,       alignment_matrices_t *nwMtxs
            ,       int                   uk
+           ,       unsigned int          costCeiling
+           ,       alignment_stats_t    *stats
            );
 
 
+/** As algn_nw_2d(), but only the cost: the same Ukkonen bands are filled, row
+ *  for row, keeping two rows of costs and no direction matrix.
+ *
+ *  precalcMtx must hold algnMtx_precalc_4algn_2d() of shorterChar, and rows
+ *  room for 2 * shorterChar->len costs.
+ *
+ *  If every cell of a row costs more than upperBound, the alignment must too,
+ *  so it stops there and returns that row's least cost, which is greater than
+ *  upperBound but not the cost. Pass UINT_MAX for no bound. The bands filled are
+ *  added to stats, unless it is NULL.
+ */
+unsigned int
+algn_nw_2d_cost ( const dyn_character_t      *shorterChar
+                , const dyn_character_t      *longerChar
+                , const cost_matrices_2d_t   *costMatrix
+                , const unsigned int         *precalcMtx
+                ,       unsigned int         *rows
+                ,       int                   deltawh
+                ,       unsigned int          upperBound
+                ,       alignment_stats_t    *stats
+                );
+
+
+/** Whether algn_nw_2d_cost_discrete() gives the cost of aligning the two characters:
+ *  the cost matrix is non-affine and TCM_NON_ADDITIVE, and, but for their leading
+ *  gaps, neither character has an element that may be a gap. Then every indel costs
+ *  costMatrix->tcm_factor, and so does every substitution of elements that share
+ *  no state.
+ */
+int
+algn_discrete_applies ( const dyn_character_t    *shorterChar
+                      , const dyn_character_t    *longerChar
+                      , const cost_matrices_2d_t *costMatrix
+                      );
+
+
+/** The number of 64-bit words algn_nw_2d_cost_discrete() needs. */
+#define ALGN_DISCRETE_WORDS(alphSize, len_shorterChar) (((alphSize) + 3) * (((len_shorterChar) + 62) / 64))
+
+
+/** As algn_nw_2d_cost() with no upper bound, where algn_discrete_applies(): the cost
+ *  is then tcm_factor times the edit distance, which is computed over the whole plane
+ *  64 rows at a time, by the bit-vector algorithm of Myers (1999) in the blocks of
+ *  Hyyr (2003). Each column is matched against the shorter character by AND-ing
+ *  bit masks of the rows holding each state, so ambiguous elements match any
+ *  element they share a state with.
+ *
+ *  words must have room for ALGN_DISCRETE_WORDS(alphSize, shorterChar->len).
+ */
+unsigned int
+algn_nw_2d_cost_discrete ( const dyn_character_t    *shorterChar
+                         , const dyn_character_t    *longerChar
+                         , const cost_matrices_2d_t *costMatrix
+                         ,       uint64_t           *words
+                         );
+
+
 /** Creates N-W matrices, then does alignment
  *  deltawh is width of ukkonnen barrier
  */
@@ -163,6 +236,7 @@ algn_nw_3d ( const dyn_character_t      *char1
            );
 
 
+/** Print the packed direction matrix of a non-affine 2D alignment. */
 void
 algn_print_bcktrck_2d( const dyn_character_t      *char1
                      , const dyn_character_t      *char2
@@ -170,6 +244,7 @@ algn_print_bcktrck_2d( const dyn_character_t      *char1
                      );
 
 
+/** Likewise, as arrows. */
 void
 algn_print_dynmtrx_2d( const dyn_character_t      *char1
                      , const dyn_character_t      *char2
@@ -187,6 +262,7 @@ algn_print_dynmtrx_2d( const dyn_character_t      *char1
  *  so they have been switched before the call (meaning that char1 is still the shortest).
  *  Depending on the case, deletion or insertion may be biased toward either longer or shorter.
  *  @param st_char1 and @param st_char2 are 0 if there are no limits, have values otherwise.
+ *  A non-affine alignment reads the packed direction matrix of @param m, an affine one algn_dirMtx.
  */
 void
 algn_backtrace_2d ( const dyn_character_t      *char1
@@ -239,7 +315,27 @@ algn_initialize_matrices_affine(       unsigned int        gap_open_cost
                                );
 
 
-// TODO: what is nobt? no backtrace?
+void
+algn_initialize_matrices_affine_nobt (       unsigned int        gap_open_cost
+                                     , const dyn_character_t    *shortChar
+                                     , const dyn_character_t    *longerChar
+                                     , const cost_matrices_2d_t *costMatrix
+                                     ,       unsigned int       *close_block_diagonal
+                                     ,       unsigned int       *extend_block_diagonal
+                                     ,       unsigned int       *extend_vertical
+                                     ,       unsigned int       *extend_horizontal
+                                     ,       unsigned int       *algn_precalcMtx
+                                     );
+
+
+/** As algn_fill_plane_2d_affine(), but without a backtrace ("nobt"): only the
+ *  cost, with each of the four matrices kept as two rows of lenj + 1 costs.
+ *  Initialize them with algn_initialize_matrices_affine_nobt().
+ *
+ *  If every cell of a row costs more than upperBound, stops there and returns
+ *  that row's least cost, which is greater than upperBound but not the cost.
+ *  Pass UINT_MAX for no bound.
+ */
 unsigned int
 algn_fill_plane_2d_affine_nobt ( const dyn_character_t   *si
                                , const dyn_character_t   *sj
@@ -253,6 +349,7 @@ algn_fill_plane_2d_affine_nobt ( const dyn_character_t   *si
                                ,       unsigned int       *precalcMtx
                                ,       unsigned int       *gap_open_prec
                                ,       unsigned int       *sj_horizontal_extension
+                               ,       unsigned int        upperBound
                                );
 
 
@@ -268,6 +365,10 @@ algn_backtrace_affine ( const dyn_character_t    *shortChar
                       );
 
 
+/** If every cell of a row costs more than costCeiling, stops there as
+ *  algn_fill_plane_2d_affine_nobt() does at its upperBound, leaving the
+ *  direction matrix unfinished. Pass UINT_MAX for no ceiling.
+ */
 unsigned int
 algn_fill_plane_2d_affine ( const dyn_character_t    *shortChar
                           , const dyn_character_t    *longChar
@@ -283,6 +384,7 @@ algn_fill_plane_2d_affine ( const dyn_character_t    *shortChar
                           ,       unsigned int       *precalcMtx
                           ,       unsigned int       *gap_open_prec
                           ,       unsigned int       *longChar_horizontal_extension
+                          ,       unsigned int        costCeiling
                           );
 
 
@@ -62,6 +62,8 @@ algnMat_clean_direction_matrix (alignment_matrices_t *alignMtx) {
 
 /** Allocate or reallocate space for the six matrices for both 2d.
  *  @param slphabetSize is length of original alphabet including gap.
+ *  @param packedDirections is 1 for a non-affine alignment, which packs its
+ *  directions; see packed_dir_mtx_t.
  *  Checks current allocation size and increases size if necessary.
  */
 inline void
@@ -69,6 +71,7 @@ algnMat_setup_size ( alignment_matrices_t *alignMtx
                    , size_t                len_char1
                    , size_t                len_char2
                    , size_t                alphabetSize
+                   , int                   packedDirections
                    )
 {
     if(DEBUG_MAT) {
@@ -80,6 +83,12 @@ algnMat_setup_size ( alignment_matrices_t *alignMtx
            cap_precalcMtx,
            cap_dir;
 
+    // Packed rows run along the shorter character, as in algn_nw_2d(). Their cells are
+    // allocated by algnMtx_packed_band(), as wide as each band needs.
+    const size_t len_rows    = len_char1 > len_char2 ? len_char1 : len_char2,
+                 len_columns = len_char1 > len_char2 ? len_char2 : len_char1,
+                 cap_dirRow  = len_columns + 1;
+
     cap            = algnMat_size_of_2d_matrix (len_char1, len_char2);
     cap_precalcMtx = (1 << alphabetSize) * len_char1;
     cap_dir        = (len_char1 + 1) * (len_char2 + 1);
@@ -97,7 +106,19 @@ algnMat_setup_size ( alignment_matrices_t *alignMtx
         assert( alignMtx->algn_costMtx != NULL && "Memory allocation problem in cost matrix.");
         alignMtx->cap_eff = cap;
     }
-    if (alignMtx->cap_nw < cap_dir) {         /* If the other matrices are not large enough */
+    if (packedDirections) {
+        if (alignMtx->cap_packedRows < len_rows) {
+            alignMtx->algn_packedRowStart = realloc( alignMtx->algn_packedRowStart, len_rows * sizeof(size_t) );
+            assert( alignMtx->algn_packedRowStart != NULL && "Memory allocation problem in packed direction rows\n" );
+            alignMtx->cap_packedRows = len_rows;
+        }
+        if (alignMtx->cap_dirRow < cap_dirRow) {
+            alignMtx->algn_dirRow = realloc( alignMtx->algn_dirRow, cap_dirRow * sizeof(DIR_MTX_ARROW_t) );
+            assert( alignMtx->algn_dirRow != NULL && "Memory allocation problem in direction row\n" );
+            alignMtx->cap_dirRow = cap_dirRow;
+        }
+    }
+    else if (alignMtx->cap_nw < cap_dir) {    /* If the other matrices are not large enough */
         if (DEBUG_MAT) {
             printf("The current capacity of the NW matrix is too small. New allocation: %zu\n", cap_dir);
         }
@@ -125,11 +146,34 @@ algnMat_setup_size ( alignment_matrices_t *alignMtx
         printf("\nFinal allocated size of matrices:\n" );
         printf("    efficiency: %zu\n", alignMtx->cap_eff);
         printf("    nw matrix:  %zu\n", alignMtx->cap_nw);
+        printf("    packed:     %zu\n", alignMtx->cap_packed);
         printf("    precalcMtx: %zu\n", alignMtx->cap_pre);
     }
 }
 
 
+packed_dir_mtx_t
+algnMtx_packed_band( alignment_matrices_t *m, size_t len_rows, size_t rowCells )
+{
+    // A row starting at an odd column keeps the even one before it as well.
+    const size_t rowBytes   = PACKED_DIR_ROW_BYTES(rowCells + 1),
+                 cap_packed = len_rows * rowBytes;
+
+    assert( m->cap_packedRows >= len_rows && "Packed direction rows not set up by algnMat_setup_size()." );
+
+    if (m->cap_packed < cap_packed) {
+        // The old cells are not needed: each band is filled afresh.
+        free( m->algn_packedDirMtx );
+        m->algn_packedDirMtx = malloc( cap_packed );
+        assert( m->algn_packedDirMtx != NULL && "Memory allocation problem in packed direction matrix\n" );
+        m->cap_packed = cap_packed;
+    }
+    m->packedRowBytes = rowBytes;
+
+    return algnMtx_packed_dirs( m );
+}
+
+
 unsigned int *
 algnMtx_get_precal_row ( unsigned int *p
                        , elem_t        item
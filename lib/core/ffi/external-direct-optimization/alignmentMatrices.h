@@ -52,7 +52,11 @@
 #define A_G_A    (1 << 5)     /** Previously S3. Move in column and row. */
 #define G_G_A    (1 << 6)     /** Previously SS. Move in rows. */
 
-// TODO: Can this be a char, instead?
+/** A cell of a direction matrix. The affine fills record flags up to DO_DIAGONAL
+ *  (see alignCharacters.c), so a cell needs 16 bits. The non-affine 2D fill
+ *  records only ALIGN, INSERT and DELETE, and packs its matrix; see
+ *  packed_dir_mtx_t.
+ */
 #define DIR_MTX_ARROW_t  unsigned short
 
 #define Matrices_struct(a) ((struct nwMatrices_t *) Data_custom_val(a))
@@ -68,8 +72,15 @@ typedef struct alignment_matrices_t {
     size_t           cap_pre;          /** Length of the precalculated matrix == max(len_s1, len_s2) * (alphSize + 1)
                                         *  ---extra 1 is for gap
                                         */
+    size_t           cap_packed;       /** Bytes of algn_packedDirMtx */
+    size_t           cap_packedRows;   /** Rows of algn_packedRowStart */
+    size_t           cap_dirRow;       /** Cells of algn_dirRow */
+    size_t           packedRowBytes;   /** Bytes of each row of algn_packedDirMtx, as last filled */
     unsigned int    *algn_costMtx;     /** NW cost matrix for 2d alignment */
-    DIR_MTX_ARROW_t *algn_dirMtx;      /** Matrix for backtrace directions in a 2d alignment */
+    DIR_MTX_ARROW_t *algn_dirMtx;      /** Matrix for backtrace directions in an affine 2d alignment */
+    unsigned char   *algn_packedDirMtx; /** The same for a non-affine 2d alignment, packed; see packed_dir_mtx_t */
+    size_t          *algn_packedRowStart; /** The first column each row of algn_packedDirMtx holds */
+    DIR_MTX_ARROW_t *algn_dirRow;      /** The row of algn_packedDirMtx being filled, unpacked */
     unsigned int    *algn_precalcMtx;  /** a three-dimensional matrix that holds
                                          *  the transition costs for the entire alphabet (of all three characters)
                                          *  with the character char3. The columns are the bases of char3, and the rows are
@@ -81,6 +92,63 @@ typedef struct alignment_matrices_t {
 void algnMtx_print(alignment_matrices_t *m, size_t alphSize);
 
 
+/** The direction matrix of a non-affine 2D alignment, which needs only ALIGN,
+ *  INSERT and DELETE in a cell: two cells to a byte, the even column in the low
+ *  nibble, and each row starting a byte of its own.
+ *
+ *  Only the cells a row filled are kept, so that a Ukkonen band takes memory in
+ *  proportion to its width rather than to the plane. Each row has rowBytes, and
+ *  holds the cells from rowStart[i], an even column, on. Any other cell of the
+ *  row is not kept, and must not be read.
+ *
+ *  The fill writes a row into `row`, a DIR_MTX_ARROW_t per cell as the row
+ *  kernels write them, then packs the cells it filled into the matrix with the
+ *  row kernel's pack(). `row` has room for one cell past the last column, so
+ *  that a row of odd length packs by whole bytes.
+ */
+typedef struct packed_dir_mtx_t {
+    unsigned char   *cells;
+    size_t           rowBytes;
+    size_t          *rowStart;
+    DIR_MTX_ARROW_t *row;
+} packed_dir_mtx_t;
+
+
+#define PACKED_DIR_ROW_BYTES(len) (((len) + 1) / 2)
+
+
+/** The packed direction matrix of m, as it was last filled. */
+static inline packed_dir_mtx_t
+algnMtx_packed_dirs( const alignment_matrices_t *m )
+{
+    packed_dir_mtx_t dirs = { m->algn_packedDirMtx, m->packedRowBytes, m->algn_packedRowStart, m->algn_dirRow };
+    return dirs;
+}
+
+
+/** Give the packed direction matrix of m room for len_rows rows of at most
+ *  rowCells cells each, starting at any column, and return it.
+ */
+packed_dir_mtx_t
+algnMtx_packed_band( alignment_matrices_t *m, size_t len_rows, size_t rowCells );
+
+
+/** Whether row i of a packed direction matrix keeps column j. */
+static inline int
+algnMtx_packed_keeps( const packed_dir_mtx_t *dirs, size_t i, size_t j )
+{
+    return j >= dirs->rowStart[i] && j - dirs->rowStart[i] < 2 * dirs->rowBytes;
+}
+
+
+/** The cell in row i, column j of a packed direction matrix, which the row must keep. */
+static inline DIR_MTX_ARROW_t
+algnMtx_packed_dir( const packed_dir_mtx_t *dirs, size_t i, size_t j )
+{
+    return (dirs->cells[i * dirs->rowBytes + ((j - dirs->rowStart[i]) >> 1)] >> ((j & 1) << 2)) & 0xF;
+}
+
+
 /*
  * Fills a precalculated matrix with the cost of comparing each elment in the
  * character inChar with each element in the alphabet specified in the transformation
@@ -120,9 +188,11 @@ algnMat_size_of_2d_matrix (size_t w, size_t h);
  * characters of length w, d and h. Note that for 2d alignments is necessary to
  * set h=0, and uk=0.
  * Order of characters is unimportant here, as just reallocing.
+ * If packedDirections, the direction matrix grown is the packed one of a
+ * non-affine alignment, and its row, rather than algn_dirMtx.
  */
 void
-algnMat_setup_size (alignment_matrices_t *m, size_t len_char1, size_t len_char2, size_t matrixDimension);
+algnMat_setup_size (alignment_matrices_t *m, size_t len_char1, size_t len_char2, size_t matrixDimension, int packedDirections);
 
 /* Printout the contents of the matrix */
 void
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE     // syscall()
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alignmentStats.h"
+
+#if defined(__linux__)
+#define ALIGNMENT_CYCLES_LINUX 1
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/** Whether cycles are counted. */
+static atomic_int cycleCounting;
+
+
+#define NO_CYCLE_COUNTER     -1   /** The thread has not tried to open one yet. */
+#define CYCLE_COUNTER_DENIED -2   /** It tried, and could not. */
+
+/** A counter of the cycles of each thread, opened the first time it is needed, and kept, one
+ *  file descriptor, for the life of the thread.
+ */
+static _Thread_local int cycleCounter = NO_CYCLE_COUNTER;
+
+
+#ifdef ALIGNMENT_CYCLES_LINUX
+/** Closes the counter of each thread as it exits, the threads of align2dAllPairs() among them,
+ *  so that they don't leak a file descriptor apiece. Its value is the descriptor plus one, as
+ *  the destructor is only called for values that are not NULL.
+ */
+static pthread_key_t  cycleCounterKey;
+static pthread_once_t cycleCounterKeyOnce = PTHREAD_ONCE_INIT;
+
+
+static void closeCycleCounter( void *fdPlusOne )
+{
+    close( (int) ((intptr_t) fdPlusOne - 1) );
+}
+
+
+static void createCycleCounterKey( void )
+{
+    pthread_key_create( &cycleCounterKey, closeCycleCounter );
+}
+#endif
+
+
+static void openCycleCounter( void )
+{
+#ifdef ALIGNMENT_CYCLES_LINUX
+    pthread_once( &cycleCounterKeyOnce, createCycleCounterKey );
+
+    struct perf_event_attr attributes;
+    memset( &attributes, 0, sizeof(attributes) );
+    attributes.type           = PERF_TYPE_HARDWARE;
+    attributes.size           = sizeof(attributes);
+    attributes.config         = PERF_COUNT_HW_CPU_CYCLES;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv     = 1;
+
+    // This thread, on any CPU.
+    const long fd = syscall( __NR_perf_event_open, &attributes, 0, -1, -1, 0 );
+    cycleCounter  = fd < 0 ? CYCLE_COUNTER_DENIED : (int) fd;
+    if (cycleCounter >= 0) pthread_setspecific( cycleCounterKey, (void *) (intptr_t) (cycleCounter + 1) );
+#else
+    cycleCounter  = CYCLE_COUNTER_DENIED;
+#endif
+}
+
+
+/** The cycles this thread has run since its counter was opened, or 0 if they are not counted. */
+static uint64_t readCycles( void )
+{
+    if (!atomic_load_explicit( &cycleCounting, memory_order_relaxed )) return 0;
+    if (cycleCounter == NO_CYCLE_COUNTER) openCycleCounter();
+
+#ifdef ALIGNMENT_CYCLES_LINUX
+    uint64_t cycles;
+    if (cycleCounter >= 0 && read( cycleCounter, &cycles, sizeof(cycles) ) == sizeof(cycles)) return cycles;
+#endif
+    return 0;
+}
+
+
+int setAlignmentCycleCounting( int on )
+{
+    atomic_store( &cycleCounting, on != 0 );
+    if (!on) return 0;
+
+    if (cycleCounter == NO_CYCLE_COUNTER) openCycleCounter();
+    return cycleCounter >= 0;
+}
+
+
+void algn_stats_begin( alignment_stats_t *stats, size_t kernel )
+{
+    memset( stats, 0, sizeof(alignment_stats_t) );
+    stats->kernel = kernel;
+    stats->cycles = readCycles();   // The start, until algn_stats_end().
+}
+
+
+void algn_stats_end( alignment_stats_t *stats, alignment_stats_t *total )
+{
+    const uint64_t now = readCycles();
+    stats->cycles = now > stats->cycles && stats->cycles ? now - stats->cycles : 0;
+
+    total->kernel          = stats->kernel;
+    total->cells          += stats->cells;
+    total->bandPasses     += stats->bandPasses;
+    total->fullPlaneFills += stats->fullPlaneFills;
+    total->memoHits       += stats->memoHits;
+    total->memoMisses     += stats->memoMisses;
+    total->cycles         += stats->cycles;
+    if (stats->bandWidth      > total->bandWidth)      total->bandWidth      = stats->bandWidth;
+    if (stats->directionBytes > total->directionBytes) total->directionBytes = stats->directionBytes;
+}
@@ -0,0 +1,64 @@
+/** Counts of the work an alignment does, to attribute the time spent aligning to the kernels
+ *  and inputs that took it.
+ *
+ *  Each _ws alignment of c_alignment_interface.h records its counts in its workspace, where
+ *  getAlignmentStats() reads them. They are kept per band or row, never per cell, so they cost
+ *  nothing measurable and are always on. Cycle counts are the exception: they need a
+ *  perf_event_open() counter on each thread that aligns, and are off until
+ *  setAlignmentCycleCounting() turns them on.
+ */
+
+#ifndef ALIGNMENT_STATS_H
+#define ALIGNMENT_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The kernel that did an alignment. */
+#define ALGN_KERNEL_NONE          0   /** No alignment yet. */
+#define ALGN_KERNEL_2D_BANDED     1   /** Ukkonen bands of algn_fill_plane_2(). */
+#define ALGN_KERNEL_2D_AFFINE     2   /** The whole plane, with affine costs. */
+#define ALGN_KERNEL_2D_LINEAR     3   /** Linear space, either cost model. */
+#define ALGN_KERNEL_2D_COST       4   /** Cost only: the bands of algn_fill_plane_2(), or the whole plane if affine. */
+#define ALGN_KERNEL_2D_DISCRETE   5   /** Cost only, bit-vector. */
+#define ALGN_KERNEL_3D            6   /** The cost-bounded search of ukk_tcm_3D_align(). */
+
+
+/** The counts of one alignment, or, summed, of many.
+ *
+ *  cells counts each cell of an alignment matrix each time it is filled, so a band that has to
+ *  double is counted again, wider; a 3D cell counts once, whatever its gap states. The linear
+ *  space alignments count the plane, which their divide and conquer fills about twice over, and
+ *  the bit-vector alignment counts it too, though it fills 64 cells a step.
+ */
+typedef struct alignment_stats_t {
+    size_t   kernel;          // ALGN_KERNEL_*; in a sum, that of the last alignment.
+    size_t   cells;           // Cells of alignment matrices filled.
+    size_t   bandWidth;       // Of the last band, in cells either side of the diagonals an alignment must
+                              // cross; the whole plane is as wide as the longer character. In a sum, the widest.
+    size_t   bandPasses;      // Bands, or planes, filled: one, plus one for each doubling.
+    size_t   fullPlaneFills;  // Of those, how many were the whole plane, as algn_fill_plane_2() falls back to.
+    size_t   directionBytes;  // Of the direction matrix the alignment addressed; in a sum, the most.
+    size_t   memoHits;        // Lookups of ambiguous triples in a lazy 3D cost matrix that found them,
+    size_t   memoMisses;      // and that had to compute them.
+    uint64_t cycles;          // CPU cycles on the aligning thread, if counted; otherwise 0.
+} alignment_stats_t;
+
+
+/** Count CPU cycles from now on, or stop counting them, for every thread. Returns whether the
+ *  calling thread can count them: the kernel must allow perf_event_open(), as
+ *  /proc/sys/kernel/perf_event_paranoid sets, and the system must be Linux.
+ */
+int setAlignmentCycleCounting( int on );
+
+
+/** Start stats for an alignment by kernel. */
+void algn_stats_begin( alignment_stats_t *stats, size_t kernel );
+
+
+/** Finish stats begun by algn_stats_begin(), and add them to total. */
+void algn_stats_end( alignment_stats_t *stats, alignment_stats_t *total );
+
+
+#endif // ALIGNMENT_STATS_H
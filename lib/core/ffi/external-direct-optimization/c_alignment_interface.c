@@ -1,8 +1,11 @@
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "alignCharacters.h"
 #include "alignmentMatrices.h"
@@ -10,9 +13,237 @@
 #include "c_code_alloc_setup.h"
 #include "debug_constants.h"
 #include "dyn_character.h"
+#include "linearSpaceAlignment.h"
+#include "ukkCheckPoint.h"
 #include "ukkCommon.h"
 
 
+/** align2dAllPairs() shares its rows among at most this many threads. */
+#define ALL_PAIRS_MAX_THREADS 16
+
+
+/** Buffers kept from one alignment to the next. Each only ever grows, so once a workspace has aligned
+ *  characters as long as those it is given, it allocates nothing more.
+ */
+struct alignment_workspace_t {
+    alignment_matrices_t matrices;        // 2D cost, direction and precalculated matrices, grown by algnMat_setup_size()
+    dyn_character_t      retLongChar;     // the aligned characters
+    dyn_character_t      retShortChar;
+    dyn_character_t      ungappedMedian;
+    dyn_character_t      gappedMedian;    // also the union
+    characters_t         powellInputs;    // 3D inputs and outputs
+    characters_t         powellOutputs;
+    size_t               powellCapacity;  // of each of the six arrays of powellInputs and powellOutputs
+    tcm_3d_buffers_t     search3d;        // planes, directions and rows of ukk_tcm_3D_align()
+    unsigned int        *costOnly;        // rows and precalculated costs of cost-only alignments
+    size_t               costOnlyCapacity;
+    size_t               alignments;
+    size_t               growths;
+    alignment_stats_t    lastStats;       // of the last alignment, and of all of them
+    alignment_stats_t    allStats;
+};
+
+
+/** Make character an empty character with room for capacity elements, as dyn_char_alloc(capacity) would.
+ *  Returns 1 if its array had to grow.
+ */
+static int reuseDynChar( dyn_character_t *character, size_t capacity )
+{
+    int grown = 0;
+    if (character->cap < capacity) {
+        free(character->array_head);
+        character->array_head = malloc( capacity * sizeof(elem_t) );
+        assert( NULL != character->array_head && "Out of memory: Can't grow workspace character." );
+        character->cap = capacity;
+        grown = 1;
+    }
+    // Characters are prepended from the end of the array, so only the last capacity elements are ever used.
+    if (capacity > 0) {
+        memset( character->array_head + character->cap - capacity, 0, capacity * sizeof(elem_t) );
+    }
+    character->end        = character->array_head + character->cap - 1;
+    character->char_begin = 0;
+    character->len        = 0;
+
+    return grown;
+}
+
+
+/** Size the 2D matrices of a workspace for the two characters, with packed directions for a non-affine
+ *  alignment. Returns 1 if any had to grow.
+ */
+static int reuseAlignmentMtx( alignment_matrices_t *matrices
+                            , size_t                len_char1
+                            , size_t                len_char2
+                            , size_t                alphSize
+                            , int                   packedDirections
+                            )
+{
+    const size_t cap_nw     = matrices->cap_nw,
+                 cap_eff    = matrices->cap_eff,
+                 cap_pre    = matrices->cap_pre,
+                 cap_rows   = matrices->cap_packedRows,
+                 cap_dirRow = matrices->cap_dirRow;
+
+    algnMat_setup_size( matrices, len_char1, len_char2, alphSize, packedDirections );
+
+    return cap_nw     != matrices->cap_nw
+        || cap_eff    != matrices->cap_eff
+        || cap_pre    != matrices->cap_pre
+        || cap_rows   != matrices->cap_packedRows
+        || cap_dirRow != matrices->cap_dirRow;
+}
+
+
+/** Give each of the six 3D arrays of a workspace room for capacity elements. Returns 1 if they had to grow. */
+static int reusePowellCharacters( alignment_workspace_t *workspace, size_t capacity )
+{
+    if (workspace->powellCapacity >= capacity) return 0;
+
+    characters_t *all[2] = { &workspace->powellInputs, &workspace->powellOutputs };
+    for (size_t i = 0; i < 2; i++) {
+        all[i]->seq1 = realloc( all[i]->seq1, capacity * sizeof(elem_t) );
+        all[i]->seq2 = realloc( all[i]->seq2, capacity * sizeof(elem_t) );
+        all[i]->seq3 = realloc( all[i]->seq3, capacity * sizeof(elem_t) );
+        assert(   NULL != all[i]->seq1
+               && NULL != all[i]->seq2
+               && NULL != all[i]->seq3
+               && "Out of memory: Can't grow workspace 3D characters." );
+    }
+    workspace->powellCapacity = capacity;
+
+    return 1;
+}
+
+
+/** Give the cost-only buffer of a workspace room for capacity costs. Returns 1 if it had to grow. */
+static int reuseCostOnly( alignment_workspace_t *workspace, size_t capacity )
+{
+    if (workspace->costOnlyCapacity >= capacity) return 0;
+
+    free( workspace->costOnly );
+    workspace->costOnly = malloc( capacity * sizeof(unsigned int) );
+    assert( NULL != workspace->costOnly && "Out of memory: Can't grow workspace cost rows." );
+    workspace->costOnlyCapacity = capacity;
+
+    return 1;
+}
+
+
+/** Record in stats the whole plane of two characters, as one pass, addressing directionBytes of directions. */
+static void recordPlane( alignment_stats_t *stats, size_t len_char1, size_t len_char2, size_t directionBytes )
+{
+    stats->cells         += len_char1 * len_char2;
+    stats->bandWidth      = len_char1 > len_char2 ? len_char1 : len_char2;
+    stats->bandPasses++;
+    stats->fullPlaneFills++;
+    stats->directionBytes = directionBytes;
+}
+
+
+/** deltawh is for use in Ukonnen, it gives the current necessary width of the Ukk matrix.
+ *  The following calculation to compute deltawh, which increases the matrix height or width in algn_nw_2d,
+ *  was pulled from POY ML code.
+ */
+static int ukkonenDeltawh( const dyn_character_t *longChar, const dyn_character_t *shortChar )
+{
+    int deltawh     = 0;
+    int diff        = longChar->len - shortChar->len;
+    int lower_limit = .1 * longChar->len;
+
+    if (deltawh) {
+        deltawh = diff < lower_limit ? lower_limit : deltawh;
+    } else {
+        deltawh = diff < lower_limit ? lower_limit / 2 : 2;
+    }
+    return deltawh;
+}
+
+
+/** Whether inputChar1 is the longer of two characters to be aligned without affine costs. Equal-length
+ *  characters are ordered lexically, so that the alignment is commutative.
+ */
+static int firstCharIsLonger( const alignIO_t *inputChar1_aio, const alignIO_t *inputChar2_aio )
+{
+    if (inputChar1_aio->length != inputChar2_aio->length) {
+        return inputChar1_aio->length > inputChar2_aio->length;
+    }
+    // Two dynamic chanracters will *only* be equal in length if they contain the same sequence of elements.
+    const elem_t *p1 = inputChar1_aio->character + (inputChar1_aio->capacity - inputChar1_aio->length);
+    const elem_t *p2 = inputChar2_aio->character + (inputChar2_aio->capacity - inputChar2_aio->length);
+    for (size_t i = 0; i < inputChar1_aio->length; ++i) {
+        if (p1[i] != p2[i]) return p1[i] > p2[i];
+    }
+    return 1;
+}
+
+
+alignment_workspace_t *allocAlignmentWorkspace( void )
+{
+    alignment_workspace_t *workspace = calloc( 1, sizeof(alignment_workspace_t) );
+    assert( NULL != workspace && "Out of memory: Can't allocate alignment workspace." );
+
+    initializeAlignmentMtx( &workspace->matrices, 1, 1, 1 );
+
+    return workspace;
+}
+
+
+void freeAlignmentWorkspace( alignment_workspace_t *workspace )
+{
+    if (NULL == workspace) return;
+
+    free( workspace->matrices.algn_costMtx );
+    free( workspace->matrices.algn_dirMtx );
+    free( workspace->matrices.algn_packedDirMtx );
+    free( workspace->matrices.algn_dirRow );
+    free( workspace->matrices.algn_precalcMtx );
+    dyn_char_free( &workspace->retLongChar );
+    dyn_char_free( &workspace->retShortChar );
+    dyn_char_free( &workspace->ungappedMedian );
+    dyn_char_free( &workspace->gappedMedian );
+    free_characters_t( &workspace->powellInputs );
+    free_characters_t( &workspace->powellOutputs );
+    ukk_tcm_3D_free_buffers( &workspace->search3d );
+    free( workspace->costOnly );
+    free( workspace );
+}
+
+
+void alignmentWorkspaceStats( const alignment_workspace_t *workspace, alignment_workspace_stats_t *stats )
+{
+    const alignment_matrices_t *matrices = &workspace->matrices;
+
+    stats->bytes      = sizeof(alignment_workspace_t)
+                      + matrices->cap_eff * sizeof(unsigned int)
+                      + matrices->cap_nw  * sizeof(DIR_MTX_ARROW_t)
+                      + matrices->cap_packed
+                      + matrices->cap_packedRows * sizeof(size_t)
+                      + matrices->cap_dirRow * sizeof(DIR_MTX_ARROW_t)
+                      + matrices->cap_pre * sizeof(unsigned int)
+                      + workspace->costOnlyCapacity * sizeof(unsigned int)
+                      + ukk_tcm_3D_buffer_bytes( &workspace->search3d )
+                      + ( workspace->retLongChar.cap
+                        + workspace->retShortChar.cap
+                        + workspace->ungappedMedian.cap
+                        + workspace->gappedMedian.cap
+                        + 6 * workspace->powellCapacity
+                        ) * sizeof(elem_t);
+    stats->alignments = workspace->alignments;
+    stats->growths    = workspace->growths;
+}
+
+
+void getAlignmentStats( const alignment_workspace_t *workspace
+                      ,       alignment_stats_t     *lastCall
+                      ,       alignment_stats_t     *allCalls
+                      )
+{
+    if (NULL != lastCall) *lastCall = workspace->lastStats;
+    if (NULL != allCalls) *allCalls = workspace->allStats;
+}
+
+
 int align2d( alignIO_t          *inputChar1_aio
            , alignIO_t          *inputChar2_aio
            , alignIO_t          *gappedOutput_aio
@@ -24,6 +255,37 @@ int align2d( alignIO_t          *inputChar1_aio
            , int                 getUnion
            )
 {
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+
+    const int algnCost = align2d_ws( inputChar1_aio
+                                   , inputChar2_aio
+                                   , gappedOutput_aio
+                                   , ungappedOutput_aio
+                                   , costMtx2d
+                                   , getUngapped
+                                   , getGapped
+                                   , getUnion
+                                   , UINT_MAX
+                                   , workspace
+                                   );
+    freeAlignmentWorkspace( workspace );
+
+    return algnCost;
+}
+
+
+int align2d_ws( alignIO_t             *inputChar1_aio
+              , alignIO_t             *inputChar2_aio
+              , alignIO_t             *gappedOutput_aio
+              , alignIO_t             *ungappedOutput_aio
+              , cost_matrices_2d_t    *costMtx2d
+              , int                    getUngapped
+              , int                    getGapped
+              , int                    getUnion
+              , unsigned int           costCeiling
+              , alignment_workspace_t *workspace
+              )
+{
 
     if (DEBUG_ALGN) {
         printf("\n\nalign2d char1 input:\n");
@@ -40,37 +302,20 @@ int align2d( alignIO_t          *inputChar1_aio
     alignIO_t *longIO,
               *shortIO;
 
-    /*** Most character allocation is now done on Haskell side, but these two are local. ***/
+    /*** Most character allocation is now done on Haskell side, the rest is in the workspace. ***/
     /*** longChar and shortChar will both have pointers into the input characters, so don't need to be initialized separately ***/
-    dyn_character_t *retLongChar  = dyn_char_alloc(CHAR_CAPACITY);
-    dyn_character_t *retShortChar = dyn_char_alloc(CHAR_CAPACITY);
-    dyn_character_t *longChar     = dyn_char_alloc(0);
-    dyn_character_t *shortChar    = dyn_char_alloc(0);
+    dyn_character_t *retLongChar  = &workspace->retLongChar;
+    dyn_character_t *retShortChar = &workspace->retShortChar;
+    dyn_character_t  longCharacter,
+                     shortCharacter;
+    dyn_character_t *longChar     = &longCharacter;
+    dyn_character_t *shortChar    = &shortCharacter;
     size_t alphabetSize = costMtx2d->alphSize;
 
-    int firstCharIsLongerOrBothAreIdenticalInValue = 1;
-
-    if (inputChar1_aio->length < inputChar2_aio->length) {
-        firstCharIsLongerOrBothAreIdenticalInValue = 0;
-    }
-    else if (inputChar1_aio->length > inputChar2_aio->length) {
-        firstCharIsLongerOrBothAreIdenticalInValue = 1;
-    }
-    else { // Length is equal!
-        // Use lexical ordering to determine "length" in the case of equal length dynamic characters
-        // Two dynamic chanracters will *only* be equal in length if they contain the same sequence of elements.
-        // By doing this we ensure that the alignment operation is commutative.
-        elem_t *p1 = inputChar1_aio->character + (inputChar1_aio->capacity - inputChar1_aio->length);
-        elem_t *p2 = inputChar2_aio->character + (inputChar2_aio->capacity - inputChar2_aio->length);
-        for (size_t i = 0; i < inputChar1_aio->length; ++i) {
-            if (p1[i] != p2[i]) {
-                firstCharIsLongerOrBothAreIdenticalInValue = p1[i] > p2[i];
-                break;
-            }
-        }
-    }
+    int grown = reuseDynChar( retLongChar,  CHAR_CAPACITY );
+    grown    |= reuseDynChar( retShortChar, CHAR_CAPACITY );
 
-    if (firstCharIsLongerOrBothAreIdenticalInValue) {
+    if (firstCharIsLonger( inputChar1_aio, inputChar2_aio )) {
         alignIOtoDynChar(longChar, inputChar1_aio, alphabetSize);
         longIO = inputChar1_aio;
 
@@ -90,64 +335,71 @@ int align2d( alignIO_t          *inputChar1_aio
         printf("\nafter copying, char 2:\n");
         dyn_char_print(shortChar);
     }
-    alignment_matrices_t *algnMtxs2d = malloc( sizeof(alignment_matrices_t) );
-    assert( algnMtxs2d != NULL && "2D alignment matrices could not be allocated." );
+    // Above the threshold a full direction matrix could take gigabytes, so align in linear space.
+    const int linearSpace = longChar->len * shortChar->len > LINEAR_SPACE_THRESHOLD;
+    int doBacktrace = getGapped || getUngapped || getUnion;
 
-    initializeAlignmentMtx( algnMtxs2d, longChar->len, shortChar->len, alphabetSize );
+    alignment_matrices_t *algnMtxs2d = &workspace->matrices;
+    alignment_stats_t    *stats      = &workspace->lastStats;
+    int algnCost;
 
-    // deltawh is for use in Ukonnen, it gives the current necessary width of the Ukk matrix.
-    // The following calculation to compute deltawh, which increases the matrix height or width in algn_nw_2d,
-    // was pulled from POY ML code.
-    int deltawh     = 0;
-    int diff        = longChar->len - shortChar->len;
-    int lower_limit = .1 * longChar->len;
+    if (linearSpace) {
+        algn_stats_begin( stats, ALGN_KERNEL_2D_LINEAR );
+        recordPlane( stats, longChar->len, shortChar->len, 0 );
 
-    if (deltawh) {
-        deltawh = diff < lower_limit ? lower_limit : deltawh;
+        algnCost = algn_linear_space_2d( shortChar, longChar, retShortChar, retLongChar, costMtx2d, doBacktrace );
     } else {
-        deltawh = diff < lower_limit ? lower_limit / 2 : 2;
-    }
+        grown |= reuseAlignmentMtx( algnMtxs2d, longChar->len, shortChar->len, alphabetSize, !costMtx2d->cost_model_type );
+
+        // An affine matrix fills the whole plane, which algn_nw_2d() does not count.
+        algn_stats_begin( stats, costMtx2d->cost_model_type ? ALGN_KERNEL_2D_AFFINE : ALGN_KERNEL_2D_BANDED );
+        if (costMtx2d->cost_model_type) {
+            recordPlane( stats, longChar->len, shortChar->len, longChar->len * shortChar->len * sizeof(DIR_MTX_ARROW_t) );
+        }
+
+        // The packed directions grow in algn_nw_2d(), as wide as its bands.
+        const size_t cap_packed = algnMtxs2d->cap_packed;
+
+        algnCost = algn_nw_2d( shortChar, longChar, costMtx2d, algnMtxs2d, ukkonenDeltawh( longChar, shortChar ), costCeiling, stats );
+        grown   |= cap_packed != algnMtxs2d->cap_packed;
 
-    int algnCost = algn_nw_2d( shortChar, longChar, costMtx2d, algnMtxs2d, deltawh );
+        // Over the ceiling the direction matrix may be unfinished, and the outputs are not wanted.
+        if ((unsigned int) algnCost > costCeiling) doBacktrace = 0;
 
-    if (getGapped || getUngapped || getUnion) {
-        //printf("Before backtrace.\n"), fflush(stdout);
-        algn_backtrace_2d( shortChar, longChar, retShortChar, retLongChar, algnMtxs2d, costMtx2d, 0, 0 );
+        if (doBacktrace) {
+            algn_backtrace_2d( shortChar, longChar, retShortChar, retLongChar, algnMtxs2d, costMtx2d, 0, 0 );
+        }
+    }
 
+    if (doBacktrace) {
         if (getUngapped) {
-            dyn_character_t *ungappedMedianChar = dyn_char_alloc( CHAR_CAPACITY );
+            dyn_character_t *ungappedMedianChar = &workspace->ungappedMedian;
+            grown |= reuseDynChar( ungappedMedianChar, CHAR_CAPACITY );
 
             algn_get_median_2d_no_gaps( retShortChar, retLongChar, costMtx2d, ungappedMedianChar );
 
             dynCharToAlignIO( ungappedOutput_aio, ungappedMedianChar, 1 );
             dynCharToAlignIO( longIO,  retLongChar, 1 );
             dynCharToAlignIO( shortIO, retShortChar, 1 );
-
-            dyn_char_free( ungappedMedianChar );
-            if (NULL != ungappedMedianChar) free(ungappedMedianChar);
         }
         if (getGapped && !getUnion) {
-            dyn_character_t *gappedMedianChar = dyn_char_alloc( CHAR_CAPACITY );
+            dyn_character_t *gappedMedianChar = &workspace->gappedMedian;
+            grown |= reuseDynChar( gappedMedianChar, CHAR_CAPACITY );
 
             algn_get_median_2d_with_gaps( retShortChar, retLongChar, costMtx2d, gappedMedianChar );
 
             dynCharToAlignIO( gappedOutput_aio, gappedMedianChar, 1 );
             dynCharToAlignIO( longIO,  retLongChar, 1 );
             dynCharToAlignIO( shortIO, retShortChar, 1 );
-
-            dyn_char_free( gappedMedianChar );
-            if (NULL != gappedMedianChar) free(gappedMedianChar);
         }
         if (getUnion) {
-            dyn_character_t *unionMedianChar = dyn_char_alloc(CHAR_CAPACITY);
+            dyn_character_t *unionMedianChar = &workspace->gappedMedian;
+            grown |= reuseDynChar( unionMedianChar, CHAR_CAPACITY );
 
             algn_union( retShortChar, retLongChar, unionMedianChar );
 
             dynCharToAlignIO( gappedOutput_aio, unionMedianChar, 1 );
 
-            dyn_char_free( unionMedianChar );
-            if (NULL != unionMedianChar) free(unionMedianChar);
-
             /*** following once union has its own output field again ***/
             // dyn_character_t *unionChar = malloc(sizeof(dyn_character_t));
             // dyn_char_alloc(unionChar, CHAR_CAPACITY);
@@ -162,15 +414,9 @@ int align2d( alignIO_t          *inputChar1_aio
         }
     }
 
-    freeNWMtx( algnMtxs2d );
-    dyn_char_free( retLongChar );
-    if (NULL != retLongChar) free(retLongChar);
-    dyn_char_free( retShortChar );
-    if (NULL != retShortChar) free(retShortChar);
-
-    // Shouldn't have to free the whole structs here because they just pointed into the retChars.
-    if (NULL !=  longChar) free( longChar);
-    if (NULL != shortChar) free(shortChar);
+    algn_stats_end( &workspace->lastStats, &workspace->allStats );
+    workspace->alignments++;
+    workspace->growths += grown;
 
     return algnCost;
 
@@ -186,6 +432,33 @@ int align2dAffine( alignIO_t          *inputChar1_aio
                  , int                 getMedians
                  )
 {
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+
+    const int algnCost = align2dAffine_ws( inputChar1_aio
+                                         , inputChar2_aio
+                                         , gappedOutput_aio
+                                         , ungappedOutput_aio
+                                         , costMtx2d_affine
+                                         , getMedians
+                                         , UINT_MAX
+                                         , workspace
+                                         );
+    freeAlignmentWorkspace( workspace );
+
+    return algnCost;
+}
+
+
+int align2dAffine_ws( alignIO_t             *inputChar1_aio
+                    , alignIO_t             *inputChar2_aio
+                    , alignIO_t             *gappedOutput_aio
+                    , alignIO_t             *ungappedOutput_aio
+                    , cost_matrices_2d_t    *costMtx2d_affine
+                    , int                    getMedians
+                    , unsigned int           costCeiling
+                    , alignment_workspace_t *workspace
+                    )
+{
 
     if (DEBUG_ALGN) {
         printf("\n\nalign2d char1 input:\n");
@@ -200,12 +473,17 @@ int align2dAffine( alignIO_t          *inputChar1_aio
     alignIO_t *longIO,
               *shortIO;
 
-    /*** Most character allocation is now done on Haskell side, but these two are local. ***/
+    /*** Most character allocation is now done on Haskell side, the rest is in the workspace. ***/
     /*** longChar and shortChar will both have pointers into the input characters, so don't need to be initialized separately ***/
-    dyn_character_t *longChar     = dyn_char_alloc(0);
-    dyn_character_t *shortChar    = dyn_char_alloc(0);
-    dyn_character_t *retLongChar  = dyn_char_alloc(CHAR_CAPACITY);
-    dyn_character_t *retShortChar = dyn_char_alloc(CHAR_CAPACITY);
+    dyn_character_t  longCharacter,
+                     shortCharacter;
+    dyn_character_t *longChar     = &longCharacter;
+    dyn_character_t *shortChar    = &shortCharacter;
+    dyn_character_t *retLongChar  = &workspace->retLongChar;
+    dyn_character_t *retShortChar = &workspace->retShortChar;
+
+    int grown = reuseDynChar( retLongChar,  CHAR_CAPACITY );
+    grown    |= reuseDynChar( retShortChar, CHAR_CAPACITY );
 
     size_t alphabetSize = costMtx2d_affine->alphSize;
 
@@ -231,67 +509,82 @@ int align2dAffine( alignIO_t          *inputChar1_aio
         dyn_char_print(shortChar);
     }
 
-    // TODO: document these variables
-    // int *matrix;                        //
-    unsigned int *close_block_diagonal;       //
-    unsigned int *extend_block_diagonal;      //
-    unsigned int *extend_vertical;            //
-    unsigned int *extend_horizontal;          //
-    unsigned int *final_cost_matrix;          //
-    unsigned int *precalcMtx;                 //
-    unsigned int *matrix_2d;                  //
-    unsigned int *precalc_gap_open_cost;      // precalculated gap opening value (top row of nw matrix)
-    unsigned int *s_horizontal_gap_extension; //
-    size_t        lenLongerChar;              //
-
-    DIR_MTX_ARROW_t  *direction_matrix;
-
-    alignment_matrices_t *algnMtxs2dAffine = malloc( sizeof(alignment_matrices_t) );
-    assert( algnMtxs2dAffine != NULL && "Can't allocate 2D affine alignment matrices." );
-
-    initializeAlignmentMtx(algnMtxs2dAffine, longChar->len, shortChar->len, alphabetSize );
-    // printf("Jut initialized alignment matrices.\n");
-    lenLongerChar = longChar->len;
-
-    matrix_2d  = algnMtxs2dAffine->algn_costMtx;
-    precalcMtx = algnMtxs2dAffine->algn_precalcMtx;
-
-
-    algnMtx_precalc_4algn_2d( algnMtxs2dAffine, costMtx2d_affine, longChar );
-
-
-    // here and in algn.c, "block" refers to a block of gaps, so close_block_diagonal is the cost to
-    // end a subcharacter of gaps, presumably with a substitution, but maybe by simply switching directions:
-    // there was a vertical gap, now there's a horizontal one.
-
-    /** 2 through 11 below are offsets into various "matrices" in the alignment matrices, of which there are four
-        of length 2 * longer_character and two of longer_character */
-    close_block_diagonal       =  matrix_2d;
-    extend_block_diagonal      = (matrix_2d + ( lenLongerChar *  2 ));
-    extend_vertical            = (matrix_2d + ( lenLongerChar *  4 ));
-    extend_horizontal          = (matrix_2d + ( lenLongerChar *  6 ));
-    final_cost_matrix          = (matrix_2d + ( lenLongerChar *  8 ));
-    precalc_gap_open_cost      = (matrix_2d + ( lenLongerChar * 10 ));
-    s_horizontal_gap_extension = (matrix_2d + ( lenLongerChar * 11 ));
-
-    direction_matrix           = algnMtxs2dAffine->algn_dirMtx;
-
-    // TODO: consider moving all of this into algn.
-    //       the following three fns were initially not declared in algn.h
-    algn_initialize_matrices_affine ( costMtx2d_affine->gap_open_cost
-                                    , shortChar
-                                    , longChar
-                                    , costMtx2d_affine
-                                    , close_block_diagonal
-                                    , extend_block_diagonal
-                                    , extend_vertical
-                                    , extend_horizontal
-                                    , final_cost_matrix
-                                    , direction_matrix
-                                    , precalcMtx
-                                    );
-
-    int algnCost = algn_fill_plane_2d_affine( shortChar
+    // Above the threshold a full direction matrix could take gigabytes, so align in linear space.
+    const int linearSpace = longChar->len * shortChar->len > LINEAR_SPACE_THRESHOLD;
+
+    alignment_matrices_t *algnMtxs2dAffine = &workspace->matrices;
+    DIR_MTX_ARROW_t      *direction_matrix = NULL;
+    int                   algnCost         = 0;
+
+    algn_stats_begin( &workspace->lastStats, linearSpace ? ALGN_KERNEL_2D_LINEAR : ALGN_KERNEL_2D_AFFINE );
+    recordPlane( &workspace->lastStats
+               , longChar->len
+               , shortChar->len
+               , linearSpace ? 0 : longChar->len * shortChar->len * sizeof(DIR_MTX_ARROW_t)
+               );
+
+    if (linearSpace) {
+        // With medians, the cost comes from the alignment below, to fill the plane only once.
+        if (!getMedians) {
+            algnCost = algn_linear_space_2d_affine( shortChar, longChar, NULL, NULL, NULL, NULL, costMtx2d_affine, 0 );
+        }
+    } else {
+        // TODO: document these variables
+        // int *matrix;                        //
+        unsigned int *close_block_diagonal;       //
+        unsigned int *extend_block_diagonal;      //
+        unsigned int *extend_vertical;            //
+        unsigned int *extend_horizontal;          //
+        unsigned int *final_cost_matrix;          //
+        unsigned int *precalcMtx;                 //
+        unsigned int *matrix_2d;                  //
+        unsigned int *precalc_gap_open_cost;      // precalculated gap opening value (top row of nw matrix)
+        unsigned int *s_horizontal_gap_extension; //
+        size_t        lenLongerChar;              //
+
+        grown |= reuseAlignmentMtx( algnMtxs2dAffine, longChar->len, shortChar->len, alphabetSize, 0 );
+        // printf("Jut initialized alignment matrices.\n");
+        lenLongerChar = longChar->len;
+
+        matrix_2d  = algnMtxs2dAffine->algn_costMtx;
+        precalcMtx = algnMtxs2dAffine->algn_precalcMtx;
+
+
+        algnMtx_precalc_4algn_2d( algnMtxs2dAffine, costMtx2d_affine, longChar );
+
+
+        // here and in algn.c, "block" refers to a block of gaps, so close_block_diagonal is the cost to
+        // end a subcharacter of gaps, presumably with a substitution, but maybe by simply switching directions:
+        // there was a vertical gap, now there's a horizontal one.
+
+        /** 2 through 11 below are offsets into various "matrices" in the alignment matrices, of which there are four
+            of length 2 * longer_character and two of longer_character */
+        close_block_diagonal       =  matrix_2d;
+        extend_block_diagonal      = (matrix_2d + ( lenLongerChar *  2 ));
+        extend_vertical            = (matrix_2d + ( lenLongerChar *  4 ));
+        extend_horizontal          = (matrix_2d + ( lenLongerChar *  6 ));
+        final_cost_matrix          = (matrix_2d + ( lenLongerChar *  8 ));
+        precalc_gap_open_cost      = (matrix_2d + ( lenLongerChar * 10 ));
+        s_horizontal_gap_extension = (matrix_2d + ( lenLongerChar * 11 ));
+
+        direction_matrix           = algnMtxs2dAffine->algn_dirMtx;
+
+        // TODO: consider moving all of this into algn.
+        //       the following three fns were initially not declared in algn.h
+        algn_initialize_matrices_affine ( costMtx2d_affine->gap_open_cost
+                                        , shortChar
+                                        , longChar
+                                        , costMtx2d_affine
+                                        , close_block_diagonal
+                                        , extend_block_diagonal
+                                        , extend_vertical
+                                        , extend_horizontal
+                                        , final_cost_matrix
+                                        , direction_matrix
+                                        , precalcMtx
+                                        );
+
+        algnCost = algn_fill_plane_2d_affine( shortChar
                                             , longChar
                                             , shortChar->len - 1  // -1 because of a loop condition in algn_fill_plane_2d_affine
                                             , longChar->len  - 1  // -1 because of a loop condition in algn_fill_plane_2d_affine
@@ -305,51 +598,274 @@ int align2dAffine( alignIO_t          *inputChar1_aio
                                             , precalcMtx
                                             , precalc_gap_open_cost
                                             , s_horizontal_gap_extension
+                                            , costCeiling
                                             );
+    }
 
-    if(getMedians) {
-        dyn_character_t *ungappedMedianChar = dyn_char_alloc(CHAR_CAPACITY);
-        dyn_character_t *gappedMedianChar   = dyn_char_alloc(CHAR_CAPACITY);
-
-        algn_backtrace_affine( shortChar
-                             , longChar
-                             , direction_matrix
-                             , ungappedMedianChar
-                             , gappedMedianChar
-                             , retShortChar
-                             , retLongChar
-                             , costMtx2d_affine
-                             );
+    if (getMedians && (unsigned int) algnCost <= costCeiling) {
+        dyn_character_t *ungappedMedianChar = &workspace->ungappedMedian;
+        dyn_character_t *gappedMedianChar   = &workspace->gappedMedian;
+        grown |= reuseDynChar( ungappedMedianChar, CHAR_CAPACITY );
+        grown |= reuseDynChar( gappedMedianChar,   CHAR_CAPACITY );
+
+        if (linearSpace) {
+            algnCost = algn_linear_space_2d_affine( shortChar
+                                                  , longChar
+                                                  , ungappedMedianChar
+                                                  , gappedMedianChar
+                                                  , retShortChar
+                                                  , retLongChar
+                                                  , costMtx2d_affine
+                                                  , 1
+                                                  );
+        } else {
+            algn_backtrace_affine( shortChar
+                                 , longChar
+                                 , direction_matrix
+                                 , ungappedMedianChar
+                                 , gappedMedianChar
+                                 , retShortChar
+                                 , retLongChar
+                                 , costMtx2d_affine
+                                 );
+        }
 
         dynCharToAlignIO( ungappedOutput_aio, ungappedMedianChar, 1 );
         dynCharToAlignIO( gappedOutput_aio,   gappedMedianChar, 1 );
 
         dynCharToAlignIO( longIO,  retLongChar, 1 );
         dynCharToAlignIO( shortIO, retShortChar, 1 );
+    }
+
+    algn_stats_end( &workspace->lastStats, &workspace->allStats );
+    workspace->alignments++;
+    workspace->growths += grown;
+
+    return algnCost;
+}
+
 
-        dyn_char_free(ungappedMedianChar);
-        if (NULL != ungappedMedianChar) free(ungappedMedianChar);
-        dyn_char_free(gappedMedianChar);
-        if (NULL != gappedMedianChar) free(gappedMedianChar);
+int align2dCost( alignIO_t          *inputChar1_aio
+               , alignIO_t          *inputChar2_aio
+               , cost_matrices_2d_t *costMtx2d
+               , unsigned int        upperBound
+               )
+{
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+
+    const int algnCost = align2dCost_ws( inputChar1_aio, inputChar2_aio, costMtx2d, upperBound, workspace );
+    freeAlignmentWorkspace( workspace );
+
+    return algnCost;
+}
+
+
+int align2dCost_ws( alignIO_t             *inputChar1_aio
+                  , alignIO_t             *inputChar2_aio
+                  , cost_matrices_2d_t    *costMtx2d
+                  , unsigned int           upperBound
+                  , alignment_workspace_t *workspace
+                  )
+{
+    const int    affine       = costMtx2d->cost_model_type;
+    const size_t alphabetSize = costMtx2d->alphSize;
+
+    dyn_character_t  longCharacter,
+                     shortCharacter;
+    dyn_character_t *longChar  = &longCharacter;
+    dyn_character_t *shortChar = &shortCharacter;
+
+    // The characters are ordered as align2d() and align2dAffine() order them, so the cost is the same.
+    const int firstIsLonger = affine ? inputChar1_aio->length >= inputChar2_aio->length
+                                     : firstCharIsLonger( inputChar1_aio, inputChar2_aio );
+
+    alignIOtoDynChar( longChar,  firstIsLonger ? inputChar1_aio : inputChar2_aio, alphabetSize );
+    alignIOtoDynChar( shortChar, firstIsLonger ? inputChar2_aio : inputChar1_aio, alphabetSize );
+
+    int                grown = 0;
+    unsigned int       algnCost;
+    alignment_stats_t *stats = &workspace->lastStats;
+
+    if (!affine && algn_discrete_applies( shortChar, longChar, costMtx2d )) {
+        algn_stats_begin( stats, ALGN_KERNEL_2D_DISCRETE );
+        recordPlane( stats, longChar->len, shortChar->len, 0 );
+
+        grown = reuseCostOnly( workspace, 2 * ALGN_DISCRETE_WORDS( alphabetSize, shortChar->len ) );
+
+        algnCost = algn_nw_2d_cost_discrete( shortChar, longChar, costMtx2d, (uint64_t *) workspace->costOnly );
+
+    } else if (affine) {
+        // Four matrices of two rows, two rows of gap costs, then the precalculated costs of longChar.
+        const size_t rowLength = longChar->len + 1;
+
+        algn_stats_begin( stats, ALGN_KERNEL_2D_COST );
+        recordPlane( stats, longChar->len, shortChar->len, 0 );
+
+        grown = reuseCostOnly( workspace, 10 * rowLength + costMtx2d->costMatrixDimension * longChar->len );
+
+        unsigned int *close_block_diagonal       = workspace->costOnly,
+                     *extend_block_diagonal      = close_block_diagonal  + 2 * rowLength,
+                     *extend_vertical            = extend_block_diagonal + 2 * rowLength,
+                     *extend_horizontal          = extend_vertical       + 2 * rowLength,
+                     *precalc_gap_open_cost      = extend_horizontal     + 2 * rowLength,
+                     *s_horizontal_gap_extension = precalc_gap_open_cost + rowLength;
+
+        alignment_matrices_t precalc = { .algn_precalcMtx = s_horizontal_gap_extension + rowLength };
+        algnMtx_precalc_4algn_2d( &precalc, costMtx2d, longChar );
+
+        algn_initialize_matrices_affine_nobt( costMtx2d->gap_open_cost
+                                            , shortChar
+                                            , longChar
+                                            , costMtx2d
+                                            , close_block_diagonal
+                                            , extend_block_diagonal
+                                            , extend_vertical
+                                            , extend_horizontal
+                                            , precalc.algn_precalcMtx
+                                            );
+
+        algnCost = algn_fill_plane_2d_affine_nobt( shortChar
+                                                 , longChar
+                                                 , shortChar->len - 1
+                                                 , longChar->len  - 1
+                                                 , costMtx2d
+                                                 , extend_horizontal
+                                                 , extend_vertical
+                                                 , close_block_diagonal
+                                                 , extend_block_diagonal
+                                                 , precalc.algn_precalcMtx
+                                                 , precalc_gap_open_cost
+                                                 , s_horizontal_gap_extension
+                                                 , upperBound
+                                                 );
+    } else {
+        // Two rows, then the precalculated costs of shortChar.
+        algn_stats_begin( stats, ALGN_KERNEL_2D_COST );
+
+        grown = reuseCostOnly( workspace, (2 + costMtx2d->costMatrixDimension) * shortChar->len );
+
+        alignment_matrices_t precalc = { .algn_precalcMtx = workspace->costOnly + 2 * shortChar->len };
+        algnMtx_precalc_4algn_2d( &precalc, costMtx2d, shortChar );
+
+        algnCost = algn_nw_2d_cost( shortChar
+                                  , longChar
+                                  , costMtx2d
+                                  , precalc.algn_precalcMtx
+                                  , workspace->costOnly
+                                  , ukkonenDeltawh( longChar, shortChar )
+                                  , upperBound
+                                  , stats
+                                  );
     }
 
-    freeNWMtx(algnMtxs2dAffine);
-    /**** Can't free these structs internals because they're pointing into inputChar1_aio and inputChar2_aio ****/
-    // dyn_char_free(longChar);
-    // dyn_char_free(shortChar);
-    if (NULL != longChar) free(longChar);
-    if (NULL != shortChar) free(shortChar);
-    dyn_char_free(retLongChar);
-    if (NULL != retLongChar) free(retLongChar);
-    dyn_char_free(retShortChar);
-    if (NULL != retShortChar) free(retShortChar);
+    algn_stats_end( &workspace->lastStats, &workspace->allStats );
+    workspace->alignments++;
+    workspace->growths += grown;
 
     return algnCost;
 }
 
 
-/** Set `gap_open_cost` == `gap_extension_cost` for non-affine. */
-// TODO: double check this
+/** The characters align2dAllPairs() aligns, where it writes their costs, and the next row no thread has taken. */
+typedef struct all_pairs_job_t {
+    const elem_t       *elements;
+    const size_t       *offsets;      // of each character in elements, and of the end of the last
+    size_t              count;
+    size_t              maxLength;
+    int                 symmetric;
+    cost_matrices_2d_t *costMtx2d;
+    unsigned int       *retCosts;
+    atomic_size_t       nextRow;
+} all_pairs_job_t;
+
+
+/** Copy character i of a job to the end of io, where the alignments read it. */
+static void loadPairCharacter( alignIO_t *io, const all_pairs_job_t *job, size_t i )
+{
+    io->length = job->offsets[i + 1] - job->offsets[i];
+    memcpy( io->character + io->capacity - io->length, job->elements + job->offsets[i], io->length * sizeof(elem_t) );
+}
+
+
+/** Take rows of a job until none is left, and fill them, with a workspace and copies of the characters of this thread's
+ *  own: alignIOtoDynChar() writes before each character.
+ */
+static void *
+align_pair_rows( void *arg )
+{
+    all_pairs_job_t       *job       = arg;
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+    alignIO_t             *rowChar   = allocAlignIO( job->maxLength + 1 ),
+                          *colChar   = allocAlignIO( job->maxLength + 1 );
+
+    for (size_t i = atomic_fetch_add( &job->nextRow, 1 ); i < job->count; i = atomic_fetch_add( &job->nextRow, 1 )) {
+        loadPairCharacter( rowChar, job, i );
+
+        for (size_t j = job->symmetric ? i : 0; j < job->count; j++) {
+            loadPairCharacter( colChar, job, j );
+
+            const unsigned int cost = rowChar->length == 0 || colChar->length == 0
+                                    ? 0
+                                    : (unsigned int) align2dCost_ws( rowChar, colChar, job->costMtx2d, UINT_MAX, workspace );
+
+            job->retCosts[i * job->count + j] = cost;
+            if (job->symmetric) job->retCosts[j * job->count + i] = cost;
+        }
+    }
+
+    freeAlignIO( rowChar );
+    freeAlignIO( colChar );
+    free( rowChar );
+    free( colChar );
+    freeAlignmentWorkspace( workspace );
+    return NULL;
+}
+
+
+void align2dAllPairs( const elem_t       *elements
+                    , const size_t       *lengths
+                    , size_t              count
+                    , cost_matrices_2d_t *costMtx2d
+                    , unsigned int       *retCosts
+                    )
+{
+    size_t *offsets = malloc( (count + 1) * sizeof(size_t) );
+    assert( NULL != offsets && "Out of memory: Can't allocate character offsets." );
+
+    size_t maxLength = 0;
+    offsets[0] = 0;
+    for (size_t i = 0; i < count; i++) {
+        offsets[i + 1] = offsets[i] + lengths[i];
+        if (lengths[i] > maxLength) maxLength = lengths[i];
+    }
+
+    // Non-affine alignments order their characters by content, so only affine ones can depend on the order given.
+    all_pairs_job_t job = { .elements  = elements
+                          , .offsets   = offsets
+                          , .count     = count
+                          , .maxLength = maxLength
+                          , .symmetric = !costMtx2d->cost_model_type || costMtx2d->tcm_structure != TCM_NON_SYMMETRIC
+                          , .costMtx2d = costMtx2d
+                          , .retCosts  = retCosts
+                          };
+    atomic_init( &job.nextRow, 0 );
+
+    long threadCount = sysconf( _SC_NPROCESSORS_ONLN );
+    if (threadCount < 1)                     threadCount = 1;
+    if (threadCount > ALL_PAIRS_MAX_THREADS) threadCount = ALL_PAIRS_MAX_THREADS;
+    if ((size_t) threadCount > count)        threadCount = count ? (long) count : 1;
+
+    pthread_t threads[ALL_PAIRS_MAX_THREADS];
+    long started = 1;   // This thread takes rows too.
+    for (; started < threadCount; started++) {
+        if (pthread_create( &threads[started], NULL, align_pair_rows, &job ) != 0) break;
+    }
+    align_pair_rows( &job );
+    for (long t = 1; t < started; t++) pthread_join( threads[t], NULL );
+
+    free(offsets);
+}
+
 int align3d( alignIO_t          *inputChar1_aio
            , alignIO_t          *inputChar2_aio
            , alignIO_t          *inputChar3_aio
@@ -359,11 +875,44 @@ int align3d( alignIO_t          *inputChar1_aio
            , alignIO_t          *gappedOutput_aio
            , alignIO_t          *ungappedOutput_aio
            , cost_matrices_3d_t *costMtx3d
-           , unsigned int        substitution_cost
-           , unsigned int        gap_open_cost      // Set `gap_open_cost` == `gap_extension_cost` for non-affine. TODO: check this.
-           , unsigned int        gap_extension_cost
+           , unsigned int        gap_open_cost
            )
 {
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+
+    const int algnCost = align3d_ws( inputChar1_aio
+                                   , inputChar2_aio
+                                   , inputChar3_aio
+                                   , outputChar1_aio
+                                   , outputChar2_aio
+                                   , outputChar3_aio
+                                   , gappedOutput_aio
+                                   , ungappedOutput_aio
+                                   , costMtx3d
+                                   , gap_open_cost
+                                   , UINT_MAX
+                                   , workspace
+                                   );
+    freeAlignmentWorkspace( workspace );
+
+    return algnCost;
+}
+
+
+int align3d_ws( alignIO_t             *inputChar1_aio
+              , alignIO_t             *inputChar2_aio
+              , alignIO_t             *inputChar3_aio
+              , alignIO_t             *outputChar1_aio
+              , alignIO_t             *outputChar2_aio
+              , alignIO_t             *outputChar3_aio
+              , alignIO_t             *gappedOutput_aio
+              , alignIO_t             *ungappedOutput_aio
+              , cost_matrices_3d_t    *costMtx3d
+              , unsigned int           gap_open_cost
+              , unsigned int           costCeiling
+              , alignment_workspace_t *workspace
+              )
+{
 
     if (DEBUG_3D) {
         printf("\n\nalign3d input:\n");
@@ -384,37 +933,60 @@ int align3d( alignIO_t          *inputChar1_aio
     unsigned int algnCost;
 
     // powellInputs will be sent to Powell 3D alignment, powellOutputs will be returned.
-    characters_t *powellInputs  = alloc_characters_t(inputChar1_aio->length, inputChar2_aio->length, inputChar3_aio->length);
-    characters_t *powellOutputs = alloc_characters_t(CHAR_CAPACITY, CHAR_CAPACITY, CHAR_CAPACITY);
+    characters_t *powellInputs  = &workspace->powellInputs;
+    characters_t *powellOutputs = &workspace->powellOutputs;
+
+    int grown = reusePowellCharacters( workspace, CHAR_CAPACITY );
+
+    algn_stats_begin( &workspace->lastStats, ALGN_KERNEL_3D );
 
     alignIOtoCharacters_t( powellInputs, inputChar1_aio, inputChar2_aio, inputChar3_aio );
 
-    if (DEBUG_CALL_ORDER) printf( "\n---Calling Powell\n\n" );
+    powellOutputs->lenSeq1 = powellOutputs->lenSeq2 = powellOutputs->lenSeq3 = CHAR_CAPACITY;
+    powellOutputs->idxSeq1 = powellOutputs->idxSeq2 = powellOutputs->idxSeq3 = 0;
+
+    if (DEBUG_CALL_ORDER) printf( "\n---Calling Ukkonen\n\n" );
 
-    // Powell aligns three sequences.
-    algnCost = powell_3D_align ( powellInputs
+    const size_t searchBytes = ukk_tcm_3D_buffer_bytes( &workspace->search3d );
+
+    algnCost = ukk_tcm_3D_align( powellInputs
                                , powellOutputs
-                               , 4 // costMtx3d->alphSize
-                               , substitution_cost   // mismatch cost, must be > 0
-                               , gap_open_cost       // must be >= 0
-                               , gap_extension_cost  // gap extension cost: must be > 0
+                               , costMtx3d
+                               , gap_open_cost
+                               , costCeiling
+                               , &workspace->lastStats
+                               , &workspace->search3d
                                );
 
-    dyn_character_t *gappedMedianChar   = dyn_char_alloc( powellOutputs->idxSeq1 );
-    dyn_character_t *ungappedMedianChar = dyn_char_alloc( powellOutputs->idxSeq1 );
+    grown |= searchBytes != ukk_tcm_3D_buffer_bytes( &workspace->search3d );
+
+    if (algnCost > costCeiling) {
+        algn_stats_end( &workspace->lastStats, &workspace->allStats );
+        workspace->alignments++;
+        workspace->growths += grown;
 
-    algnCost = algn_get_cost_medians_3d( powellOutputs
-                                       , costMtx3d
-                                       , ungappedMedianChar
-                                       , gappedMedianChar
-                                       );
+        return algnCost;
+    }
+
+    dyn_character_t *gappedMedianChar   = &workspace->gappedMedian;
+    dyn_character_t *ungappedMedianChar = &workspace->ungappedMedian;
+    grown |= reuseDynChar( gappedMedianChar,   powellOutputs->idxSeq1 );
+    grown |= reuseDynChar( ungappedMedianChar, powellOutputs->idxSeq1 );
+
+    // Only the medians: the cost is the search's, which includes the gap open costs.
+    algn_get_cost_medians_3d( powellOutputs
+                            , costMtx3d
+                            , ungappedMedianChar
+                            , gappedMedianChar
+                            );
 
     dynCharToAlignIO( gappedOutput_aio,   gappedMedianChar,   0 );
     dynCharToAlignIO( ungappedOutput_aio, ungappedMedianChar, 0 );
 
-    copyValsToAIO( outputChar1_aio, powellOutputs->seq1, powellOutputs->lenSeq1, powellOutputs->lenSeq1 );
-    copyValsToAIO( outputChar2_aio, powellOutputs->seq2, powellOutputs->lenSeq1, powellOutputs->lenSeq1 );
-    copyValsToAIO( outputChar3_aio, powellOutputs->seq3, powellOutputs->lenSeq1, powellOutputs->lenSeq1 );
+    // Into the callers' buffers as they are, as dynCharToAlignIO() writes the medians.
+    copyValsToAIO( outputChar1_aio, powellOutputs->seq1, powellOutputs->lenSeq1, outputChar1_aio->capacity );
+    copyValsToAIO( outputChar2_aio, powellOutputs->seq2, powellOutputs->lenSeq1, outputChar2_aio->capacity );
+    copyValsToAIO( outputChar3_aio, powellOutputs->seq3, powellOutputs->lenSeq1, outputChar3_aio->capacity );
 
     reverseCharacterElements(outputChar1_aio);
     reverseCharacterElements(outputChar2_aio);
@@ -422,15 +994,9 @@ int align3d( alignIO_t          *inputChar1_aio
     reverseCharacterElements(gappedOutput_aio);
     reverseCharacterElements(ungappedOutput_aio);
 
-    dyn_char_free(gappedMedianChar);
-    if (gappedMedianChar != NULL) free(gappedMedianChar);
-    dyn_char_free(ungappedMedianChar);
-    if (ungappedMedianChar != NULL) free(ungappedMedianChar);
-
-    free_characters_t(powellInputs);
-    if (powellInputs != NULL) free(powellInputs);
-    free_characters_t(powellOutputs);
-    if (powellOutputs != NULL) free(powellOutputs);
+    algn_stats_end( &workspace->lastStats, &workspace->allStats );
+    workspace->alignments++;
+    workspace->growths += grown;
 
     return algnCost;
 }
@@ -484,10 +1050,6 @@ void alignIOtoCharacters_t( characters_t *output
                           , alignIO_t    *inputChar3
                           )
 {
-    output->seq1 = realloc( output->seq1, inputChar1->length * sizeof(elem_t) );
-    output->seq2 = realloc( output->seq2, inputChar2->length * sizeof(elem_t) );
-    output->seq3 = realloc( output->seq3, inputChar3->length * sizeof(elem_t) );
-
     memcpy( output->seq1, inputChar1->character + inputChar1->capacity - inputChar1->length, inputChar1->length * sizeof(elem_t) );
     memcpy( output->seq2, inputChar2->character + inputChar2->capacity - inputChar2->length, inputChar2->length * sizeof(elem_t) );
     memcpy( output->seq3, inputChar3->character + inputChar3->capacity - inputChar3->length, inputChar3->length * sizeof(elem_t) );
@@ -526,12 +1088,11 @@ void copyAioToVals( elem_t *vals, alignIO_t *inChar )
 
 void copyValsToAIO( alignIO_t *outChar, elem_t *vals, size_t length, size_t capacity )
 {
-    outChar->length   = length;
-    outChar->capacity = capacity;
-    outChar->character = realloc( outChar->character, outChar->capacity * sizeof(elem_t) );
-    assert( NULL != outChar->character && "Can't allocate alignIO character field." );
+    assert( outChar->capacity == capacity && "alignIO capacity differs from the one given." );
+    assert( outChar->capacity >= length   && "alignIO character field is too short." );
 
-    size_t offset = capacity - length;
+    outChar->length = length;
+    size_t offset   = outChar->capacity - length;
     memcpy(outChar->character + offset, vals, length * sizeof(elem_t));
 }
 
@@ -575,9 +1136,7 @@ void dynCharToAlignIO( alignIO_t *output, dyn_character_t *input, int delete_ini
     output->length = copy_length;
     // output->capacity = input->cap;     // this shouldn't change
     size_t offset  = output->capacity - copy_length; // How far into output to start copying input character.
-
-    output->character = realloc( output->character, output->capacity * sizeof(elem_t) );
-    assert( NULL != output->character && "Can't allocate alignIO character field." );
+    assert( output->capacity >= copy_length && "alignIO character field is too short." );
 
     // Start copy after unnecessary gap char in input, if it exists.
     memcpy( output->character + offset, input_begin, copy_length * sizeof(elem_t) );
@@ -3,6 +3,7 @@
 
 #include "alignCharacters.h"
 #include "alignmentMatrices.h"
+#include "alignmentStats.h"
 #include "c_code_alloc_setup.h"
 #include "costMatrix.h"
 #include "debug_constants.h"
@@ -10,6 +11,12 @@
 /** Input/output structure for Haskell FFI. Essentially a cut down dyn_character_t.
  *
  *  Note that the character will be in the last `length` elements of the array.
+ *
+ *  The 2D alignments read their inputs in place, write their outputs into the
+ *  arrays they are given, and keep no pointer to them after returning, so the
+ *  caller may pass its own memory, such as a pinned Haskell buffer. Each input
+ *  needs room for one more element before it, for the gap alignIOtoDynChar()
+ *  prepends.
  */
 typedef struct alignIO_t {
     elem_t *character;
@@ -18,6 +25,46 @@ typedef struct alignIO_t {
 } alignIO_t;
 
 
+/** Buffers for alignments, reused from one alignment to the next.
+ *
+ *  Each of align2d(), align2dAffine() and align3d() allocates its matrices and
+ *  working characters, and frees them on return. The _ws variants below take
+ *  them from a workspace instead, which grows as needed and never shrinks, so
+ *  that once it has seen characters as long as those it is given an alignment
+ *  allocates nothing.
+ *
+ *  A workspace may be used by only one alignment at a time: make one for each
+ *  thread, C or Haskell, that aligns.
+ */
+typedef struct alignment_workspace_t alignment_workspace_t;
+
+
+/** What a workspace holds, and how often it has had to grow. */
+typedef struct alignment_workspace_stats_t {
+    size_t bytes;       // Memory held by the workspace.
+    size_t alignments;  // Alignments done with it.
+    size_t growths;     // Of those, how many had to grow one of its buffers.
+} alignment_workspace_stats_t;
+
+
+alignment_workspace_t *allocAlignmentWorkspace( void );
+
+
+void freeAlignmentWorkspace( alignment_workspace_t *workspace );
+
+
+void alignmentWorkspaceStats( const alignment_workspace_t *workspace, alignment_workspace_stats_t *stats );
+
+
+/** The alignment_stats_t of the last alignment done with a workspace, and of all of them. Either
+ *  may be NULL.
+ */
+void getAlignmentStats( const alignment_workspace_t *workspace
+                      ,       alignment_stats_t     *lastCall
+                      ,       alignment_stats_t     *allCalls
+                      );
+
+
 /** Do a 2d alignment. Depending on the values of last two inputs,
  *  | (0,0) = return only a cost
  *  | (0,1) = calculate gapped and ungapped characters
@@ -38,6 +85,27 @@ int align2d( alignIO_t          *inputChar1_aio
            );
 
 
+/** As align2d, with the buffers taken from workspace, and a cost ceiling.
+ *
+ *  If the cost is greater than costCeiling, returns a value greater than
+ *  costCeiling, which need not be the cost, and leaves the outputs and inputs
+ *  as they were. Unless the characters are long enough to be aligned in linear
+ *  space, it stops as soon as every cell of a row of the alignment matrix costs
+ *  more than costCeiling. Pass UINT_MAX for no ceiling.
+ */
+int align2d_ws( alignIO_t             *inputChar1_aio
+              , alignIO_t             *inputChar2_aio
+              , alignIO_t             *gappedOutput_aio
+              , alignIO_t             *ungappedOutput_aio
+              , cost_matrices_2d_t    *costMtx2d
+              , int                    getUngapped
+              , int                    getGapped
+              , int                    getUnion
+              , unsigned int           costCeiling
+              , alignment_workspace_t *workspace
+              );
+
+
 /** As align2d, but affine.
  *
  *  If `getMedians` gapped & ungapped outputs will be medians.
@@ -52,15 +120,79 @@ int align2dAffine( alignIO_t          *inputChar1_aio
                  );
 
 
-/** Aligns three characters using affine algorithm.
- *  Set `gap_open_cost` to equal `gap_extension_cost` for non-affine.
+/** As align2dAffine, with the buffers taken from workspace, and a cost
+ *  ceiling as in align2d_ws.
+ */
+int align2dAffine_ws( alignIO_t             *inputChar1_aio
+                    , alignIO_t             *inputChar2_aio
+                    , alignIO_t             *gappedOutput_aio
+                    , alignIO_t             *ungappedOutput_aio
+                    , cost_matrices_2d_t    *costMtx2d_affine
+                    , int                    getMedians
+                    , unsigned int           costCeiling
+                    , alignment_workspace_t *workspace
+                    );
+
+
+/** The cost of aligning two characters, as align2d() or align2dAffine() would
+ *  return it, according to costMtx2d->cost_model_type, but computing only the
+ *  cost: no direction matrix, and costs kept in two rolling rows. The inputs
+ *  are left as they are.
+ *
+ *  If upperBound is exceeded, stops as soon as every cell of a row of the
+ *  alignment matrix costs more than it, and returns a value greater than
+ *  upperBound that is not the cost. Pass UINT_MAX for no bound. The bound is
+ *  not used for discrete characters (see algn_discrete_applies()), whose cost
+ *  is found by bit vectors. The rolling rows already take memory linear in
+ *  the lengths, so unlike align2d() this never switches to Hirschberg.
+ */
+int align2dCost( alignIO_t          *inputChar1_aio
+               , alignIO_t          *inputChar2_aio
+               , cost_matrices_2d_t *costMtx2d
+               , unsigned int        upperBound
+               );
+
+
+/** As align2dCost, with the buffers taken from workspace. */
+int align2dCost_ws( alignIO_t             *inputChar1_aio
+                  , alignIO_t             *inputChar2_aio
+                  , cost_matrices_2d_t    *costMtx2d
+                  , unsigned int           upperBound
+                  , alignment_workspace_t *workspace
+                  );
+
+
+/** The cost align2dCost() gives each pair of count characters, written to the count * count, row-major matrix
+ *  retCosts, which the caller allocates.
+ *
+ *  The characters are laid end to end in elements, the ith taking lengths[i] of them. A character of length 0 is
+ *  missing, and costs 0 against any other, as those Haskell leaves unaligned.
+ *
+ *  Each pair is aligned once, and its cost written to both of its cells, unless the alignment is affine and the TCM
+ *  not symmetric, when the order of the two characters can change the cost. Rows are taken, one at a time, from a
+ *  shared counter by up to one thread per processor, each with a workspace of its own, so that threads given
+ *  the long rows at the top do not hold up those that finish first.
+ */
+void align2dAllPairs( const elem_t       *elements
+                    , const size_t       *lengths
+                    , size_t              count
+                    , cost_matrices_2d_t *costMtx2d
+                    , unsigned int       *retCosts
+                    );
+
+/** Aligns three characters with the least cost by costMtx3d, plus `gap_open_cost` for each gap
+ *  opened in a character. Set `gap_open_cost` to 0 for non-affine. Every column, substitutions
+ *  and gap extensions included, costs what costMtx3d gives.
  *
  *  First declares, allocates and initializes data structures.
- *  Calls ukkCheckPoint.powell_3D_align().
- *  Calls alignCharacters.algn_get_cost_medians_3d().
+ *  Calls ukkCheckPoint.ukk_tcm_3D_align().
+ *  Calls alignCharacters.algn_get_cost_medians_3d() for the medians.
  *  Copies output to correct return structures.
  *
  *  Ordering of inputs by length does not matter, as they will be sorted inside the fn.
+ *
+ *  Each output must have a capacity of at least the sum of the inputs' lengths. Outputs are
+ *  written into their buffers as they are, which are never reallocated.
  */
 int align3d( alignIO_t          *inputChar1_aio
            , alignIO_t          *inputChar2_aio
@@ -71,12 +203,32 @@ int align3d( alignIO_t          *inputChar1_aio
            , alignIO_t          *ungappedOutput_aio
            , alignIO_t          *gappedOutput_aio
            , cost_matrices_3d_t *costMtx3d
-           , unsigned int        substitution_cost
            , unsigned int        gap_open_cost
-           , unsigned int        gap_extension_cost
            );
 
 
+/** As align3d, with the buffers taken from workspace, and a cost ceiling.
+ *
+ *  The ceiling bounds the cost of the alignment, which is searched for with an
+ *  increasing threshold. If none costs costCeiling or less, returns
+ *  costCeiling + 1 as soon as that is known, and leaves the outputs as they
+ *  were. Pass UINT_MAX for no ceiling.
+ */
+int align3d_ws( alignIO_t             *inputChar1_aio
+              , alignIO_t             *inputChar2_aio
+              , alignIO_t             *inputChar3_aio
+              , alignIO_t             *outputChar1_aio
+              , alignIO_t             *outputChar2_aio
+              , alignIO_t             *outputChar3_aio
+              , alignIO_t             *ungappedOutput_aio
+              , alignIO_t             *gappedOutput_aio
+              , cost_matrices_3d_t    *costMtx3d
+              , unsigned int           gap_open_cost
+              , unsigned int           costCeiling
+              , alignment_workspace_t *workspace
+              );
+
+
 /**  prints an alignIO struct */
 void alignIO_print( const alignIO_t *character );
 
@@ -120,12 +272,12 @@ alignIO_t *allocAlignIO( size_t capacity );
 
 /** For use in 3DO and for testing.
  *
- *  Copy an array of elem_t into an *already alloc'ed* (but see note below) alignIO struct. Then sets length of input length and
- *  capacity to `capacity`.
+ *  Copy an array of elem_t into an *already alloc'ed* alignIO struct, whose capacity must be `capacity`. Then sets length to
+ *  `length`.
  *
- *  Array values should fill *last* `length` elements of character buffer.
+ *  Array values fill *last* `length` elements of character buffer.
  *
- *  Allocates array that holds dynamic character of length capacity.
+ *  Does not allocate: the buffer may be the caller's, pinned or foreign, so it is never grown.
  */
 void copyValsToAIO( alignIO_t *outChar, elem_t *vals, size_t length, size_t capacity );
 
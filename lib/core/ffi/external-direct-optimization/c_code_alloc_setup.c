@@ -1,8 +1,10 @@
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "alignCharacters.h"
 #include "alignmentMatrices.h"
@@ -10,6 +12,18 @@
 #include "costMatrix.h"
 #include "debug_constants.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define COST_ROW_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+
+/** setUp2dCostMtx() fills matrices of at least this many rows on several threads, at most
+ *  COST_SETUP_MAX_THREADS of them.
+ */
+#define COST_SETUP_PARALLEL_ROWS 256
+#define COST_SETUP_MAX_THREADS   16
+
 
 /** Find distance between an ambiguous nucleotide and an unambiguous ambElem. Return that value and the median.
  *  @param ambElem is ambiguous input.
@@ -60,6 +74,7 @@ void freeCostMtx(void * input, int is_2d) {
     } else {
         if (NULL != ((cost_matrices_3d_t *) input)->cost)   free( ((cost_matrices_3d_t *) input)->cost);
         if (NULL != ((cost_matrices_3d_t *) input)->median) free( ((cost_matrices_3d_t *) input)->median);
+        cm_free_3d_lazy( (cost_matrices_3d_t *) input );
     }
 
     if (NULL != input) free (input);
@@ -73,6 +88,9 @@ void freeCostMtx(void * input, int is_2d) {
 void freeNWMtx(alignment_matrices_t *input) {
     if (NULL != input->algn_costMtx)    free (input->algn_costMtx);
     if (NULL != input->algn_dirMtx)     free (input->algn_dirMtx);
+    free (input->algn_packedDirMtx);
+    free (input->algn_packedRowStart);
+    free (input->algn_dirRow);
     if (NULL != input->algn_precalcMtx) free (input->algn_precalcMtx);
 
     if (NULL != input) free(input);
@@ -90,10 +108,17 @@ void initializeAlignmentMtx( alignment_matrices_t *retMtx
     retMtx->cap_nw          =  0; // a suitably small number to trigger realloc, but be larger than len_eff
     retMtx->cap_eff         =  0; // cap_eff was -1 so that cap_eff < cap, triggering the realloc
     retMtx->cap_pre         =  0; // again, trigger realloc
+    retMtx->cap_packed      =  0; // the packed directions are only allocated for non-affine alignments
+    retMtx->cap_packedRows  =  0;
+    retMtx->cap_dirRow      =  0;
+    retMtx->packedRowBytes  =  0;
 
     retMtx->algn_costMtx    = malloc( sizeof( unsigned int    ) );
     retMtx->algn_dirMtx     = malloc( sizeof( DIR_MTX_ARROW_t ) );
     retMtx->algn_precalcMtx = malloc( sizeof( unsigned int    ) );
+    retMtx->algn_packedDirMtx   = NULL;
+    retMtx->algn_packedRowStart = NULL;
+    retMtx->algn_dirRow         = NULL;
     /* don't have to allocate these two, because they're just pointing to algn_costMtx and algn_dirMtx.
     retMtx->cube          = malloc ( sizeof( int* ) );
     retMtx->cube_d        = malloc ( sizeof( int* ) );
@@ -103,7 +128,136 @@ void initializeAlignmentMtx( alignment_matrices_t *retMtx
            && retMtx->algn_precalcMtx != NULL
            && "Can't allocate alignment matrices." );
 
-    algnMat_setup_size (retMtx, len_char1, len_char2, alphSize);
+    algnMat_setup_size (retMtx, len_char1, len_char2, alphSize, 0);
+}
+
+
+/** For every element, ambiguous or not, its distance() to every unambiguous one:
+ *  distances[s * (all_elements + 1) + e] is the least tcm[x * alphSize + s] over the bits x of e.
+ *  Each element's is that of its lowest bit's, combined with that of the element without it.
+ *  Laid out by unambiguous element so that a vector holds consecutive elements e.
+ */
+static unsigned int *
+element_distances( const unsigned int *tcm, size_t alphSize, elem_t all_elements )
+{
+    const size_t  stride    = (size_t) all_elements + 1;
+    unsigned int *distances = malloc( alphSize * stride * sizeof(unsigned int) );
+    assert( distances != NULL && "OOM: Cannot allocate element distances." );
+
+    for (size_t s = 0; s < alphSize; s++) {
+        unsigned int *row = distances + s * stride;
+        row[0] = INT_MAX;
+        for (elem_t e = 1; e <= all_elements; e++) {
+            const elem_t       rest = e & (e - 1);
+            const unsigned int own  = tcm[__builtin_ctz(e) * alphSize + s];
+            row[e] = rest != 0 && row[rest] < own ? row[rest] : own;
+        }
+    }
+    return distances;
+}
+
+
+/** Fill costs and medians, row ambElem1 of a 2D cost matrix, for ambElem2 in [first, last], as the
+ *  loop over nucleotides in setUp2dCostMtx() did: the least sum of distances, and every
+ *  nucleotide reaching it.
+ */
+static void
+fill_cost_row_scalar( const unsigned int *distances
+                    ,       size_t        alphSize
+                    ,       size_t        stride
+                    ,       elem_t        ambElem1
+                    ,       elem_t        first
+                    ,       elem_t        last
+                    ,       unsigned int *costRow
+                    ,       elem_t       *medianRow
+                    )
+{
+    for (elem_t ambElem2 = first; ambElem2 <= last; ambElem2++) {
+        unsigned int minCost = INT_MAX;
+        elem_t       median  = 0;
+        for (size_t s = 0; s < alphSize; s++) {
+            const unsigned int curCost = distances[s * stride + ambElem1] + distances[s * stride + ambElem2];
+            if (curCost < minCost) {
+                minCost = curCost;
+                median  = 1 << s;
+            } else if (curCost == minCost) {
+                median |= 1 << s;
+            }
+        }
+        costRow[ambElem2]   = minCost;
+        medianRow[ambElem2] = median;
+    }
+}
+
+
+#ifdef COST_ROW_KERNEL_X86
+
+/** As fill_cost_row_scalar(), eight ambElem2 at a time. */
+__attribute__((target("avx2")))
+static void
+fill_cost_row_avx2( const unsigned int *distances
+                  ,       size_t        alphSize
+                  ,       size_t        stride
+                  ,       elem_t        ambElem1
+                  ,       elem_t        first
+                  ,       elem_t        last
+                  ,       unsigned int *costRow
+                  ,       elem_t       *medianRow
+                  )
+{
+    elem_t ambElem2 = first;
+    for (; ambElem2 + 7 <= last; ambElem2 += 8) {
+        __m256i minCost = _mm256_set1_epi32( INT_MAX ),
+                median  = _mm256_setzero_si256();
+        for (size_t s = 0; s < alphSize; s++) {
+            const __m256i curCost = _mm256_add_epi32( _mm256_set1_epi32( (int) distances[s * stride + ambElem1] )
+                                                    , _mm256_loadu_si256( (const __m256i *) (distances + s * stride + ambElem2) ) ),
+                          bit     = _mm256_set1_epi32( 1 << s ),
+                          less    = _mm256_cmpgt_epi32( minCost, curCost ),
+                          equal   = _mm256_cmpeq_epi32( minCost, curCost );
+            median  = _mm256_blendv_epi8( _mm256_or_si256( median, _mm256_and_si256( equal, bit ) ), bit, less );
+            minCost = _mm256_min_epi32( minCost, curCost );
+        }
+        _mm256_storeu_si256( (__m256i *) (costRow   + ambElem2), minCost );
+        _mm256_storeu_si256( (__m256i *) (medianRow + ambElem2), median  );
+    }
+    if (ambElem2 <= last) {
+        fill_cost_row_scalar( distances, alphSize, stride, ambElem1, ambElem2, last, costRow, medianRow );
+    }
+}
+
+#endif // COST_ROW_KERNEL_X86
+
+
+typedef struct cost_rows_job_t {
+    cost_matrices_2d_t *costMtx;
+    const unsigned int *distances;
+    elem_t              all_elements;
+    size_t              first;       // Fill rows first, first + step, ... up to all_elements.
+    size_t              step;
+} cost_rows_job_t;
+
+
+static void *
+fill_cost_rows( void *arg )
+{
+    const cost_rows_job_t *job      = arg;
+    const size_t           alphSize = job->costMtx->alphSize,
+                           stride   = (size_t) job->all_elements + 1;
+
+    void (*fill_row)( const unsigned int *, size_t, size_t, elem_t, elem_t, elem_t, unsigned int *, elem_t * ) = fill_cost_row_scalar;
+#ifdef COST_ROW_KERNEL_X86
+    __builtin_cpu_init();
+    // Costs are compared as signed ints; they are far below INT_MAX.
+    if (__builtin_cpu_supports("avx2")) fill_row = fill_cost_row_avx2;
+#endif
+
+    for (size_t ambElem1 = job->first; ambElem1 <= job->all_elements; ambElem1 += job->step) {
+        const size_t offset = ambElem1 << alphSize;     // as cm_calc_cost_position_2d()
+        fill_row( job->distances, alphSize, stride, ambElem1, 1, job->all_elements
+                , job->costMtx->cost + offset, job->costMtx->median + offset );
+    }
+    return NULL;
 }
 
 
@@ -122,16 +276,6 @@ void setUp2dCostMtx( cost_matrices_2d_t *retCostMtx
     int    is_metric    = 1;
     elem_t all_elements = (1 << alphSize) - 1;   // Given data is DNA (plus gap), there are 2^5 - 1 possible character states
 
-    int    minCost      = INT_MAX;
-    elem_t median       = 0;                     // cumulative median for 2d; combo of median1, etc., below
-    int    curCost;
-
-    // int    median1, median2;                    // median of a given nucleotide and current ambElem, for each ambElem
-
-    //    int tcm2[25] = {0,1,1,1,1,1,0,1,1,1,1,1,0,1,1,1,1,1,0,1,1,1,1,1,0};
-
-    //    tcm = tcm2;
-
     cm_alloc_2d( retCostMtx
                , alphSize
                , combinations
@@ -140,6 +284,8 @@ void setUp2dCostMtx( cost_matrices_2d_t *retCostMtx
                , is_metric
                , all_elements
                );
+    retCostMtx->tcm_structure = cm_diagnose_tcm( tcm, alphSize, &retCostMtx->tcm_factor );
+
     // Print TCM in pretty format
     if(DEBUG_MAT) {
         printf("setUp2dCostMtx\n");
@@ -152,30 +298,33 @@ void setUp2dCostMtx( cost_matrices_2d_t *retCostMtx
         }
     }
 
-    for (elem_t ambElem1 = 1; ambElem1 <= all_elements; ambElem1++) { // for every possible value of ambElem1, ambElem2
-        for (elem_t ambElem2 = 1; ambElem2 <= all_elements; ambElem2++) {
-            //curCost = 0;                // don't actually need to do this
-            minCost = INT_MAX;
-            median  = 0;
-            // median1 = median2 = 0;
-
-            elem_t nucleotide;
-            for ( nucleotide = 1; nucleotide <= alphSize; nucleotide++) {
-                curCost = distance (tcm, alphSize, nucleotide, ambElem1)
-                        + distance (tcm, alphSize, nucleotide, ambElem2);
-                // now seemingly recreating logic in distance(), but that was to get the cost for each
-                // ambElem; now we're combining those costs get overall cost and median
-                if (curCost < minCost) {
-                    minCost = curCost;
-                    median  = 1 << (nucleotide - 1); // median = this nucleotide, because it has the lowest cost thus far
-                } else if (curCost == minCost) {
-                    median |= 1 << (nucleotide - 1); // median = this nucleotide | old median
-                }
-            } // nucleotide
-            cm_set_cost_2d   (retCostMtx, ambElem1, ambElem2, minCost);
-            cm_set_median_2d (retCostMtx, ambElem1, ambElem2, median);
-        } // ambElem2
-    } // ambElem1
+    // Each cost is the least, over nucleotides, of the sum of the two elements' distance() to it; the
+    // median is every nucleotide reaching it. The distances are computed once per element, then each
+    // row is filled a vector at a time, rows divided among threads for large alphabets.
+    unsigned int *distances = element_distances( tcm, alphSize, all_elements );
+
+    long threadCount = 1;
+    if (all_elements + 1 >= COST_SETUP_PARALLEL_ROWS) {
+        threadCount = sysconf( _SC_NPROCESSORS_ONLN );
+        if (threadCount < 1)                      threadCount = 1;
+        if (threadCount > COST_SETUP_MAX_THREADS) threadCount = COST_SETUP_MAX_THREADS;
+    }
+
+    cost_rows_job_t jobs[COST_SETUP_MAX_THREADS];
+    pthread_t       threads[COST_SETUP_MAX_THREADS];
+    for (long t = 0; t < threadCount; t++) {
+        jobs[t] = (cost_rows_job_t) { retCostMtx, distances, all_elements, 1 + t, threadCount };
+    }
+    long started = 1;   // The first share is filled on this thread.
+    for (; started < threadCount; started++) {
+        if (pthread_create( &threads[started], NULL, fill_cost_rows, &jobs[started] ) != 0) break;
+    }
+    // Should a thread not start, this one fills its share, and those after it.
+    for (long t = started; t < threadCount; t++) fill_cost_rows( &jobs[t] );
+    fill_cost_rows( &jobs[0] );
+    for (long t = 1; t < started; t++) pthread_join( threads[t], NULL );
+    free(distances);
+
     // Gap number is alphSize - 1, which makes bit representation
     // i << (alphSize - 1), because first char value is i << 0.
 
@@ -223,6 +372,11 @@ void setUp3dCostMtx( cost_matrices_3d_t *retMtx
     elem_t median = 0;        // and 3d; combos of median1, etc., below
     int curCost;
 
+    if (alphSize > CM_3D_DENSE_MAX_ALPHABET) {
+        cm_alloc_3d_lazy( retMtx, alphSize, do_aff, gap_open, tcm );
+        return;
+    }
+
     cm_alloc_3d( retMtx
                , alphSize
                , combinations
@@ -72,6 +72,9 @@ void resetCharValues( dyn_character_t *retChar );
  *  Nota bene:
  *  No longer setting max, as algorithm to do so is unclear: see note below.
  *  Not sure which of two loops to set prepend and tail arrays is correct.
+ *
+ *  Matrices of COST_SETUP_PARALLEL_ROWS rows or more, from alphabets of 8 elements, are filled on several threads.
+ *  The structure of tcm is diagnosed, and kept in retMtx->tcm_structure, for the alignments to choose kernels by.
  */
 void setUp2dCostMtx( cost_matrices_2d_t *retMtx
                    , unsigned int       *tcm
@@ -83,6 +86,8 @@ void setUp2dCostMtx( cost_matrices_2d_t *retMtx
 /** Nearly identical to setUp2dCostMtx. Code duplication necessary in order to have two different return types.
  *  I attempted to do with with a return of void *, but was having trouble with allocation, and was forced to move
  *  it outside this fn.
+ *
+ *  For alphabets of more than CM_3D_DENSE_MAX_ALPHABET elements the matrix is lazy; see cm_alloc_3d_lazy().
  */
 void setUp3dCostMtx( cost_matrices_3d_t *retMtx
                    , unsigned int       *tcm
@@ -18,10 +18,19 @@
 /* USA                                                                        */
 
 #include <assert.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LAZY_3D_X86 1
+#include <immintrin.h>
+#endif
+
 #include "costMatrix.h"
 
 static inline int
@@ -161,8 +170,10 @@ cm_alloc_2d ( cost_matrices_2d_t *res
         res->include_ambiguities = 0;
     }
 
-    res->num_elements = num_elements;
-    res->is_metric    = is_metric;
+    res->num_elements  = num_elements;
+    res->is_metric     = is_metric;
+    res->tcm_structure = TCM_NON_SYMMETRIC;   // Nothing is assumed until cm_diagnose_tcm() is called.
+    res->tcm_factor    = 1;
 
     cm_set_affine (res, do_aff, gap_open_cost);
 
@@ -202,6 +213,95 @@ cm_alloc_2d ( cost_matrices_2d_t *res
 }
 
 
+static unsigned int
+cm_gcd (unsigned int a, unsigned int b)
+{
+    while (b != 0) {
+        const unsigned int r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+
+/** Each of these checks tcm / factor, at index (i, j) of the alphSize x alphSize TCM,
+ *  as the function of the same name in Data.TCM.Internal.
+ */
+#define TCM_AT(i, j) (tcm[(i) * alphSize + (j)] / factor)
+
+static int
+cm_tcm_is_symmetric (const unsigned int *tcm, size_t alphSize, unsigned int factor)
+{
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = i + 1; j < alphSize; j++) {
+            if (TCM_AT(i, j) != TCM_AT(j, i)) return 0;
+        }
+    }
+    return 1;
+}
+
+
+/** Zero on the diagonal only, and, as tcmPoints3D enumerates them, the triangle inequality
+ *  (or, if ultra, the ultrametric one) for i < j < k.
+ */
+static int
+cm_tcm_is_metric (const unsigned int *tcm, size_t alphSize, unsigned int factor, int ultra)
+{
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if ((i == j) != (TCM_AT(i, j) == 0)) return 0;
+        }
+    }
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = i + 1; j < alphSize; j++) {
+            for (size_t k = j + 1; k < alphSize; k++) {
+                const unsigned int ij = TCM_AT(i, j),
+                                   ik = TCM_AT(i, k),
+                                   kj = TCM_AT(k, j);
+                if (ultra ? ij > (ik > kj ? ik : kj) : ij > ik + kj) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+/** Every cost is |i - j| (if additive), or 0 on the diagonal and 1 off it. */
+static int
+cm_tcm_is_additive (const unsigned int *tcm, size_t alphSize, unsigned int factor, int nonAdditive)
+{
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            const unsigned int expected = nonAdditive ? i != j : (i > j ? i - j : j - i);
+            if (TCM_AT(i, j) != expected) return 0;
+        }
+    }
+    return 1;
+}
+
+#undef TCM_AT
+
+
+tcm_structure_t
+cm_diagnose_tcm ( const unsigned int *tcm
+                , size_t              alphSize
+                ,       unsigned int *factor
+                )
+{
+    unsigned int gcd = 0;
+    for (size_t i = 0; i < alphSize * alphSize; i++) gcd = cm_gcd( gcd, tcm[i] );
+    *factor = gcd > 1 ? gcd : 1;
+
+    if (!cm_tcm_is_symmetric( tcm, alphSize, *factor ))     return TCM_NON_SYMMETRIC;
+    if (!cm_tcm_is_metric(    tcm, alphSize, *factor, 0 ))  return TCM_SYMMETRIC;
+    if ( cm_tcm_is_additive(  tcm, alphSize, *factor, 0 ))  return TCM_ADDITIVE;
+    if (!cm_tcm_is_metric(    tcm, alphSize, *factor, 1 ))  return TCM_METRIC;
+    if (!cm_tcm_is_additive(  tcm, alphSize, *factor, 1 ))  return TCM_ULTRAMETRIC;
+    return TCM_NON_ADDITIVE;
+}
+
+
 static inline elem_t
 cm_calc_median_2d ( unsigned int *tcm
                   , elem_t a
@@ -350,6 +450,10 @@ void cm_print_3d (cost_matrices_3d_t *costMatrix)
     printf("  gap open:             %d\n",  costMatrix->gap_open_cost);
     printf("  num elements:         %zu\n", costMatrix->num_elements);
 
+    if (costMatrix->lazy != NULL) {
+        printf("  lazy, ambiguous triples computed: %zu\n\n", cm_count_3d_lazy(costMatrix));
+        return;
+    }
     printf("\n  Cost matrix:\n    ");
     cm_print_matrix_3d(costMatrix->cost,   costMatrix->costMatrixDimension + 1);
     printf("  Median costs:\n    ");
@@ -443,6 +547,7 @@ cm_alloc_3d ( cost_matrices_3d_t *res
 
     res->cost         = calloc (size * sizeof(int),  1);
     res->median       = calloc (size * sizeof(elem_t), 1);
+    res->lazy         = NULL;
     assert(   res->cost   != NULL
            && res->median != NULL
            && "Memory error during cost matrix allocation." );
@@ -475,6 +580,303 @@ cm_get_value_3d( const unsigned int *p
 }
 
 
+/******************************** Lazy 3D matrices ********************************/
+
+/** Ambiguous triples are kept in this many independently locked hash tables, chosen by hash,
+ *  so that threads looking up different triples seldom wait for each other.
+ */
+#define LAZY_3D_STRIPES 64
+
+
+typedef struct lazy_3d_entry_t {
+    elem_t       a, b, c;       // a == 0 marks an empty slot
+    unsigned int cost;
+    elem_t       median;
+} lazy_3d_entry_t;
+
+
+typedef struct lazy_3d_stripe_t {
+    atomic_flag      lock;
+    size_t           count;
+    size_t           capacity;  // 0, or a power of 2
+    lazy_3d_entry_t *slots;
+} lazy_3d_stripe_t;
+
+
+struct cost_memo_3d_t {
+    unsigned int     *tcm;          // alphSize x alphSize
+    unsigned int     *coreCost;     // The unambiguous triples, indexed by the position of each element's bit
+    elem_t           *coreMedian;
+    lazy_3d_stripe_t  stripes[LAZY_3D_STRIPES];
+};
+
+
+/** This thread's lookups of ambiguous triples, in any lazy matrix, that found them, and that
+ *  computed them, for cm_lazy_3d_lookups().
+ */
+static _Thread_local size_t lazyHits, lazyMisses;
+
+
+/** The cost and median of a triple, as setUp3dCostMtx() computes them for a dense matrix. */
+static void
+cm_calc_3d_lazy ( const unsigned int *tcm
+                ,       size_t        alphSize
+                ,       elem_t        a
+                ,       elem_t        b
+                ,       elem_t        c
+                ,       unsigned int *cost
+                ,       elem_t       *median
+                )
+{
+    const elem_t elems[3] = { a, b, c };
+    unsigned int minCost  = UINT_MAX;
+    elem_t       med      = 0;
+
+    for (size_t state = 0; state < alphSize; state++) {
+        unsigned int curCost = 0;
+        for (size_t e = 0; e < 3; e++) {
+            unsigned int distance = UINT_MAX;
+            for (size_t pos = 0; pos < alphSize; pos++) {
+                if ((elems[e] >> pos) & 1 && tcm[pos * alphSize + state] < distance) {
+                    distance = tcm[pos * alphSize + state];
+                }
+            }
+            curCost += distance;
+        }
+        if (curCost < minCost) {
+            minCost = curCost;
+            med     = ((elem_t) 1) << state;
+        } else if (curCost == minCost) {
+            med    |= ((elem_t) 1) << state;
+        }
+    }
+    *cost   = minCost;
+    *median = med;
+}
+
+
+static inline uint64_t
+cm_hash_3d_lazy (elem_t a, elem_t b, elem_t c)
+{
+    uint64_t h = (uint64_t) a * 0x9E3779B97F4A7C15u
+               ^ (uint64_t) b * 0xC2B2AE3D27D4EB4Fu
+               ^ (uint64_t) c * 0x165667B19E3779F9u;
+    return h ^ (h >> 29);
+}
+
+
+/** Spins this many times, pausing, before a thread waiting for a stripe yields its processor. */
+#define LAZY_3D_SPINS 64
+
+
+/** Take a stripe's lock. A waiting thread pauses between attempts, so as not to slow the holder
+ *  with contended test-and-sets, then yields if the stripe stays locked.
+ */
+static inline void
+cm_lock_3d_lazy (lazy_3d_stripe_t *stripe)
+{
+    for (unsigned int spins = 0; atomic_flag_test_and_set_explicit( &stripe->lock, memory_order_acquire ); spins++) {
+#ifdef LAZY_3D_X86
+        if (spins < LAZY_3D_SPINS) {
+            _mm_pause();
+            continue;
+        }
+#endif
+        sched_yield();
+    }
+}
+
+
+static inline void
+cm_unlock_3d_lazy (lazy_3d_stripe_t *stripe)
+{
+    atomic_flag_clear_explicit( &stripe->lock, memory_order_release );
+}
+
+
+/** Find the triple in a stripe, or the empty slot where it belongs. The stripe must have slots. */
+static lazy_3d_entry_t *
+cm_probe_3d_lazy (const lazy_3d_stripe_t *stripe, uint64_t hash, elem_t a, elem_t b, elem_t c)
+{
+    size_t i = (size_t) (hash / LAZY_3D_STRIPES);
+    for (;; i++) {
+        lazy_3d_entry_t *slot = stripe->slots + (i & (stripe->capacity - 1));
+        if (slot->a == 0 || (slot->a == a && slot->b == b && slot->c == c)) return slot;
+    }
+}
+
+
+/** Double a stripe's table, or give it its first slots, keeping it at most half full. */
+static void
+cm_grow_3d_lazy (lazy_3d_stripe_t *stripe)
+{
+    lazy_3d_stripe_t grown = { .capacity = stripe->capacity ? 2 * stripe->capacity : 16 };
+    grown.slots = calloc( grown.capacity, sizeof(lazy_3d_entry_t) );
+    assert( grown.slots != NULL && "Memory error during lazy cost matrix growth." );
+
+    for (size_t i = 0; i < stripe->capacity; i++) {
+        const lazy_3d_entry_t *entry = stripe->slots + i;
+        if (entry->a != 0) {
+            *cm_probe_3d_lazy( &grown, cm_hash_3d_lazy(entry->a, entry->b, entry->c), entry->a, entry->b, entry->c ) = *entry;
+        }
+    }
+    free(stripe->slots);
+    stripe->slots    = grown.slots;
+    stripe->capacity = grown.capacity;
+}
+
+
+/** The cost and median of a triple in a lazy matrix, computed now if they have not been before. */
+static void
+cm_lookup_3d_lazy ( const cost_matrices_3d_t *matrix
+                  ,       elem_t              a
+                  ,       elem_t              b
+                  ,       elem_t              c
+                  ,       unsigned int       *cost
+                  ,       elem_t             *median
+                  )
+{
+    struct cost_memo_3d_t *lazy     = matrix->lazy;
+    const size_t           alphSize = matrix->alphSize;
+
+    // As for a dense matrix. Without asserts, an empty element has no median, and is not stored:
+    // an empty a would read as an empty slot of the hash table.
+    assert(a > 0 && "Cannot have an empty element!");
+    assert(b > 0 && "Cannot have an empty element!");
+    assert(c > 0 && "Cannot have an empty element!");
+    if (a == 0 || b == 0 || c == 0) {
+        *cost   = UINT_MAX;
+        *median = 0;
+        return;
+    }
+
+    // Nonzero, so __builtin_ctz is defined, and with one bit each.
+    if ((a & (a - 1)) == 0 && (b & (b - 1)) == 0 && (c & (c - 1)) == 0) {
+        const size_t index = ((size_t) __builtin_ctz(a) * alphSize + __builtin_ctz(b)) * alphSize + __builtin_ctz(c);
+        *cost   = lazy->coreCost[index];
+        *median = lazy->coreMedian[index];
+        return;
+    }
+
+    const uint64_t    hash   = cm_hash_3d_lazy(a, b, c);
+    lazy_3d_stripe_t *stripe = lazy->stripes + hash % LAZY_3D_STRIPES;
+
+    cm_lock_3d_lazy( stripe );
+    const lazy_3d_entry_t *found = stripe->capacity ? cm_probe_3d_lazy( stripe, hash, a, b, c ) : NULL;
+    if (found != NULL && found->a != 0) {
+        *cost   = found->cost;
+        *median = found->median;
+        cm_unlock_3d_lazy( stripe );
+        lazyHits++;
+        return;
+    }
+    cm_unlock_3d_lazy( stripe );
+
+    // Computed unlocked, so that lookups of other triples of the stripe do not wait for it.
+    lazy_3d_entry_t computed = { .a = a, .b = b, .c = c };
+    cm_calc_3d_lazy( lazy->tcm, alphSize, a, b, c, &computed.cost, &computed.median );
+    *cost   = computed.cost;
+    *median = computed.median;
+    lazyMisses++;
+
+    // Another thread may have stored the triple meanwhile, with the same cost and median.
+    cm_lock_3d_lazy( stripe );
+    lazy_3d_entry_t *slot = stripe->capacity ? cm_probe_3d_lazy( stripe, hash, a, b, c ) : NULL;
+    if (slot == NULL || slot->a == 0) {
+        if (2 * (stripe->count + 1) > stripe->capacity) {
+            cm_grow_3d_lazy( stripe );
+            slot = cm_probe_3d_lazy( stripe, hash, a, b, c );
+        }
+        *slot = computed;
+        stripe->count++;
+    }
+    cm_unlock_3d_lazy( stripe );
+}
+
+
+void
+cm_alloc_3d_lazy ( cost_matrices_3d_t *res
+                 , size_t              alphSize
+                 , int                 do_aff
+                 , unsigned int        gap_open
+                 , const unsigned int *tcm
+                 )
+{
+    assert( alphSize > 0 && alphSize < sizeof(elem_t) * CHAR_BIT && "Alphabet too large for elem_t." );
+
+    res->alphSize            = alphSize;
+    res->costMatrixDimension = cm_combinations_of_alphabet (alphSize);
+    res->gap_char            = 1 << (alphSize - 1);
+    res->include_ambiguities = 1;
+    res->num_elements        = (1 << alphSize) - 1;
+    res->cost                = NULL;
+    res->median              = NULL;
+    cm_set_affine_3d (res, do_aff, gap_open);
+
+    struct cost_memo_3d_t *lazy = calloc( 1, sizeof(struct cost_memo_3d_t) );
+    const size_t           core = alphSize * alphSize * alphSize;
+    assert( lazy != NULL && "Memory error during cost matrix allocation." );
+
+    lazy->tcm        = malloc( alphSize * alphSize * sizeof(unsigned int) );
+    lazy->coreCost   = malloc( core * sizeof(unsigned int) );
+    lazy->coreMedian = malloc( core * sizeof(elem_t) );
+    assert(   lazy->tcm        != NULL
+           && lazy->coreCost   != NULL
+           && lazy->coreMedian != NULL
+           && "Memory error during cost matrix allocation." );
+
+    memcpy( lazy->tcm, tcm, alphSize * alphSize * sizeof(unsigned int) );
+    for (size_t i = 0; i < LAZY_3D_STRIPES; i++) atomic_flag_clear( &lazy->stripes[i].lock );
+
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            for (size_t k = 0; k < alphSize; k++) {
+                const size_t index = (i * alphSize + j) * alphSize + k;
+                cm_calc_3d_lazy( lazy->tcm, alphSize, 1 << i, 1 << j, 1 << k, lazy->coreCost + index, lazy->coreMedian + index );
+            }
+        }
+    }
+    res->lazy = lazy;
+}
+
+
+void
+cm_free_3d_lazy (cost_matrices_3d_t *res)
+{
+    struct cost_memo_3d_t *lazy = res->lazy;
+    if (lazy == NULL) return;
+
+    for (size_t i = 0; i < LAZY_3D_STRIPES; i++) free(lazy->stripes[i].slots);
+    free(lazy->tcm);
+    free(lazy->coreCost);
+    free(lazy->coreMedian);
+    free(lazy);
+    res->lazy = NULL;
+}
+
+
+size_t
+cm_count_3d_lazy (const cost_matrices_3d_t *res)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < LAZY_3D_STRIPES; i++) {
+        lazy_3d_stripe_t *stripe = res->lazy->stripes + i;
+        cm_lock_3d_lazy( stripe );
+        count += stripe->count;
+        cm_unlock_3d_lazy( stripe );
+    }
+    return count;
+}
+
+
+void
+cm_lazy_3d_lookups (size_t *hits, size_t *misses)
+{
+    *hits   = lazyHits;
+    *misses = lazyMisses;
+}
+
+
 elem_t
 cm_get_median_3d( const cost_matrices_3d_t *matrix
                 ,       elem_t              a
@@ -483,6 +885,15 @@ cm_get_median_3d( const cost_matrices_3d_t *matrix
                 )
 {
     unsigned int upperBound = ((elem_t) 1) << matrix->alphSize;
+
+    if (matrix->lazy != NULL) {
+        assert( upperBound > a && upperBound > b && upperBound > c && "Element has a larger than allowed value." );
+        unsigned int cost;
+        elem_t       median;
+        cm_lookup_3d_lazy( matrix, a, b, c, &cost, &median );
+        return median;
+    }
+
     if (DEBUG_3D) printf( "alphSize: %zu, upperBound: %2u;  elements a: %2u, b: %2u, c: %2u;  median: %2u\n"
                         , matrix->alphSize
                         , upperBound
@@ -547,6 +958,12 @@ cm_get_cost_3d ( const cost_matrices_3d_t *costMtx
                ,       elem_t              elem3
                )
 {
+    if (costMtx->lazy != NULL) {
+        unsigned int cost;
+        elem_t       median;
+        cm_lookup_3d_lazy( costMtx, elem1, elem2, elem3, &cost, &median );
+        return cost;
+    }
     return cm_get_value_3d (costMtx->cost, elem1, elem2, elem3, costMtx->alphSize);
 }
 
@@ -28,6 +28,20 @@
 //#include "alignmentMatrices.h"
 #include "dyn_character.h"
 
+/** The structure of a TCM, as TCMStructure in Data.TCM, and in the same order.
+ *  Each is more restrictive than those before it, except that an ultrametric
+ *  TCM need not be additive. Fill kernels may use it to replace table lookups.
+ */
+typedef enum tcm_structure_t {
+    TCM_NON_SYMMETRIC = 0,
+    TCM_SYMMETRIC     = 1,
+    TCM_METRIC        = 2,
+    TCM_ULTRAMETRIC   = 3,
+    TCM_ADDITIVE      = 4,
+    TCM_NON_ADDITIVE  = 5  /** Every substitution and indel costs the same. */
+} tcm_structure_t;
+
+
 /*
  * Check cost_matrices_3d for further information. This is the corresponding data
  * structure for two dimensional character alignment.
@@ -59,6 +73,12 @@ typedef struct cost_matrices_2d_t {
                                  *
                                  * -- MISSING IN 3D
                                  */
+    int tcm_structure;          /* The most restrictive tcm_structure_t of the TCM, divided
+                                 * by tcm_factor. Set by setUp2dCostMtx(); see cm_diagnose_tcm().
+                                 *
+                                 * -- MISSING IN 3D
+                                 */
+    unsigned int tcm_factor;    /* The greatest common divisor of the TCM's costs, or 1. */
     size_t num_elements;        /** total number of elements. This is alphSize if we're using only unambiguous elems,
                                  *  otherwise |power set|
                                  */
@@ -127,9 +147,20 @@ typedef struct cost_matrices_3d_t {
                                   *  alphabet. The best possible medians according to the cost
                                   *  matrix.
                                   */
+    struct cost_memo_3d_t *lazy; /** NULL, unless this is a lazy matrix, made by
+                                  *  cm_alloc_3d_lazy(). Then cost and median are NULL, and
+                                  *  this holds the entries computed so far.
+                                  */
 } cost_matrices_3d_t;
 
 
+/** 3D cost matrices for alphabets of more than this many elements, gap included, are lazy.
+ *  A dense matrix has (2 ^ alphSize)^3 entries: for eight elements 2^24, of 8 bytes each,
+ *  each the minimum over the alphabet of three ambiguous distances.
+ */
+#define CM_3D_DENSE_MAX_ALPHABET 6
+
+
 void cm_print_2d (cost_matrices_2d_t *c);
 
 
@@ -157,6 +188,17 @@ void cm_alloc_2d ( cost_matrices_2d_t *res
                  );
 
 
+/** The structure of the alphSize x alphSize matrix tcm, once divided by the
+ *  greatest common divisor of its costs, which is written to factor; diagnosed
+ *  as diagnoseTcm in Data.TCM does.
+ */
+tcm_structure_t
+cm_diagnose_tcm ( const unsigned int *tcm
+                , size_t              alphSize
+                ,       unsigned int *factor
+                );
+
+
 void
 cm_set_cost_2d (cost_matrices_2d_t *costMtx, elem_t elem1, elem_t elem2, unsigned int v);
 
@@ -294,6 +336,47 @@ cm_alloc_3d ( cost_matrices_3d_t *res
             , int                 all_elements
             );
 
+/** A 3D cost matrix that computes its entries when they are first looked up, rather than
+ *  all at once, for alphabets too large for a dense matrix.
+ *
+ *  The entries for unambiguous triples, alphSize^3 of them, are computed here. Those for
+ *  ambiguous ones are computed by cm_get_cost_3d() and cm_get_median_3d() as they are asked
+ *  for, and kept; so the memory held grows with the triples actually aligned. Lookups may
+ *  be made from several threads at once; each computes an entry without holding a lock.
+ *
+ *  An empty element, 0, is an assertion failure; without asserts, it costs UINT_MAX, has the
+ *  median 0, and is not kept.
+ *
+ *  tcm is the alphSize x alphSize matrix given to setUp3dCostMtx(), and is copied. As there,
+ *  it must be symmetric.
+ */
+void
+cm_alloc_3d_lazy ( cost_matrices_3d_t *res
+                 , size_t              alphSize
+                 , int                 do_aff
+                 , unsigned int        gap_open
+                 , const unsigned int *tcm
+                 );
+
+
+/** Free what cm_alloc_3d_lazy() allocated, but not res itself. */
+void
+cm_free_3d_lazy (cost_matrices_3d_t *res);
+
+
+/** The number of ambiguous triples a lazy matrix has computed so far. */
+size_t
+cm_count_3d_lazy (const cost_matrices_3d_t *res);
+
+
+/** The lookups of ambiguous triples this thread has made in lazy matrices: those that found
+ *  the triple computed already, and those that computed it. Running totals, so the lookups of
+ *  a call are the difference of those before it and after.
+ */
+void
+cm_lazy_3d_lookups (size_t *hits, size_t *misses);
+
+
 /*
  * The median between three alphabet elements a, b and c.
  * @param t is the transformation cost matrix
@@ -0,0 +1,335 @@
+#include <stdatomic.h>
+
+#include "fillRowKernel.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FILL_ROW_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+
+/** Lanes shifted into a scan from before the start of a vector: a cell no path comes from. */
+#define SCAN_INFINITY 0x3FFFFFFF
+
+
+/************************************ Portable kernel ************************************/
+
+static void fillRowScalar(       unsigned int    *curRow
+                         , const unsigned int    *prevRow
+                         , const unsigned int    *gap_row
+                         , const unsigned int    *align_row
+                         ,       DIR_MTX_ARROW_t *dirVect
+                         ,       unsigned int     c
+                         ,       size_t           startIndex
+                         ,       size_t           finalIndex
+                         )
+{
+    for (size_t i = startIndex; i <= finalIndex; i++) {
+        const unsigned int upwardCost   = prevRow[i    ] + c,
+                           leftwardCost = curRow[i - 1] + gap_row[i],
+                           diagonalCost = prevRow[i - 1] + align_row[i];
+
+        unsigned int minCost = diagonalCost < upwardCost ? diagonalCost : upwardCost;
+        if (leftwardCost < minCost) minCost = leftwardCost;
+
+        curRow[i] = minCost;
+        if (dirVect != NULL) {
+            dirVect[i] = (diagonalCost == minCost ? ALIGN  : 0)
+                       | (leftwardCost == minCost ? INSERT : 0)
+                       | (upwardCost   == minCost ? DELETE : 0);
+        }
+    }
+}
+
+
+/** The nibble of a cell outside [first, last] is packed as 0; its direction is never read. */
+static void packRowScalar(       unsigned char   *row
+                         , const DIR_MTX_ARROW_t *dirVect
+                         ,       size_t           first
+                         ,       size_t           last
+                         )
+{
+    for (size_t i = first & ~(size_t) 1; i <= last; i += 2) {
+        const unsigned int low  = i     >= first ? dirVect[i]     : 0,
+                           high = i + 1 <= last  ? dirVect[i + 1] : 0;
+        row[i >> 1] = (unsigned char) (low | (high << 4));
+    }
+}
+
+
+#ifdef FILL_ROW_KERNEL_X86
+
+/************************************ SSE4.1 kernel ************************************/
+
+__attribute__((target("sse4.1")))
+static void fillRowSSE41(       unsigned int    *curRow
+                        , const unsigned int    *prevRow
+                        , const unsigned int    *gap_row
+                        , const unsigned int    *align_row
+                        ,       DIR_MTX_ARROW_t *dirVect
+                        ,       unsigned int     c
+                        ,       size_t           startIndex
+                        ,       size_t           finalIndex
+                        )
+{
+    const __m128i deletion  = _mm_set1_epi32( (int) c ),
+                  infinity  = _mm_set1_epi32( SCAN_INFINITY ),
+                  alignBit  = _mm_set1_epi32( ALIGN  ),
+                  insertBit = _mm_set1_epi32( INSERT ),
+                  deleteBit = _mm_set1_epi32( DELETE );
+
+    size_t i = startIndex;
+    int carry = (int) curRow[i - 1];
+    for (; i + 3 <= finalIndex; i += 4) {
+        const __m128i up   = _mm_add_epi32( _mm_loadu_si128( (const __m128i *) (prevRow + i) ), deletion ),
+                      diag = _mm_add_epi32( _mm_loadu_si128( (const __m128i *) (prevRow + i - 1) )
+                                          , _mm_loadu_si128( (const __m128i *) (align_row + i) ) ),
+                      gap  = _mm_loadu_si128( (const __m128i *) (gap_row + i) );
+
+        // Scan of the insertions within the vector.
+        __m128i scanCost = _mm_min_epi32( up, diag ),
+                scanGap  = gap;
+        scanCost = _mm_min_epi32( scanCost, _mm_add_epi32( _mm_alignr_epi8( scanCost, infinity, 12 ), scanGap ) );
+        scanGap  = _mm_add_epi32( scanGap, _mm_slli_si128( scanGap, 4 ) );
+        scanCost = _mm_min_epi32( scanCost, _mm_add_epi32( _mm_alignr_epi8( scanCost, infinity, 8 ), scanGap ) );
+        scanGap  = _mm_add_epi32( scanGap, _mm_slli_si128( scanGap, 8 ) );
+
+        const __m128i carried = _mm_set1_epi32( carry ),
+                      cost    = _mm_min_epi32( scanCost, _mm_add_epi32( carried, scanGap ) );
+
+        _mm_storeu_si128( (__m128i *) (curRow + i), cost );
+        if (dirVect != NULL) {
+            const __m128i left = _mm_add_epi32( _mm_alignr_epi8( cost, carried, 12 ), gap ),
+                          dir  = _mm_or_si128( _mm_and_si128( _mm_cmpeq_epi32( diag, cost ), alignBit )
+                                             , _mm_or_si128( _mm_and_si128( _mm_cmpeq_epi32( left, cost ), insertBit )
+                                                           , _mm_and_si128( _mm_cmpeq_epi32( up,   cost ), deleteBit ) ) );
+            _mm_storel_epi64( (__m128i *) (dirVect + i), _mm_packus_epi32( dir, dir ) );
+        }
+        carry = _mm_extract_epi32( cost, 3 );
+    }
+    if (i <= finalIndex) {
+        fillRowScalar( curRow, prevRow, gap_row, align_row, dirVect, c, i, finalIndex );
+    }
+}
+
+
+/** Narrow sixteen cells to bytes, then shift each odd byte into the high nibble of the even one before it. */
+__attribute__((target("sse4.1")))
+static void packRowSSE41(       unsigned char   *row
+                        , const DIR_MTX_ARROW_t *dirVect
+                        ,       size_t           first
+                        ,       size_t           last
+                        )
+{
+    const __m128i evenBytes = _mm_set1_epi16( 0x00FF );
+
+    size_t i = first;
+    if (i & 1) {
+        packRowScalar( row, dirVect, i, i );
+        i++;
+    }
+    for (; i + 15 <= last; i += 16) {
+        const __m128i cells = _mm_packus_epi16( _mm_loadu_si128( (const __m128i *) (dirVect + i) )
+                                              , _mm_loadu_si128( (const __m128i *) (dirVect + i + 8) ) ),
+                      pairs = _mm_or_si128( _mm_and_si128( cells, evenBytes ), _mm_slli_epi16( _mm_srli_epi16( cells, 8 ), 4 ) );
+        _mm_storel_epi64( (__m128i *) (row + (i >> 1)), _mm_packus_epi16( pairs, pairs ) );
+    }
+    if (i <= last) {
+        packRowScalar( row, dirVect, i, last );
+    }
+}
+
+
+/************************************ AVX2 kernel ************************************/
+
+/** Shift the lanes of x up by k, filling the lowest k from fill. */
+#define SHIFT_LANES_AVX2(x, fill, k, index) \
+    _mm256_blend_epi32( _mm256_permutevar8x32_epi32( x, index ), fill, (1 << (k)) - 1 )
+
+__attribute__((target("avx2")))
+static void fillRowAVX2(       unsigned int    *curRow
+                       , const unsigned int    *prevRow
+                       , const unsigned int    *gap_row
+                       , const unsigned int    *align_row
+                       ,       DIR_MTX_ARROW_t *dirVect
+                       ,       unsigned int     c
+                       ,       size_t           startIndex
+                       ,       size_t           finalIndex
+                       )
+{
+    const __m256i deletion  = _mm256_set1_epi32( (int) c ),
+                  infinity  = _mm256_set1_epi32( SCAN_INFINITY ),
+                  zero      = _mm256_setzero_si256(),
+                  alignBit  = _mm256_set1_epi32( ALIGN  ),
+                  insertBit = _mm256_set1_epi32( INSERT ),
+                  deleteBit = _mm256_set1_epi32( DELETE ),
+                  shift1    = _mm256_setr_epi32( 0, 0, 1, 2, 3, 4, 5, 6 ),
+                  shift2    = _mm256_setr_epi32( 0, 0, 0, 1, 2, 3, 4, 5 ),
+                  shift4    = _mm256_setr_epi32( 0, 0, 0, 0, 0, 1, 2, 3 );
+
+    size_t i = startIndex;
+    int carry = (int) curRow[i - 1];
+    for (; i + 7 <= finalIndex; i += 8) {
+        const __m256i up   = _mm256_add_epi32( _mm256_loadu_si256( (const __m256i *) (prevRow + i) ), deletion ),
+                      diag = _mm256_add_epi32( _mm256_loadu_si256( (const __m256i *) (prevRow + i - 1) )
+                                             , _mm256_loadu_si256( (const __m256i *) (align_row + i) ) ),
+                      gap  = _mm256_loadu_si256( (const __m256i *) (gap_row + i) );
+
+        __m256i scanCost = _mm256_min_epi32( up, diag ),
+                scanGap  = gap;
+        scanCost = _mm256_min_epi32( scanCost, _mm256_add_epi32( SHIFT_LANES_AVX2( scanCost, infinity, 1, shift1 ), scanGap ) );
+        scanGap  = _mm256_add_epi32( scanGap, SHIFT_LANES_AVX2( scanGap, zero, 1, shift1 ) );
+        scanCost = _mm256_min_epi32( scanCost, _mm256_add_epi32( SHIFT_LANES_AVX2( scanCost, infinity, 2, shift2 ), scanGap ) );
+        scanGap  = _mm256_add_epi32( scanGap, SHIFT_LANES_AVX2( scanGap, zero, 2, shift2 ) );
+        scanCost = _mm256_min_epi32( scanCost, _mm256_add_epi32( SHIFT_LANES_AVX2( scanCost, infinity, 4, shift4 ), scanGap ) );
+        scanGap  = _mm256_add_epi32( scanGap, SHIFT_LANES_AVX2( scanGap, zero, 4, shift4 ) );
+
+        const __m256i carried = _mm256_set1_epi32( carry ),
+                      cost    = _mm256_min_epi32( scanCost, _mm256_add_epi32( carried, scanGap ) );
+
+        _mm256_storeu_si256( (__m256i *) (curRow + i), cost );
+        if (dirVect != NULL) {
+            const __m256i left = _mm256_add_epi32( SHIFT_LANES_AVX2( cost, carried, 1, shift1 ), gap ),
+                          dir  = _mm256_or_si256( _mm256_and_si256( _mm256_cmpeq_epi32( diag, cost ), alignBit )
+                                                , _mm256_or_si256( _mm256_and_si256( _mm256_cmpeq_epi32( left, cost ), insertBit )
+                                                                 , _mm256_and_si256( _mm256_cmpeq_epi32( up,   cost ), deleteBit ) ) );
+            _mm_storeu_si128( (__m128i *) (dirVect + i)
+                            , _mm_packus_epi32( _mm256_castsi256_si128( dir ), _mm256_extracti128_si256( dir, 1 ) ) );
+        }
+        carry = _mm256_extract_epi32( cost, 7 );
+    }
+    if (i <= finalIndex) {
+        fillRowScalar( curRow, prevRow, gap_row, align_row, dirVect, c, i, finalIndex );
+    }
+}
+
+
+/** As packRowSSE41(), thirty-two cells at a time. _mm256_packus_epi16() packs within 128-bit lanes, so the
+ *  bytes are put back in order before they are paired. The AVX-512 kernel uses this too.
+ */
+__attribute__((target("avx2")))
+static void packRowAVX2(       unsigned char   *row
+                       , const DIR_MTX_ARROW_t *dirVect
+                       ,       size_t           first
+                       ,       size_t           last
+                       )
+{
+    const __m256i evenBytes = _mm256_set1_epi16( 0x00FF );
+
+    size_t i = first;
+    if (i & 1) {
+        packRowScalar( row, dirVect, i, i );
+        i++;
+    }
+    for (; i + 31 <= last; i += 32) {
+        const __m256i cells = _mm256_permute4x64_epi64( _mm256_packus_epi16( _mm256_loadu_si256( (const __m256i *) (dirVect + i) )
+                                                                           , _mm256_loadu_si256( (const __m256i *) (dirVect + i + 16) ) )
+                                                      , 0xD8 ),
+                      pairs = _mm256_or_si256( _mm256_and_si256( cells, evenBytes )
+                                             , _mm256_slli_epi16( _mm256_srli_epi16( cells, 8 ), 4 ) );
+        _mm_storeu_si128( (__m128i *) (row + (i >> 1))
+                        , _mm_packus_epi16( _mm256_castsi256_si128( pairs ), _mm256_extracti128_si256( pairs, 1 ) ) );
+    }
+    if (i <= last) {
+        packRowSSE41( row, dirVect, i, last );
+    }
+}
+
+
+/************************************ AVX-512 kernel ************************************/
+
+__attribute__((target("avx512f")))
+static void fillRowAVX512(       unsigned int    *curRow
+                         , const unsigned int    *prevRow
+                         , const unsigned int    *gap_row
+                         , const unsigned int    *align_row
+                         ,       DIR_MTX_ARROW_t *dirVect
+                         ,       unsigned int     c
+                         ,       size_t           startIndex
+                         ,       size_t           finalIndex
+                         )
+{
+    const __m512i deletion  = _mm512_set1_epi32( (int) c ),
+                  infinity  = _mm512_set1_epi32( SCAN_INFINITY ),
+                  zero      = _mm512_setzero_si512(),
+                  alignBit  = _mm512_set1_epi32( ALIGN  ),
+                  insertBit = _mm512_set1_epi32( INSERT ),
+                  deleteBit = _mm512_set1_epi32( DELETE );
+
+    size_t i = startIndex;
+    int carry = (int) curRow[i - 1];
+    for (; i + 15 <= finalIndex; i += 16) {
+        const __m512i up   = _mm512_add_epi32( _mm512_loadu_si512( prevRow + i ), deletion ),
+                      diag = _mm512_add_epi32( _mm512_loadu_si512( prevRow + i - 1 ), _mm512_loadu_si512( align_row + i ) ),
+                      gap  = _mm512_loadu_si512( gap_row + i );
+
+        // _mm512_alignr_epi32( x, fill, 16 - k ) shifts the lanes of x up by k, filling the lowest k from fill.
+        __m512i scanCost = _mm512_min_epi32( up, diag ),
+                scanGap  = gap;
+        scanCost = _mm512_min_epi32( scanCost, _mm512_add_epi32( _mm512_alignr_epi32( scanCost, infinity, 15 ), scanGap ) );
+        scanGap  = _mm512_add_epi32( scanGap, _mm512_alignr_epi32( scanGap, zero, 15 ) );
+        scanCost = _mm512_min_epi32( scanCost, _mm512_add_epi32( _mm512_alignr_epi32( scanCost, infinity, 14 ), scanGap ) );
+        scanGap  = _mm512_add_epi32( scanGap, _mm512_alignr_epi32( scanGap, zero, 14 ) );
+        scanCost = _mm512_min_epi32( scanCost, _mm512_add_epi32( _mm512_alignr_epi32( scanCost, infinity, 12 ), scanGap ) );
+        scanGap  = _mm512_add_epi32( scanGap, _mm512_alignr_epi32( scanGap, zero, 12 ) );
+        scanCost = _mm512_min_epi32( scanCost, _mm512_add_epi32( _mm512_alignr_epi32( scanCost, infinity, 8 ), scanGap ) );
+        scanGap  = _mm512_add_epi32( scanGap, _mm512_alignr_epi32( scanGap, zero, 8 ) );
+
+        const __m512i carried = _mm512_set1_epi32( carry ),
+                      cost    = _mm512_min_epi32( scanCost, _mm512_add_epi32( carried, scanGap ) );
+
+        _mm512_storeu_si512( curRow + i, cost );
+        if (dirVect != NULL) {
+            const __m512i left = _mm512_add_epi32( _mm512_alignr_epi32( cost, carried, 15 ), gap );
+            __m512i dir = _mm512_maskz_mov_epi32( _mm512_cmpeq_epi32_mask( diag, cost ), alignBit );
+            dir = _mm512_mask_or_epi32( dir, _mm512_cmpeq_epi32_mask( left, cost ), dir, insertBit );
+            dir = _mm512_mask_or_epi32( dir, _mm512_cmpeq_epi32_mask( up,   cost ), dir, deleteBit );
+            _mm256_storeu_si256( (__m256i *) (dirVect + i), _mm512_cvtepi32_epi16( dir ) );
+        }
+        carry = _mm_extract_epi32( _mm512_extracti32x4_epi32( cost, 3 ), 3 );
+    }
+    if (i <= finalIndex) {
+        fillRowScalar( curRow, prevRow, gap_row, align_row, dirVect, c, i, finalIndex );
+    }
+}
+
+#endif // FILL_ROW_KERNEL_X86
+
+
+/************************************ Dispatch ************************************/
+
+static const fill_row_kernel_t scalarKernel = { "scalar",  fillRowScalar, packRowScalar };
+#ifdef FILL_ROW_KERNEL_X86
+static const fill_row_kernel_t sse41Kernel  = { "SSE4.1",  fillRowSSE41,  packRowSSE41  };
+static const fill_row_kernel_t avx2Kernel   = { "AVX2",    fillRowAVX2,   packRowAVX2   };
+static const fill_row_kernel_t avx512Kernel = { "AVX-512", fillRowAVX512, packRowAVX2   };
+#endif
+
+
+size_t algn_fill_row_kernels( const fill_row_kernel_t *kernels[] )
+{
+    size_t count = 0;
+    kernels[count++] = &scalarKernel;
+#ifdef FILL_ROW_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))  kernels[count++] = &sse41Kernel;
+    if (__builtin_cpu_supports("avx2"))    kernels[count++] = &avx2Kernel;
+    if (__builtin_cpu_supports("avx512f")) kernels[count++] = &avx512Kernel;
+#endif
+    return count;
+}
+
+
+const fill_row_kernel_t *algn_fill_row_kernel( void )
+{
+    // Every thread chooses the same kernel, so a race to store it is harmless.
+    static _Atomic(const fill_row_kernel_t *) chosen = NULL;
+
+    const fill_row_kernel_t *kernel = atomic_load_explicit( &chosen, memory_order_relaxed );
+    if (kernel == NULL) {
+        const fill_row_kernel_t *kernels[FILL_ROW_KERNEL_COUNT];
+        kernel = kernels[algn_fill_row_kernels( kernels ) - 1];
+        atomic_store_explicit( &chosen, kernel, memory_order_relaxed );
+    }
+    return kernel;
+}
@@ -0,0 +1,82 @@
+/** Vectorized kernels for filling one row of a 2D, non-affine alignment matrix.
+ *
+ *  Each cell of a row is the minimum of three moves: down from the cell above
+ *  (DELETE), diagonally from the cell above and to the left (ALIGN), and right
+ *  from the cell to its left (INSERT). The first two depend only on the row above,
+ *  and are computed a vector at a time. The third makes each cell depend on the
+ *  one before it; it is resolved with a prefix scan over the vector: the function
+ *  x -> min(t, x + gap) of each cell composes with that of the next as
+ *
+ *      (t1, g1) then (t2, g2)  =  (min(t2, t1 + g2), g1 + g2)
+ *
+ *  so log2(width) shift-and-combine steps give every lane its cost from the last
+ *  cell of the previous vector. The direction bits are then every move that
+ *  reaches the minimum, exactly as in the scalar loop.
+ *
+ *  Kernels are provided as portable scalar code and, on x86-64, as SSE4.1, AVX2
+ *  and AVX-512 code. The best kernel the running CPU supports is chosen once, at
+ *  first use, so no special compiler flags are needed.
+ *
+ *  Costs are compared as signed ints in the vector kernels, as they were in the
+ *  assembler loop these replace, so they must stay below INT_MAX / 2.
+ */
+
+#ifndef FILL_ROW_KERNEL_H
+#define FILL_ROW_KERNEL_H
+
+#include <stddef.h>
+
+#include "alignmentMatrices.h"
+
+
+typedef struct fill_row_kernel_t {
+
+    /** For benchmarks and diagnostics. */
+    const char *name;
+
+    /** Fill curRow[i] and dirVect[i] for startIndex <= i <= finalIndex.
+     *
+     *  curRow[startIndex - 1] must already be filled; prevRow is the row above.
+     *  gap_row[i] is the cost of an insertion into cell i, align_row[i] that of
+     *  aligning into it, and c that of a deletion into any cell of the row.
+     *  dirVect may be NULL, to fill only the costs.
+     *  Requires 1 <= startIndex <= finalIndex.
+     */
+    void (*fill)(       unsigned int    *curRow
+                , const unsigned int    *prevRow
+                , const unsigned int    *gap_row
+                , const unsigned int    *align_row
+                ,       DIR_MTX_ARROW_t *dirVect
+                ,       unsigned int     c
+                ,       size_t           startIndex
+                ,       size_t           finalIndex
+                );
+
+    /** Pack dirVect[i] for first <= i <= last into row, two cells to a byte as
+     *  in packed_dir_mtx_t: cell i goes to row[i / 2]. Whole bytes are written,
+     *  and the nibble of the cell before first, or after last, in them is 0:
+     *  those cells of dirVect are never read.
+     */
+    void (*pack)(       unsigned char   *row
+                , const DIR_MTX_ARROW_t *dirVect
+                ,       size_t           first
+                ,       size_t           last
+                );
+
+} fill_row_kernel_t;
+
+
+/** The fastest kernel supported by this CPU. */
+const fill_row_kernel_t *algn_fill_row_kernel( void );
+
+
+/** Write every kernel supported by this CPU, scalar first, into kernels, and
+ *  return their number. At most FILL_ROW_KERNEL_COUNT are written.
+ *  For tests and benchmarks.
+ */
+size_t algn_fill_row_kernels( const fill_row_kernel_t *kernels[] );
+
+#define FILL_ROW_KERNEL_COUNT 4
+
+
+#endif // FILL_ROW_KERNEL_H
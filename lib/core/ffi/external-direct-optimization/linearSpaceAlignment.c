@@ -0,0 +1,815 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#include "alignCharacters.h"
+#include "alignmentMatrices.h"
+#include "costMatrix.h"
+#include "dyn_character.h"
+#include "linearSpaceAlignment.h"
+
+
+/** Subproblems of at most this many cells are aligned directly, with a direction matrix.
+ *  Tests define it smaller, to exercise the divide and conquer on short characters.
+ */
+#ifndef LINEAR_SPACE_BLOCK
+#define LINEAR_SPACE_BLOCK 65536
+#endif
+
+/** Costs at or above this are unreachable. Half of UINT_MAX, so adding a cost to it cannot overflow. */
+#define UNREACHABLE (UINT_MAX / 2)
+
+
+static inline unsigned int
+plus (unsigned int cost, unsigned int step)
+{
+    return cost >= UNREACHABLE ? UNREACHABLE : cost + step;
+}
+
+
+static void *
+checked_malloc (size_t count, size_t size)
+{
+    void *result = malloc(count * size);
+    assert( result != NULL && "OOM: can't allocate linear-space alignment buffers." );
+    return result;
+}
+
+
+/******************************************************************************/
+/*                      Non-affine alignment (Hirschberg)                     */
+/******************************************************************************/
+/*
+ * Rows are elements of the longer character, columns those of the shorter, as
+ * in algn_fill_plane(). Both exclude the leading gap here, so the subproblem
+ * [r0, r1) x [c0, c1) aligns longer[r0 .. r1 - 1] with shorter[c0 .. c1 - 1].
+ */
+
+typedef struct linear_2d_t {
+    const elem_t             *longer;
+    const elem_t             *shorter;
+    const cost_matrices_2d_t *costMatrix;
+          unsigned int       *deleteCost;    /** Cost of each element of longer against a gap. */
+          unsigned int       *insertCost;    /** Cost of a gap against each element of shorter. */
+          unsigned int       *forward;       /** One row of costs, from the top left corner. */
+          unsigned int       *reverse;       /** One row of costs, to the bottom right corner. */
+          DIR_MTX_ARROW_t    *block;         /** Direction matrix of a directly aligned subproblem. */
+          DIR_MTX_ARROW_t    *moves;         /** The alignment so far, last move first. */
+          size_t              moveCount;
+} linear_2d_t;
+
+
+/** Costs of aligning longer[r0 .. r1 - 1] with each prefix of shorter[c0 .. c1 - 1]. */
+static void
+linear_2d_forward ( const linear_2d_t  *w
+                  ,       size_t        r0
+                  ,       size_t        r1
+                  ,       size_t        c0
+                  ,       size_t        c1
+                  ,       unsigned int *row
+                  )
+{
+    const size_t        width       = c1 - c0;
+    const elem_t       *shorter     = w->shorter    + c0;
+    const unsigned int *insert_cost = w->insertCost + c0;
+
+    row[0] = 0;
+    for (size_t j = 1; j <= width; j++) {
+        row[j] = row[j - 1] + insert_cost[j - 1];
+    }
+    for (size_t i = r0; i < r1; i++) {
+        const unsigned int *align_row   = cm_get_row( w->costMatrix->cost, w->longer[i], w->costMatrix->alphSize );
+        const unsigned int  delete_cost = w->deleteCost[i];
+              unsigned int  diagonal    = row[0];
+
+        row[0] += delete_cost;
+        for (size_t j = 1; j <= width; j++) {
+            const unsigned int upward   = row[j]     + delete_cost,
+                               leftward = row[j - 1] + insert_cost[j - 1],
+                               aligned  = diagonal   + align_row[shorter[j - 1]];
+            diagonal = row[j];
+            row[j]   = aligned <= upward ? aligned : upward;
+            if (leftward < row[j]) row[j] = leftward;
+        }
+    }
+}
+
+
+/** Costs of aligning longer[r0 .. r1 - 1] with each suffix of shorter[c0 .. c1 - 1]. */
+static void
+linear_2d_reverse ( const linear_2d_t  *w
+                  ,       size_t        r0
+                  ,       size_t        r1
+                  ,       size_t        c0
+                  ,       size_t        c1
+                  ,       unsigned int *row
+                  )
+{
+    const size_t        width       = c1 - c0;
+    const elem_t       *shorter     = w->shorter    + c0;
+    const unsigned int *insert_cost = w->insertCost + c0;
+
+    row[width] = 0;
+    for (size_t j = width; j-- > 0; ) {
+        row[j] = row[j + 1] + insert_cost[j];
+    }
+    for (size_t i = r1; i-- > r0; ) {
+        const unsigned int *align_row   = cm_get_row( w->costMatrix->cost, w->longer[i], w->costMatrix->alphSize );
+        const unsigned int  delete_cost = w->deleteCost[i];
+              unsigned int  diagonal    = row[width];
+
+        row[width] += delete_cost;
+        for (size_t j = width; j-- > 0; ) {
+            const unsigned int upward   = row[j]     + delete_cost,
+                               leftward = row[j + 1] + insert_cost[j],
+                               aligned  = diagonal   + align_row[shorter[j]];
+            diagonal = row[j];
+            row[j]   = aligned <= upward ? aligned : upward;
+            if (leftward < row[j]) row[j] = leftward;
+        }
+    }
+}
+
+
+/** Align a subproblem with a direction matrix, and backtrace it onto the moves.
+ *  Ties are broken as algn_backtrace_2d() breaks them: ALIGN, then DELETE, then INSERT.
+ */
+static void
+linear_2d_direct (       linear_2d_t *w
+                 ,       size_t       r0
+                 ,       size_t       r1
+                 ,       size_t       c0
+                 ,       size_t       c1
+                 )
+{
+    const size_t        rows        = r1 - r0,
+                        width       = c1 - c0,
+                        stride      = width + 1;
+    const elem_t       *shorter     = w->shorter    + c0;
+    const unsigned int *insert_cost = w->insertCost + c0;
+          unsigned int *row         = w->forward;
+          DIR_MTX_ARROW_t *dirMtx   = w->block;
+
+    row[0] = 0;
+    for (size_t j = 1; j <= width; j++) {
+        row[j]    = row[j - 1] + insert_cost[j - 1];
+        dirMtx[j] = INSERT;
+    }
+    for (size_t i = 1; i <= rows; i++) {
+        const unsigned int *align_row   = cm_get_row( w->costMatrix->cost, w->longer[r0 + i - 1], w->costMatrix->alphSize );
+        const unsigned int  delete_cost = w->deleteCost[r0 + i - 1];
+              unsigned int  diagonal    = row[0];
+        DIR_MTX_ARROW_t    *dirRow      = dirMtx + i * stride;
+
+        row[0]   += delete_cost;
+        dirRow[0] = DELETE;
+        for (size_t j = 1; j <= width; j++) {
+            const unsigned int upward   = row[j]     + delete_cost,
+                               leftward = row[j - 1] + insert_cost[j - 1],
+                               aligned  = diagonal   + align_row[shorter[j - 1]];
+            diagonal = row[j];
+            if (aligned <= upward && aligned <= leftward) {
+                row[j]    = aligned;
+                dirRow[j] = ALIGN;
+            } else if (upward <= leftward) {
+                row[j]    = upward;
+                dirRow[j] = DELETE;
+            } else {
+                row[j]    = leftward;
+                dirRow[j] = INSERT;
+            }
+        }
+    }
+
+    for (size_t i = rows, j = width; i > 0 || j > 0; ) {
+        const DIR_MTX_ARROW_t move = dirMtx[i * stride + j];
+        w->moves[w->moveCount++] = move;
+        if (move != INSERT) i--;
+        if (move != DELETE) j--;
+    }
+}
+
+
+static void
+linear_2d_divide (       linear_2d_t *w
+                 ,       size_t       r0
+                 ,       size_t       r1
+                 ,       size_t       c0
+                 ,       size_t       c1
+                 )
+{
+    if (r1 - r0 < 2 || (r1 - r0 + 1) * (c1 - c0 + 1) <= LINEAR_SPACE_BLOCK) {
+        linear_2d_direct( w, r0, r1, c0, c1 );
+        return;
+    }
+
+    const size_t mid = r0 + (r1 - r0) / 2;
+    linear_2d_forward( w, r0,  mid, c0, c1, w->forward );
+    linear_2d_reverse( w, mid, r1,  c0, c1, w->reverse );
+
+    size_t       split = 0;
+    unsigned int best  = w->forward[0] + w->reverse[0];
+    for (size_t k = 1; k <= c1 - c0; k++) {
+        if (w->forward[k] + w->reverse[k] < best) {
+            best  = w->forward[k] + w->reverse[k];
+            split = k;
+        }
+    }
+
+    // Moves are recorded last first, so the lower half goes first.
+    linear_2d_divide( w, mid, r1,  c0 + split, c1         );
+    linear_2d_divide( w, r0,  mid, c0,         c0 + split );
+}
+
+
+unsigned int
+algn_linear_space_2d ( const dyn_character_t    *shorterChar
+                     , const dyn_character_t    *longerChar
+                     ,       dyn_character_t    *ret_longerChar
+                     ,       dyn_character_t    *ret_shorterChar
+                     , const cost_matrices_2d_t *costMatrix
+                     ,       int                 doBacktrace
+                     )
+{
+    const elem_t INDEL_GAP = 0;   // As in algn_backtrace_2d().
+
+    const size_t longerLen  = longerChar->len  - 1,
+                 shorterLen = shorterChar->len - 1;
+
+    assert (longerLen >= shorterLen);
+
+    linear_2d_t w;
+    w.longer     = longerChar->char_begin  + 1;
+    w.shorter    = shorterChar->char_begin + 1;
+    w.costMatrix = costMatrix;
+    w.deleteCost = checked_malloc( longerLen + 1,  sizeof(unsigned int) );
+    w.insertCost = checked_malloc( shorterLen + 1, sizeof(unsigned int) );
+    w.forward    = checked_malloc( shorterLen + 1, sizeof(unsigned int) );
+    w.reverse    = NULL;
+    w.block      = NULL;
+    w.moves      = NULL;
+    w.moveCount  = 0;
+
+    for (size_t i = 0; i < longerLen; i++) {
+        w.deleteCost[i] = cm_calc_cost_2d( costMatrix->cost, w.longer[i], costMatrix->gap_char, costMatrix->alphSize );
+    }
+    for (size_t j = 0; j < shorterLen; j++) {
+        w.insertCost[j] = costMatrix->prepend_cost[w.shorter[j]];
+    }
+
+    linear_2d_forward( &w, 0, longerLen, 0, shorterLen, w.forward );
+    const unsigned int cost = w.forward[shorterLen];
+
+    if (doBacktrace) {
+        const size_t blockSize = 2 * (shorterLen + 1) > LINEAR_SPACE_BLOCK ? 2 * (shorterLen + 1) : LINEAR_SPACE_BLOCK;
+        w.reverse = checked_malloc( shorterLen + 1,          sizeof(unsigned int)    );
+        w.block   = checked_malloc( blockSize,               sizeof(DIR_MTX_ARROW_t) );
+        w.moves   = checked_malloc( longerLen + shorterLen,  sizeof(DIR_MTX_ARROW_t) );
+
+        linear_2d_divide( &w, 0, longerLen, 0, shorterLen );
+
+        size_t idx_longerChar  = longerLen,
+               idx_shorterChar = shorterLen;
+        for (size_t k = 0; k < w.moveCount; k++) {
+            const DIR_MTX_ARROW_t move = w.moves[k];
+            if (move == INSERT) {
+                prepend_an_element(ret_longerChar, INDEL_GAP);
+            } else {
+                prepend_an_element(ret_longerChar, get_elem(longerChar, idx_longerChar));
+                idx_longerChar--;
+            }
+            if (move == DELETE) {
+                prepend_an_element(ret_shorterChar, INDEL_GAP);
+            } else {
+                prepend_an_element(ret_shorterChar, get_elem(shorterChar, idx_shorterChar));
+                idx_shorterChar--;
+            }
+        }
+        assert (idx_longerChar == 0 && idx_shorterChar == 0);
+
+        // The leading gaps, which algn_backtrace_2d() emits from the top left cell.
+        prepend_an_element(ret_longerChar,  get_elem(longerChar,  0));
+        prepend_an_element(ret_shorterChar, get_elem(shorterChar, 0));
+    }
+
+    free(w.deleteCost);
+    free(w.insertCost);
+    free(w.forward);
+    free(w.reverse);
+    free(w.block);
+    free(w.moves);
+
+    return cost;
+}
+
+
+/******************************************************************************/
+/*                    Affine alignment (Myers & Miller)                       */
+/******************************************************************************/
+/*
+ * Rows are elements of the shorter character, columns those of the longer, as
+ * in algn_fill_plane_2d_affine(), and both include the leading gap, so the
+ * subproblem [r0, r1] x [c0, c1] is a rectangle of cells of that plane.
+ *
+ * Each cell has the four states of algn_fill_plane_2d_affine(): a horizontal
+ * gap (extend_horizontal), an alignment (close_block_diagonal), a vertical gap
+ * (extend_vertical) and a gap aligned with a gap (extend_block_diagonal). A
+ * subproblem starts at its top left cell in a given state, or, if it is the
+ * top left of the whole plane, with the initial values set by
+ * algn_initialize_matrices_affine(); it ends at its bottom right cell.
+ *
+ * The gap opening costs there depend on each element's predecessor, so the
+ * recurrence cannot be run backwards from the bottom right corner. Instead of
+ * a reverse pass, the forward pass carries, for each cell and state below the
+ * middle row, the last cell and state at which its optimal path was in the
+ * middle row. That point splits the subproblem in two.
+ */
+
+/** States, in the order in which algn_backtrace_affine() prefers them. */
+enum { STATE_HORIZONTAL, STATE_ALIGN, STATE_VERTICAL, STATE_DIAGONAL, STATE_COUNT };
+
+/** Start state of the subproblem at the top left of the plane. */
+#define STATE_ORIGIN STATE_COUNT
+
+/** End state of a subproblem whose end state is free: the best one is chosen. */
+#define STATE_ANY    STATE_COUNT
+
+typedef struct affine_cell_t {
+    unsigned int cost[STATE_COUNT];
+} affine_cell_t;
+
+typedef struct linear_affine_t {
+    const elem_t             *shortChar;
+    const elem_t             *longerChar;
+    const cost_matrices_2d_t *costMatrix;
+          elem_t              gap_char;
+          elem_t              all_ambiguous;
+          unsigned int        gap_open_cost;
+          /* Per column, as gap_row, gap_open_prec and longerChar_horizontal_extension. */
+          unsigned int       *gap_row;
+          unsigned int       *gap_open_prec;
+          unsigned int       *horizontal_extension;
+          affine_cell_t      *rows[2];
+          size_t             *crossings[2];  /** Per cell and state, the last (column - c0) * STATE_COUNT + state in the middle row. */
+          unsigned char      *preds;         /** Per cell, the predecessor state of each state, two bits each. */
+          unsigned char      *moves;         /** The alignment so far, as the state of each move, last move first. */
+          size_t              moveCount;
+} linear_affine_t;
+
+
+/** Costs of row i that are the same in every column. */
+typedef struct affine_row_t {
+          elem_t        elem;
+          unsigned int  gap_extend_cost;     /** lesserChar_gap_extend_cost */
+          unsigned int  gap_open_cost;       /** lesserChar_gap_open_cost */
+          unsigned int  vertical_extension;  /** shortChar_vertical_extension */
+    const unsigned int *align_row;           /** Cost of the row's element, less any gap, against each element. */
+} affine_row_t;
+
+
+static inline unsigned int
+gap_opening ( elem_t prev, elem_t curr, elem_t gap_char, unsigned int gap_open_cost )
+{
+    // As HAS_GAP_OPENING() in alignCharacters.c.
+    return (!(gap_char & prev) && (gap_char & curr)) ? 0 : gap_open_cost;
+}
+
+
+static affine_row_t
+affine_row ( const linear_affine_t *w, size_t i )
+{
+    const cost_matrices_2d_t *costMatrix = w->costMatrix;
+
+    affine_row_t row;
+    row.elem               = w->shortChar[i];
+    row.gap_extend_cost    = cm_calc_cost_2d( costMatrix->cost, row.elem, w->gap_char, costMatrix->alphSize );
+    row.gap_open_cost      = i > 0 ? gap_opening( w->shortChar[i - 1], row.elem, w->gap_char, w->gap_open_cost ) : 0;
+    row.vertical_extension = (i > 1 && (w->shortChar[i - 1] & w->gap_char) && !(row.elem & w->gap_char))
+                           ? row.gap_open_cost + row.gap_extend_cost
+                           : row.gap_extend_cost;
+    row.align_row          = cm_get_row( costMatrix->cost, row.elem & w->all_ambiguous, costMatrix->alphSize );
+    return row;
+}
+
+
+/** Fill columns c0 through c1 of row i of a subproblem, into cur, from the row above, prev.
+ *
+ *  If prev is NULL, row i is the first row of the subproblem, which starts in state start.
+ *  The predecessor states of each cell are written to preds.
+ */
+static void
+affine_fill_row ( const linear_affine_t *w
+                ,       size_t           i
+                ,       size_t           c0
+                ,       size_t           c1
+                ,       int              start
+                , const affine_cell_t   *prev
+                ,       affine_cell_t   *cur
+                ,       unsigned char   *preds
+                )
+{
+    const size_t        width    = c1 - c0 + 1;
+    const elem_t        gap_char = w->gap_char;
+    const elem_t       *longer   = w->longerChar + c0;
+    const unsigned int *gap_row  = w->gap_row + c0,
+                       *gap_open = w->gap_open_prec + c0,
+                       *h_extend = w->horizontal_extension + c0;
+
+    if (prev == NULL && start == STATE_ORIGIN) {
+        // Row 0 of the plane, as algn_initialize_matrices_affine() sets it.
+        cur[0].cost[STATE_HORIZONTAL] = w->gap_open_cost;
+        cur[0].cost[STATE_ALIGN]      = 0;
+        cur[0].cost[STATE_VERTICAL]   = w->gap_open_cost;
+        cur[0].cost[STATE_DIAGONAL]   = 0;
+        preds[0] = 0;
+        for (size_t j = 1; j < width; j++) {
+            cur[j].cost[STATE_HORIZONTAL] = cur[j - 1].cost[STATE_HORIZONTAL] + gap_row[j];
+            cur[j].cost[STATE_ALIGN]      = cur[j].cost[STATE_HORIZONTAL];
+            cur[j].cost[STATE_VERTICAL]   = UNREACHABLE;
+            cur[j].cost[STATE_DIAGONAL]   = UNREACHABLE;
+            preds[j] = 0;
+        }
+        return;
+    }
+
+    if (prev == NULL) {
+        for (size_t s = 0; s < STATE_COUNT; s++) cur[0].cost[s] = UNREACHABLE;
+        cur[0].cost[start] = 0;
+        preds[0] = 0;
+        for (size_t j = 1; j < width; j++) {
+            const unsigned int extend = plus( cur[j - 1].cost[STATE_HORIZONTAL], h_extend[j] ),
+                               open   = plus( cur[j - 1].cost[STATE_ALIGN],      gap_open[j] + gap_row[j] );
+            cur[j].cost[STATE_HORIZONTAL] = extend < open ? extend : open;
+            cur[j].cost[STATE_ALIGN]      = UNREACHABLE;
+            cur[j].cost[STATE_VERTICAL]   = UNREACHABLE;
+            cur[j].cost[STATE_DIAGONAL]   = UNREACHABLE;
+            preds[j] = (extend < open ? STATE_HORIZONTAL : STATE_ALIGN) << (2 * STATE_HORIZONTAL);
+        }
+        return;
+    }
+
+    const affine_row_t row          = affine_row( w, i );
+    const int          short_gapped = (row.elem & gap_char) != 0;
+
+    // The first column can only be entered from above.
+    {
+        const unsigned int extend = plus( prev[0].cost[STATE_VERTICAL], row.vertical_extension ),
+                           open   = plus( prev[0].cost[STATE_ALIGN],    row.gap_open_cost + row.gap_extend_cost );
+        cur[0].cost[STATE_HORIZONTAL] = UNREACHABLE;
+        cur[0].cost[STATE_ALIGN]      = UNREACHABLE;
+        cur[0].cost[STATE_VERTICAL]   = extend < open ? extend : open;
+        cur[0].cost[STATE_DIAGONAL]   = UNREACHABLE;
+        preds[0] = (extend < open ? STATE_VERTICAL : STATE_ALIGN) << (2 * STATE_VERTICAL);
+    }
+
+    for (size_t j = 1; j < width; j++) {
+        const affine_cell_t *left     = cur  + j - 1,
+                            *up       = prev + j,
+                            *diagonal = prev + j - 1;
+        const elem_t         elem     = longer[j];
+        const int            gapped   = (elem & gap_char) != 0;
+        unsigned char        pred     = 0;
+        unsigned int         extend, open;
+
+        // FILL_EXTEND_HORIZONTAL
+        extend = plus( left->cost[STATE_HORIZONTAL], h_extend[j] );
+        open   = plus( left->cost[STATE_ALIGN],      gap_open[j] + gap_row[j] );
+        cur[j].cost[STATE_HORIZONTAL] = extend < open ? extend : open;
+        pred |= (extend < open ? STATE_HORIZONTAL : STATE_ALIGN) << (2 * STATE_HORIZONTAL);
+
+        // FILL_EXTEND_VERTICAL
+        extend = plus( up->cost[STATE_VERTICAL], row.vertical_extension );
+        open   = plus( up->cost[STATE_ALIGN],    row.gap_open_cost + row.gap_extend_cost );
+        cur[j].cost[STATE_VERTICAL] = extend < open ? extend : open;
+        pred |= (extend < open ? STATE_VERTICAL : STATE_ALIGN) << (2 * STATE_VERTICAL);
+
+        // FILL_EXTEND_BLOCK_DIAGONAL: only a gap may be aligned with a gap.
+        if (short_gapped && gapped) {
+            extend = diagonal->cost[STATE_DIAGONAL];
+            open   = diagonal->cost[STATE_ALIGN];
+            cur[j].cost[STATE_DIAGONAL] = extend < open ? extend : open;
+            pred |= (extend < open ? STATE_DIAGONAL : STATE_ALIGN) << (2 * STATE_DIAGONAL);
+        } else {
+            cur[j].cost[STATE_DIAGONAL] = UNREACHABLE;
+        }
+
+        // FILL_CLOSE_BLOCK_DIAGONAL
+        {
+            const unsigned int substitution = row.align_row[elem & w->all_ambiguous],
+                               extra_open   = gap_open[j] < row.gap_open_cost ? row.gap_open_cost : gap_open[j];
+            const unsigned int from[STATE_COUNT] = {
+                [STATE_HORIZONTAL] = plus( diagonal->cost[STATE_HORIZONTAL], gapped       ? row.gap_open_cost : 0 ),
+                [STATE_ALIGN]      = diagonal->cost[STATE_ALIGN],
+                [STATE_VERTICAL]   = plus( diagonal->cost[STATE_VERTICAL],   short_gapped ? gap_open[j]       : 0 ),
+                [STATE_DIAGONAL]   = plus( diagonal->cost[STATE_DIAGONAL],   extra_open )
+            };
+            int best = STATE_ALIGN;
+            if (from[STATE_VERTICAL]   < from[best]) best = STATE_VERTICAL;
+            if (from[STATE_HORIZONTAL] < from[best]) best = STATE_HORIZONTAL;
+            if (from[STATE_DIAGONAL]   < from[best]) best = STATE_DIAGONAL;
+            cur[j].cost[STATE_ALIGN] = plus( from[best], substitution );
+            pred |= best << (2 * STATE_ALIGN);
+        }
+
+        preds[j] = pred;
+    }
+}
+
+
+/** The state to end in at a cell, preferring states as algn_backtrace_affine() does. */
+static int
+affine_best_state ( const affine_cell_t *cell, int end )
+{
+    if (end != STATE_ANY) return end;
+
+    int best = 0;
+    for (int s = 1; s < STATE_COUNT; s++) {
+        if (cell->cost[s] < cell->cost[best]) best = s;
+    }
+    return best;
+}
+
+
+/** Fill rows r0 through r1 of a subproblem, leaving its bottom right cell in *last.
+ *
+ *  If mid > r0, also find for each state of that cell the last point of its optimal path
+ *  in row mid, as the crossing index described in linear_affine_t.
+ */
+static void
+affine_sweep (       linear_affine_t *w
+             ,       size_t           r0
+             ,       size_t           r1
+             ,       size_t           c0
+             ,       size_t           c1
+             ,       int              start
+             ,       size_t           mid
+             ,       affine_cell_t   *last
+             ,       size_t          *crossing
+             )
+{
+    const size_t   width = c1 - c0 + 1;
+    affine_cell_t *prev  = NULL,
+                  *cur   = w->rows[0];
+    size_t        *prevCrossing = w->crossings[1],
+                  *curCrossing  = w->crossings[0];
+
+    for (size_t i = r0; i <= r1; i++) {
+        affine_fill_row( w, i, c0, c1, start, prev, cur, w->preds );
+
+        if (mid > r0 && i == mid) {
+            for (size_t k = 0; k < width * STATE_COUNT; k++) curCrossing[k] = k;
+        } else if (mid > r0 && i > mid) {
+            for (size_t j = 0; j < width; j++) {
+                for (int s = 0; s < STATE_COUNT; s++) {
+                    const int p = (w->preds[j] >> (2 * s)) & 3;
+                    size_t from;
+                    if      (s == STATE_VERTICAL) from = j;
+                    else if (j == 0)              { curCrossing[s] = 0; continue; }   // Unreachable.
+                    else                          from = j - 1;
+
+                    curCrossing[j * STATE_COUNT + s] = (s == STATE_HORIZONTAL ? curCrossing : prevCrossing)[from * STATE_COUNT + p];
+                }
+            }
+        }
+
+        prev = cur;
+        cur  = cur == w->rows[0] ? w->rows[1] : w->rows[0];
+        size_t *swap = prevCrossing;
+        prevCrossing = curCrossing;
+        curCrossing  = swap;
+    }
+
+    *last = prev[width - 1];
+    if (mid > r0) {
+        for (int s = 0; s < STATE_COUNT; s++) crossing[s] = prevCrossing[(width - 1) * STATE_COUNT + s];
+    }
+}
+
+
+/** Align a subproblem with a matrix of predecessor states, and backtrace it onto the moves.
+ *  Returns its cost, and sets *end to the state it ends in.
+ */
+static unsigned int
+affine_direct (       linear_affine_t *w
+              ,       size_t           r0
+              ,       size_t           r1
+              ,       size_t           c0
+              ,       size_t           c1
+              ,       int              start
+              ,       int             *end
+              )
+{
+    const size_t   width = c1 - c0 + 1;
+    affine_cell_t *prev  = NULL,
+                  *cur   = w->rows[0];
+
+    for (size_t i = r0; i <= r1; i++) {
+        affine_fill_row( w, i, c0, c1, start, prev, cur, w->preds + (i - r0) * width );
+        prev = cur;
+        cur  = cur == w->rows[0] ? w->rows[1] : w->rows[0];
+    }
+
+    int state = affine_best_state( prev + width - 1, *end );
+    const unsigned int cost = prev[width - 1].cost[state];
+    *end = state;
+
+    size_t i = r1,
+           j = c1;
+    if (start == STATE_ORIGIN) {
+        // Like algn_backtrace_affine(), stop at the first row or column, which are all gaps.
+        while (i > 0 && j > 0) {
+            const int pred = (w->preds[(i - r0) * width + (j - c0)] >> (2 * state)) & 3;
+            w->moves[w->moveCount++] = state;
+            if (state != STATE_HORIZONTAL) i--;
+            if (state != STATE_VERTICAL)   j--;
+            state = pred;
+        }
+        for (; i > 0; i--) w->moves[w->moveCount++] = STATE_VERTICAL;
+        for (; j > 0; j--) w->moves[w->moveCount++] = STATE_HORIZONTAL;
+    } else {
+        while (i > r0 || j > c0) {
+            const int pred = (w->preds[(i - r0) * width + (j - c0)] >> (2 * state)) & 3;
+            w->moves[w->moveCount++] = state;
+            if (state != STATE_HORIZONTAL) i--;
+            if (state != STATE_VERTICAL)   j--;
+            state = pred;
+        }
+        assert (state == start);
+    }
+    return cost;
+}
+
+
+/** Align a subproblem, ending in state *end, or the best state if that is STATE_ANY. Returns its cost,
+ *  and sets *end to the state it ends in.
+ */
+static unsigned int
+affine_divide (       linear_affine_t *w
+              ,       size_t           r0
+              ,       size_t           r1
+              ,       size_t           c0
+              ,       size_t           c1
+              ,       int              start
+              ,       int             *end
+              )
+{
+    if (r1 - r0 < 2 || (r1 - r0 + 1) * (c1 - c0 + 1) <= LINEAR_SPACE_BLOCK) {
+        return affine_direct( w, r0, r1, c0, c1, start, end );
+    }
+
+    const size_t  mid = r0 + (r1 - r0) / 2;
+    affine_cell_t last;
+    size_t        crossing[STATE_COUNT];
+    affine_sweep( w, r0, r1, c0, c1, start, mid, &last, crossing );
+
+    *end = affine_best_state( &last, *end );
+    const unsigned int cost = last.cost[*end];
+
+    const size_t split     = c0 + crossing[*end] / STATE_COUNT;
+    int          midState  = crossing[*end] % STATE_COUNT;
+    int          endState  = *end;
+
+    // Moves are recorded last first, so the lower half goes first.
+    affine_divide( w, mid, r1,  split, c1,    midState, &endState );
+    affine_divide( w, r0,  mid, c0,    split, start,    &midState );
+
+    return cost;
+}
+
+
+unsigned int
+algn_linear_space_2d_affine ( const dyn_character_t    *shortChar
+                            , const dyn_character_t    *longerChar
+                            ,       dyn_character_t    *gapped_median
+                            ,       dyn_character_t    *ungapped_median
+                            ,       dyn_character_t    *retShortChar
+                            ,       dyn_character_t    *retLongChar
+                            , const cost_matrices_2d_t *costMatrix
+                            ,       int                 doBacktrace
+                            )
+{
+    const size_t shortChar_len  = shortChar->len  - 1,
+                 longerChar_len = longerChar->len - 1,
+                 width          = longerChar_len + 1;
+
+    assert (shortChar_len <= longerChar_len);
+
+    linear_affine_t w;
+    w.shortChar            = shortChar->char_begin;
+    w.longerChar           = longerChar->char_begin;
+    w.costMatrix           = costMatrix;
+    w.gap_char             = costMatrix->gap_char;
+    w.all_ambiguous        = costMatrix->gap_char - 1;
+    w.gap_open_cost        = costMatrix->gap_open_cost;
+    w.gap_row              = checked_malloc( width, sizeof(unsigned int) );
+    w.gap_open_prec        = checked_malloc( width, sizeof(unsigned int) );
+    w.horizontal_extension = checked_malloc( width, sizeof(unsigned int) );
+    w.rows[0]              = checked_malloc( width, sizeof(affine_cell_t) );
+    w.rows[1]              = checked_malloc( width, sizeof(affine_cell_t) );
+    w.crossings[0]         = NULL;
+    w.crossings[1]         = NULL;
+    w.preds                = checked_malloc( width, 1 );
+    w.moves                = NULL;
+    w.moveCount            = 0;
+
+    // As algn_fill_plane_2d_affine() precalculates them.
+    w.gap_row[0] = w.gap_open_prec[0] = w.horizontal_extension[0] = 0;
+    for (size_t j = 1; j < width; j++) {
+        const elem_t prev = w.longerChar[j - 1],
+                     curr = w.longerChar[j];
+        w.gap_row[j]              = costMatrix->prepend_cost[curr];
+        w.gap_open_prec[j]        = gap_opening( prev, curr, w.gap_char, w.gap_open_cost );
+        w.horizontal_extension[j] = (j > 1 && (prev & w.gap_char) && !(curr & w.gap_char))
+                                  ? w.gap_open_prec[j] + w.gap_row[j]
+                                  : w.gap_row[j];
+    }
+
+    unsigned int cost;
+    int          end = STATE_ANY;
+    if (!doBacktrace) {
+        affine_cell_t last;
+        affine_sweep( &w, 0, shortChar_len, 0, longerChar_len, STATE_ORIGIN, 0, &last, NULL );
+        cost = last.cost[affine_best_state( &last, end )];
+    } else {
+        const size_t blockSize = 2 * width > LINEAR_SPACE_BLOCK ? 2 * width : LINEAR_SPACE_BLOCK;
+        free(w.preds);
+        w.preds        = checked_malloc( blockSize, 1 );
+        w.crossings[0] = checked_malloc( width * STATE_COUNT, sizeof(size_t) );
+        w.crossings[1] = checked_malloc( width * STATE_COUNT, sizeof(size_t) );
+        w.moves        = checked_malloc( shortChar_len + longerChar_len, 1 );
+
+        cost = affine_divide( &w, 0, shortChar_len, 0, longerChar_len, STATE_ORIGIN, &end );
+
+        // Emit the moves as algn_backtrace_affine() emits each mode.
+        const elem_t gap_char = w.gap_char;
+        size_t shortIdx = shortChar_len,
+               longIdx  = longerChar_len;
+        for (size_t k = 0; k < w.moveCount; k++) {
+            const elem_t shortCharElem  = w.shortChar[shortIdx],
+                         longerCharElem = w.longerChar[longIdx];
+            switch (w.moves[k]) {
+                case STATE_VERTICAL:
+                    if (!(shortCharElem & gap_char)) {
+                        dyn_char_prepend(gapped_median,   shortCharElem | gap_char);
+                        dyn_char_prepend(ungapped_median, shortCharElem | gap_char);
+                    } else {
+                        dyn_char_prepend(ungapped_median, gap_char);
+                    }
+                    dyn_char_prepend(retShortChar, shortCharElem);
+                    dyn_char_prepend(retLongChar,  gap_char);
+                    shortIdx--;
+                    break;
+                case STATE_HORIZONTAL:
+                    if (!(longerCharElem & gap_char)) {
+                        dyn_char_prepend(gapped_median,   longerCharElem | gap_char);
+                        dyn_char_prepend(ungapped_median, longerCharElem | gap_char);
+                    } else {
+                        dyn_char_prepend(ungapped_median, gap_char);
+                    }
+                    dyn_char_prepend(retShortChar, gap_char);
+                    dyn_char_prepend(retLongChar,  longerCharElem);
+                    longIdx--;
+                    break;
+                case STATE_DIAGONAL:
+                    dyn_char_prepend(retShortChar,    shortCharElem);
+                    dyn_char_prepend(retLongChar,     longerCharElem);
+                    dyn_char_prepend(ungapped_median, gap_char);
+                    shortIdx--;
+                    longIdx--;
+                    break;
+                default: {
+                    const elem_t prep = cm_get_median_2d( costMatrix
+                                                        , shortCharElem  & w.all_ambiguous
+                                                        , longerCharElem & w.all_ambiguous
+                                                        );
+                    dyn_char_prepend(gapped_median,   prep);
+                    dyn_char_prepend(ungapped_median, prep);
+                    dyn_char_prepend(retShortChar,    shortCharElem);
+                    dyn_char_prepend(retLongChar,     longerCharElem);
+                    shortIdx--;
+                    longIdx--;
+                }
+            }
+        }
+        assert (shortIdx == 0 && longIdx == 0);
+
+        dyn_char_prepend(retShortChar,    gap_char);
+        dyn_char_prepend(retLongChar,     gap_char);
+        dyn_char_prepend(ungapped_median, gap_char);
+        if (gapped_median->len == 0 || gap_char != gapped_median->char_begin[0]) {
+            dyn_char_prepend(gapped_median, gap_char);
+        }
+    }
+
+    free(w.gap_row);
+    free(w.gap_open_prec);
+    free(w.horizontal_extension);
+    free(w.rows[0]);
+    free(w.rows[1]);
+    free(w.crossings[0]);
+    free(w.crossings[1]);
+    free(w.preds);
+    free(w.moves);
+
+    return cost;
+}
@@ -0,0 +1,68 @@
+/** Linear-space pairwise alignment.
+ *
+ *  The full-matrix alignments in alignCharacters.c keep a direction matrix of
+ *  len_longer * len_shorter cells for the backtrace, which for characters of
+ *  50--100 kb is many gigabytes. The functions here find an optimal alignment
+ *  under the same cost model in O(len_longer + len_shorter) memory, by divide
+ *  and conquer: find the cell at which an optimal path crosses the middle row,
+ *  then align the two halves independently (Hirschberg; for the affine model
+ *  Myers & Miller). Small subproblems are aligned directly.
+ *
+ *  Each function's outputs have the same layout as those of the backtrace it
+ *  replaces, so the callers' median and union code is unchanged. Both align the
+ *  whole plane rather than a Ukkonen band. The non-affine band widens until its
+ *  cost is that of the whole plane, so the non-affine costs are equal; the
+ *  affine band is fixed, so the affine cost here can be lower than the banded
+ *  fill's when the optimal path leaves the band.
+ */
+
+#ifndef LINEAR_SPACE_ALIGNMENT_H
+#define LINEAR_SPACE_ALIGNMENT_H
+
+#include "costMatrix.h"
+#include "dyn_character.h"
+
+
+/** align2d() and align2dAffine() use the linear-space alignments for characters
+ *  whose full direction matrix would have more than this many cells.
+ */
+#define LINEAR_SPACE_THRESHOLD ((size_t) 1 << 24)
+
+
+/** As algn_nw_2d() followed by algn_backtrace_2d(), with the same arguments and
+ *  outputs, but in linear space.
+ *
+ *  Both input characters include their leading gap, and shorterChar must be no
+ *  longer than longerChar. If doBacktrace is 0 only the cost is computed, and
+ *  the return characters are untouched.
+ */
+unsigned int
+algn_linear_space_2d ( const dyn_character_t    *shorterChar
+                     , const dyn_character_t    *longerChar
+                     ,       dyn_character_t    *ret_longerChar
+                     ,       dyn_character_t    *ret_shorterChar
+                     , const cost_matrices_2d_t *costMatrix
+                     ,       int                 doBacktrace
+                     );
+
+
+/** As algn_fill_plane_2d_affine() followed by algn_backtrace_affine(), with the
+ *  same outputs, but in linear space.
+ *
+ *  Both input characters include their leading gap, and shortChar must be no
+ *  longer than longerChar. If doBacktrace is 0 only the cost is computed, and
+ *  the medians and return characters are untouched.
+ */
+unsigned int
+algn_linear_space_2d_affine ( const dyn_character_t    *shortChar
+                            , const dyn_character_t    *longerChar
+                            ,       dyn_character_t    *gapped_median
+                            ,       dyn_character_t    *ungapped_median
+                            ,       dyn_character_t    *retShortChar
+                            ,       dyn_character_t    *retLongChar
+                            , const cost_matrices_2d_t *costMatrix
+                            ,       int                 doBacktrace
+                            );
+
+
+#endif // LINEAR_SPACE_ALIGNMENT_H
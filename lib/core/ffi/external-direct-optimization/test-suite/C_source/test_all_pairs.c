@@ -0,0 +1,221 @@
+/** Tests align2dAllPairs() against align2dCost() on each ordered pair in turn: every cell of the matrix must be the cost of
+    its row's character aligned with its column's, and 0 for missing characters, with linear and affine costs, symmetric
+    and non-symmetric TCMs. With cycles counted, repeated calls must not leak the counters of their threads. Then times
+    both.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../alignCharacters.h"
+#include "../../alignmentStats.h"
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define ALPH_SIZE   5
+#define TEST_COUNT  30
+#define BENCH_COUNT 60
+#define LEAK_COUNT  50
+
+
+typedef struct characters_set_t {
+    elem_t *elements;
+    size_t *lengths;
+    size_t  count;
+} characters_set_t;
+
+
+/** Mostly unambiguous elements, never a gap. */
+static elem_t random_elem( void )
+{
+    const size_t states = ALPH_SIZE - 1;
+    return rand() % 5 ? 1u << (rand() % states) : (elem_t) (rand() % ((1u << states) - 1) + 1);
+}
+
+
+/** Characters mutated from a common ancestor of about length elements, one in every tenth missing if withMissing. */
+static void alloc_characters( characters_set_t *set, size_t count, size_t length, int withMissing )
+{
+    elem_t *ancestor = malloc( length * sizeof(elem_t) );
+    for (size_t k = 0; k < length; k++) ancestor[k] = random_elem();
+
+    set->count    = count;
+    set->lengths  = malloc( count * sizeof(size_t) );
+    set->elements = malloc( count * (2 * length + 1) * sizeof(elem_t) );
+
+    elem_t *next = set->elements;
+    for (size_t i = 0; i < count; i++) {
+        set->lengths[i] = 0;
+        if (withMissing && i % 10 == 3) continue;
+        for (size_t k = 0; k < length; k++) {
+            const int change = rand() % 12;
+            if (change == 0) continue;                                  // deleted
+            if (change == 1) next[set->lengths[i]++] = random_elem();   // inserted before
+            next[set->lengths[i]++] = change == 2 ? random_elem() : ancestor[k];
+        }
+        next += set->lengths[i];
+    }
+    free(ancestor);
+}
+
+
+static void free_characters( characters_set_t *set )
+{
+    free(set->elements);
+    free(set->lengths);
+}
+
+
+/** The matrix as align2dCost() gives it, one ordered pair at a time, on this thread. */
+static void serial_costs( const characters_set_t *set, cost_matrices_2d_t *costMtx, unsigned int *retCosts )
+{
+    size_t maxLength = 0;
+    for (size_t i = 0; i < set->count; i++) if (set->lengths[i] > maxLength) maxLength = set->lengths[i];
+
+    alignIO_t *io[2] = { allocAlignIO( maxLength + 1 ), allocAlignIO( maxLength + 1 ) };
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+
+    const elem_t *row = set->elements;
+    for (size_t i = 0; i < set->count; row += set->lengths[i++]) {
+        const elem_t *col = set->elements;
+        for (size_t j = 0; j < set->count; col += set->lengths[j++]) {
+            if (set->lengths[i] == 0 || set->lengths[j] == 0) {
+                retCosts[i * set->count + j] = 0;
+                continue;
+            }
+            copyValsToAIO( io[0], (elem_t *) row, set->lengths[i], maxLength + 1 );
+            copyValsToAIO( io[1], (elem_t *) col, set->lengths[j], maxLength + 1 );
+            retCosts[i * set->count + j] = align2dCost_ws( io[0], io[1], costMtx, UINT_MAX, workspace );
+        }
+    }
+
+    freeAlignmentWorkspace( workspace );
+    for (size_t k = 0; k < 2; k++) {
+        freeAlignIO(io[k]);
+        free(io[k]);
+    }
+}
+
+
+/** The file descriptors this process has open, or 0 if /proc cannot tell. */
+static size_t open_fd_count( void )
+{
+    DIR *fds = opendir("/proc/self/fd");
+    if (fds == NULL) return 0;
+
+    size_t count = 0;
+    while (readdir(fds) != NULL) count++;
+    closedir(fds);
+    return count;
+}
+
+
+static double seconds( struct timespec start )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (double) (now.tv_sec - start.tv_sec) + (double) (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+int main()
+{
+    srand(59);
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing the all-pairs cost matrix. ******\n");
+
+    // Linear and affine, each with a symmetric then a non-symmetric TCM.
+    cost_matrices_2d_t *costMatrices[4];
+    const char         *names[4] = { "linear, symmetric", "linear, non-symmetric", "affine, symmetric", "affine, non-symmetric" };
+    for (size_t m = 0; m < 4; m++) {
+        unsigned int tcm[ALPH_SIZE * ALPH_SIZE];
+        for (size_t i = 0; i < ALPH_SIZE; i++) {
+            for (size_t j = 0; j < ALPH_SIZE; j++) {
+                tcm[i * ALPH_SIZE + j] = i == j ? 0 : m % 2 ? 1 + (i < j) + (i + j) % 2 : 1 + (i + j) % 2;
+            }
+        }
+        costMatrices[m] = malloc( sizeof(cost_matrices_2d_t) );
+        setUp2dCostMtx( costMatrices[m], tcm, ALPH_SIZE, m < 2 ? 0 : 3 );
+    }
+
+    for (size_t m = 0; m < 4; m++) {
+        size_t wrong = 0;
+        for (size_t k = 0; k < TEST_COUNT; k++) {
+            characters_set_t set;
+            alloc_characters( &set, rand() % 25 + 1, rand() % (k % 3 ? 40 : 300) + 1, k % 2 );
+
+            unsigned int *expected = malloc( set.count * set.count * sizeof(unsigned int) ),
+                         *actual   = malloc( set.count * set.count * sizeof(unsigned int) );
+            serial_costs( &set, costMatrices[m], expected );
+            align2dAllPairs( set.elements, set.lengths, set.count, costMatrices[m], actual );
+            wrong += memcmp( expected, actual, set.count * set.count * sizeof(unsigned int) ) != 0;
+
+            free(expected);
+            free(actual);
+            free_characters( &set );
+        }
+        printf("  %-24s %-40s %s\n", names[m], "the cost of each pair", wrong ? "FAILED" : "ok");
+        failures += wrong;
+    }
+
+    // Each call starts its own threads, and each of them opens a cycle counter, if it can, that it must close as it exits.
+    {
+        const int counted = setAlignmentCycleCounting(1);
+        characters_set_t set;
+        alloc_characters( &set, 20, 40, 0 );
+        unsigned int *costs = malloc( set.count * set.count * sizeof(unsigned int) );
+
+        align2dAllPairs( set.elements, set.lengths, set.count, costMatrices[0], costs );
+        const size_t before = open_fd_count();
+        for (size_t k = 0; k < LEAK_COUNT; k++) {
+            align2dAllPairs( set.elements, set.lengths, set.count, costMatrices[0], costs );
+        }
+        const size_t after = open_fd_count();
+        const int    leaked = after > before;
+
+        printf( "  %-24s %-40s %s\n", counted ? "cycles counted" : "cycles uncountable"
+              , "open file descriptors stay flat", leaked ? "FAILED" : "ok" );
+        failures += leaked;
+
+        setAlignmentCycleCounting(0);
+        free(costs);
+        free_characters( &set );
+    }
+
+    printf("\n******* Timing the costs of %d characters. ******\n", BENCH_COUNT);
+    const size_t lengths[2] = { 300, 1000 };
+    for (size_t l = 0; l < 2; l++) {
+        characters_set_t set;
+        alloc_characters( &set, BENCH_COUNT, lengths[l], 0 );
+        unsigned int *costs = malloc( set.count * set.count * sizeof(unsigned int) );
+
+        struct timespec start;
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        serial_costs( &set, costMatrices[0], costs );
+        const double serial = seconds(start);
+
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        align2dAllPairs( set.elements, set.lengths, set.count, costMatrices[0], costs );
+        const double allPairs = seconds(start);
+
+        printf( "  length %5zu   every ordered pair, serially %8.4f s   align2dAllPairs %8.4f s\n"
+              , lengths[l], serial, allPairs );
+        free(costs);
+        free_characters( &set );
+    }
+
+    for (size_t m = 0; m < 4; m++) freeCostMtx( costMatrices[m], 1 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
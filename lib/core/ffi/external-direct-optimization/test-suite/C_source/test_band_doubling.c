@@ -0,0 +1,222 @@
+/** Tests the doubling Ukkonen band of non-affine 2D alignment: align2d_ws() and align2dCost_ws()
+    must return the cost of the whole plane, which algn_linear_space_2d() computes, both for close
+    characters, whose first band suffices, and for distant ones, whose band must grow. The alignment
+    backtraced from the band must re-score to that cost, and close characters must keep fewer
+    directions than the plane has. Then times them against filling the whole plane.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../alignCharacters.h"
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+#include "../../dyn_character.h"
+#include "../../linearSpaceAlignment.h"
+
+#define TEST_COUNT  120
+#define BENCH_COUNT 200
+
+
+typedef struct pair_t {
+    elem_t    *vals[2];
+    size_t     lengths[2];
+    alignIO_t *io[4];        // two inputs, gapped and ungapped outputs
+} pair_t;
+
+
+static elem_t random_elem( void )
+{
+    return rand() % 5 ? 1 << (rand() % 4) : rand() % 15 + 1;
+}
+
+
+/** A pair of characters, the second a copy of the first with one change in every `distance`
+ *  elements, two in three of them insertions or deletions.
+ */
+static void alloc_pair( pair_t *pair, size_t length, size_t distance )
+{
+    pair->vals[0] = malloc( length * sizeof(elem_t) );
+    pair->vals[1] = malloc( 2 * length * sizeof(elem_t) );
+    for (size_t j = 0; j < length; j++) pair->vals[0][j] = random_elem();
+
+    size_t n = 0;
+    for (size_t j = 0; j < length; j++) {
+        switch (rand() % distance ? 3 : rand() % 3) {
+            case 0:  pair->vals[1][n++] = random_elem();            break;   // substitution
+            case 1:                                                  break;   // deletion
+            case 2:  pair->vals[1][n++] = random_elem();                      // insertion
+                     pair->vals[1][n++] = pair->vals[0][j];         break;
+            default: pair->vals[1][n++] = pair->vals[0][j];
+        }
+    }
+    if (n == 0) pair->vals[1][n++] = random_elem();
+    pair->lengths[0] = length;
+    pair->lengths[1] = n;
+
+    const size_t room = pair->lengths[0] + pair->lengths[1] + 2;
+    for (size_t i = 0; i < 4; i++) pair->io[i] = allocAlignIO(room);
+}
+
+
+static void free_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) free(pair->vals[i]);
+    for (size_t i = 0; i < 4; i++) {
+        freeAlignIO(pair->io[i]);
+        free(pair->io[i]);
+    }
+}
+
+
+/** Put a pair's values back into its inputs, which alignments overwrite. */
+static void reset_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) {
+        alignIO_t *io = pair->io[i];
+        io->length = pair->lengths[i];
+        memcpy( io->character + io->capacity - io->length, pair->vals[i], io->length * sizeof(elem_t) );
+    }
+    pair->io[2]->length = pair->io[3]->length = 0;
+}
+
+
+static int banded_cost( pair_t *pair, cost_matrices_2d_t *costMtx, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    return align2d_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1, 1, 0, UINT_MAX, workspace );
+}
+
+
+static int cost_only( pair_t *pair, cost_matrices_2d_t *costMtx, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    return align2dCost_ws( pair->io[0], pair->io[1], costMtx, UINT_MAX, workspace );
+}
+
+
+/** The cost of the aligned characters align2d_ws() left in the inputs of pair. */
+static unsigned int rescore( const pair_t *pair, const cost_matrices_2d_t *costMtx )
+{
+    const alignIO_t *a = pair->io[0],
+                    *b = pair->io[1];
+    const elem_t    *x = a->character + a->capacity - a->length,
+                    *y = b->character + b->capacity - b->length;
+
+    if (a->length != b->length) return UINT_MAX;
+
+    // A gap comes out as 0.
+    const elem_t gap  = (elem_t) 1 << (costMtx->alphSize - 1);
+    unsigned int cost = 0;
+    for (size_t i = 0; i < a->length; i++) {
+        cost += cm_calc_cost_2d( costMtx->cost, x[i] ? x[i] : gap, y[i] ? y[i] : gap, costMtx->alphSize );
+    }
+    return cost;
+}
+
+
+/** The cost of the whole plane. */
+static unsigned int plane_cost( pair_t *pair, cost_matrices_2d_t *costMtx )
+{
+    reset_pair( pair );
+    const int    firstLonger = pair->lengths[0] > pair->lengths[1];
+    alignIO_t   *longIO      = pair->io[firstLonger ? 0 : 1],
+                *shortIO     = pair->io[firstLonger ? 1 : 0];
+    dyn_character_t longChar, shortChar;
+    alignIOtoDynChar( &longChar,  longIO,  costMtx->alphSize );
+    alignIOtoDynChar( &shortChar, shortIO, costMtx->alphSize );
+
+    return algn_linear_space_2d( &shortChar, &longChar, NULL, NULL, costMtx, 0 );
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main()
+{
+    srand(41);
+
+    const size_t alphSize = 5;
+    unsigned int tcm[25];
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 2;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % 2;
+        }
+    }
+    cost_matrices_2d_t *costMtx = malloc( sizeof(cost_matrices_2d_t) );
+    setUp2dCostMtx( costMtx, tcm, alphSize, 0 );
+
+    // One change in every 50, 10 and 2 elements.
+    const size_t distances[3] = { 50, 10, 2 };
+    const char  *names[3]     = { "close", "middling", "distant" };
+    pair_t       pairs[3][TEST_COUNT];
+    for (size_t d = 0; d < 3; d++) {
+        for (size_t k = 0; k < TEST_COUNT; k++) alloc_pair( &pairs[d][k], rand() % 1500 + 1, distances[d] );
+    }
+
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing the doubling band against the whole plane. ******\n");
+
+    for (size_t d = 0; d < 3; d++) {
+        size_t wrong = 0, wrongAlignment = 0, wrongCostOnly = 0, wide = 0;
+        for (size_t k = 0; k < TEST_COUNT; k++) {
+            const int cost = plane_cost( &pairs[d][k], costMtx );
+            wrong          += banded_cost( &pairs[d][k], costMtx, workspace ) != cost;
+            wrongAlignment += rescore( &pairs[d][k], costMtx ) != (unsigned int) cost;
+
+            // The first band of a long, close pair is a small part of the plane.
+            alignment_stats_t stats;
+            getAlignmentStats( workspace, &stats, NULL );
+            const size_t longer  = pairs[d][k].lengths[0] > pairs[d][k].lengths[1] ? pairs[d][k].lengths[0] : pairs[d][k].lengths[1],
+                         shorter = pairs[d][k].lengths[0] > pairs[d][k].lengths[1] ? pairs[d][k].lengths[1] : pairs[d][k].lengths[0];
+            wide += d == 0 && shorter > 1000 && stats.directionBytes * 4 > longer * PACKED_DIR_ROW_BYTES(shorter);
+
+            wrongCostOnly  += cost_only(   &pairs[d][k], costMtx, workspace ) != cost;
+        }
+        printf("  %-10s %-40s %s\n", names[d], "alignment cost is that of the plane", wrong          ? "FAILED" : "ok");
+        printf("  %-10s %-40s %s\n", names[d], "alignment re-scores to that cost",    wrongAlignment ? "FAILED" : "ok");
+        printf("  %-10s %-40s %s\n", names[d], "cost-only cost is that of the plane", wrongCostOnly  ? "FAILED" : "ok");
+        if (d == 0) {
+            printf("  %-10s %-40s %s\n", names[d], "band keeps under a quarter of the plane", wide ? "FAILED" : "ok");
+        }
+        failures += wrong + wrongAlignment + wrongCostOnly + wide;
+    }
+
+    printf("\n******* Timing %d cost-only alignments of each kind. ******\n", BENCH_COUNT);
+    for (size_t d = 0; d < 3; d++) {
+        clock_t start = clock();
+        for (size_t k = 0; k < BENCH_COUNT; k++) cost_only( &pairs[d][k % TEST_COUNT], costMtx, workspace );
+        const double banded = seconds(start);
+
+        start = clock();
+        for (size_t k = 0; k < BENCH_COUNT; k++) plane_cost( &pairs[d][k % TEST_COUNT], costMtx );
+        const double plane = seconds(start);
+
+        printf("  %-10s band %8.3f s   whole plane %8.3f s\n", names[d], banded, plane);
+    }
+
+    freeAlignmentWorkspace( workspace );
+    for (size_t d = 0; d < 3; d++) {
+        for (size_t k = 0; k < TEST_COUNT; k++) free_pair( &pairs[d][k] );
+    }
+    freeCostMtx( costMtx, 1 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -0,0 +1,254 @@
+/** Tests the cost ceilings of align2d_ws(), align2dAffine_ws() and align3d_ws():
+    1. a ceiling at or above the cost changes neither the cost nor the alignment;
+    2. one below it returns a value above the ceiling, and leaves the outputs as they were.
+    Then times 2D alignments with and without a ceiling of half their cost.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define TEST_COUNT   200
+#define BENCH_COUNT  2000
+#define TRIPLE_COUNT 12
+
+
+typedef struct pair_t {
+    elem_t    *vals[2];
+    size_t     lengths[2];
+    alignIO_t *io[4];        // two inputs, gapped and ungapped outputs
+} pair_t;
+
+
+/** Lengths for each case of algn_fill_plane_2(): short, one much longer than the other, and long and close. */
+static void choose_lengths( size_t test, size_t *lengths )
+{
+    switch (test % 3) {
+        case 0:  lengths[0] = rand() % 60 + 1;    lengths[1] = rand() % 60 + 1;                   break;
+        case 1:  lengths[0] = rand() % 200 + 20;  lengths[1] = lengths[0] * 2 + rand() % 50;      break;
+        default: lengths[0] = rand() % 400 + 150; lengths[1] = lengths[0] + rand() % 30;
+    }
+}
+
+
+static void alloc_pair( pair_t *pair, size_t test )
+{
+    choose_lengths( test, pair->lengths );
+    for (size_t i = 0; i < 2; i++) {
+        pair->vals[i] = malloc( pair->lengths[i] * sizeof(elem_t) );
+        for (size_t j = 0; j < pair->lengths[i]; j++) {
+            pair->vals[i][j] = rand() % 5 ? 1 << (rand() % 4) : rand() % 15 + 1;
+        }
+    }
+    const size_t room = pair->lengths[0] + pair->lengths[1] + 2;
+    for (size_t i = 0; i < 4; i++) pair->io[i] = allocAlignIO(room);
+}
+
+
+static void free_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) free(pair->vals[i]);
+    for (size_t i = 0; i < 4; i++) {
+        freeAlignIO(pair->io[i]);
+        free(pair->io[i]);
+    }
+}
+
+
+/** Put a pair's values back into its inputs, and empty its outputs. */
+static void reset_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) {
+        alignIO_t *io = pair->io[i];
+        io->length = pair->lengths[i];
+        memcpy( io->character + io->capacity - io->length, pair->vals[i], io->length * sizeof(elem_t) );
+    }
+    pair->io[2]->length = pair->io[3]->length = 0;
+}
+
+
+/** The used parts of a pair's four alignIOs, one after another. Returns the number of elements written. */
+static size_t result( const pair_t *pair, elem_t *out )
+{
+    size_t n = 0;
+    for (size_t i = 0; i < 4; i++) {
+        const alignIO_t *io = pair->io[i];
+        out[n++] = io->length;
+        memcpy( out + n, io->character + io->capacity - io->length, io->length * sizeof(elem_t) );
+        n += io->length;
+    }
+    return n;
+}
+
+
+static int align_pair( pair_t *pair, cost_matrices_2d_t *costMtx, unsigned int costCeiling, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    return costMtx->cost_model_type
+         ? align2dAffine_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1, costCeiling, workspace )
+         : align2d_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1, 1, 0, costCeiling, workspace );
+}
+
+
+/** Aligns three characters, and writes the lengths and used parts of the five outputs to out. */
+static int align_triple( elem_t **vals, size_t *lengths, cost_matrices_3d_t *costMtx, unsigned int costCeiling
+                       , alignment_workspace_t *workspace, elem_t *out )
+{
+    const size_t room = lengths[0] + lengths[1] + lengths[2];
+    alignIO_t *inputs[3]  = { allocAlignIO(room), allocAlignIO(room), allocAlignIO(room) },
+              *outputs[5] = { allocAlignIO(room), allocAlignIO(room), allocAlignIO(room), allocAlignIO(room), allocAlignIO(room) };
+    for (size_t i = 0; i < 3; i++) copyValsToAIO( inputs[i], vals[i], lengths[i], room );
+
+    const int cost = align3d_ws( inputs[0], inputs[1], inputs[2], outputs[0], outputs[1], outputs[2], outputs[3], outputs[4]
+                               , costMtx, 2, costCeiling, workspace );
+
+    size_t n = 0;
+    for (size_t i = 0; i < 5; i++) {
+        out[n++] = outputs[i]->length;
+        memcpy( out + n, outputs[i]->character + outputs[i]->capacity - outputs[i]->length, outputs[i]->length * sizeof(elem_t) );
+        n += outputs[i]->length;
+        freeAlignIO(outputs[i]);
+        free(outputs[i]);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        freeAlignIO(inputs[i]);
+        free(inputs[i]);
+    }
+    return cost;
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main()
+{
+    srand(37);
+
+    const size_t alphSize = 5;
+    unsigned int tcm[25];
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 2;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % 2;
+        }
+    }
+    cost_matrices_2d_t *costMatrices[2] = { malloc( sizeof(cost_matrices_2d_t) ), malloc( sizeof(cost_matrices_2d_t) ) };
+    cost_matrices_3d_t *costMtx3d       = malloc( sizeof(cost_matrices_3d_t) );
+    setUp2dCostMtx( costMatrices[0], tcm, alphSize, 0 );
+    setUp2dCostMtx( costMatrices[1], tcm, alphSize, 3 );
+    setUp3dCostMtx( costMtx3d,       tcm, alphSize, 0 );
+
+    pair_t pairs[TEST_COUNT];
+    size_t maxResult = 0;
+    for (size_t k = 0; k < TEST_COUNT; k++) {
+        alloc_pair( &pairs[k], k );
+        const size_t resultLength = 4 * (pairs[k].lengths[0] + pairs[k].lengths[1] + 3);
+        if (resultLength > maxResult) maxResult = resultLength;
+    }
+    elem_t *expected = malloc( maxResult * sizeof(elem_t) ),
+           *actual   = malloc( maxResult * sizeof(elem_t) );
+
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing cost ceilings. ******\n");
+
+    for (size_t m = 0; m < 2; m++) {
+        cost_matrices_2d_t *costMtx = costMatrices[m];
+        size_t changed = 0, notStopped = 0;
+
+        for (size_t k = 0; k < TEST_COUNT; k++) {
+            const int    cost   = align_pair( &pairs[k], costMtx, UINT_MAX, workspace );
+            const size_t length = result( &pairs[k], expected );
+
+            const unsigned int atOrAbove[2] = { cost, cost + 10 };
+            for (size_t c = 0; c < 2; c++) {
+                changed += align_pair( &pairs[k], costMtx, atOrAbove[c], workspace ) != cost
+                        || result( &pairs[k], actual ) != length
+                        || memcmp( expected, actual, length * sizeof(elem_t) ) != 0;
+            }
+            if (cost > 0) {
+                const unsigned int below[2] = { cost - 1, cost / 2 };
+                for (size_t c = 0; c < 2; c++) {
+                    notStopped += (unsigned int) align_pair( &pairs[k], costMtx, below[c], workspace ) <= below[c]
+                               || pairs[k].io[2]->length != 0
+                               || pairs[k].io[3]->length != 0;
+                }
+            }
+        }
+        const char *model = m ? "affine" : "non-affine";
+        printf("  %-10s %-55s %s\n", model, "a ceiling at or above the cost changes nothing", changed    ? "FAILED" : "ok");
+        printf("  %-10s %-55s %s\n", model, "one below it is exceeded, and leaves the outputs empty", notStopped ? "FAILED" : "ok");
+        failures += changed + notStopped;
+    }
+
+    // 3D alignment is slow, so only short triples. Raise the ceiling until it is met.
+    size_t wrong3d = 0;
+    for (size_t k = 0; k < TRIPLE_COUNT; k++) {
+        elem_t *vals[3];
+        size_t  lengths[3];
+        for (size_t i = 0; i < 3; i++) {
+            lengths[i] = rand() % 15 + 5;
+            vals[i]    = malloc( lengths[i] * sizeof(elem_t) );
+            for (size_t j = 0; j < lengths[i]; j++) vals[i][j] = 1 << (rand() % 4);
+        }
+        elem_t expected3d[5 * 60] = { 0 }, actual3d[5 * 60] = { 0 };
+        const int cost = align_triple( vals, lengths, costMtx3d, UINT_MAX, workspace, expected3d );
+
+        for (unsigned int ceiling = 0; ; ceiling++) {
+            const int ceilingCost = align_triple( vals, lengths, costMtx3d, ceiling, workspace, actual3d );
+            if (actual3d[0] == 0) {
+                wrong3d += (unsigned int) ceilingCost != ceiling + 1;
+                continue;
+            }
+            wrong3d += ceilingCost != cost || memcmp( expected3d, actual3d, sizeof(expected3d) ) != 0;
+            break;
+        }
+        for (size_t i = 0; i < 3; i++) free(vals[i]);
+    }
+    printf("  %-10s %-55s %s\n", "3D", "below the cost exceeded, at it unchanged", wrong3d ? "FAILED" : "ok");
+    failures += wrong3d;
+
+    printf("\n******* Timing %d alignments of each kind. ******\n", BENCH_COUNT);
+    for (size_t m = 0; m < 2; m++) {
+        cost_matrices_2d_t *costMtx = costMatrices[m];
+        unsigned int halfCosts[TEST_COUNT];
+        for (size_t k = 0; k < TEST_COUNT; k++) halfCosts[k] = align_pair( &pairs[k], costMtx, UINT_MAX, workspace ) / 2;
+
+        clock_t start = clock();
+        for (size_t k = 0; k < BENCH_COUNT; k++) align_pair( &pairs[k % TEST_COUNT], costMtx, UINT_MAX, workspace );
+        const double unbounded = seconds(start);
+
+        start = clock();
+        for (size_t k = 0; k < BENCH_COUNT; k++) align_pair( &pairs[k % TEST_COUNT], costMtx, halfCosts[k % TEST_COUNT], workspace );
+        const double bounded = seconds(start);
+
+        printf("  %-10s no ceiling %8.3f s   half the cost %8.3f s\n", m ? "affine" : "non-affine", unbounded, bounded);
+    }
+
+    freeAlignmentWorkspace( workspace );
+    free(expected);
+    free(actual);
+    for (size_t k = 0; k < TEST_COUNT; k++) free_pair( &pairs[k] );
+    freeCostMtx( costMatrices[0], 1 );
+    freeCostMtx( costMatrices[1], 1 );
+    freeCostMtx( costMtx3d,       0 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -0,0 +1,213 @@
+/** Tests align2dCost() against align2d() and align2dAffine() without medians: on random characters
+    whose lengths reach each case of the Ukkonen band, the costs must be equal. Then checks that an
+    upper bound below the cost stops it early, with a value above the bound, and that one at or
+    above the cost does not change it, also for a pair long enough that align2d() aligns it in linear
+    space. Finally times both.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+#include "../../linearSpaceAlignment.h"
+
+#define TEST_COUNT  400
+#define BENCH_COUNT 4000
+
+
+typedef struct pair_t {
+    elem_t    *vals[2];
+    size_t     lengths[2];
+    alignIO_t *io[4];        // two inputs, gapped and ungapped outputs
+} pair_t;
+
+
+/** Lengths for each case of algn_fill_plane_2(): short, one much longer than the other, and long and close. */
+static void choose_lengths( size_t test, size_t *lengths )
+{
+    switch (test % 4) {
+        case 0:  lengths[0] = rand() % 60 + 1;    lengths[1] = rand() % 60 + 1;                   break;
+        case 1:  lengths[0] = rand() % 200 + 20;  lengths[1] = lengths[0] * 2 + rand() % 50;      break;
+        case 2:  lengths[0] = rand() % 400 + 150; lengths[1] = lengths[0] + rand() % 30;          break;
+        default: lengths[0] = rand() % 300 + 100; lengths[1] = lengths[0] + lengths[0] / 4 + rand() % 20;
+    }
+    if (rand() % 2) {
+        const size_t tmp = lengths[0];
+        lengths[0] = lengths[1];
+        lengths[1] = tmp;
+    }
+}
+
+
+static void alloc_pair( pair_t *pair, size_t test )
+{
+    choose_lengths( test, pair->lengths );
+    for (size_t i = 0; i < 2; i++) {
+        pair->vals[i] = malloc( pair->lengths[i] * sizeof(elem_t) );
+        // Mostly unambiguous, so that alignments are not all free.
+        for (size_t j = 0; j < pair->lengths[i]; j++) {
+            pair->vals[i][j] = rand() % 5 ? 1 << (rand() % 4) : rand() % 15 + 1;
+        }
+    }
+    const size_t room = pair->lengths[0] + pair->lengths[1] + 2;
+    for (size_t i = 0; i < 4; i++) pair->io[i] = allocAlignIO(room);
+}
+
+
+static void free_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) free(pair->vals[i]);
+    for (size_t i = 0; i < 4; i++) {
+        freeAlignIO(pair->io[i]);
+        free(pair->io[i]);
+    }
+}
+
+
+/** Put a pair's values back into its inputs, which alignments overwrite. */
+static void reset_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) {
+        alignIO_t *io = pair->io[i];
+        io->length = pair->lengths[i];
+        memcpy( io->character + io->capacity - io->length, pair->vals[i], io->length * sizeof(elem_t) );
+    }
+}
+
+
+/** A pair over LINEAR_SPACE_THRESHOLD cells, the second a copy of the first with about one element in 20 changed. */
+static void alloc_long_pair( pair_t *pair )
+{
+    pair->lengths[0] = 4200;
+    pair->lengths[1] = 4150;
+    assert( pair->lengths[0] * pair->lengths[1] > LINEAR_SPACE_THRESHOLD );
+    for (size_t i = 0; i < 2; i++) pair->vals[i] = malloc( pair->lengths[0] * sizeof(elem_t) );
+    for (size_t j = 0; j < pair->lengths[0]; j++) {
+        pair->vals[0][j] = 1 << (rand() % 4);
+        pair->vals[1][j] = rand() % 20 ? pair->vals[0][j] : 1u << (rand() % 5);
+    }
+    const size_t room = pair->lengths[0] + pair->lengths[1] + 2;
+    for (size_t i = 0; i < 4; i++) pair->io[i] = allocAlignIO(room);
+}
+
+
+static int full_cost( pair_t *pair, cost_matrices_2d_t *costMtx, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    return costMtx->cost_model_type
+         ? align2dAffine_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 0, UINT_MAX, workspace )
+         : align2d_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 0, 0, 0, UINT_MAX, workspace );
+}
+
+
+static int cost_only( pair_t *pair, cost_matrices_2d_t *costMtx, unsigned int upperBound, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    return align2dCost_ws( pair->io[0], pair->io[1], costMtx, upperBound, workspace );
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main()
+{
+    srand(31);
+
+    const size_t alphSize = 5;
+    unsigned int tcm[25];
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 2;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % 2;
+        }
+    }
+    cost_matrices_2d_t *costMatrices[2] = { malloc( sizeof(cost_matrices_2d_t) ), malloc( sizeof(cost_matrices_2d_t) ) };
+    setUp2dCostMtx( costMatrices[0], tcm, alphSize, 0 );
+    setUp2dCostMtx( costMatrices[1], tcm, alphSize, 3 );
+
+    pair_t pairs[TEST_COUNT];
+    for (size_t k = 0; k < TEST_COUNT; k++) alloc_pair( &pairs[k], k );
+
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing cost-only 2D alignment. ******\n");
+
+    for (size_t m = 0; m < 2; m++) {
+        cost_matrices_2d_t *costMtx = costMatrices[m];
+        size_t wrong = 0, unbounded = 0, notStopped = 0;
+
+        for (size_t k = 0; k < TEST_COUNT; k++) {
+            const int cost = full_cost( &pairs[k], costMtx, workspace );
+
+            wrong     += cost_only( &pairs[k], costMtx, UINT_MAX,  workspace ) != cost;
+            unbounded += cost_only( &pairs[k], costMtx, cost,      workspace ) != cost;
+            unbounded += cost_only( &pairs[k], costMtx, cost + 10, workspace ) != cost;
+            if (cost > 0) {
+                notStopped += cost_only( &pairs[k], costMtx, cost - 1, workspace ) <= cost - 1;
+                notStopped += cost_only( &pairs[k], costMtx, cost / 2, workspace ) <= cost / 2;
+            }
+        }
+        const char *model = m ? "affine" : "non-affine";
+        printf("  %-10s %-45s %s\n", model, "costs equal those of the full alignment", wrong      ? "FAILED" : "ok");
+        printf("  %-10s %-45s %s\n", model, "a bound at or above the cost changes nothing", unbounded  ? "FAILED" : "ok");
+        printf("  %-10s %-45s %s\n", model, "a bound below the cost is exceeded",          notStopped ? "FAILED" : "ok");
+        failures += wrong + unbounded + notStopped;
+    }
+
+    // align2d() and align2dAffine() align this in linear space; the cost-only rows need not.
+    pair_t longPair;
+    alloc_long_pair( &longPair );
+    for (size_t m = 0; m < 2; m++) {
+        cost_matrices_2d_t *costMtx = costMatrices[m];
+
+        const int cost      = full_cost( &longPair, costMtx, workspace );
+        const int wrong     = cost_only( &longPair, costMtx, UINT_MAX, workspace ) != cost;
+        const int unbounded = cost_only( &longPair, costMtx, cost,     workspace ) != cost;
+        const int stopped   = cost_only( &longPair, costMtx, cost / 2, workspace ) > cost / 2;
+
+        const char *model = m ? "affine" : "non-affine";
+        printf("  %-10s %-45s %s\n", model, "over the linear space threshold, costs equal", wrong || unbounded ? "FAILED" : "ok");
+        printf("  %-10s %-45s %s\n", model, "and a bound below the cost is exceeded",       stopped            ? "ok" : "FAILED");
+        failures += wrong + unbounded + !stopped;
+    }
+    free_pair( &longPair );
+
+    printf("\n******* Timing %d alignments of each kind. ******\n", BENCH_COUNT);
+    for (size_t m = 0; m < 2; m++) {
+        cost_matrices_2d_t *costMtx = costMatrices[m];
+
+        clock_t start = clock();
+        for (size_t k = 0; k < BENCH_COUNT; k++) full_cost( &pairs[k % TEST_COUNT], costMtx, workspace );
+        const double full = seconds(start);
+
+        start = clock();
+        for (size_t k = 0; k < BENCH_COUNT; k++) cost_only( &pairs[k % TEST_COUNT], costMtx, UINT_MAX, workspace );
+        const double costOnly = seconds(start);
+
+        printf("  %-10s full %8.3f s   cost only %8.3f s\n", m ? "affine" : "non-affine", full, costOnly);
+    }
+
+    freeAlignmentWorkspace( workspace );
+    for (size_t k = 0; k < TEST_COUNT; k++) free_pair( &pairs[k] );
+    freeCostMtx( costMatrices[0], 1 );
+    freeCostMtx( costMatrices[1], 1 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
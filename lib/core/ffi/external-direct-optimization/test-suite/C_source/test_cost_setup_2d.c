@@ -0,0 +1,113 @@
+/** Tests setUp2dCostMtx() against the loop it replaced, which called distance() for every pair of elements and
+    every nucleotide: costs, medians, prepend and tail costs must be identical for every alphabet size. Then
+    times both on the larger alphabets.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define MAX_ALPHABET 11
+
+
+/** A random symmetric matrix, with many ties. */
+static unsigned int *make_tcm( size_t alphSize )
+{
+    unsigned int *tcm = malloc( alphSize * alphSize * sizeof(unsigned int) );
+    for (size_t i = 0; i < alphSize; i++) {
+        tcm[i * alphSize + i] = 0;
+        for (size_t j = 0; j < i; j++) tcm[i * alphSize + j] = tcm[j * alphSize + i] = rand() % 4 + 1;
+    }
+    return tcm;
+}
+
+
+/** setUp2dCostMtx() as it was. */
+static void reference_setup( cost_matrices_2d_t *costMtx, unsigned int *tcm, size_t alphSize )
+{
+    const elem_t all_elements = (1 << alphSize) - 1;
+    cm_alloc_2d( costMtx, alphSize, 1, 0, 0, 1, all_elements );
+
+    for (elem_t ambElem1 = 1; ambElem1 <= all_elements; ambElem1++) {
+        for (elem_t ambElem2 = 1; ambElem2 <= all_elements; ambElem2++) {
+            int    minCost = INT_MAX;
+            elem_t median  = 0;
+            for (elem_t nucleotide = 1; nucleotide <= alphSize; nucleotide++) {
+                const int curCost = distance (tcm, alphSize, nucleotide, ambElem1)
+                                  + distance (tcm, alphSize, nucleotide, ambElem2);
+                if (curCost < minCost) {
+                    minCost = curCost;
+                    median  = 1 << (nucleotide - 1);
+                } else if (curCost == minCost) {
+                    median |= 1 << (nucleotide - 1);
+                }
+            }
+            cm_set_cost_2d   (costMtx, ambElem1, ambElem2, minCost);
+            cm_set_median_2d (costMtx, ambElem1, ambElem2, median);
+        }
+    }
+    const elem_t gap = 1 << (alphSize - 1);
+    costMtx->gap_char = gap;
+    for (size_t i = 1; i <= all_elements; i++) {
+        cm_set_prepend_2d (costMtx, i, cm_get_cost_2d(costMtx, gap,   i));
+        cm_set_tail_2d    (costMtx, i, cm_get_cost_2d(costMtx,   i, gap));
+    }
+}
+
+
+/** Wall-clock seconds: the setup may run on several threads. */
+static double now( void )
+{
+    struct timespec time;
+    timespec_get( &time, TIME_UTC );
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+
+int main()
+{
+    srand(47);
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing 2D cost matrix setup against the pairwise loop, and timing both. ******\n");
+
+    for (size_t alphSize = 2; alphSize <= MAX_ALPHABET; alphSize++) {
+        unsigned int       *tcm       = make_tcm( alphSize );
+        cost_matrices_2d_t *expected  = malloc( sizeof(cost_matrices_2d_t) ),
+                           *actual    = malloc( sizeof(cost_matrices_2d_t) );
+
+        double start = now();
+        reference_setup( expected, tcm, alphSize );
+        const double before = now() - start;
+
+        start = now();
+        setUp2dCostMtx( actual, tcm, alphSize, 0 );
+        const double after = now() - start;
+
+        // Only the first of the 2 * dimension^2 cells allocated for each matrix are used.
+        const size_t cells = actual->costMatrixDimension * actual->costMatrixDimension;
+        const int    wrong = memcmp( expected->cost,         actual->cost,         cells * sizeof(unsigned int) ) != 0
+                          || memcmp( expected->median,       actual->median,       cells * sizeof(elem_t)       ) != 0
+                          || memcmp( expected->prepend_cost, actual->prepend_cost, cells * sizeof(unsigned int) ) != 0
+                          || memcmp( expected->tail_cost,    actual->tail_cost,    cells * sizeof(unsigned int) ) != 0
+                          || expected->gap_char != actual->gap_char;
+        printf("  %2zu elements  %-10s   pairwise loop %8.4f s   now %8.4f s\n", alphSize, wrong ? "FAILED" : "identical", before, after);
+        failures += wrong;
+
+        freeCostMtx( expected, 1 );
+        freeCostMtx( actual,   1 );
+        free(tcm);
+    }
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -0,0 +1,174 @@
+/** Checks every row kernel this CPU supports against the scalar one, on random rows with many
+    ties, with and without directions, and its packing of directions. Then times each on long rows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../fillRowKernel.h"
+
+#define TEST_COUNT   2000
+#define MAX_LENGTH   300
+#define BENCH_LENGTH 20000
+#define BENCH_ROWS   2000
+
+
+typedef struct row_t {
+    unsigned int    *prevRow,
+                    *gap_row,
+                    *align_row,
+                    *curRow;
+    DIR_MTX_ARROW_t *dirVect;
+} row_t;
+
+
+static void alloc_row( row_t *row, size_t length )
+{
+    row->prevRow   = malloc( length * sizeof(unsigned int) );
+    row->gap_row   = malloc( length * sizeof(unsigned int) );
+    row->align_row = malloc( length * sizeof(unsigned int) );
+    row->curRow    = malloc( length * sizeof(unsigned int) );
+    row->dirVect   = malloc( length * sizeof(DIR_MTX_ARROW_t) );
+}
+
+
+static void free_row( row_t *row )
+{
+    free(row->prevRow);
+    free(row->gap_row);
+    free(row->align_row);
+    free(row->curRow);
+    free(row->dirVect);
+}
+
+
+/** A row of costs near a diagonal of the matrix, with small steps so that moves tie often. */
+static void set_row( row_t *row, size_t length, unsigned int base )
+{
+    for (size_t i = 0; i < length; i++) {
+        row->prevRow[i]   = base + i + rand() % 4;
+        row->gap_row[i]   = rand() % 3 + 1;
+        row->align_row[i] = rand() % 3;
+        row->curRow[i]    = 0xDEAD;
+        row->dirVect[i]   = 0xBEEF;
+    }
+    row->curRow[0] = base + rand() % 4;
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main()
+{
+    srand(11);
+
+    const fill_row_kernel_t *kernels[FILL_ROW_KERNEL_COUNT];
+    const size_t kernelCount = algn_fill_row_kernels( kernels );
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing row kernels against the scalar one. ******\n");
+    printf("  chosen kernel: %s\n", algn_fill_row_kernel()->name);
+
+    row_t expected, actual;
+    alloc_row( &expected, MAX_LENGTH + 1 );
+    alloc_row( &actual,   MAX_LENGTH + 1 );
+    unsigned int *costsOnly = malloc( (MAX_LENGTH + 1) * sizeof(unsigned int) );
+
+    for (size_t k = 1; k < kernelCount; k++) {
+        size_t wrong = 0;
+        for (size_t test = 0; test < TEST_COUNT; test++) {
+            const size_t       length     = rand() % MAX_LENGTH + 2,
+                               startIndex = rand() % (length - 1) + 1,
+                               finalIndex = startIndex + rand() % (length - startIndex);
+            const unsigned int c          = rand() % 3 + 1;
+
+            set_row( &expected, length, rand() % 1000 );
+            memcpy( actual.prevRow,   expected.prevRow,   length * sizeof(unsigned int) );
+            memcpy( actual.gap_row,   expected.gap_row,   length * sizeof(unsigned int) );
+            memcpy( actual.align_row, expected.align_row, length * sizeof(unsigned int) );
+            memcpy( actual.curRow,    expected.curRow,    length * sizeof(unsigned int) );
+            memcpy( actual.dirVect,   expected.dirVect,   length * sizeof(DIR_MTX_ARROW_t) );
+            // The cell before the start is the carry into the row.
+            actual.curRow[startIndex - 1] = expected.curRow[startIndex - 1] = expected.curRow[0];
+            memcpy( costsOnly,        actual.curRow,      length * sizeof(unsigned int) );
+
+            kernels[0]->fill( expected.curRow, expected.prevRow, expected.gap_row, expected.align_row
+                            , expected.dirVect, c, startIndex, finalIndex );
+            kernels[k]->fill( actual.curRow, actual.prevRow, actual.gap_row, actual.align_row
+                            , actual.dirVect, c, startIndex, finalIndex );
+            kernels[k]->fill( costsOnly, actual.prevRow, actual.gap_row, actual.align_row
+                            , NULL, c, startIndex, finalIndex );
+
+            // Cells outside the range must be untouched, too.
+            wrong += memcmp( actual.curRow,  expected.curRow,  length * sizeof(unsigned int) ) != 0
+                  || memcmp( costsOnly,      expected.curRow,  length * sizeof(unsigned int) ) != 0
+                  || memcmp( actual.dirVect, expected.dirVect, length * sizeof(DIR_MTX_ARROW_t) ) != 0;
+        }
+        printf("  %-10s %s\n", kernels[k]->name, wrong ? "FAILED" : "ok");
+        failures += wrong;
+    }
+
+    DIR_MTX_ARROW_t *dirs = malloc( (MAX_LENGTH + 1) * sizeof(DIR_MTX_ARROW_t) );
+    unsigned char   *expectedPacked = malloc( MAX_LENGTH / 2 + 1 ),
+                    *actualPacked   = malloc( MAX_LENGTH / 2 + 1 );
+    // The scalar packer is checked, too, for the nibbles outside the range.
+    for (size_t k = 0; k < kernelCount; k++) {
+        size_t wrong = 0;
+        for (size_t test = 0; test < TEST_COUNT; test++) {
+            const size_t length = rand() % MAX_LENGTH + 1,
+                         first  = rand() % length,
+                         last   = first + rand() % (length - first);
+
+            // Cells outside the range hold no direction, and must pack as 0.
+            for (size_t i = 0; i <= MAX_LENGTH; i++) dirs[i] = first <= i && i <= last ? rand() % 8 : 0xF;
+            memset( expectedPacked, 0xA5, MAX_LENGTH / 2 + 1 );
+            memset( actualPacked,   0xA5, MAX_LENGTH / 2 + 1 );
+
+            kernels[0]->pack( expectedPacked, dirs, first, last );
+            kernels[k]->pack( actualPacked,   dirs, first, last );
+
+            wrong += memcmp( actualPacked, expectedPacked, MAX_LENGTH / 2 + 1 ) != 0;
+            for (size_t i = first; i <= last; i++) {
+                wrong += ((expectedPacked[i / 2] >> (i % 2 * 4)) & 0xF) != dirs[i];
+            }
+            wrong += first % 2 == 1 && (actualPacked[first / 2] & 0xF) != 0;
+            wrong += last  % 2 == 0 && (actualPacked[last  / 2] >> 4)  != 0;
+        }
+        printf("  %-10s %s\n", kernels[k]->name, wrong ? "FAILED packing" : "ok packing");
+        failures += wrong;
+    }
+    free(dirs);
+    free(expectedPacked);
+    free(actualPacked);
+
+    free_row( &expected );
+    free_row( &actual );
+    free(costsOnly);
+
+    printf("\n******* Timing %d rows of %d cells. ******\n", BENCH_ROWS, BENCH_LENGTH);
+    row_t bench;
+    alloc_row( &bench, BENCH_LENGTH );
+    set_row( &bench, BENCH_LENGTH, 0 );
+    for (size_t k = 0; k < kernelCount; k++) {
+        const clock_t start = clock();
+        for (size_t r = 0; r < BENCH_ROWS; r++) {
+            kernels[k]->fill( bench.curRow, bench.prevRow, bench.gap_row, bench.align_row
+                            , bench.dirVect, 1, 1, BENCH_LENGTH - 1 );
+        }
+        printf("  %-10s %8.3f s\n", kernels[k]->name, seconds(start));
+    }
+    free_row( &bench );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
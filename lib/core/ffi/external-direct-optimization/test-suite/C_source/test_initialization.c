@@ -204,7 +204,7 @@ int main() {
         // printf("Original alignment matrix before algn_nw_2d: \n");
         // algn_print_dynmtrx_2d( longChar, shortChar, algn_mtxs2d );
 
-        algnCost = algn_nw_2d( shortChar, longChar, costMtx2d, algn_mtxs2d, deltawh );
+        algnCost = algn_nw_2d( shortChar, longChar, costMtx2d, algn_mtxs2d, deltawh, UINT_MAX, NULL );
 
         if (DEBUG_MAT) {
             printf("\n\nFinal alignment matrix: \n\n");
@@ -389,6 +389,7 @@ int main() {
                                              , precalcMtx
                                              , gap_open_prec
                                              , s_horizontal_gap_extension
+                                             , UINT_MAX
                                              );
 
 
@@ -615,9 +615,7 @@ void do3D( unsigned int *tcm, size_t alphSize )
                       , ungappedMedianChar
                       , gappedMedianChar
                       , costMtx3d
-                      , 1        // substitution_cost
                       , 1        // gap open cost
-                      , 2        // gap extension cost
                       );
     // if (DEBUG_MAT) {
     //     printf("\n\nFinal alignment matrix: \n\n");
@@ -166,9 +166,7 @@ int wrapperFunction( elem_t *input_vals1
                       , ungappedMedianChar
                       , gappedMedianChar
                       , costMtx3d
-                      , 1        // substitution cost
-                      , 2        // gap open cost > 1 == affine
-                      , 1        // gap extension cost
+                      , 2        // gap open cost > 0 == affine
                       );
 
     /* I started to do this to send the three outputs back to Python for eventual comparison to the POY output. But then I realized
@@ -0,0 +1,264 @@
+/** Tests lazy 3D cost matrices:
+    1. for alphabets small enough for a dense matrix, every entry of a lazy one is that of the dense one,
+       and align3d() gives the same alignments with either;
+    2. for larger alphabets, entries are those computed directly, also when looked up from several threads;
+    3. only the ambiguous triples looked up are kept.
+    Then times setting up dense and lazy matrices.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define ALIGN_COUNT  12
+#define LOOKUP_COUNT 20000
+#define THREAD_COUNT 4
+
+
+/** A symmetric matrix with a costlier gap, the last element, and several substitution costs. */
+static unsigned int *make_tcm( size_t alphSize )
+{
+    unsigned int *tcm = malloc( alphSize * alphSize * sizeof(unsigned int) );
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 3;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % 3;
+        }
+    }
+    return tcm;
+}
+
+
+/** Cost and median of a triple, straight from the definition. */
+static unsigned int expected_cost( const unsigned int *tcm, size_t alphSize, const elem_t *triple, elem_t *median )
+{
+    unsigned int minCost = UINT_MAX;
+    for (size_t state = 0; state < alphSize; state++) {
+        unsigned int cost = 0;
+        for (size_t e = 0; e < 3; e++) {
+            unsigned int best = UINT_MAX;
+            for (size_t pos = 0; pos < alphSize; pos++) {
+                if (triple[e] & (1u << pos) && tcm[pos * alphSize + state] < best) best = tcm[pos * alphSize + state];
+            }
+            cost += best;
+        }
+        if      (cost <  minCost) { minCost = cost; *median  = 1u << state; }
+        else if (cost == minCost) {                 *median |= 1u << state; }
+    }
+    return minCost;
+}
+
+
+/** rand() is shared by all threads, so each thread draws from its own generator (xorshift32). */
+static unsigned int next_random( unsigned int *state )
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+/** Mostly unambiguous elements, as in real characters. */
+static elem_t random_elem( size_t alphSize, unsigned int *state )
+{
+    const elem_t all = (1u << alphSize) - 1;
+    return next_random(state) % 3 ? 1u << (next_random(state) % alphSize) : next_random(state) % all + 1;
+}
+
+
+typedef struct lookups_t {
+    const cost_matrices_3d_t *costMtx;
+    const unsigned int       *tcm;
+    unsigned int              seed;
+    size_t                    wrong;
+} lookups_t;
+
+
+/** Look up random triples, and count those that are wrong. */
+static void *check_lookups( void *arg )
+{
+    lookups_t   *job   = arg;
+    const size_t size  = job->costMtx->alphSize;
+    unsigned int state = job->seed;
+    for (size_t k = 0; k < LOOKUP_COUNT; k++) {
+        const elem_t triple[3] = { random_elem(size, &state), random_elem(size, &state), random_elem(size, &state) };
+        elem_t median = 0;
+        const unsigned int cost = expected_cost( job->tcm, size, triple, &median );
+        job->wrong += cm_get_cost_3d(   job->costMtx, triple[0], triple[1], triple[2] ) != cost
+                   || cm_get_median_3d( job->costMtx, triple[0], triple[1], triple[2] ) != median;
+    }
+    return NULL;
+}
+
+
+/** Aligns three characters, and writes the lengths and used parts of the five outputs to out. */
+static int align_triple( elem_t **vals, size_t *lengths, cost_matrices_3d_t *costMtx, elem_t *out )
+{
+    const size_t room = lengths[0] + lengths[1] + lengths[2];
+    alignIO_t *inputs[3]  = { allocAlignIO(room), allocAlignIO(room), allocAlignIO(room) },
+              *outputs[5] = { allocAlignIO(room), allocAlignIO(room), allocAlignIO(room), allocAlignIO(room), allocAlignIO(room) };
+    for (size_t i = 0; i < 3; i++) copyValsToAIO( inputs[i], vals[i], lengths[i], room );
+
+    const int cost = align3d( inputs[0], inputs[1], inputs[2], outputs[0], outputs[1], outputs[2], outputs[3], outputs[4]
+                            , costMtx, 2 );
+
+    size_t n = 0;
+    for (size_t i = 0; i < 5; i++) {
+        out[n++] = outputs[i]->length;
+        memcpy( out + n, outputs[i]->character + outputs[i]->capacity - outputs[i]->length, outputs[i]->length * sizeof(elem_t) );
+        n += outputs[i]->length;
+        freeAlignIO(outputs[i]);
+        free(outputs[i]);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        freeAlignIO(inputs[i]);
+        free(inputs[i]);
+    }
+    return cost;
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main()
+{
+    srand(43);
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing lazy 3D cost matrices. ******\n");
+
+    // Every entry, against a dense matrix.
+    for (size_t alphSize = 5; alphSize <= CM_3D_DENSE_MAX_ALPHABET; alphSize++) {
+        unsigned int       *tcm   = make_tcm( alphSize );
+        cost_matrices_3d_t *dense = malloc( sizeof(cost_matrices_3d_t) ),
+                           *lazy  = malloc( sizeof(cost_matrices_3d_t) );
+        setUp3dCostMtx(   dense, tcm, alphSize, 0 );
+        cm_alloc_3d_lazy( lazy,  alphSize, 0, 0, tcm );
+
+        const elem_t all   = (1u << alphSize) - 1;
+        size_t       wrong = lazy->gap_char != dense->gap_char || lazy->costMatrixDimension != dense->costMatrixDimension;
+        for (elem_t a = 1; a <= all; a++) {
+            for (elem_t b = 1; b <= all; b++) {
+                for (elem_t c = 1; c <= all; c++) {
+                    wrong += cm_get_cost_3d(   lazy, a, b, c ) != cm_get_cost_3d(   dense, a, b, c )
+                          || cm_get_median_3d( lazy, a, b, c ) != cm_get_median_3d( dense, a, b, c );
+                }
+            }
+        }
+        printf("  %2zu elements  %-45s %s\n", alphSize, "every entry is that of the dense matrix", wrong ? "FAILED" : "ok");
+        failures += wrong;
+
+        freeCostMtx( dense, 0 );
+        freeCostMtx( lazy,  0 );
+        free(tcm);
+    }
+
+    // Alignments, against a dense matrix.
+    {
+        unsigned int       *tcm   = make_tcm( 5 );
+        cost_matrices_3d_t *dense = malloc( sizeof(cost_matrices_3d_t) ),
+                           *lazy  = malloc( sizeof(cost_matrices_3d_t) );
+        setUp3dCostMtx(   dense, tcm, 5, 0 );
+        cm_alloc_3d_lazy( lazy,  5, 0, 0, tcm );
+
+        size_t wrong = 0;
+        for (size_t k = 0; k < ALIGN_COUNT; k++) {
+            elem_t *vals[3];
+            size_t  lengths[3];
+            for (size_t i = 0; i < 3; i++) {
+                lengths[i] = rand() % 20 + 5;
+                vals[i]    = malloc( lengths[i] * sizeof(elem_t) );
+                for (size_t j = 0; j < lengths[i]; j++) vals[i][j] = rand() % 4 ? 1u << (rand() % 4) : (elem_t) (rand() % 15 + 1);
+            }
+            elem_t expected[5 * 80] = { 0 }, actual[5 * 80] = { 0 };
+            wrong += align_triple( vals, lengths, dense, expected ) != align_triple( vals, lengths, lazy, actual )
+                  || memcmp( expected, actual, sizeof(expected) ) != 0;
+            for (size_t i = 0; i < 3; i++) free(vals[i]);
+        }
+        printf("  %2zu elements  %-45s %s\n", (size_t) 5, "align3d() is unchanged", wrong ? "FAILED" : "ok");
+        failures += wrong;
+
+        freeCostMtx( dense, 0 );
+        freeCostMtx( lazy,  0 );
+        free(tcm);
+    }
+
+    // Alphabets too large for a dense matrix, from several threads at once.
+    const size_t largeSizes[2] = { 8, 21 };
+    for (size_t s = 0; s < 2; s++) {
+        const size_t        alphSize = largeSizes[s];
+        unsigned int       *tcm      = make_tcm( alphSize );
+        cost_matrices_3d_t *costMtx  = malloc( sizeof(cost_matrices_3d_t) );
+        setUp3dCostMtx( costMtx, tcm, alphSize, 0 );
+
+        size_t    wrong = costMtx->lazy == NULL;
+        lookups_t jobs[THREAD_COUNT];
+        pthread_t threads[THREAD_COUNT];
+        for (size_t t = 0; t < THREAD_COUNT; t++) {
+            jobs[t] = (lookups_t) { costMtx, tcm, (unsigned int) (t % 2 + 7 * s + 1), 0 };   // Pairs of threads look up the same triples.
+            pthread_create( &threads[t], NULL, check_lookups, &jobs[t] );
+        }
+        for (size_t t = 0; t < THREAD_COUNT; t++) {
+            pthread_join( threads[t], NULL );
+            wrong += jobs[t].wrong;
+        }
+        printf("  %2zu elements  %-45s %s\n", alphSize, "entries are right, from several threads", wrong ? "FAILED" : "ok");
+        failures += wrong;
+
+        // Looking up the same triples again computes nothing more.
+        const size_t computed = cm_count_3d_lazy( costMtx );
+        jobs[0].wrong = 0;
+        check_lookups( &jobs[0] );
+        const size_t kept = computed > 2 * LOOKUP_COUNT || cm_count_3d_lazy( costMtx ) != computed || jobs[0].wrong;
+        printf("  %2zu elements  %-45s %s\n", alphSize, "only the triples looked up are kept", kept ? "FAILED" : "ok");
+        failures += kept;
+
+        freeCostMtx( costMtx, 0 );
+        free(tcm);
+    }
+
+    printf("\n******* Timing setting up 3D cost matrices. ******\n");
+    const size_t timedSizes[4] = { 5, 6, 8, 21 };
+    for (size_t s = 0; s < 4; s++) {
+        const size_t        alphSize = timedSizes[s];
+        unsigned int       *tcm      = make_tcm( alphSize );
+        cost_matrices_3d_t *costMtx  = malloc( sizeof(cost_matrices_3d_t) );
+
+        clock_t start = clock();
+        cm_alloc_3d_lazy( costMtx, alphSize, 0, 0, tcm );
+        const double lazy = seconds(start);
+        cm_free_3d_lazy( costMtx );
+
+        if (alphSize <= CM_3D_DENSE_MAX_ALPHABET) {
+            start = clock();
+            setUp3dCostMtx( costMtx, tcm, alphSize, 0 );
+            printf("  %2zu elements  dense %8.4f s   lazy %8.4f s\n", alphSize, seconds(start), lazy);
+            free(costMtx->cost);
+            free(costMtx->median);
+        } else {
+            printf("  %2zu elements  dense        -     lazy %8.4f s\n", alphSize, lazy);
+        }
+        free(costMtx);
+        free(tcm);
+    }
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
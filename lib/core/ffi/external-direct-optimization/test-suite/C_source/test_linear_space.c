@@ -0,0 +1,265 @@
+/** Tests the linear-space alignments against the full-matrix ones in align2d() and align2dAffine():
+    1. their costs must be equal, except that the affine one may be lower, where the affine
+       full-matrix fill is banded;
+    2. their alignments must be alignments of the inputs;
+    3. non-affine alignments must re-score to the cost returned.
+
+    Build with a small LINEAR_SPACE_BLOCK (see the makefile), so that short characters are divided.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../alignCharacters.h"
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+#include "../../dyn_character.h"
+#include "../../linearSpaceAlignment.h"
+
+#define TEST_COUNT 40
+
+
+static size_t failures = 0;
+
+
+static void check( int condition, const char *description, size_t test )
+{
+    if (!condition) {
+        printf("  test %2zu: %s FAILED\n", test, description);
+        failures++;
+    }
+}
+
+
+/** Random elements below max_val, without the gap bit unless withGaps. */
+static void set_vals( elem_t *vals, size_t length, elem_t gap_char, int withGaps )
+{
+    for (size_t k = 0; k < length; k++) {
+        elem_t val;
+        do {
+            val = rand() % (gap_char << 1);
+            if (!withGaps) val &= ~gap_char;
+        } while (val == 0);
+        vals[k] = val;
+    }
+}
+
+
+/** Copy vals into a new alignIO of capacity room, as the Haskell side passes them. */
+static alignIO_t *make_aio( const elem_t *vals, size_t length, size_t room )
+{
+    alignIO_t *aio = allocAlignIO(room);
+    copyValsToAIO( aio, (elem_t *) vals, length, room );
+    return aio;
+}
+
+
+static void drop_aio( alignIO_t *aio )
+{
+    freeAlignIO(aio);
+    free(aio);
+}
+
+
+/** Elements of an aligned character, less its leading gap and every gap, must be the input. */
+static int reproduces( const dyn_character_t *aligned, elem_t gap, const elem_t *vals, size_t length )
+{
+    size_t k = 0;
+    for (size_t i = 1; i < aligned->len; i++) {
+        const elem_t elem = aligned->char_begin[i];
+        if (elem == gap) continue;
+        if (k == length || elem != vals[k]) return 0;
+        k++;
+    }
+    return k == length && aligned->char_begin[0] != 0;
+}
+
+
+static void test2d( cost_matrices_2d_t *costMtx, size_t test, size_t lenA, size_t lenB )
+{
+    const elem_t gap_char = costMtx->gap_char;
+    const size_t room     = lenA + lenB + 2;
+
+    elem_t *valsA = malloc( lenA * sizeof(elem_t) ),
+           *valsB = malloc( lenB * sizeof(elem_t) );
+    set_vals( valsA, lenA, gap_char, test % 2 );
+    set_vals( valsB, lenB, gap_char, test % 2 );
+
+    // Full matrix, through the interface.
+    alignIO_t *inA      = make_aio( valsA, lenA, room ),
+              *inB      = make_aio( valsB, lenB, room ),
+              *gapped   = allocAlignIO(room),
+              *ungapped = allocAlignIO(room);
+    const unsigned int fullCost = align2d( inA, inB, gapped, ungapped, costMtx, 1, 1, 0 );
+
+    // Linear space, directly.
+    alignIO_t *longIO  = make_aio( lenA > lenB ? valsA : valsB, lenA > lenB ? lenA : lenB, room ),
+              *shortIO = make_aio( lenA > lenB ? valsB : valsA, lenA > lenB ? lenB : lenA, room );
+    dyn_character_t *longChar    = dyn_char_alloc(0),
+                    *shortChar   = dyn_char_alloc(0),
+                    *retLonger   = dyn_char_alloc(room),
+                    *retShorter  = dyn_char_alloc(room);
+    alignIOtoDynChar( longChar,  longIO,  costMtx->alphSize );
+    alignIOtoDynChar( shortChar, shortIO, costMtx->alphSize );
+
+    const unsigned int costOnly = algn_linear_space_2d( shortChar, longChar, retLonger, retShorter, costMtx, 0 );
+    const unsigned int cost     = algn_linear_space_2d( shortChar, longChar, retLonger, retShorter, costMtx, 1 );
+
+    check( costOnly == cost, "cost only equals cost with alignment", test );
+    // algn_nw_2d() widens its band until its cost is that of the whole plane.
+    check( cost == fullCost, "cost equals the full-matrix cost", test );
+
+    check( retLonger->len == retShorter->len, "aligned characters have equal lengths", test );
+    check( reproduces( retLonger,  0, longChar->char_begin  + 1, longChar->len  - 1 ), "longer character is aligned", test );
+    check( reproduces( retShorter, 0, shortChar->char_begin + 1, shortChar->len - 1 ), "shorter character is aligned", test );
+
+    unsigned int rescored = 0;
+    for (size_t i = 1; i < retLonger->len; i++) {
+        const elem_t l = retLonger->char_begin[i],
+                     s = retShorter->char_begin[i];
+        if      (l == 0) rescored += costMtx->prepend_cost[s];
+        else if (s == 0) rescored += cm_calc_cost_2d( costMtx->cost, l, gap_char, costMtx->alphSize );
+        else             rescored += cm_calc_cost_2d( costMtx->cost, l, s, costMtx->alphSize );
+    }
+    check( rescored == cost, "alignment re-scores to its cost", test );
+
+    printf("  test %2zu: lengths %4zu, %4zu  full-matrix cost %5u  linear-space cost %5u\n", test, lenA, lenB, fullCost, cost);
+
+    dyn_char_free(retLonger);
+    dyn_char_free(retShorter);
+    free(retLonger);
+    free(retShorter);
+    free(longChar);
+    free(shortChar);
+    drop_aio(inA);
+    drop_aio(inB);
+    drop_aio(gapped);
+    drop_aio(ungapped);
+    drop_aio(longIO);
+    drop_aio(shortIO);
+    free(valsA);
+    free(valsB);
+}
+
+
+static void test2dAffine( cost_matrices_2d_t *costMtx, size_t test, size_t lenA, size_t lenB )
+{
+    const elem_t gap_char = costMtx->gap_char;
+    const size_t room     = lenA + lenB + 2;
+    const int    withGaps = test % 2;
+
+    elem_t *valsA = malloc( lenA * sizeof(elem_t) ),
+           *valsB = malloc( lenB * sizeof(elem_t) );
+    set_vals( valsA, lenA, gap_char, withGaps );
+    set_vals( valsB, lenB, gap_char, withGaps );
+
+    alignIO_t *inA      = make_aio( valsA, lenA, room ),
+              *inB      = make_aio( valsB, lenB, room ),
+              *gapped   = allocAlignIO(room),
+              *ungapped = allocAlignIO(room);
+    const unsigned int fullCost = align2dAffine( inA, inB, gapped, ungapped, costMtx, 1 );
+
+    // align2dAffine() takes the first character as the longer when their lengths are equal.
+    alignIO_t *longIO  = make_aio( lenA >= lenB ? valsA : valsB, lenA >= lenB ? lenA : lenB, room ),
+              *shortIO = make_aio( lenA >= lenB ? valsB : valsA, lenA >= lenB ? lenB : lenA, room );
+    dyn_character_t *longChar       = dyn_char_alloc(0),
+                    *shortChar      = dyn_char_alloc(0),
+                    *gappedMedian   = dyn_char_alloc(room),
+                    *ungappedMedian = dyn_char_alloc(room),
+                    *retShortChar   = dyn_char_alloc(room),
+                    *retLongChar    = dyn_char_alloc(room);
+    alignIOtoDynChar( longChar,  longIO,  costMtx->alphSize );
+    alignIOtoDynChar( shortChar, shortIO, costMtx->alphSize );
+
+    const unsigned int costOnly = algn_linear_space_2d_affine( shortChar, longChar, NULL, NULL, NULL, NULL, costMtx, 0 );
+    const unsigned int cost     = algn_linear_space_2d_affine( shortChar, longChar
+                                                             , ungappedMedian, gappedMedian
+                                                             , retShortChar, retLongChar
+                                                             , costMtx, 1
+                                                             );
+
+    check( costOnly == cost, "cost only equals cost with alignment", test );
+    // algn_fill_plane_2d_affine() fills a band at least 40 wide.
+    if (longChar->len <= 40) {
+        check( cost == fullCost, "cost equals the full-matrix cost", test );
+    } else {
+        check( cost <= fullCost, "cost is no higher than the banded cost", test );
+    }
+
+    check( retShortChar->len == retLongChar->len, "aligned characters have equal lengths", test );
+    if (!withGaps) {
+        check( reproduces( retLongChar,  gap_char, longChar->char_begin  + 1, longChar->len  - 1 ), "longer character is aligned", test );
+        check( reproduces( retShortChar, gap_char, shortChar->char_begin + 1, shortChar->len - 1 ), "shorter character is aligned", test );
+    }
+    check( gappedMedian->len > 0 && gappedMedian->char_begin[0] == gap_char, "gapped median starts with a gap", test );
+
+    printf("  test %2zu: lengths %4zu, %4zu  full-matrix cost %5u  linear-space cost %5u\n", test, lenA, lenB, fullCost, cost);
+
+    dyn_char_free(gappedMedian);
+    dyn_char_free(ungappedMedian);
+    dyn_char_free(retShortChar);
+    dyn_char_free(retLongChar);
+    free(gappedMedian);
+    free(ungappedMedian);
+    free(retShortChar);
+    free(retLongChar);
+    free(longChar);
+    free(shortChar);
+    drop_aio(inA);
+    drop_aio(inB);
+    drop_aio(gapped);
+    drop_aio(ungapped);
+    drop_aio(longIO);
+    drop_aio(shortIO);
+    free(valsA);
+    free(valsB);
+}
+
+
+int main()
+{
+    srand(17);
+
+    const size_t alphSize = 5;
+    unsigned int tcm[25];
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 2;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % 2;
+        }
+    }
+
+    cost_matrices_2d_t *costMtx2d        = malloc( sizeof(cost_matrices_2d_t) ),
+                       *costMtx2d_affine = malloc( sizeof(cost_matrices_2d_t) );
+    setUp2dCostMtx( costMtx2d,        tcm, alphSize, 0 );
+    setUp2dCostMtx( costMtx2d_affine, tcm, alphSize, 3 );
+
+    printf("\n\n\n******* Testing linear-space non-affine alignment. ******\n");
+    for (size_t test = 0; test < TEST_COUNT; test++) {
+        const size_t shorter = rand() % 120 + 1,
+                     longer  = test < TEST_COUNT / 2 ? shorter + shorter / 2 + rand() % 60 : shorter + rand() % 20;
+        if (test % 3) test2d( costMtx2d, test, longer, shorter );
+        else          test2d( costMtx2d, test, shorter, longer );
+    }
+
+    printf("\n\n\n******* Testing linear-space affine alignment. ******\n");
+    for (size_t test = 0; test < TEST_COUNT; test++) {
+        const size_t shorter = test < TEST_COUNT / 2 ? rand() % 38 + 1 : rand() % 150 + 1,
+                     longer  = test < TEST_COUNT / 2 ? shorter + rand() % (40 - shorter) : shorter + rand() % 30;
+        if (test % 3) test2dAffine( costMtx2d_affine, test, longer, shorter );
+        else          test2dAffine( costMtx2d_affine, test, shorter, longer );
+    }
+
+    freeCostMtx( costMtx2d,        1 );
+    freeCostMtx( costMtx2d_affine, 1 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
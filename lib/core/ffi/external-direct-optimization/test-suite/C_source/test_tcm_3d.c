@@ -0,0 +1,259 @@
+/** Tests that align3d() finds alignments of least cost by the 3D cost matrix: its cost must equal
+    that of a search of the whole cube over the matrix, with and without a gap open cost, for
+    metric and non-metric TCMs, ambiguous elements, and dense and lazy matrices. Each alignment
+    must be of the input characters, cost what it is said to, and have the matrix's medians.
+    Then times it against Powell's search, which knows only a mismatch cost, and which is kept only
+    as this legacy reference.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+#include "../../ukkCommon.h"
+
+#define TEST_COUNT  40
+#define BENCH_COUNT 2
+
+
+/** Mostly unambiguous elements, never only a gap. */
+static elem_t random_elem( size_t alphSize )
+{
+    const elem_t symbols = (1u << (alphSize - 1)) - 1,
+                 gap     = 1u << (alphSize - 1);
+    if (rand() % 4) return 1u << (rand() % (alphSize - 1));
+    return (elem_t) (rand() % symbols + 1) | (rand() % 3 ? 0 : gap);
+}
+
+
+/** Three characters mutated from a common ancestor of length elements, one change in every rate. */
+static void alloc_triple( elem_t **vals, size_t *lengths, size_t alphSize, size_t length, size_t rate )
+{
+    elem_t *ancestor = malloc( (length + 1) * sizeof(elem_t) );
+    for (size_t k = 0; k < length; k++) ancestor[k] = random_elem( alphSize );
+
+    for (size_t i = 0; i < 3; i++) {
+        vals[i]    = malloc( (2 * length + 1) * sizeof(elem_t) );
+        lengths[i] = 0;
+        for (size_t k = 0; k < length; k++) {
+            const size_t change = rand() % (3 * rate);
+            if (change == 0) continue;                                          // deleted
+            if (change == 1) vals[i][lengths[i]++] = random_elem( alphSize );   // inserted before
+            vals[i][lengths[i]++] = change == 2 ? random_elem( alphSize ) : ancestor[k];
+        }
+    }
+    free(ancestor);
+}
+
+
+/** The least cost of an alignment, by searching the whole cube, a state for each set of
+ *  characters in the last column when there is a gap open cost.
+ */
+static unsigned int whole_cube_cost( elem_t **vals, size_t *lengths, const cost_matrices_3d_t *costMtx, unsigned int gapOpen )
+{
+    const size_t l1 = lengths[0] + 1, l2 = lengths[1] + 1, l3 = lengths[2] + 1;
+    unsigned int *cube = malloc( l1 * l2 * l3 * 7 * sizeof(unsigned int) );
+    for (size_t n = 0; n < l1 * l2 * l3 * 7; n++) cube[n] = UINT_MAX;
+    cube[6] = 0;
+
+    for (size_t i = 0; i < l1; i++) {
+        for (size_t j = 0; j < l2; j++) {
+            for (size_t k = 0; k < l3; k++) {
+                for (unsigned int column = 1; column <= 7; column++) {
+                    const size_t a = column & 1, b = (column >> 1) & 1, c = (column >> 2) & 1;
+                    if (i < a || j < b || k < c) continue;
+
+                    const unsigned int *before = cube + (((i - a) * l2 + (j - b)) * l3 + (k - c)) * 7;
+                    unsigned int best = UINT_MAX;
+                    for (unsigned int last = 1; last <= 7; last++) {
+                        if (before[last - 1] == UINT_MAX) continue;
+                        const unsigned int through = before[last - 1] + gapOpen * __builtin_popcount( last & ~column & 7 );
+                        if (through < best) best = through;
+                    }
+                    if (best == UINT_MAX) continue;
+
+                    cube[((i * l2 + j) * l3 + k) * 7 + column - 1] = best
+                        + cm_get_cost_3d( costMtx, a ? vals[0][i - 1] : costMtx->gap_char
+                                                 , b ? vals[1][j - 1] : costMtx->gap_char
+                                                 , c ? vals[2][k - 1] : costMtx->gap_char );
+                }
+            }
+        }
+    }
+
+    unsigned int best = UINT_MAX;
+    for (size_t s = 0; s < 7; s++) {
+        const unsigned int end = cube[(l1 * l2 * l3 - 1) * 7 + s];
+        if (end < best) best = end;
+    }
+    free(cube);
+    return best;
+}
+
+
+/** Aligns the triple with align3d(), and checks its outputs. Returns the cost, or UINT_MAX if the
+ *  outputs are not an alignment of the triple of that cost with the matrix's medians.
+ */
+static unsigned int check_align3d( elem_t **vals, size_t *lengths, const cost_matrices_3d_t *costMtx, unsigned int gapOpen )
+{
+    const size_t room = lengths[0] + lengths[1] + lengths[2] + 1;
+    alignIO_t *inputs[3], *outputs[5];
+    for (size_t i = 0; i < 3; i++) {
+        inputs[i] = allocAlignIO(room);
+        copyValsToAIO( inputs[i], vals[i], lengths[i], room );
+    }
+    for (size_t i = 0; i < 5; i++) outputs[i] = allocAlignIO(room);
+
+    unsigned int cost = align3d( inputs[0], inputs[1], inputs[2], outputs[0], outputs[1], outputs[2], outputs[3], outputs[4]
+                               , (cost_matrices_3d_t *) costMtx, gapOpen );
+
+    const size_t length = outputs[0]->length;
+    const elem_t gap    = costMtx->gap_char;
+    const elem_t *aligned[3], *gapped = outputs[3]->character + outputs[3]->capacity - outputs[3]->length;
+    for (size_t i = 0; i < 3; i++) aligned[i] = outputs[i]->character + outputs[i]->capacity - length;
+
+    int ok = outputs[1]->length == length && outputs[2]->length == length && outputs[3]->length == length;
+    unsigned int recomputed = 0, last = 7;
+    size_t       used[3]    = { 0, 0, 0 };
+    for (size_t n = 0; ok && n < length; n++) {
+        unsigned int column = 0;
+        for (size_t i = 0; i < 3; i++) {
+            if (aligned[i][n] == gap) continue;
+            column |= 1u << i;
+            ok &= used[i] < lengths[i] && aligned[i][n] == vals[i][used[i]];
+            used[i]++;
+        }
+        ok &= column != 0;
+        recomputed += cm_get_cost_3d( costMtx, aligned[0][n], aligned[1][n], aligned[2][n] )
+                    + gapOpen * __builtin_popcount( last & ~column & 7 );
+        ok &= gapped[n] == cm_get_median_3d( costMtx, aligned[0][n], aligned[1][n], aligned[2][n] );
+        last = column;
+    }
+    for (size_t i = 0; i < 3; i++) ok &= used[i] == lengths[i];
+    ok &= recomputed == cost;
+
+    for (size_t i = 0; i < 3; i++) {
+        freeAlignIO(inputs[i]);
+        free(inputs[i]);
+    }
+    for (size_t i = 0; i < 5; i++) {
+        freeAlignIO(outputs[i]);
+        free(outputs[i]);
+    }
+    return ok ? cost : UINT_MAX;
+}
+
+
+/** A TCM with a gap, the last element, costing gapCost, and substitutions from 1 to spread,
+ *  which is not a metric if spread is more than twice the least substitution.
+ */
+static unsigned int *make_tcm( size_t alphSize, unsigned int gapCost, unsigned int spread )
+{
+    unsigned int *tcm = malloc( alphSize * alphSize * sizeof(unsigned int) );
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = gapCost;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % spread;
+        }
+    }
+    return tcm;
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+int main()
+{
+    srand(67);
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing 3D alignment with the 3D cost matrix. ******\n");
+
+    // Nucleotides with a cheap and a dear gap, a non-metric TCM, and a lazy matrix.
+    const size_t       alphSizes[4] = { 5, 5, 5, 8 };
+    const unsigned int gapCosts[4]  = { 1, 4, 2, 3 },
+                       spreads[4]   = { 2, 2, 5, 3 };
+    const char        *names[4]     = { "cheap gap", "dear gap", "non-metric", "lazy, 8 elements" };
+
+    for (size_t m = 0; m < 4; m++) {
+        unsigned int       *tcm     = make_tcm( alphSizes[m], gapCosts[m], spreads[m] );
+        cost_matrices_3d_t *costMtx = malloc( sizeof(cost_matrices_3d_t) );
+        setUp3dCostMtx( costMtx, tcm, alphSizes[m], 0 );
+
+        for (unsigned int gapOpen = 0; gapOpen <= 3; gapOpen += 3) {
+            size_t wrong = 0;
+            for (size_t k = 0; k < TEST_COUNT; k++) {
+                elem_t *vals[3];
+                size_t  lengths[3];
+                alloc_triple( vals, lengths, alphSizes[m], k % 8 == 0 ? rand() % 3 : k % 5 == 1 ? rand() % 40 + 40 : rand() % 18 + 1
+                            , k % 2 ? 2 : 6 );
+
+                const unsigned int expected = whole_cube_cost( vals, lengths, costMtx, gapOpen ),
+                                   actual   = check_align3d( vals, lengths, costMtx, gapOpen );
+                wrong += expected != actual;
+                for (size_t i = 0; i < 3; i++) free(vals[i]);
+            }
+            printf( "  %-18s gap open %u   %-32s %s\n", names[m], gapOpen, "the least cost of the whole cube", wrong ? "FAILED" : "ok" );
+            failures += wrong;
+        }
+        freeCostMtx( costMtx, 0 );
+        free(tcm);
+    }
+
+    printf("\n******* Timing against Powell's search. ******\n");
+    {
+        unsigned int       *tcm     = make_tcm( 5, 2, 2 );
+        cost_matrices_3d_t *costMtx = malloc( sizeof(cost_matrices_3d_t) );
+        setUp3dCostMtx( costMtx, tcm, 5, 0 );
+
+        for (size_t length = 100; length <= 400; length *= 2) {
+            elem_t *vals[3];
+            size_t  lengths[3];
+            alloc_triple( vals, lengths, 5, length, 12 );
+            for (size_t i = 0; i < 3; i++) {
+                for (size_t k = 0; k < lengths[i]; k++) vals[i][k] = 1u << __builtin_ctz(vals[i][k]);   // Powell can't do ambiguity.
+            }
+
+            clock_t start = clock();
+            for (size_t b = 0; b < BENCH_COUNT; b++) check_align3d( vals, lengths, costMtx, 0 );
+            const double matrix = seconds(start);
+
+            characters_t *in  = alloc_characters_t( lengths[0], lengths[1], lengths[2] ),
+                         *out = alloc_characters_t( lengths[0] + lengths[1] + lengths[2]
+                                                  , lengths[0] + lengths[1] + lengths[2]
+                                                  , lengths[0] + lengths[1] + lengths[2] );
+            memcpy( in->seq1, vals[0], lengths[0] * sizeof(elem_t) );
+            memcpy( in->seq2, vals[1], lengths[1] * sizeof(elem_t) );
+            memcpy( in->seq3, vals[2], lengths[2] * sizeof(elem_t) );
+            start = clock();
+            for (size_t b = 0; b < BENCH_COUNT; b++) powell_3D_align( in, out, 4, 1, 0, 2, UINT_MAX );
+            const double powell = seconds(start);
+
+            printf( "  length %4zu   with the 3D matrix %8.4f s   Powell, a mismatch cost only %8.4f s\n", length, matrix, powell );
+            free_characters_t(in);
+            free_characters_t(out);
+            free(in);
+            free(out);
+            for (size_t i = 0; i < 3; i++) free(vals[i]);
+        }
+        freeCostMtx( costMtx, 0 );
+        free(tcm);
+    }
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -0,0 +1,233 @@
+/** Tests the structures setUp2dCostMtx() diagnoses, then the bit-vector alignment of discrete characters against
+    the generic one: align2dCost() with a TCM_NON_ADDITIVE matrix must give the cost it gives when the structure is
+    hidden, and that of align2d(), whatever the lengths, ambiguities and factor; characters that may hold gaps must
+    be left to the generic alignment. Then times both.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../alignCharacters.h"
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define ALPH_SIZE   5
+#define TEST_COUNT  300
+#define BENCH_COUNT 40
+
+
+typedef struct pair_t {
+    elem_t    *vals[2];
+    size_t     lengths[2];
+    alignIO_t *io[4];        // two inputs, gapped and ungapped outputs
+} pair_t;
+
+
+/** Mostly unambiguous elements; gaps may be among the states if withGaps. */
+static elem_t random_elem( int withGaps )
+{
+    const size_t states = withGaps ? ALPH_SIZE : ALPH_SIZE - 1;
+    return rand() % 5 ? 1u << (rand() % states) : (elem_t) (rand() % ((1u << states) - 1) + 1);
+}
+
+
+/** A character, and another that differs from it at about one element in mutationRate; or, if that is 0, an
+    unrelated one.
+ */
+static void alloc_pair( pair_t *pair, size_t length1, size_t length2, size_t mutationRate, int withGaps )
+{
+    pair->lengths[0] = length1;
+    pair->lengths[1] = length2;
+    for (size_t i = 0; i < 2; i++) pair->vals[i] = malloc( (pair->lengths[i] + 1) * sizeof(elem_t) );
+    for (size_t j = 0; j < length1; j++) pair->vals[0][j] = random_elem( withGaps );
+    for (size_t j = 0; j < length2; j++) {
+        pair->vals[1][j] = mutationRate && j < length1 && rand() % mutationRate ? pair->vals[0][j] : random_elem( withGaps );
+    }
+    const size_t room = length1 + length2 + 2;
+    for (size_t i = 0; i < 4; i++) pair->io[i] = allocAlignIO(room);
+}
+
+
+static void free_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) free(pair->vals[i]);
+    for (size_t i = 0; i < 4; i++) {
+        freeAlignIO(pair->io[i]);
+        free(pair->io[i]);
+    }
+}
+
+
+/** Put a pair's values back into its inputs, which alignments overwrite. */
+static void reset_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) {
+        alignIO_t *io = pair->io[i];
+        io->length = pair->lengths[i];
+        memcpy( io->character + io->capacity - io->length, pair->vals[i], io->length * sizeof(elem_t) );
+    }
+}
+
+
+static int full_cost( pair_t *pair, cost_matrices_2d_t *costMtx, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    return align2d_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 0, 0, 0, UINT_MAX, workspace );
+}
+
+
+/** The cost from align2dCost(), with the matrix's structure as diagnosed, or, if generic, hidden. */
+static int cost_only( pair_t *pair, cost_matrices_2d_t *costMtx, int generic, alignment_workspace_t *workspace )
+{
+    const int structure = costMtx->tcm_structure;
+    if (generic) costMtx->tcm_structure = TCM_NON_SYMMETRIC;
+
+    reset_pair( pair );
+    const int cost = align2dCost_ws( pair->io[0], pair->io[1], costMtx, UINT_MAX, workspace );
+
+    costMtx->tcm_structure = structure;
+    return cost;
+}
+
+
+/** Whether the bit-vector alignment would be chosen for the pair. */
+static int discrete_applies( pair_t *pair, cost_matrices_2d_t *costMtx )
+{
+    dyn_character_t chars[2];
+    reset_pair( pair );
+    for (size_t i = 0; i < 2; i++) alignIOtoDynChar( &chars[i], pair->io[i], ALPH_SIZE );
+    return algn_discrete_applies( &chars[0], &chars[1], costMtx );
+}
+
+
+/** Whether an element of the pair may be a gap. */
+static int has_gaps( const pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) {
+        for (size_t j = 0; j < pair->lengths[i]; j++) {
+            if (pair->vals[i][j] & (1u << (ALPH_SIZE - 1))) return 1;
+        }
+    }
+    return 0;
+}
+
+
+static double seconds( clock_t start )
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+/** A TCM of each structure, and the factor it has. */
+static const struct {
+    tcm_structure_t structure;
+    unsigned int    factor;
+    unsigned int    tcm[9];
+} diagnoses[] =
+    { { TCM_NON_SYMMETRIC, 1, { 0, 1, 2,   2, 0, 1,   2, 1, 0 } }
+    , { TCM_SYMMETRIC,     1, { 0, 5, 1,   5, 0, 1,   1, 1, 0 } }   // 5 > 1 + 1
+    , { TCM_SYMMETRIC,     2, { 0, 0, 2,   0, 0, 2,   2, 2, 0 } }   // a zero off the diagonal
+    , { TCM_METRIC,        1, { 0, 3, 2,   3, 0, 2,   2, 2, 0 } }   // 3 > max(2, 2)
+    , { TCM_ULTRAMETRIC,   1, { 0, 2, 2,   2, 0, 1,   2, 1, 0 } }
+    , { TCM_ADDITIVE,      3, { 0, 3, 6,   3, 0, 3,   6, 3, 0 } }
+    , { TCM_NON_ADDITIVE,  1, { 0, 1, 1,   1, 0, 1,   1, 1, 0 } }
+    , { TCM_NON_ADDITIVE,  4, { 0, 4, 4,   4, 0, 4,   4, 4, 0 } }
+    };
+
+
+int main()
+{
+    srand(53);
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing TCM structures and the discrete alignment. ******\n");
+
+    size_t misdiagnosed = 0;
+    for (size_t d = 0; d < sizeof(diagnoses) / sizeof(diagnoses[0]); d++) {
+        unsigned int factor = 0;
+        misdiagnosed += cm_diagnose_tcm( diagnoses[d].tcm, 3, &factor ) != diagnoses[d].structure
+                     || factor != diagnoses[d].factor;
+    }
+    printf("  %-60s %s\n", "each structure is diagnosed, with its factor", misdiagnosed ? "FAILED" : "ok");
+    failures += misdiagnosed;
+
+    // Discrete matrices with factors 1 and 3, then one that is not discrete.
+    cost_matrices_2d_t *costMatrices[3];
+    for (size_t m = 0; m < 3; m++) {
+        unsigned int tcm[ALPH_SIZE * ALPH_SIZE];
+        for (size_t i = 0; i < ALPH_SIZE; i++) {
+            for (size_t j = 0; j < ALPH_SIZE; j++) {
+                tcm[i * ALPH_SIZE + j] = i == j ? 0 : m == 0 ? 1 : m == 1 ? 3 : 1 + (i + j) % 2;
+            }
+        }
+        costMatrices[m] = malloc( sizeof(cost_matrices_2d_t) );
+        setUp2dCostMtx( costMatrices[m], tcm, ALPH_SIZE, 0 );
+    }
+    const int structured = costMatrices[0]->tcm_structure == TCM_NON_ADDITIVE && costMatrices[0]->tcm_factor == 1
+                        && costMatrices[1]->tcm_structure == TCM_NON_ADDITIVE && costMatrices[1]->tcm_factor == 3
+                        && costMatrices[2]->tcm_structure != TCM_NON_ADDITIVE;
+    printf("  %-60s %s\n", "setUp2dCostMtx() keeps the structure", structured ? "ok" : "FAILED");
+    failures += !structured;
+
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+
+    for (size_t m = 0; m < 3; m++) {
+        size_t wrong = 0, chosen = 0;
+        for (size_t k = 0; k < TEST_COUNT; k++) {
+            // Across block boundaries: empty, under a word, about a word, and many.
+            const size_t bounds[4] = { 3, 70, 200, 700 },
+                         length1   = rand() % bounds[k % 4] + 1,
+                         length2   = length1 + rand() % (length1 / 2 + 2);
+            const int    withGaps  = k % 5 == 0;
+
+            pair_t pair;
+            alloc_pair( &pair, length1, length2, k % 3 ? 10 : 0, withGaps );
+
+            const int cost = full_cost( &pair, costMatrices[m], workspace );
+            wrong  += cost_only( &pair, costMatrices[m], 0, workspace ) != cost
+                   || cost_only( &pair, costMatrices[m], 1, workspace ) != cost;
+            chosen += discrete_applies( &pair, costMatrices[m] ) != (m < 2 && !has_gaps( &pair ));
+
+            free_pair( &pair );
+        }
+        printf("  matrix %zu  %-50s %s\n", m, "costs equal those of the generic alignment", wrong  ? "FAILED" : "ok");
+        printf("  matrix %zu  %-50s %s\n", m, "bit vectors used only for discrete characters", chosen ? "FAILED" : "ok");
+        failures += wrong + chosen;
+    }
+
+    printf("\n******* Timing %d cost-only alignments of discrete characters. ******\n", BENCH_COUNT);
+    const size_t lengths[3]       = { 300, 2000, 8000 },
+                 mutationRates[2] = { 10, 0 };
+    for (size_t l = 0; l < 3; l++) {
+        for (size_t r = 0; r < 2; r++) {
+            pair_t pair;
+            alloc_pair( &pair, lengths[l], lengths[l] + lengths[l] / 20, mutationRates[r], 0 );
+
+            clock_t start = clock();
+            for (size_t k = 0; k < BENCH_COUNT; k++) cost_only( &pair, costMatrices[0], 1, workspace );
+            const double generic = seconds(start);
+
+            start = clock();
+            for (size_t k = 0; k < BENCH_COUNT; k++) cost_only( &pair, costMatrices[0], 0, workspace );
+            const double discrete = seconds(start);
+
+            printf( "  length %5zu  %-9s   generic %8.4f s   bit vectors %8.4f s\n"
+                  , lengths[l], mutationRates[r] ? "related" : "unrelated", generic, discrete );
+            free_pair( &pair );
+        }
+    }
+
+    freeAlignmentWorkspace( workspace );
+    for (size_t m = 0; m < 3; m++) freeCostMtx( costMatrices[m], 1 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
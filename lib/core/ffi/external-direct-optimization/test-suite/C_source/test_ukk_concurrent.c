@@ -0,0 +1,170 @@
+/** Tests that align3d() may be called from several threads at once: a set of random triples is
+    aligned serially, then again from many threads, each starting at a different triple, and every
+    concurrent result (cost, aligned characters and medians) must equal the serial one.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define JOB_COUNT    32
+#define THREAD_COUNT 8
+#define OUTPUT_COUNT 5
+
+
+typedef struct job_t {
+    elem_t *vals[3];
+    size_t  lengths[3];
+    int     cost;
+    elem_t *outputs[OUTPUT_COUNT];    // three aligned characters, then ungapped and gapped medians
+    size_t  outputLengths[OUTPUT_COUNT];
+} job_t;
+
+
+typedef struct worker_t {
+    job_t              *serial;
+    cost_matrices_3d_t *costMtx3d;
+    size_t              start;
+    size_t              mismatches;
+} worker_t;
+
+
+/** Aligns the job's inputs and copies its outputs into it. */
+static void run( job_t *job, cost_matrices_3d_t *costMtx3d )
+{
+    const size_t room = job->lengths[0] + job->lengths[1] + job->lengths[2];
+
+    alignIO_t *inputs[3], *outputs[OUTPUT_COUNT];
+    for (size_t i = 0; i < 3; i++) {
+        inputs[i] = allocAlignIO(room);
+        copyValsToAIO( inputs[i], job->vals[i], job->lengths[i], room );
+    }
+    for (size_t i = 0; i < OUTPUT_COUNT; i++) outputs[i] = allocAlignIO(room);
+
+    job->cost = align3d( inputs[0], inputs[1], inputs[2]
+                       , outputs[0], outputs[1], outputs[2]
+                       , outputs[3], outputs[4]
+                       , costMtx3d
+                       , 2        // gap open cost
+                       );
+
+    for (size_t i = 0; i < OUTPUT_COUNT; i++) {
+        const alignIO_t *out = outputs[i];
+        job->outputLengths[i] = out->length;
+        job->outputs[i]       = malloc( (out->length + 1) * sizeof(elem_t) );
+        memcpy( job->outputs[i], out->character + out->capacity - out->length, out->length * sizeof(elem_t) );
+        freeAlignIO(outputs[i]);
+        free(outputs[i]);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        freeAlignIO(inputs[i]);
+        free(inputs[i]);
+    }
+}
+
+
+static int same( const job_t *a, const job_t *b )
+{
+    if (a->cost != b->cost) return 0;
+    for (size_t i = 0; i < OUTPUT_COUNT; i++) {
+        if (a->outputLengths[i] != b->outputLengths[i]) return 0;
+        if (memcmp( a->outputs[i], b->outputs[i], a->outputLengths[i] * sizeof(elem_t) )) return 0;
+    }
+    return 1;
+}
+
+
+static void drop_outputs( job_t *job )
+{
+    for (size_t i = 0; i < OUTPUT_COUNT; i++) free(job->outputs[i]);
+}
+
+
+/** Runs half the jobs, from a different one in each thread, and counts those differing from the serial run. */
+static void *work( void *arg )
+{
+    worker_t *worker = arg;
+    for (size_t k = 0; k < JOB_COUNT / 2; k++) {
+        const job_t *serial = &worker->serial[(worker->start + k) % JOB_COUNT];
+        job_t job = *serial;
+
+        run( &job, worker->costMtx3d );
+        worker->mismatches += !same( &job, serial );
+        drop_outputs( &job );
+    }
+    return NULL;
+}
+
+
+int main()
+{
+    srand(23);
+
+    const size_t alphSize = 5;
+    unsigned int tcm[25];
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 2;
+            else                                               tcm[i * alphSize + j] = 1;
+        }
+    }
+    cost_matrices_3d_t *costMtx3d = malloc( sizeof(cost_matrices_3d_t) );
+    setUp3dCostMtx( costMtx3d, tcm, alphSize, 0 );
+
+    printf("\n\n\n******* Testing concurrent 3D alignment. ******\n");
+
+    job_t serial[JOB_COUNT];
+    for (size_t k = 0; k < JOB_COUNT; k++) {
+        for (size_t i = 0; i < 3; i++) {
+            serial[k].lengths[i] = rand() % 26 + 5;
+            serial[k].vals[i]    = malloc( serial[k].lengths[i] * sizeof(elem_t) );
+            for (size_t j = 0; j < serial[k].lengths[i]; j++) {
+                serial[k].vals[i][j] = 1 << (rand() % (alphSize - 1));
+            }
+        }
+        run( &serial[k], costMtx3d );
+    }
+
+    // Sanity check of the serial runs themselves: they must be repeatable.
+    size_t failures = 0;
+    for (size_t k = 0; k < JOB_COUNT; k++) {
+        job_t again = serial[k];
+        run( &again, costMtx3d );
+        failures += !same( &again, &serial[k] );
+        drop_outputs( &again );
+    }
+    printf("  %-50s %s\n", "serial alignments are repeatable", failures ? "FAILED" : "ok");
+
+    pthread_t threads[THREAD_COUNT];
+    worker_t  workers[THREAD_COUNT];
+    for (size_t t = 0; t < THREAD_COUNT; t++) {
+        workers[t] = (worker_t) { serial, costMtx3d, t * JOB_COUNT / THREAD_COUNT, 0 };
+        pthread_create( &threads[t], NULL, work, &workers[t] );
+    }
+    size_t mismatches = 0;
+    for (size_t t = 0; t < THREAD_COUNT; t++) {
+        pthread_join( threads[t], NULL );
+        mismatches += workers[t].mismatches;
+    }
+    printf("  %-50s %s\n", "concurrent alignments equal the serial ones", mismatches ? "FAILED" : "ok");
+    failures += mismatches;
+
+    for (size_t k = 0; k < JOB_COUNT; k++) {
+        for (size_t i = 0; i < 3; i++) free(serial[k].vals[i]);
+        drop_outputs( &serial[k] );
+    }
+    freeCostMtx( costMtx3d, 0 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -0,0 +1,256 @@
+/** Tests alignment workspaces:
+    1. align2d_ws(), align2dAffine_ws() and align3d_ws() with one workspace, reused for characters of
+       varying lengths, give the same results as align2d(), align2dAffine() and align3d();
+    2. once a workspace has grown for the longest characters, 2D and 3D alignments allocate nothing,
+       and do not grow it again.
+    3. the alignment_stats_t a workspace keeps count the kernel and the cells of each alignment.
+
+    Built with malloc, calloc and realloc wrapped (see the makefile), to count heap allocations.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../c_alignment_interface.h"
+#include "../../c_code_alloc_setup.h"
+#include "../../costMatrix.h"
+
+#define TEST_COUNT 60
+#define MAX_LENGTH 150
+
+
+static size_t allocations = 0;
+static size_t allocations3d = 0;    // Those made by align3d_ws() itself, not by align_triple() around it.
+
+void *__real_malloc( size_t size );
+void *__real_calloc( size_t count, size_t size );
+void *__real_realloc( void *p, size_t size );
+
+void *__wrap_malloc( size_t size )                { allocations++; return __real_malloc(size);          }
+void *__wrap_calloc( size_t count, size_t size )  { allocations++; return __real_calloc(count, size);   }
+void *__wrap_realloc( void *p, size_t size )      { allocations++; return __real_realloc(p, size);      }
+
+
+static size_t failures = 0;
+
+static void check( int condition, const char *description )
+{
+    printf("  %-60s %s\n", description, condition ? "ok" : "FAILED");
+    failures += !condition;
+}
+
+
+typedef struct pair_t {
+    elem_t    *vals[2];
+    size_t     lengths[2];
+    alignIO_t *io[4];        // two inputs, gapped and ungapped outputs
+} pair_t;
+
+
+/** Put a pair's values back into its inputs, without allocating. */
+static void reset_pair( pair_t *pair )
+{
+    for (size_t i = 0; i < 2; i++) {
+        alignIO_t *io = pair->io[i];
+        io->length = pair->lengths[i];
+        memcpy( io->character + io->capacity - io->length, pair->vals[i], io->length * sizeof(elem_t) );
+    }
+    pair->io[2]->length = pair->io[3]->length = 0;
+}
+
+
+/** The used parts of a pair's four alignIOs, one after another. Returns the number of elements written. */
+static size_t result( const pair_t *pair, elem_t *out )
+{
+    size_t n = 0;
+    for (size_t i = 0; i < 4; i++) {
+        const alignIO_t *io = pair->io[i];
+        out[n++] = io->length;
+        memcpy( out + n, io->character + io->capacity - io->length, io->length * sizeof(elem_t) );
+        n += io->length;
+    }
+    return n;
+}
+
+
+static int align_pair( pair_t *pair, cost_matrices_2d_t *costMtx, int affine, alignment_workspace_t *workspace )
+{
+    reset_pair( pair );
+    if (affine) {
+        return workspace ? align2dAffine_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1, UINT_MAX, workspace )
+                         : align2dAffine   ( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1 );
+    }
+    return workspace ? align2d_ws( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1, 1, 0, UINT_MAX, workspace )
+                     : align2d   ( pair->io[0], pair->io[1], pair->io[2], pair->io[3], costMtx, 1, 1, 0 );
+}
+
+
+static int align_triple( pair_t *pair, elem_t *third, size_t thirdLength, cost_matrices_3d_t *costMtx, alignment_workspace_t *workspace )
+{
+    const size_t room = pair->lengths[0] + pair->lengths[1] + thirdLength;
+    alignIO_t *inputs[3]  = { allocAlignIO(room), allocAlignIO(room), allocAlignIO(room) },
+              *outputs[5] = { allocAlignIO(room), allocAlignIO(room), allocAlignIO(room), allocAlignIO(room), allocAlignIO(room) };
+    copyValsToAIO( inputs[0], pair->vals[0], pair->lengths[0], room );
+    copyValsToAIO( inputs[1], pair->vals[1], pair->lengths[1], room );
+    copyValsToAIO( inputs[2], third,         thirdLength,      room );
+
+    const size_t before = allocations;
+    const int cost = workspace
+                   ? align3d_ws( inputs[0], inputs[1], inputs[2], outputs[0], outputs[1], outputs[2], outputs[3], outputs[4]
+                               , costMtx, 2, UINT_MAX, workspace )
+                   : align3d   ( inputs[0], inputs[1], inputs[2], outputs[0], outputs[1], outputs[2], outputs[3], outputs[4]
+                               , costMtx, 2 );
+    allocations3d += allocations - before;
+
+    // Fold the outputs into the cost, so that a difference in any shows.
+    int hash = cost;
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = outputs[i]->capacity - outputs[i]->length; j < outputs[i]->capacity; j++) {
+            hash = hash * 31 + outputs[i]->character[j];
+        }
+        freeAlignIO(outputs[i]);
+        free(outputs[i]);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        freeAlignIO(inputs[i]);
+        free(inputs[i]);
+    }
+    return hash;
+}
+
+
+int main()
+{
+    srand(29);
+
+    const size_t alphSize = 5;
+    unsigned int tcm[25];
+    for (size_t i = 0; i < alphSize; i++) {
+        for (size_t j = 0; j < alphSize; j++) {
+            if      (i == j)                                   tcm[i * alphSize + j] = 0;
+            else if (i == alphSize - 1 || j == alphSize - 1)   tcm[i * alphSize + j] = 2;
+            else                                               tcm[i * alphSize + j] = 1 + (i + j) % 2;
+        }
+    }
+    cost_matrices_2d_t *costMtx2d        = malloc( sizeof(cost_matrices_2d_t) ),
+                       *costMtx2d_affine = malloc( sizeof(cost_matrices_2d_t) );
+    cost_matrices_3d_t *costMtx3d        = malloc( sizeof(cost_matrices_3d_t) );
+    setUp2dCostMtx( costMtx2d,        tcm, alphSize, 0 );
+    setUp2dCostMtx( costMtx2d_affine, tcm, alphSize, 3 );
+    setUp3dCostMtx( costMtx3d,        tcm, alphSize, 0 );
+
+    // The first pair is the longest, so that the workspace need only grow for it.
+    pair_t pairs[TEST_COUNT];
+    for (size_t k = 0; k < TEST_COUNT; k++) {
+        for (size_t i = 0; i < 2; i++) {
+            pairs[k].lengths[i] = k == 0 ? MAX_LENGTH : rand() % MAX_LENGTH + 1;
+            pairs[k].vals[i]    = malloc( pairs[k].lengths[i] * sizeof(elem_t) );
+            for (size_t j = 0; j < pairs[k].lengths[i]; j++) {
+                pairs[k].vals[i][j] = rand() % 15 + 1;
+            }
+        }
+        const size_t room = pairs[k].lengths[0] + pairs[k].lengths[1] + 2;
+        for (size_t i = 0; i < 4; i++) pairs[k].io[i] = allocAlignIO(room);
+    }
+
+    printf("\n\n\n******* Testing alignment workspaces. ******\n");
+
+    alignment_workspace_t *workspace = allocAlignmentWorkspace();
+    elem_t *expected = malloc( 4 * (2 * MAX_LENGTH + 3) * sizeof(elem_t) ),
+           *actual   = malloc( 4 * (2 * MAX_LENGTH + 3) * sizeof(elem_t) );
+
+    for (int affine = 0; affine < 2; affine++) {
+        cost_matrices_2d_t *costMtx = affine ? costMtx2d_affine : costMtx2d;
+        size_t wrong = 0;
+        for (size_t k = 0; k < TEST_COUNT; k++) {
+            const int    expectedCost   = align_pair( &pairs[k], costMtx, affine, NULL );
+            const size_t expectedLength = result( &pairs[k], expected );
+            const int    actualCost     = align_pair( &pairs[k], costMtx, affine, workspace );
+            const size_t actualLength   = result( &pairs[k], actual );
+
+            wrong += expectedCost != actualCost
+                  || expectedLength != actualLength
+                  || memcmp( expected, actual, expectedLength * sizeof(elem_t) ) != 0;
+        }
+        check( wrong == 0, affine ? "affine alignments equal those without a workspace"
+                                  : "non-affine alignments equal those without a workspace" );
+    }
+
+    // Powell's alignment is slow, so only the shorter triples.
+    size_t wrong3d = 0;
+    elem_t thirds[TEST_COUNT][20];
+    for (size_t k = 1; k < TEST_COUNT; k += 4) {
+        if (pairs[k].lengths[0] > 40 || pairs[k].lengths[1] > 40) continue;
+        for (size_t j = 0; j < 20; j++) thirds[k][j] = 1 << (rand() % 4);
+        // 3D alignments take single elements only.
+        for (size_t i = 0; i < 2; i++) {
+            for (size_t j = 0; j < pairs[k].lengths[i]; j++) pairs[k].vals[i][j] = 1 << (pairs[k].vals[i][j] % 4);
+        }
+        wrong3d += align_triple( &pairs[k], thirds[k], 20, costMtx3d, NULL ) != align_triple( &pairs[k], thirds[k], 20, costMtx3d, workspace );
+    }
+    check( wrong3d == 0, "3D alignments equal those without a workspace" );
+
+    // Again, the 3D search finds the buffers it grew in the workspace.
+    alignment_workspace_stats_t before3d, after3d;
+    alignmentWorkspaceStats( workspace, &before3d );
+    allocations3d = 0;
+    for (size_t k = 1; k < TEST_COUNT; k += 4) {
+        if (pairs[k].lengths[0] > 40 || pairs[k].lengths[1] > 40) continue;
+        align_triple( &pairs[k], thirds[k], 20, costMtx3d, workspace );
+    }
+    alignmentWorkspaceStats( workspace, &after3d );
+    check( allocations3d == 0,                                                      "a grown workspace makes 3D alignments allocate nothing" );
+    check( after3d.growths == before3d.growths && after3d.bytes == before3d.bytes, "and reuses its 3D search buffers" );
+
+    alignment_workspace_stats_t before, after;
+    alignmentWorkspaceStats( workspace, &before );
+
+    allocations = 0;
+    for (size_t k = 0; k < TEST_COUNT; k++) {
+        align_pair( &pairs[k], costMtx2d,        0, workspace );
+        align_pair( &pairs[k], costMtx2d_affine, 1, workspace );
+    }
+    const size_t steadyAllocations = allocations;
+    alignmentWorkspaceStats( workspace, &after );
+
+    printf("  workspace: %zu bytes, %zu alignments, %zu of which grew it\n", after.bytes, after.alignments, after.growths);
+    check( steadyAllocations == 0,                               "a grown workspace makes 2D alignments allocate nothing" );
+    check( after.growths == before.growths,                      "and does not grow again" );
+    check( after.bytes == before.bytes && after.bytes > 0,       "and holds the same memory" );
+    check( after.alignments == before.alignments + 2 * TEST_COUNT, "and counts every alignment" );
+
+    alignment_stats_t lastStats, allStats;
+    align_pair( &pairs[0], costMtx2d, 0, workspace );
+    getAlignmentStats( workspace, &lastStats, &allStats );
+
+    const size_t plane = (pairs[0].lengths[0] + 1) * (pairs[0].lengths[1] + 1);
+    printf( "  last alignment: %zu cells in %zu bands, %zu of them the whole plane, %zu direction bytes\n"
+          , lastStats.cells, lastStats.bandPasses, lastStats.fullPlaneFills, lastStats.directionBytes );
+    check( lastStats.kernel == ALGN_KERNEL_2D_BANDED,                                "stats name the kernel of the last alignment" );
+    check( lastStats.cells > 0 && lastStats.cells <= plane * lastStats.bandPasses,   "and count its cells, within its bands" );
+    check( lastStats.bandPasses >= 1 && lastStats.directionBytes > 0,                "and its bands and direction matrix" );
+    check( allStats.cells > lastStats.cells && allStats.bandPasses > TEST_COUNT,     "and sum those of every alignment" );
+
+    freeAlignmentWorkspace( workspace );
+    free(expected);
+    free(actual);
+    for (size_t k = 0; k < TEST_COUNT; k++) {
+        for (size_t i = 0; i < 2; i++) free(pairs[k].vals[i]);
+        for (size_t i = 0; i < 4; i++) {
+            freeAlignIO(pairs[k].io[i]);
+            free(pairs[k].io[i]);
+        }
+    }
+    freeCostMtx( costMtx2d,        1 );
+    freeCostMtx( costMtx2d_affine, 1 );
+    freeCostMtx( costMtx3d,        0 );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -22,9 +22,13 @@
 // not retrieving the alignment.  Note also, the 'computed' field is
 // used to store which cost (actually d + costOffset) the cell contains
 // instead of simply whether the cell has been computed or not.
+//
+// All state lives in the ukk_context_t passed down from powell_3D_align(),
+// so alignments on different threads do not interfere.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 #include <assert.h>
 
@@ -37,11 +41,6 @@
           // MMM, MMD, MDD, IMM, etc.  all have exactly one neighbour
           // Not possible to have more than 1 'I' state (eg. MII IMI)
 
-typedef struct {
-    long cells;
-    long innerLoop;
-} Counts;
-
 //typedef struct {int dist; long computed;} U_cell_type;
 typedef struct {
     int ab,
@@ -65,71 +64,33 @@ typedef struct {
 
 //typedef struct {int from_ab, from_ac, from_cost, from_state;} From_type;
 
-// Functions to appear.
-AllocInfo_t myUAllocInfo;
-AllocInfo_t myCPAllocInfo;
-
-U_cell_type UdummyCell;
-CPType      CPdummyCell;
-
-U_cell_type *U(int ab, int ac, int d, int s)
+U_cell_type *U(ukk_context_t *context, int ab, int ac, int d, int s)
 {
-    return getPtr(&myUAllocInfo, ab, ac, d, s);
+    return getPtr(&context->uAllocInfo, ab, ac, d, s);
 }
 
-CPType *CP(int ab, int ac, int d, int s)
+CPType *CP(ukk_context_t *context, int ab, int ac, int d, int s)
 {
-    return getPtr(&myCPAllocInfo, ab, ac, d, s);
+    return getPtr(&context->cpAllocInfo, ab, ac, d, s);
 }
 
 
-void printTraceBack();
+void printTraceBack( ukk_context_t *context, characters_t *inputs, characters_t *outputs );
 
 
 
-int best( int ab, int ac, int d, int wantState );
+int best( ukk_context_t *context, int ab, int ac, int d, int wantState );
 
-int calcUkk( int ab, int ac, int d, int toState, characters_t *inputs );
+int calcUkk( ukk_context_t *context, int ab, int ac, int d, int toState, characters_t *inputs );
 
 int okIndex( int a, int da, int end );
 
 int whichCharCost( int a, int b, int c );
 
 
-Counts counts;
-
-// costOffset---added to the `computed` field of each cell. `costOffset` is
-// recursive step of the checlpoint algorithm. It's really a hack so I don't
-// have to reinitialize the memory structures.
-long costOffset = 1;
-long finalCost;
-
-int furthestReached_g = -1;
-int CPonDist;   // Flag for whether to use distance of cost as the CP criteria
-                // CP on dist is only done for first iteration when then final
-                // cost is unknown
-
-
-// Use these globals cause don't want to pass them around, and they're needed
-// by the withinMatrix func. Be nice to have closures :-)
-int sabG    = 0,
-    sacG    = 0,
-    sCostG  = 0,
-    sStateG = 0;
-
-int endA,     // Used to define where to end on the three strings in the
-    endB,     // checkp recursion. So endA contains the distance the recursion
-    endC;     // must finish on + 1.
-
-int completeFromInfo = 0;    // Set to 1 for base cases, so 'from' info that alignment
-                             // can be retrieved from is set.
-
-int CPwidth;
-int CPcost;
-
-
-int doUkk( characters_t *inputs
-         , characters_t *outputs
+int doUkk( ukk_context_t *context
+         , characters_t  *inputs
+         , characters_t  *outputs
          )
 {
     int d = -1,
@@ -137,15 +98,23 @@ int doUkk( characters_t *inputs
         finalac,
         startDist;
 
-    CPwidth = maxSingleStep_g;
+    context->CPwidth = context->maxSingleStep;
     // Concern: what is the correct value to use for Umatrix depth.
-    // Would think that maxSingleCost = maxSingleStep_g * 2 would be enough
+    // Would think that maxSingleCost = maxSingleStep * 2 would be enough
     // but doesn't seem to be.  No idea why. *shrug*
-    myUAllocInfo  = allocInit(sizeof(U_cell_type), maxSingleCost, inputs);
-    myCPAllocInfo = allocInit(sizeof(CPType),      CPwidth,       inputs);
+    context->uAllocInfo  = allocInit(sizeof(U_cell_type), context->maxSingleStep * 2, context->numStates, inputs);
+    context->cpAllocInfo = allocInit(sizeof(CPType),      context->CPwidth,           context->numStates, inputs);
+
+    context->costOffset       = 1;
+    context->furthestReached  = -1;
+    context->completeFromInfo = 0;
+    context->sab              = 0;
+    context->sac              = 0;
+    context->sCost            = 0;
+    context->sState           = 0;
 
-    counts.cells     = 0;
-    counts.innerLoop = 0;
+    context->counts.cells     = 0;
+    context->counts.innerLoop = 0;
 
     // Calculate starting position
     startDist = 0;
@@ -153,57 +122,64 @@ int doUkk( characters_t *inputs
            && (   inputs->seq1[startDist] == inputs->seq2[startDist]
                && inputs->seq1[startDist] == inputs->seq3[startDist]) ) {
         startDist++;
-        counts.innerLoop++;
+        context->counts.innerLoop++;
     }
-    U(0, 0, 0, 0)->dist     = startDist;
-    U(0, 0, 0, 0)->computed = 0 + costOffset;
+    U(context, 0, 0, 0, 0)->dist     = startDist;
+    U(context, 0, 0, 0, 0)->computed = 0 + context->costOffset;
     // startDist = startDist;
 
     finalab = inputs->lenSeq1 - inputs->lenSeq2;
     finalac = inputs->lenSeq1 - inputs->lenSeq3;
-    endA    = inputs->lenSeq1;
-    endB    = inputs->lenSeq2;
-    endC    = inputs->lenSeq3;
+    context->endA    = inputs->lenSeq1;
+    context->endB    = inputs->lenSeq2;
+    context->endC    = inputs->lenSeq3;
 
-    CPonDist = 1;
-    CPcost   = INFINITY;
+    context->CPonDist = 1;
+    context->CPcost   = INFINITY;
     do {
         d++;
+        // Every alignment costing d - 1 or less has been searched for, so the cost is over the ceiling.
+        if ((unsigned int) d > context->costCeiling) {
+            allocFree(&context->uAllocInfo);
+            allocFree(&context->cpAllocInfo);
+            return d;
+        }
         if (DEBUG_3D)     fprintf(stderr, "About to do cost %d\n", d);
-        Ukk(finalab, finalac, d, 0, inputs);
+        Ukk(context, finalab, finalac, d, 0, inputs);
 
-        if (DEBUG_3D) fprintf(stderr, "Furthest reached for cost %d is %d.\n", d, furthestReached_g);
+        if (DEBUG_3D) fprintf(stderr, "Furthest reached for cost %d is %d.\n", d, context->furthestReached);
 
-        if (CPonDist && furthestReached_g >= inputs->lenSeq1 / 2) {
-            CPcost   = d + 1;
-            CPonDist = 0;
-            if (DEBUG_3D) fprintf(stderr, "Setting CPcost = %d\n", CPcost);
+        if (context->CPonDist && context->furthestReached >= inputs->lenSeq1 / 2) {
+            context->CPcost   = d + 1;
+            context->CPonDist = 0;
+            if (DEBUG_3D) fprintf(stderr, "Setting CPcost = %d\n", context->CPcost);
         }
-    } while (best(finalab, finalac, d, 0) < inputs->lenSeq1);
+    } while (best(context, finalab, finalac, d, 0) < inputs->lenSeq1);
 
-    assert( best(finalab, finalac, d, 0) == inputs->lenSeq1 );
+    assert( best(context, finalab, finalac, d, 0) == inputs->lenSeq1 );
 
-    CPonDist  = 0;
-    finalCost = d;
+    context->CPonDist  = 0;
+    context->finalCost = d;
 
     {
         // Recurse for alignment
-        int fState = best(finalab, finalac, finalCost, 1);
+        int fState = best(context, finalab, finalac, context->finalCost, 1);
         int dist;
 
-        if (U( finalab, finalac, finalCost, fState )->from.cost <= 0) {
+        if (U( context, finalab, finalac, context->finalCost, fState )->from.cost <= 0) {
             // We check pointed too late on this first pass.
             // So we got no useful information. Oh well, have to do it all over again
-            assert( U(finalab, finalac, finalCost, fState)->computed == finalCost + costOffset );
+            assert( U(context, finalab, finalac, context->finalCost, fState)->computed == context->finalCost + context->costOffset );
 
-            dist = doUkkInLimits( 0
+            dist = doUkkInLimits( context
+                                , 0
                                 , 0
                                 , 0
                                 , 0
                                 , startDist
                                 , finalab
                                 , finalac
-                                , finalCost
+                                , context->finalCost
                                 , fState
                                 , inputs->lenSeq1  // TODO: Remove inputs->lenSeq1
                                 , inputs
@@ -211,14 +187,15 @@ int doUkk( characters_t *inputs
                                 );
         } else {
             // Use the 'from' info and do the two sub parts.
-            dist = getSplitRecurse( 0
+            dist = getSplitRecurse( context
+                                  , 0
                                   , 0
                                   , 0
                                   , 0
                                   , startDist
                                   , finalab
                                   , finalac
-                                  , finalCost
+                                  , context->finalCost
                                   , fState
                                   , inputs->lenSeq1  // TODO: Remove inputs->lenSeq1
                                   , inputs
@@ -227,47 +204,54 @@ int doUkk( characters_t *inputs
         }
 
         assert(dist == inputs->lenSeq1);
-        if (DEBUG_3D)    printTraceBack(inputs, outputs);
+        if (DEBUG_3D)    printTraceBack(context, inputs, outputs);
     }
     if (DEBUG_3D) {
-        printf("Final cost = %ld\n", finalCost);
+        printf("Final cost = %ld\n", context->finalCost);
 
         printf("Number of cells calculated = %ld.  Inner Loop = %ld\n",
-                counts.cells, counts.innerLoop);
+                context->counts.cells, context->counts.innerLoop);
         printf("DPA(N^3) would calculate %ld (or %ld)\n",
-                (inputs->lenSeq1 + 1L) * (inputs->lenSeq2 + 1) * (inputs->lenSeq3 + 1) * numStates_g,
+                (inputs->lenSeq1 + 1L) * (inputs->lenSeq2 + 1) * (inputs->lenSeq3 + 1) * context->numStates,
                 (inputs->lenSeq1 + 1L) * (inputs->lenSeq2 + 1) * (inputs->lenSeq3 + 1) * (MAX_STATES - 1));
 
         printf("\nU matrix Alloc info\n");
     }
-    allocFinal(&myUAllocInfo, (&UdummyCell.computed), (&UdummyCell));
+    if (OUTPUT_FINAL_ALLOC) {
+        U_cell_type UdummyCell;
+        CPType      CPdummyCell;
 
-    if (DEBUG_3D)    printf("\nCP matrix Alloc info\n");
+        allocFinal(&context->uAllocInfo, (&UdummyCell.computed), (&UdummyCell));
 
-    allocFinal(&myCPAllocInfo, (&CPdummyCell.cost), (&CPdummyCell));
+        if (DEBUG_3D)    printf("\nCP matrix Alloc info\n");
+
+        allocFinal(&context->cpAllocInfo, (&CPdummyCell.cost), (&CPdummyCell));
+    }
+    allocFree(&context->uAllocInfo);
+    allocFree(&context->cpAllocInfo);
 
     // Because lengths are never actually changed in output, but it should be clear to outside fns that the values can be used.
     outputs->lenSeq1 = outputs->idxSeq1;
     outputs->lenSeq2 = outputs->idxSeq2;
     outputs->lenSeq3 = outputs->idxSeq3;
 
-    return finalCost;
+    return context->finalCost;
 }
 
 
-int doUkkInLimits(int sab, int sac, int sCost, int sState, int sDist,
+int doUkkInLimits(ukk_context_t *context, int sab, int sac, int sCost, int sState, int sDist,
           int fab, int fac, int fCost, int fState, int fDist, characters_t *inputs, characters_t *outputs)
 {
 
     assert( sCost >= 0 && fCost >= 0 );
 
-    sabG    = sab;
-    sacG    = sac;
-    sCostG  = sCost;
-    sStateG = sState;
-    endA    = fDist;
-    endB    = fDist - fab;
-    endC    = fDist - fac;
+    context->sab    = sab;
+    context->sac    = sac;
+    context->sCost  = sCost;
+    context->sState = sState;
+    context->endA    = fDist;
+    context->endB    = fDist - fab;
+    context->endC    = fDist - fac;
 
     if (DEBUG_3D) {
         fprintf(stderr, "\nDoing(sab = %d, sac = %d, sCost = %d, sState = %d, sDist = %d,\n", sab, sac, sCost, sState, sDist);
@@ -283,32 +267,32 @@ int doUkkInLimits(int sab, int sac, int sCost, int sState, int sDist,
             fprintf(stderr, "\n");
     }
 
-    completeFromInfo = 0;
+    context->completeFromInfo = 0;
 
-    costOffset += finalCost + 1;
-    assert(costOffset > 0 && "Oops, overflow in costOffset");
+    context->costOffset += context->finalCost + 1;
+    assert(context->costOffset > 0 && "Oops, overflow in costOffset");
 
-    U(sab, sac, sCost, sState)->dist = sDist;
-    U(sab, sac, sCost, sState)->computed = sCost + costOffset;
+    U(context, sab, sac, sCost, sState)->dist = sDist;
+    U(context, sab, sac, sCost, sState)->computed = sCost + context->costOffset;
 
-    if (fCost - sCost <= CPwidth) { // Is it the base case?
+    if (fCost - sCost <= context->CPwidth) { // Is it the base case?
         int i;
-        completeFromInfo = 1;
+        context->completeFromInfo = 1;
 
         if (DEBUG_3D)    fprintf(stderr, "Base case.\n");
 
   // #if 0
   //     for (i = sCost; i <= fCost; i++)
-  //       Ukk(fab, fac, i, 0);
+  //       Ukk(context, fab, fac, i, 0);
 
-  //     assert(U(fab, fac, fCost, fState)->dist == fDist);
+  //     assert(U(context, fab, fac, fCost, fState)->dist == fDist);
   // #else
       {
           int dist;
           i = sCost - 1;
           do {
             i++;
-            dist = Ukk( fab, fac, i, fState, inputs );
+            dist = Ukk( context, fab, fac, i, fState, inputs );
           } while (dist < fDist);
 
           assert( dist == fDist );
@@ -323,7 +307,8 @@ int doUkkInLimits(int sab, int sac, int sCost, int sState, int sDist,
 
         if (DEBUG_3D)    fprintf(stderr, "\n\nTracing back in base case.\n");
 
-        traceBack( sab
+        traceBack( context
+                 , sab
                  , sac
                  , sCost
                  , sState
@@ -335,12 +320,12 @@ int doUkkInLimits(int sab, int sac, int sCost, int sState, int sDist,
                  , outputs
                  );
 
-        completeFromInfo = 0;
-        return best( fab, fac, fCost, 0 );
+        context->completeFromInfo = 0;
+        return best( context, fab, fac, fCost, 0 );
     } // end (fCost - sCost <= CPwidth)
 
 
-    CPcost = (fCost + sCost - CPwidth + 1) / 2;
+    context->CPcost = (fCost + sCost - context->CPwidth + 1) / 2;
 
     {
       int dist,
@@ -349,8 +334,8 @@ int doUkkInLimits(int sab, int sac, int sCost, int sState, int sDist,
       do {
           i++;
           if (DEBUG_3D)    fprintf(stderr, "About to do cost %d\n", i);
-          dist = Ukk(fab, fac, i, 0, inputs);      // Need this (?) otherwise if fState != 0 we may need larger than expected slice size.
-          dist = Ukk(fab, fac, i, fState, inputs);
+          dist = Ukk(context, fab, fac, i, 0, inputs);      // Need this (?) otherwise if fState != 0 we may need larger than expected slice size.
+          dist = Ukk(context, fab, fac, i, fState, inputs);
       } while (dist < fDist);
 
       assert(dist == fDist);
@@ -361,22 +346,23 @@ int doUkkInLimits(int sab, int sac, int sCost, int sState, int sDist,
       }
     }
 
-    return getSplitRecurse(sab, sac, sCost, sState, sDist,
+    return getSplitRecurse(context, sab, sac, sCost, sState, sDist,
                            fab, fac, fCost, fState, fDist, inputs, outputs);
 }
 
-int getSplitRecurse( int           sab
-                   , int           sac
-                   , int           sCost
-                   , int           sState
-                   , int           sDist
-                   , int           fab
-                   , int           fac
-                   , int           fCost
-                   , int           fState
-                   , int           fDist
-                   , characters_t *inputs
-                   , characters_t *outputs
+int getSplitRecurse( ukk_context_t *context
+                   , int            sab
+                   , int            sac
+                   , int            sCost
+                   , int            sState
+                   , int            sDist
+                   , int            fab
+                   , int            fac
+                   , int            fCost
+                   , int            fState
+                   , int            fDist
+                   , characters_t  *inputs
+                   , characters_t  *outputs
                    )
 {
     // Get 'from' and CP data.  Then recurse
@@ -385,19 +371,19 @@ int getSplitRecurse( int           sab
     fromType f;
 
     assert(sCost >= 0 && fCost >= 0);
-    assert(U(fab, fac, fCost, fState)->computed == fCost + costOffset);
-    f = U(fab, fac, fCost, fState)->from;
+    assert(U(context, fab, fac, fCost, fState)->computed == fCost + context->costOffset);
+    f = U(context, fab, fac, fCost, fState)->from;
 
     assert(f.cost >= 0);
 
-    if (CP(f.ab, f.ac, f.cost, f.state)->cost == 0)    CP(f.ab, f.ac, f.cost, f.state)->cost = 1;
+    if (CP(context, f.ab, f.ac, f.cost, f.state)->cost == 0)    CP(context, f.ab, f.ac, f.cost, f.state)->cost = 1;
 
-    assert(CP(f.ab, f.ac, f.cost, f.state)->cost == f.cost + 1);   // Use cost + 1 so can tell if not used (cost == 0)
-    CPdist = CP(f.ab, f.ac, f.cost, f.state)->dist;
+    assert(CP(context, f.ab, f.ac, f.cost, f.state)->cost == f.cost + 1);   // Use cost + 1 so can tell if not used (cost == 0)
+    CPdist = CP(context, f.ab, f.ac, f.cost, f.state)->dist;
     assert(CPdist >= 0);
 
     if (DEBUG_3D) {
-        fprintf(stderr, "CPcost = %d CPwidth = %d\n", CPcost, CPwidth);
+        fprintf(stderr, "CPcost = %d CPwidth = %d\n", context->CPcost, context->CPwidth);
         fprintf(stderr, "From: ab = %d ac = %d d = %d s = %d\n", f.ab, f.ac, f.cost, f.state);
         fprintf(stderr, "CP dist = %d\n", CPdist);
     }
@@ -406,38 +392,32 @@ int getSplitRecurse( int           sab
     // Note: Doing second half of alignment first.  Only reason
     // for this is so the alignment is retrieved in exactly reverse order
     // making it easy to print out.
-    finalLen = doUkkInLimits(f.ab, f.ac, f.cost, f.state, CPdist,
+    finalLen = doUkkInLimits(context, f.ab, f.ac, f.cost, f.state, CPdist,
                              fab, fac, fCost, fState, fDist, inputs, outputs);
 
-    doUkkInLimits(sab, sac, sCost, sState, sDist,
+    doUkkInLimits(context, sab, sac, sCost, sState, sDist,
                   f.ab, f.ac, f.cost, f.state, CPdist, inputs, outputs);
 
     if (DEBUG_3D) {
         fprintf(stderr, "Done.\n");
     }
 
-    //  return best(fab, fac, fCost, 0);
+    //  return best(context, fab, fac, fCost, 0);
     return finalLen;
 }
 
 // -- Traceback routines --------------------------------------------------------------
-int si    = 0,
-    costi = 0;
-
-int state_vector[MAX_STR * 2],
-    cost_vector[MAX_STR * 2];
-
-
-void traceBack( int           sab
-              , int           sac
-              , int           sCost
-              , int           sState
-              , int           fab
-              , int           fac
-              , int           fCost
-              , int           fState
-              , characters_t *inputs
-              , characters_t *outputs
+void traceBack( ukk_context_t *context
+              , int            sab
+              , int            sac
+              , int            sCost
+              , int            sState
+              , int            fab
+              , int            fac
+              , int            fCost
+              , int            fState
+              , characters_t  *inputs
+              , characters_t  *outputs
               )
 {
     int ab = fab,
@@ -449,21 +429,21 @@ void traceBack( int           sab
            || ac != sac
            || d  != sCost
            || s  != sState) {
-        int a   = U(ab, ac, d, s)->dist;
-        int nab = U(ab, ac, d, s)->from.ab;
-        int nac = U(ab, ac, d, s)->from.ac;
-        int nd  = U(ab, ac, d, s)->from.cost;
-        int ns  = U(ab, ac, d, s)->from.state;
+        int a   = U(context, ab, ac, d, s)->dist;
+        int nab = U(context, ab, ac, d, s)->from.ab;
+        int nac = U(context, ab, ac, d, s)->from.ac;
+        int nd  = U(context, ab, ac, d, s)->from.cost;
+        int ns  = U(context, ab, ac, d, s)->from.state;
 
         int b = a - ab,
             c = a - ac;
 
-        int a1 = U(nab, nac, nd, ns)->dist,
+        int a1 = U(context, nab, nac, nd, ns)->dist,
             b1 = a1 - nab,
             c1 = a1 - nac;
 
-        assert( U( ab,  ac,  d,  s)->computed ==  d + costOffset );
-        assert( U(nab, nac, nd, ns)->computed == nd + costOffset );
+        assert( U( context, ab,  ac,  d,  s)->computed ==  d + context->costOffset );
+        assert( U(context, nab, nac, nd, ns)->computed == nd + context->costOffset );
 
         if (DEBUG_3D) {
             fprintf(stderr, " ab = %3d  ac = %3d  d = %3d  s = %2d  dist = %3d\nnab = %3d nac = %3d nd = %3d ns = %2d ndist = %3d\n",
@@ -497,8 +477,8 @@ void traceBack( int           sab
                 printf( "  %d\n", outputs->seq3[outputs->idxSeq3 - 1] );
             }
 
-            state_vector[si++]   = 0;        /* The match state */
-            cost_vector[costi++] = d;
+            context->state_vector[context->si++]   = 0;        /* The match state */
+            context->cost_vector[context->costi++] = d;
         } // while a > a1, etc.
 
         // The step for (nab, nac, nd, ns) -> (ab, ac, d, s)
@@ -507,16 +487,16 @@ void traceBack( int           sab
             || c != c1 ) {
 
             if (a > a1)   outputs->seq1[outputs->idxSeq1++] = inputs->seq1[--a];
-            else          outputs->seq1[outputs->idxSeq1++] = gap_char_g;
+            else          outputs->seq1[outputs->idxSeq1++] = context->gap_char;
 
             if (b > b1)   outputs->seq2[outputs->idxSeq2++] = inputs->seq2[--b];
-            else          outputs->seq2[outputs->idxSeq2++] = gap_char_g;
+            else          outputs->seq2[outputs->idxSeq2++] = context->gap_char;
 
             if (c > c1)   outputs->seq3[outputs->idxSeq3++] = inputs->seq3[--c];
-            else          outputs->seq3[outputs->idxSeq3++] = gap_char_g;
+            else          outputs->seq3[outputs->idxSeq3++] = context->gap_char;
 
-            state_vector[si++]   = s;
-            cost_vector[costi++] = d;
+            context->state_vector[context->si++]   = s;
+            context->cost_vector[context->costi++] = d;
         }
 
         assert(   a == a1
@@ -532,6 +512,8 @@ void traceBack( int           sab
     if (DEBUG_3D) {
         int i;
 
+        char stateName[4];
+
         fprintf(stderr, "\n\nAlignment so far\n");
         printf("Aidx: %d\n", outputs->idxSeq1);
         for (i = outputs->idxSeq1 - 1; i >= 0; i--)    fprintf( stderr, "%6d", outputs->seq1[i] );
@@ -546,11 +528,11 @@ void traceBack( int           sab
         fprintf(stderr, "\n\n" );
 
         // Print state information
-        for (i = si - 1; i >= 0; i--)               fprintf( stderr, "%s ", state2str(state_vector[i]) );
+        for (i = context->si - 1; i >= 0; i--)               fprintf( stderr, "%s ", state2str(context, context->state_vector[i], stateName) );
         fprintf(stderr, "\n");
 
         // Print cost stuff
-        for (i = costi - 1; i >= 0; i--)             fprintf( stderr, "%-2d  ", cost_vector[i]);
+        for (i = context->costi - 1; i >= 0; i--)             fprintf( stderr, "%-2d  ", context->cost_vector[i]);
         fprintf( stderr, "\n\n" );
     }
 
@@ -560,7 +542,7 @@ void traceBack( int           sab
     assert( s  == sState );
 }
 
-void printTraceBack( characters_t *inputs, characters_t *outputs )
+void printTraceBack( ukk_context_t *context, characters_t *inputs, characters_t *outputs )
 {
     printf("Yes, we actually do traceback!");
     // Print out the alignment
@@ -595,8 +577,8 @@ void printTraceBack( characters_t *inputs, characters_t *outputs )
             outputs->seq1[outputs->idxSeq1++] = inputs->seq1[i];
             outputs->seq2[outputs->idxSeq2++] = inputs->seq2[i];
             outputs->seq3[outputs->idxSeq3++] = inputs->seq3[i];
-            state_vector[si++]             = 0;               /* The match state */
-            cost_vector[costi++]           = 0;
+            context->state_vector[context->si++]             = 0;               /* The match state */
+            context->cost_vector[context->costi++]           = 0;
         }
     }
 
@@ -606,14 +588,15 @@ void printTraceBack( characters_t *inputs, characters_t *outputs )
         //revElem_tArray( outputs->seq2, 0, outputs->idxSeq2 );
         //revElem_tArray( outputs->seq3, 0, outputs->idxSeq3 );
 
-        revIntArray( state_vector,  0, si    );
-        revIntArray( cost_vector,   0, costi );
+        revIntArray( context->state_vector,  0, context->si    );
+        revIntArray( context->cost_vector,   0, context->costi );
     }
     if (DEBUG_3D) {
         // Print out the alignment
         printf( "ALIGNMENT\n" );
 
-        int print_idx;
+        int  print_idx;
+        char stateName[4];
 
         for (print_idx = 0; print_idx < outputs->idxSeq1; print_idx++)   printf( "%6u", outputs->seq1[print_idx] );
         printf( "\n" );
@@ -625,49 +608,49 @@ void printTraceBack( characters_t *inputs, characters_t *outputs )
         printf( "\n\n" );
 
         // Print state information
-        for (print_idx = 0; print_idx < si; print_idx++)    printf( "%s ", state2str(state_vector[print_idx]) );
+        for (print_idx = 0; print_idx < context->si; print_idx++)    printf( "%s ", state2str(context, context->state_vector[print_idx], stateName) );
         printf( "\n" );
 
         // Print cost stuff
-        for (print_idx = 0; print_idx < costi; print_idx++) printf( "%-2d  ", cost_vector[print_idx] );
+        for (print_idx = 0; print_idx < context->costi; print_idx++) printf( "%-2d  ", context->cost_vector[print_idx] );
         printf( "\n" );
     }
 
     assert( outputs->idxSeq1 == outputs->idxSeq2 );
     assert( outputs->idxSeq1 == outputs->idxSeq3 );
-    assert( outputs->idxSeq1 == si );
-    assert( outputs->idxSeq1 == costi );
+    assert( outputs->idxSeq1 == context->si );
+    assert( outputs->idxSeq1 == context->costi );
 
-    checkAlign( outputs->seq1, outputs->idxSeq1, inputs->seq1, inputs->lenSeq1 );
-    checkAlign( outputs->seq2, outputs->idxSeq2, inputs->seq2, inputs->lenSeq2 );
-    checkAlign( outputs->seq3, outputs->idxSeq3, inputs->seq3, inputs->lenSeq3 );
+    checkAlign( context, outputs->seq1, outputs->idxSeq1, inputs->seq1, inputs->lenSeq1 );
+    checkAlign( context, outputs->seq2, outputs->idxSeq2, inputs->seq2, inputs->lenSeq2 );
+    checkAlign( context, outputs->seq3, outputs->idxSeq3, inputs->seq3, inputs->lenSeq3 );
 
-    assert( alignmentCost( state_vector
+    assert( alignmentCost( context, context->state_vector
                          , outputs->seq1
                          , outputs->seq2
                          , outputs->seq3
-                         , outputs->idxSeq1 ) == finalCost
+                         , outputs->idxSeq1 ) == context->finalCost
           );
 }
 
 
 // Find the furthest distance at ab, ac, d.   wantState selects whether the
 // best distance is returned, or the best final state (needed for ukk.alloc traceback)
-int best( int ab, int ac, int d, int wantState )
+int best( ukk_context_t *context, int ab, int ac, int d, int wantState )
 {
 
     int s;
     int best = -INFINITY;
     int bestState = -1;
-    for (s = 0; s < numStates_g; s++) {
-        if (      U(ab, ac, d, s)->computed == d + costOffset
-               && U(ab, ac, d, s)->dist > best) {
-            best = U(ab, ac, d, s)->dist;
+    for (s = 0; s < context->numStates; s++) {
+        if (      U(context, ab, ac, d, s)->computed == d + context->costOffset
+               && U(context, ab, ac, d, s)->dist > best) {
+            best = U(context, ab, ac, d, s)->dist;
             bestState = s;
         }
     }
 
-//  fprintf(stderr, "best(%d, %d, %d, (%d)) = %d\n", ab, ac, d, bestState, best);
+//  fprintf(stderr, "best(context, %d, %d, %d, (%d)) = %d\n", ab, ac, d, bestState, best);
 
     if (wantState)    return bestState;
     else              return best;
@@ -691,7 +674,7 @@ void sort( int aval[], int len )
 }
 
 
-int withinMatrix( int ab, int ac, int d )
+int withinMatrix( ukk_context_t *context, int ab, int ac, int d )
 {
   // The new method for checking the boundary condition.  Much tighter ~20%(?)  -- 28 / 02 / 1999
   int bc = ac - ab;
@@ -700,66 +683,67 @@ int withinMatrix( int ab, int ac, int d )
 
   if (d < 0) return 0;
 
-  aval[0] = abs(sabG - ab);
-  aval[1] = abs(sacG - ac);
-  aval[2] = abs((sacG - sabG) - bc);
+  aval[0] = abs(context->sab - ab);
+  aval[1] = abs(context->sac - ac);
+  aval[2] = abs((context->sac - context->sab) - bc);
 
   // Set g and h to the smallest and second smallest of aval[] respectively
   sort(aval, 3);
   g = aval[0];
   h = aval[1];
 
-  if (sStateG == 0) {
+  if (context->sState == 0) {
     // We know a good boudary check if the start state is MMM
     cheapest = ( g == 0 ? 0
-                        : startInsert_g + g * continueInsert_g )
+                        : context->startInsert + g * context->continueInsert )
              + ( h == 0 ? 0
-                        : startInsert_g + h * continueInsert_g );
+                        : context->startInsert + h * context->continueInsert );
   } else {
     // If start state is something else.  Can't charge for start of gaps unless we
     // do something more clever,
-    cheapest = (g == 0 ? 0 : g * continueInsert_g) + (h == 0 ? 0 : h * continueInsert_g);
+    cheapest = (g == 0 ? 0 : g * context->continueInsert) + (h == 0 ? 0 : h * context->continueInsert);
   }
 
-  if (cheapest + sCostG > d)    return 0;
+  if (cheapest + context->sCost > d)    return 0;
   else                          return 1;
 }
 
 
-int Ukk( int           ab
-       , int           ac
-       , int           d
-       , unsigned int  state
-       , characters_t *inputs
+int Ukk( ukk_context_t *context
+       , int            ab
+       , int            ac
+       , int            d
+       , unsigned int   state
+       , characters_t  *inputs
        )
 {
     if (DEBUG_CALL_ORDER)    printf("Ukk: %d\n", *inputs->seq1);
 
-    if (!withinMatrix(ab, ac, d))                           return -INFINITY;
-    if (U(ab, ac, d, state)->computed == d + costOffset)    return U(ab, ac, d, state)->dist;
+    if (!withinMatrix(context, ab, ac, d))                                    return -INFINITY;
+    if (U(context, ab, ac, d, state)->computed == d + context->costOffset)    return U(context, ab, ac, d, state)->dist;
 
   /*
     fprintf(stderr, "Calculating U(%d, %d, %d, %d)", ab, ac, d, state);
   */
-    counts.cells++;
+    context->counts.cells++;
 
-    calcUkk(ab, ac, d, state, inputs);
+    calcUkk(context, ab, ac, d, state, inputs);
 
     // Store away CP from info in necessary
-    if (d >= CPcost && d < CPcost + CPwidth) {
-        CP(ab, ac, d, state)->dist = U(ab, ac, d, state)->dist;
-        CP(ab, ac, d, state)->cost = d + 1;          // Note adding 1 so cost == 0 signifies unused cell
+    if (d >= context->CPcost && d < context->CPcost + context->CPwidth) {
+        CP(context, ab, ac, d, state)->dist = U(context, ab, ac, d, state)->dist;
+        CP(context, ab, ac, d, state)->cost = d + 1;          // Note adding 1 so cost == 0 signifies unused cell
     }
 
-    if (U(ab, ac, d, state)->dist > furthestReached_g)    furthestReached_g = U(ab, ac, d, state)->dist;
+    if (U(context, ab, ac, d, state)->dist > context->furthestReached)    context->furthestReached = U(context, ab, ac, d, state)->dist;
 
-    return U(ab, ac, d, state)->dist;
+    return U(context, ab, ac, d, state)->dist;
 }
 
 
-int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
+int calcUkk(ukk_context_t *context, int ab, int ac, int d, int toState, characters_t *inputs)
 {
-    int neighbour = neighbours[toState];
+    int neighbour = context->neighbours[toState];
     int da, db, dc, ab1, ac1;
 
     fromType from;
@@ -783,11 +767,11 @@ int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
         indent[indenti]   = 0;
     }
 
-    assert( U(ab, ac, d, toState)->computed < d + costOffset );
+    assert( U(context, ab, ac, d, toState)->computed < d + context->costOffset );
     bestDist = -INFINITY;
 
     // Initialise CP from info if necessary
-    if (d >= CPcost && d < CPcost + CPwidth) {
+    if (d >= context->CPcost && d < context->CPcost + context->CPwidth) {
         from.ab    = ab;
         from.ac    = ac;
         from.cost  = d;
@@ -799,43 +783,43 @@ int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
     ac1 = ac - da + dc;
 
     // calculate if its a valid diagonal
-    if (      ab1 >= -endB
-           && ab1 <= endA
-           && ac1 >= -endC
-           && ac1 <= endA) {
+    if (      ab1 >= -context->endB
+           && ab1 <= context->endA
+           && ac1 >= -context->endC
+           && ac1 <= context->endA) {
         int fromState;
 
         // Loop over possible state we are moving from
         //   May be possible to limit this?
-        for (fromState = 0; fromState < numStates_g; fromState++) {
+        for (fromState = 0; fromState < context->numStates; fromState++) {
 
-            int transCost = stateTransitionCost(fromState, toState);
+            int transCost = stateTransitionCost(context, fromState, toState);
             int fromCost  = -INFINITY;
             int dist      = -INFINITY;
-            int cost      = d - transCost - contCost[toState];
-            int a1        = Ukk( ab1, ac1, cost, fromState, inputs );
+            int cost      = d - transCost - context->contCost[toState];
+            int a1        = Ukk( context, ab1, ac1, cost, fromState, inputs );
             int a2        = -1;
 
-            if (     okIndex(a1,       da, endA)
-                  && okIndex(a1 - ab1, db, endB)
-                  && okIndex(a1 - ac1, dc, endC)
-                  && whichCharCost( da ? inputs->seq1[a1]       : gap_char_g
-                                  , db ? inputs->seq2[a1 - ab1] : gap_char_g
-                                  , dc ? inputs->seq3[a1 - ac1] : gap_char_g
+            if (     okIndex(a1,       da, context->endA)
+                  && okIndex(a1 - ab1, db, context->endB)
+                  && okIndex(a1 - ac1, dc, context->endC)
+                  && whichCharCost( da ? inputs->seq1[a1]       : context->gap_char
+                                  , db ? inputs->seq2[a1 - ab1] : context->gap_char
+                                  , dc ? inputs->seq3[a1 - ac1] : context->gap_char
                                   ) == 1 ) {
                 fromCost = cost;
                 dist     = a1 + da;
 
             } else {
 
-                if (!secondCost[toState])    continue;
+                if (!context->secondCost[toState])    continue;
 
-                a2 = Ukk(ab1, ac1, cost - misCost_g, fromState, inputs);
+                a2 = Ukk(context, ab1, ac1, cost - context->misCost, fromState, inputs);
 
-                if (     okIndex( a2,       da, endA )
-                      && okIndex( a2 - ab1, db, endB )
-                      && okIndex( a2 - ac1, dc, endC ) ) {
-                    fromCost = cost - misCost_g;
+                if (     okIndex( a2,       da, context->endA )
+                      && okIndex( a2 - ab1, db, context->endB )
+                      && okIndex( a2 - ac1, dc, context->endC ) ) {
+                    fromCost = cost - context->misCost;
                     dist     = a2 + da;
                 }
             }
@@ -844,35 +828,35 @@ int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
             if (bestDist < dist) {
                 bestDist = dist;
 
-                if (completeFromInfo) {        // Do we need to store complete from information for a base case?
+                if (context->completeFromInfo) {        // Do we need to store complete from information for a base case?
                     from.ab = ab1;
                     from.ac = ac1;
                     from.cost = fromCost;
                     from.state = fromState;
-                } else if (d >= CPcost + CPwidth) { // Store from info for CP
-                    from = U(ab1, ac1, fromCost, fromState)->from;
+                } else if (d >= context->CPcost + context->CPwidth) { // Store from info for CP
+                    from = U(context, ab1, ac1, fromCost, fromState)->from;
                 }
             }
-        } // End loop over from state_vector
+        } // End loop over from context->state_vector
     } // End if valid neighbour
 
     // Insure that we have how we can reach for AT MOST cost d
     {
-        int dist = Ukk(ab, ac, d - 1, toState, inputs);
+        int dist = Ukk(context, ab, ac, d - 1, toState, inputs);
         // Check if this is an improvment
-        if (     okIndex(dist, 0, endA)
-              && okIndex(dist - ab, 0, endB)
-              && okIndex(dist - ac, 0, endC)
+        if (     okIndex(dist, 0, context->endA)
+              && okIndex(dist - ab, 0, context->endB)
+              && okIndex(dist - ac, 0, context->endC)
               && bestDist < dist) {
             bestDist = dist;
 
-            if (completeFromInfo) {        // Do we need to store complete from information for a base case?
+            if (context->completeFromInfo) {        // Do we need to store complete from information for a base case?
                 from.ab = ab;
                 from.ac = ac;
                 from.cost = d - 1;
                 from.state = toState;
-            } else if (d >= CPcost + CPwidth) { // Store from info for CP
-                from = U(ab, ac, d - 1, toState)->from;
+            } else if (d >= context->CPcost + context->CPwidth) { // Store from info for CP
+                from = U(context, ab, ac, d - 1, toState)->from;
             }
         }
     }
@@ -892,13 +876,13 @@ int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
        U matrix and the D matrix.
     */
 
-        // Get furthest of state_vector for this cost
+        // Get furthest of context->state_vector for this cost
         int dist = -INFINITY;
         int from_state = -1, s;
 
-        for (s = 0; s < numStates_g; s++) {
+        for (s = 0; s < context->numStates; s++) {
             int thisdist;
-            thisdist = (s == 0) ? bestDist : Ukk(ab, ac, d, s, inputs);
+            thisdist = (s == 0) ? bestDist : Ukk(context, ab, ac, d, s, inputs);
             if (thisdist > dist) {
                 dist = thisdist;
                 from_state = s;
@@ -906,13 +890,13 @@ int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
         }
 
        // Try to extend to diagonal
-       while (  okIndex(dist, 1, endA)
-              && okIndex(dist - ab, 1, endB)
-              && okIndex(dist - ac, 1, endC)
+       while (  okIndex(dist, 1, context->endA)
+              && okIndex(dist - ab, 1, context->endB)
+              && okIndex(dist - ac, 1, context->endC)
               && (   inputs->seq1[dist] == inputs->seq2[dist - ab]
                   && inputs->seq1[dist] == inputs->seq3[dist - ac])) {
            dist++;
-           counts.innerLoop++;
+           context->counts.innerLoop++;
        }
 
        // Was there an improvement?
@@ -922,34 +906,410 @@ int calcUkk(int ab, int ac, int d, int toState, characters_t *inputs)
             // Update 'from' information if the state we extended from was
             // not the same state we are in (the MMM state).
             if (from_state != 0) {
-                if (completeFromInfo) {        // Do we need to store complete 'from' information for a base case?
+                if (context->completeFromInfo) {        // Do we need to store complete 'from' information for a base case?
                     from.ab = ab;
                     from.ac = ac;
                     from.cost = d;
                     from.state = from_state;
-                } else if (d >= CPcost + CPwidth) { // Store from info for CP
-                   from = U(ab, ac, d, from_state)->from;
+                } else if (d >= context->CPcost + context->CPwidth) { // Store from info for CP
+                   from = U(context, ab, ac, d, from_state)->from;
                 }
             }
         }
     } // End attempt to extend diagonal on a run of matches
 
-    assert( U(ab, ac, d, toState)->computed < d + costOffset );
+    assert( U(context, ab, ac, d, toState)->computed < d + context->costOffset );
 
-    U( ab, ac, d, toState )->dist     = bestDist;
-    U( ab, ac, d, toState )->computed = d + costOffset;
-    U( ab, ac, d, toState )->from     = from;
+    U( context, ab, ac, d, toState )->dist     = bestDist;
+    U( context, ab, ac, d, toState )->computed = d + context->costOffset;
+    U( context, ab, ac, d, toState )->from     = from;
 
     if (DEBUGTRACE) {
         indent[indenti] = 0;
         fprintf(stderr, "%sCalcUKK(ab = %d, ac = %d, d = %d, toState = %d) = %d\n",
                 indent,
-                ab, ac, d, toState, U(ab, ac, d, toState)->dist);
+                ab, ac, d, toState, U(context, ab, ac, d, toState)->dist);
         fprintf(stderr, "%sFrom: ab = %d ac = %d cost = %d state = %d\n",
                 indent,
-                U(ab, ac, d, toState)->from.ab, U(ab, ac, d, toState)->from.ac,
-                U(ab, ac, d, toState)->from.cost, U(ab, ac, d, toState)->from.state);
+                U(context, ab, ac, d, toState)->from.ab, U(context, ab, ac, d, toState)->from.ac,
+                U(context, ab, ac, d, toState)->from.cost, U(context, ab, ac, d, toState)->from.state);
+    }
+
+    return U(context, ab, ac, d, toState)->dist;
+}
+
+
+// -- Cost-bounded search with the 3D cost matrix ------------------------------------------------
+//
+// The search above follows Powell: a cell holds the furthest distance along its diagonal reached
+// for a given cost, which is only sound while cost never decreases along a diagonal, as it does
+// not for a general TCM. So costs taken from the 3D matrix are searched for with Ukkonen's cut
+// off instead: only cells some alignment costing at most a threshold could pass through are
+// filled, and the threshold doubles until the cheapest alignment is within it.
+//
+// A column is named by the set of characters with an element in it: bit 0 for the first, bit 1
+// the second, bit 2 the third. With a gap open cost, a cell has a state for each of the seven
+// sets, the set of its last column, so that a gap is opened whenever a character missing from a
+// column was in the one before. The first column follows one with all three.
+
+#define TCM_3D_COLUMNS 7
+#define TCM_3D_NO_COST UINT_MAX
+
+
+/** The cells of one plane of the search, those of the first character's element i, that may be
+ *  filled: the box [jlo, jhi] x [klo, khi]. Empty if jhi < jlo or khi < klo.
+ */
+typedef struct tcm_3d_plane_t {
+    int    jlo, jhi;
+    int    klo, khi;
+    size_t offset;      // Of the plane's first cell in the direction buffer.
+} tcm_3d_plane_t;
+
+
+typedef struct tcm_3d_search_t {
+    const characters_t       *inputs;
+    const cost_matrices_3d_t *costMtx;
+    size_t                    numStates;  // TCM_3D_COLUMNS with a gap open cost, otherwise 1.
+    unsigned int              openCost[TCM_3D_COLUMNS][TCM_3D_COLUMNS];  // From the set of one column to the next.
+    unsigned long long        absenceCost2;   // Twice a lower bound on each gap in a column.
+    tcm_3d_buffers_t         *buffers;        // Planes, directions and rows; see ukkCheckPoint.h.
+    alignment_stats_t        *stats;          // NULL for none.
+} tcm_3d_search_t;
+
+
+static int max3( int a, int b, int c )
+{
+    const int m = a > b ? a : b;
+    return m > c ? m : c;
+}
+
+
+/** A lower bound on the cost of any alignment through cell (i, j, k). Each column is as long as
+ *  the longest of the parts of the characters it aligns, so getting to the cell needs at least
+ *  3 * max(i, j, k) - (i + j + k) gaps, and likewise from it to the end.
+ */
+static unsigned long long tcm_3d_bound( const tcm_3d_search_t *search, int i, int j, int k )
+{
+    const characters_t *in = search->inputs;
+    const unsigned long long gaps = 3ULL * max3( i, j, k ) - i - j - k
+                                  + 3ULL * max3( in->lenSeq1 - i, in->lenSeq2 - j, in->lenSeq3 - k )
+                                  - (in->lenSeq1 - i) - (in->lenSeq2 - j) - (in->lenSeq3 - k);
+
+    return (gaps * search->absenceCost2 + 1) / 2;
+}
+
+
+/** The cost of each state of cell (j, k) of the plane row, or NULL if the plane does not hold it. */
+static const unsigned int *tcm_3d_cell( const tcm_3d_search_t *search, const tcm_3d_plane_t *plane
+                                      , const unsigned int *row, int j, int k )
+{
+    if (j < plane->jlo || j > plane->jhi || k < plane->klo || k > plane->khi) return NULL;
+
+    const size_t width = plane->khi - plane->klo + 1;
+    return row + ((j - plane->jlo) * width + (k - plane->klo)) * search->numStates;
+}
+
+
+/** Fills the cells through which an alignment costing at most threshold may pass, and returns
+ *  the least cost of an alignment of those cells, or TCM_3D_NO_COST. complete is set if no cell
+ *  was left out, in which case that cost is the least of all alignments.
+ */
+static unsigned int tcm_3d_fill( tcm_3d_search_t *search, unsigned long long threshold, int *complete )
+{
+    const characters_t *in      = search->inputs;
+    const size_t        states  = search->numStates;
+    const elem_t        gap     = search->costMtx->gap_char;
+    const int           lengths[3] = { in->lenSeq1, in->lenSeq2, in->lenSeq3 };
+
+    // Any cell off its diagonals by more than reach has a bound above the threshold.
+    const unsigned long long longest = (unsigned long long) lengths[0] + lengths[1] + lengths[2];
+    const long reach = search->absenceCost2 == 0 || 2 * threshold / search->absenceCost2 > longest
+                     ? (long) longest
+                     : (long) (2 * threshold / search->absenceCost2);
+
+    size_t cells = 0, rowCells = 0;
+    for (int i = 0; i <= lengths[0]; i++) {
+        tcm_3d_plane_t *plane = &search->buffers->planes[i];
+        const long jlo = i - reach > i + lengths[1] - lengths[0] - reach ? i - reach : i + lengths[1] - lengths[0] - reach,
+                   jhi = i + reach < i + lengths[1] - lengths[0] + reach ? i + reach : i + lengths[1] - lengths[0] + reach,
+                   klo = i - reach > i + lengths[2] - lengths[0] - reach ? i - reach : i + lengths[2] - lengths[0] - reach,
+                   khi = i + reach < i + lengths[2] - lengths[0] + reach ? i + reach : i + lengths[2] - lengths[0] + reach;
+        plane->jlo    = jlo < 0 ? 0 : jlo;
+        plane->jhi    = jhi > lengths[1] ? lengths[1] : jhi;
+        plane->klo    = klo < 0 ? 0 : klo;
+        plane->khi    = khi > lengths[2] ? lengths[2] : khi;
+        plane->offset = cells;
+        if (plane->jhi < plane->jlo || plane->khi < plane->klo) {
+            plane->jhi = plane->jlo - 1;
+            continue;
+        }
+        const size_t area = (size_t) (plane->jhi - plane->jlo + 1) * (plane->khi - plane->klo + 1);
+        cells   += area * states;
+        rowCells = area * states > rowCells ? area * states : rowCells;
+    }
+
+    tcm_3d_buffers_t *buffers = search->buffers;
+    if (cells > buffers->directionCap) {
+        free( buffers->directions );
+        buffers->directions   = malloc( cells );
+        buffers->directionCap = cells;
+    }
+    if (rowCells > buffers->rowCap) {
+        for (size_t r = 0; r < 2; r++) {
+            free( buffers->rows[r] );
+            buffers->rows[r] = malloc( rowCells * sizeof(unsigned int) );
+        }
+        buffers->rowCap = rowCells;
+    }
+    assert(   (cells    == 0 || buffers->directions != NULL)
+           && (rowCells == 0 || (buffers->rows[0] != NULL && buffers->rows[1] != NULL))
+           && "Out of Memory error: Can't allocate the 3D search." );
+
+    size_t filled = 0;
+    for (int i = 0; i <= lengths[0]; i++) {
+        const tcm_3d_plane_t *plane    = &search->buffers->planes[i],
+                             *previous = i > 0 ? &search->buffers->planes[i - 1] : NULL;
+        unsigned int         *row      = search->buffers->rows[i % 2];
+        const unsigned int   *lastRow  = search->buffers->rows[(i + 1) % 2];
+
+        for (int j = plane->jlo; j <= plane->jhi; j++) {
+            for (int k = plane->klo; k <= plane->khi; k++) {
+                const size_t   index = ((j - plane->jlo) * (plane->khi - plane->klo + 1) + (k - plane->klo)) * states;
+                unsigned int  *cost  = row + index;
+                unsigned char *from  = search->buffers->directions + plane->offset + index;
+
+                for (size_t s = 0; s < states; s++) cost[s] = TCM_3D_NO_COST;
+
+                if (tcm_3d_bound( search, i, j, k ) > threshold) continue;
+                filled++;
+
+                if (i == 0 && j == 0 && k == 0) {
+                    cost[states - 1] = 0;   // As if after a column of all three.
+                    continue;
+                }
+
+                // Prefer columns of more elements between equal costs, so the order is fixed.
+                for (int column = TCM_3D_COLUMNS; column >= 1; column--) {
+                    const int a = column & 1, b = (column >> 1) & 1, c = (column >> 2) & 1;
+                    if (i < a || j < b || k < c) continue;
+
+                    const unsigned int *before = a ? (previous ? tcm_3d_cell( search, previous, lastRow, j - b, k - c ) : NULL)
+                                                   : tcm_3d_cell( search, plane, row, j - b, k - c );
+                    if (before == NULL) continue;
+
+                    unsigned int best  = TCM_3D_NO_COST;
+                    size_t       bestS = 0;
+                    for (size_t s = 0; s < states; s++) {
+                        if (before[s] == TCM_3D_NO_COST) continue;
+                        const unsigned int through = before[s] + (states > 1 ? search->openCost[s][column - 1] : 0);
+                        if (through < best) {
+                            best  = through;
+                            bestS = s;
+                        }
+                    }
+                    if (best == TCM_3D_NO_COST) continue;
+
+                    best += cm_get_cost_3d( search->costMtx
+                                          , a ? in->seq1[i - 1] : gap
+                                          , b ? in->seq2[j - 1] : gap
+                                          , c ? in->seq3[k - 1] : gap
+                                          );
+
+                    const size_t to = states > 1 ? (size_t) column - 1 : 0;
+                    if (best < cost[to]) {
+                        cost[to] = best;
+                        from[to] = states > 1 ? bestS + 1 : (size_t) column;
+                    }
+                }
+            }
+        }
+    }
+
+    *complete = filled == (size_t) (lengths[0] + 1) * (lengths[1] + 1) * (lengths[2] + 1);
+
+    if (search->stats != NULL) {
+        alignment_stats_t *stats = search->stats;
+        stats->cells          += filled;
+        stats->bandWidth       = (size_t) reach;
+        stats->bandPasses++;
+        stats->fullPlaneFills += *complete;
+        if (cells > stats->directionBytes) stats->directionBytes = cells;
+    }
+
+    const unsigned int *end = tcm_3d_cell( search, &search->buffers->planes[lengths[0]], search->buffers->rows[lengths[0] % 2], lengths[1], lengths[2] );
+    unsigned int best = TCM_3D_NO_COST;
+    for (size_t s = 0; end != NULL && s < states; s++) best = end[s] < best ? end[s] : best;
+
+    return best;
+}
+
+
+/** Writes the alignment of the last fill, which cost cost, to outputs, last column first. */
+static void tcm_3d_trace_back( const tcm_3d_search_t *search, unsigned int cost, characters_t *outputs )
+{
+    const characters_t *in     = search->inputs;
+    const size_t        states = search->numStates;
+    const elem_t        gap    = search->costMtx->gap_char;
+
+    int i = in->lenSeq1, j = in->lenSeq2, k = in->lenSeq3;
+
+    // With states, the state costing cost names the last column.
+    const unsigned int *end = tcm_3d_cell( search, &search->buffers->planes[i], search->buffers->rows[i % 2], j, k );
+    size_t state = 0;
+    while (end[state] != cost) state++;
+
+    while (i > 0 || j > 0 || k > 0) {
+        const tcm_3d_plane_t *plane = &search->buffers->planes[i];
+        const size_t width = plane->khi - plane->klo + 1,
+                     cell  = plane->offset + ((j - plane->jlo) * width + (k - plane->klo)) * states;
+
+        const unsigned char from   = search->buffers->directions[cell + state];
+        const int           column = states > 1 ? (int) state + 1 : from;
+        state = states > 1 ? (size_t) from - 1 : 0;
+
+        outputs->seq1[outputs->idxSeq1++] = column & 1        ? in->seq1[--i] : gap;
+        outputs->seq2[outputs->idxSeq2++] = (column >> 1) & 1 ? in->seq2[--j] : gap;
+        outputs->seq3[outputs->idxSeq3++] = (column >> 2) & 1 ? in->seq3[--k] : gap;
+    }
+}
+
+
+static int compare_elements( const void *a, const void *b )
+{
+    const elem_t x = *(const elem_t *) a,
+                 y = *(const elem_t *) b;
+    return (x > y) - (x < y);
+}
+
+
+void ukk_tcm_3D_free_buffers( tcm_3d_buffers_t *buffers )
+{
+    free( buffers->planes );
+    free( buffers->directions );
+    free( buffers->rows[0] );
+    free( buffers->rows[1] );
+    free( buffers->elements );
+    memset( buffers, 0, sizeof(tcm_3d_buffers_t) );
+}
+
+
+size_t ukk_tcm_3D_buffer_bytes( const tcm_3d_buffers_t *buffers )
+{
+    return buffers->planeCap     * sizeof(tcm_3d_plane_t)
+         + buffers->directionCap
+         + buffers->rowCap       * 2 * sizeof(unsigned int)
+         + buffers->elementCap   * sizeof(elem_t);
+}
+
+
+unsigned int ukk_tcm_3D_align( characters_t             *inputs
+                             , characters_t             *outputs
+                             , const cost_matrices_3d_t *costMtx3d
+                             , unsigned int              gapOpenCost
+                             , unsigned int              costCeiling
+                             , alignment_stats_t        *stats
+                             , tcm_3d_buffers_t         *buffers
+                             )
+{
+    size_t hits, misses;
+    cm_lazy_3d_lookups( &hits, &misses );
+
+    // Without buffers to reuse, the search's own are freed on return.
+    tcm_3d_buffers_t ownBuffers = { 0 };
+    if (buffers == NULL) buffers = &ownBuffers;
+
+    tcm_3d_search_t search = { 0 };
+    search.buffers   = buffers;
+    search.stats     = stats;
+    search.inputs    = inputs;
+    search.costMtx   = costMtx3d;
+    search.numStates = gapOpenCost > 0 ? TCM_3D_COLUMNS : 1;
+    for (int from = 1; from <= TCM_3D_COLUMNS; from++) {
+        for (int to = 1; to <= TCM_3D_COLUMNS; to++) {
+            search.openCost[from - 1][to - 1] = gapOpenCost * __builtin_popcount( from & ~to & TCM_3D_COLUMNS );
+        }
+    }
+
+    // A column of one element and two gaps costs at least the least of those of the characters'
+    // elements. One of two elements, x and y, and a gap costs at least that of (x, gap, every
+    // element), as no element of y is nearer a median than the nearest of every element. So each
+    // gap in a column costs at least the lesser of the latter and half the former.
+    const elem_t gap = costMtx3d->gap_char,
+                 all = ((elem_t) 1 << (costMtx3d->alphSize - 1) << 1) - 1;
+    unsigned long long pairBound = ULLONG_MAX, singleBound = ULLONG_MAX;
+    {
+        const int total = inputs->lenSeq1 + inputs->lenSeq2 + inputs->lenSeq3;
+        if ((size_t) total + 1 > buffers->elementCap) {
+            free( buffers->elements );
+            buffers->elements   = malloc( (total + 1) * sizeof(elem_t) );
+            buffers->elementCap = total + 1;
+        }
+        elem_t *elements = buffers->elements;
+        assert( elements != NULL && "Out of Memory error: Can't allocate the 3D search." );
+        memcpy( elements,                                     inputs->seq1, inputs->lenSeq1 * sizeof(elem_t) );
+        memcpy( elements + inputs->lenSeq1,                   inputs->seq2, inputs->lenSeq2 * sizeof(elem_t) );
+        memcpy( elements + inputs->lenSeq1 + inputs->lenSeq2, inputs->seq3, inputs->lenSeq3 * sizeof(elem_t) );
+        qsort( elements, total, sizeof(elem_t), compare_elements );
+
+        for (int e = 0; e < total; e++) {
+            if (e > 0 && elements[e] == elements[e - 1]) continue;
+            const unsigned long long pair   = cm_get_cost_3d( costMtx3d, elements[e], gap, all ),
+                                     single = cm_get_cost_3d( costMtx3d, elements[e], gap, gap );
+            pairBound   = pair   < pairBound   ? pair   : pairBound;
+            singleBound = single < singleBound ? single : singleBound;
+        }
+    }
+    search.absenceCost2 = 2 * pairBound < singleBound ? 2 * pairBound : singleBound;
+    if (search.absenceCost2 == ULLONG_MAX) search.absenceCost2 = 0;   // No elements at all.
+
+    if ((size_t) inputs->lenSeq1 + 1 > buffers->planeCap) {
+        free( buffers->planes );
+        buffers->planes   = malloc( (inputs->lenSeq1 + 1) * sizeof(tcm_3d_plane_t) );
+        buffers->planeCap = inputs->lenSeq1 + 1;
+    }
+    assert( buffers->planes != NULL && "Out of Memory error: Can't allocate the 3D search." );
+
+    // The band starts eight gaps wider than the characters' lengths need, as in 2D.
+    const unsigned long long lowest = tcm_3d_bound( &search, 0, 0, 0 );
+    unsigned long long threshold    = lowest + 4 * search.absenceCost2;
+    unsigned int       cost         = TCM_3D_NO_COST;
+    int                found        = 0;
+
+    if (lowest <= costCeiling) {
+        for (;;) {
+            if (threshold > costCeiling) threshold = costCeiling;
+
+            int complete;
+            cost = tcm_3d_fill( &search, threshold, &complete );
+            if (cost <= threshold || complete) {
+                found = cost <= costCeiling;
+                break;
+            }
+            if (threshold == costCeiling) break;
+            threshold = 2 * threshold + 1;
+        }
+    }
+
+    if (found) {
+        outputs->idxSeq1 = outputs->idxSeq2 = outputs->idxSeq3 = 0;
+        tcm_3d_trace_back( &search, cost, outputs );
+
+        // As doUkk(), so it is clear outside that the lengths can be used.
+        outputs->lenSeq1 = outputs->idxSeq1;
+        outputs->lenSeq2 = outputs->idxSeq2;
+        outputs->lenSeq3 = outputs->idxSeq3;
+    }
+
+    if (buffers == &ownBuffers) ukk_tcm_3D_free_buffers( &ownBuffers );
+
+    if (stats != NULL) {
+        const size_t before[2] = { hits, misses };
+        cm_lazy_3d_lookups( &hits, &misses );
+        stats->memoHits   += hits   - before[0];
+        stats->memoMisses += misses - before[1];
     }
 
-    return U(ab, ac, d, toState)->dist;
+    // Over the ceiling, but the greatest ceiling has no cost above it.
+    if (found) return cost;
+    return costCeiling < UINT_MAX ? costCeiling + 1 : UINT_MAX;
 }
@@ -18,6 +18,8 @@
  * Call order is:
  * powell_3D_align -> alignUkk ->
  *
+ * powell_3D_align is kept only as a legacy reference; align3d calls ukk_tcm_3D_align.
+ *
  */
 
 // TODO: Is this true?
@@ -38,6 +40,7 @@
 #ifndef UKKCHECKP_H
 #define UKKCHECKP_H
 
+#include "alignmentStats.h"
 #include "costMatrix.h"
 #include "ukkCommon.h"
 
@@ -51,13 +54,6 @@ typedef struct checkPoint_cell_t {
 } checkPoint_cell_t;
 
 
-// TODO: /** How many cells there are, and how wide ukk band is? */
-typedef struct counts_t {
-    long cells;
-    long innerLoop;
-} counts_t;
-
-
 /** The previous finite state machine state. */
 typedef struct from_t {
     int ac;                 // This and next are used to map into Ukkonnen matrix, where each cell, (ab, d) is (_idx_diff, edit distance).
@@ -76,6 +72,21 @@ typedef struct ukk_cell_t {
 } ukk_cell_t;
 
 
+/** The arrays of a search of ukk_tcm_3D_align(), kept from one search to the next so that they
+ *  only ever grow. Zero it before its first search; ukk_tcm_3D_free_buffers() frees them.
+ */
+typedef struct tcm_3d_buffers_t {
+    struct tcm_3d_plane_t *planes;        // The cells of each plane filled, one per element of the first character, and one more.
+    size_t                 planeCap;
+    unsigned char         *directions;    // Per cell and state filled.
+    size_t                 directionCap;
+    unsigned int          *rows[2];       // The costs of the previous plane and this one.
+    size_t                 rowCap;
+    elem_t                *elements;      // The inputs' elements, sorted, to bound the cost of gaps.
+    size_t                 elementCap;
+} tcm_3d_buffers_t;
+
+
 /** Sets up structs that will be passed through rest of process.
  *  Finds first cell in which the three characters no long match.
  *  Calls functions that do actual affine Ukkonnen calculations.
@@ -99,7 +110,8 @@ int align3d_ukk( dyn_character_t *retLesserChar
 
 
 /**  */
-int calcUkk( int             ab
+int calcUkk( ukk_context_t  *context
+           , int             ab
            , int             ac
            , int             input_editDist
            , int             toState
@@ -115,15 +127,56 @@ int calcUkk( int             ab
 int char_to_base (char v);
 
 
-int doUkk( characters_t *inputs
-         , characters_t *outputs
+/** Aligns inputs into outputs with the least cost in costMtx3d, plus gapOpenCost for each gap
+ *  opened in a character, and returns that cost. Unlike the legacy powell_3D_align(), which knows
+ *  only a single mismatch cost, the cost of each column, ambiguous elements and gaps included, is
+ *  the matrix's, so the alignment is one of least cost by the matrix.
+ *
+ *  Searches with Ukkonen's cut off: the cells that an alignment costing no more than a threshold
+ *  could pass through, by a lower bound on the cost of its gaps, are filled, and the threshold
+ *  doubles until an alignment within it is found. Time and memory are about the number of cells
+ *  within the cost of the alignment of the diagonals.
+ *
+ *  outputs are written last column first, as doUkk() writes them. If no alignment costs
+ *  costCeiling or less, returns costCeiling + 1, or UINT_MAX if costCeiling is UINT_MAX, without
+ *  filling outputs. Thread-safe, so long as concurrent searches have buffers of their own.
+ *
+ *  Each search, and the lazy matrix lookups of all of them, are added to stats, unless it is NULL.
+ *  The search's arrays are taken from buffers, which grow as needed, or, if it is NULL, are
+ *  allocated for this search alone.
+ */
+unsigned int ukk_tcm_3D_align( characters_t             *inputs
+                             , characters_t             *outputs
+                             , const cost_matrices_3d_t *costMtx3d
+                             , unsigned int              gapOpenCost
+                             , unsigned int              costCeiling
+                             , alignment_stats_t        *stats
+                             , tcm_3d_buffers_t         *buffers
+                             );
+
+
+/** Frees the arrays of buffers, and empties it. */
+void ukk_tcm_3D_free_buffers( tcm_3d_buffers_t *buffers );
+
+
+/** The memory held by the arrays of buffers. */
+size_t ukk_tcm_3D_buffer_bytes( const tcm_3d_buffers_t *buffers );
+
+
+/** Aligns inputs into outputs, with the costs and finite state machine already set up in context.
+ *  Returns context->costCeiling + 1, with outputs unfilled, if the cost is greater than that.
+ */
+int doUkk( ukk_context_t *context
+         , characters_t  *inputs
+         , characters_t  *outputs
          );
 
 
 /** For Ukkonen check point between to specified points in the U matrix... TODO: ...?
  *  All distances and costs are signed, as often initialized to -INFINITY
  */
-int doUkkInLimits( int             start_ab
+int doUkkInLimits( ukk_context_t  *context
+                 , int             start_ab
                  , int             start_ac
                  , int             startCost
                  , int             startState
@@ -170,7 +223,8 @@ int find_bestState( int    ab
 /** Extracts info from the 'from' and CP info then recurses with doUkkInLimits for the two subparts.
  *  All distances and costs are signed, as often initialized to -INFINITY
  */
-int getSplitRecurse( int             start_ab
+int getSplitRecurse( ukk_context_t  *context
+                   , int             start_ab
                    , int             start_ac
                    , int             startCost
                    , int             startState
@@ -190,23 +244,25 @@ int getSplitRecurse( int             start_ab
 /** Recovers an alignment directly from the Ukkonnen matrix.
  *  Used for the base case of the check point recursion.
  */
-void traceBack( int           start_ab
-              , int           start_ac
-              , int           startCost
-              , int           startState
-              , int           final_ac
-              , int           final_ab
-              , int           finalCost
-              , int           finalState
-              , characters_t *inputChars
-              , characters_t *resultChars
+void traceBack( ukk_context_t *context
+              , int            start_ab
+              , int            start_ac
+              , int            startCost
+              , int            startState
+              , int            final_ac
+              , int            final_ab
+              , int            finalCost
+              , int            finalState
+              , characters_t  *inputChars
+              , characters_t  *resultChars
               );
 
 /** Return the edit distance of the ukk cell indicated by inputs.
  *  Checks to see if edit distance is
  *  Calls `calcUkk`.
  */
-int Ukk( int             ab
+int Ukk( ukk_context_t  *context
+       , int             ab
        , int             ac
        , int             editDistance
        , unsigned int    fsm_state
@@ -52,43 +52,40 @@
 #include "ukkCheckPoint.h"
 #include "ukkCommon.h"
 
-int neighbours[MAX_STATES];
-int contCost[MAX_STATES];
-int secondCost[MAX_STATES];
-int transCost[MAX_STATES][MAX_STATES];
-int stateNum[MAX_STATES];
-
-int misCost_g        = 1;
-int startInsert_g    = 3;             // a: w(k) = a + b * k
-int continueInsert_g = 1;             // b:
-int startDelete_g    = 3;
-int continueDelete_g = 1;
-
-elem_t gap_char_g;
-
-int numStates_g;
-int maxSingleStep_g;
-
-
+// Legacy reference implementation; see ukkCommon.h. align3d() calls ukk_tcm_3D_align() instead.
 int powell_3D_align ( characters_t *inputSeqs     // lengths set correctly; idices set to 0
                     , characters_t *outputSeqs    // lengths set correctly; idices set to 0
                     , size_t        alphabetSize  // not including gap
                     , int           mm            // mismatch cost, must be > 0
                     , int           go            // gap open cost, must be >= 0
                     , int           ge            // gap extension cost, must be > 0
+                    , unsigned int  costCeiling
                     )
 {
-    gap_char_g = 1 << alphabetSize;
+    ukk_context_t context;
+
+    context.gap_char    = 1 << alphabetSize;
+    context.costCeiling = costCeiling;
 
     outputSeqs->idxSeq1 = 0;
     outputSeqs->idxSeq2 = 0;
     outputSeqs->idxSeq3 = 0;
 
-    misCost_g        = mm;
-    startInsert_g    = go;
-    continueInsert_g = ge;
-    startDelete_g    = go;    // note that these are same as insert
-    continueDelete_g = ge;    // note that these are same as insert
+    context.misCost        = mm;
+    context.startInsert    = go;
+    context.continueInsert = ge;
+    context.startDelete    = go;    // note that these are same as insert
+    context.continueDelete = ge;    // note that these are same as insert
+
+    // An alignment is no longer than the three characters together.
+    const size_t maxAlignmentLength = inputSeqs->lenSeq1 + inputSeqs->lenSeq2 + inputSeqs->lenSeq3 + 1;
+    context.state_vector = malloc( maxAlignmentLength * sizeof(int) );
+    context.cost_vector  = malloc( maxAlignmentLength * sizeof(int) );
+    assert(   context.state_vector != NULL
+           && context.cost_vector  != NULL
+           && "Out of Memory error: Can't allocate 3D traceback vectors." );
+    context.si    = 0;
+    context.costi = 0;
 
     if (DEBUG_3D) {
         int i;
@@ -106,8 +103,13 @@ int powell_3D_align ( characters_t *inputSeqs     // lengths set correctly; idic
         printf("\n");
     }
 
-    setup();
-    return doUkk( inputSeqs, outputSeqs );
+    setup( &context );
+    const int cost = doUkk( &context, inputSeqs, outputSeqs );
+
+    free( context.state_vector );
+    free( context.cost_vector );
+
+    return cost;
 }
 
 
@@ -164,9 +166,9 @@ int okIndex( int a, int da, int end)
 /*-- -------------------------------------------------------------------- */
 /* Common setup routines */
 
-int stateTransitionCost( int from, int to )
+int stateTransitionCost( const ukk_context_t *context, int from, int to )
 {
-  return transCost[from][to];
+  return context->transCost[from][to];
 }
 
 void exists_neighbor_in_delete_state( int n, int *a, int *b, int *c )
@@ -191,17 +193,17 @@ void transitions(int s, Trans st[3])
     st[2] = (s / 9) % 3;
 }
 
-char *state2str(int s)
+char *state2str( const ukk_context_t *context, int s, char str[4] )
 {
-    static char str[4];
     Trans st[3];
     int i;
-    transitions(stateNum[s], st);
+    transitions(context->stateNum[s], st);
     for (i = 0; i < 3; i++) {
         str[i] = ( st[i] == match ? 'M'
                                   : ( st[i] == del ? 'D'
                                                    : 'I' ) );
     }
+    str[3] = 0;
     return str;
 }
 
@@ -217,13 +219,13 @@ int countTrans(Trans st[3], Trans t)
 
 // TODO: Should be able to replace the first part of this with static array declaration.
 // Also, see my update of this using mod.
-void setup()
+void setup( ukk_context_t *context )
 {
     int s,
         ns = 0;
 
-    assert( startInsert_g    == startDelete_g    && "Need to rewrite setup routine" );
-    assert( continueInsert_g == continueDelete_g && "Need to rewrite setup routine" );
+    assert( context->startInsert    == context->startDelete    && "Need to rewrite setup routine" );
+    assert( context->continueInsert == context->continueDelete && "Need to rewrite setup routine" );
 
     for (s = 0; s < MAX_STATES; s++) {
         Trans st[3];
@@ -238,18 +240,18 @@ void setup()
         if (countTrans(st, ins) + countTrans(st, del) > 1)    continue;
 #endif
 
-        stateNum[ns] = s;
+        context->stateNum[ns] = s;
 
         { // Setup possible neighbours for states (neighbours[])
             int numInserts = countTrans(st, ins);
             if (numInserts == 0) {
-                neighbours[ns] = neighbourNum( st[0] == match ? 1 : 0,
-                                               st[1] == match ? 1 : 0,
-                                               st[2] == match ? 1 : 0 );
+                context->neighbours[ns] = neighbourNum( st[0] == match ? 1 : 0,
+                                                        st[1] == match ? 1 : 0,
+                                                        st[2] == match ? 1 : 0 );
             } else { // (numInserts == 1)
-                neighbours[ns] = neighbourNum( st[0] == ins ? 1 : 0,
-                                               st[1] == ins ? 1 : 0,
-                                               st[2] == ins ? 1 : 0 );
+                context->neighbours[ns] = neighbourNum( st[0] == ins ? 1 : 0,
+                                                        st[1] == ins ? 1 : 0,
+                                                        st[2] == ins ? 1 : 0 );
             }
         } // End setting up neighbo ur s
 
@@ -257,73 +259,73 @@ void setup()
         { // Setup cost for continuing a state (contCost[])
             int cost, cont2;
             if (countTrans(st, ins) > 0) {
-                cost  = continueInsert_g;        /* Can only continue 1 insert at a time */
+                cost  = context->continueInsert;        /* Can only continue 1 insert at a time */
                 cont2 = 0;
             } else if (countTrans(st, match) == 3) {
-                cost  = misCost_g;               /* All match states */
+                cost  = context->misCost;               /* All match states */
                 cont2 = 1;
             } else if (countTrans(st, del) == 1) {
-                cost  = continueDelete_g;        /* Continuing a delete */
+                cost  = context->continueDelete;        /* Continuing a delete */
                 cont2 = 1;
             } else {
-                cost = 2 * continueDelete_g;     /* Continuing 2 deletes */
+                cost = 2 * context->continueDelete;     /* Continuing 2 deletes */
                 cont2 = 0;
             }
-            contCost[ns]   = cost;
-            secondCost[ns] = cont2;
+            context->contCost[ns]   = cost;
+            context->secondCost[ns] = cont2;
         } // End setup of contCost[]
 
       ns++;
     } // end MAX STATES assignments
 
-    numStates_g = ns;
+    context->numStates = ns;
 
     { // Setup state transition costs (transCost[][])
         int s1, s2;
         int maxCost = 0;
 
-        assert( startInsert_g == startDelete_g && "Need to rewrite setup routine" );
-        for (s1 = 0; s1 < numStates_g; s1++) {
-            for (s2 = 0; s2 < numStates_g; s2++) {
+        assert( context->startInsert == context->startDelete && "Need to rewrite setup routine" );
+        for (s1 = 0; s1 < context->numStates; s1++) {
+            for (s2 = 0; s2 < context->numStates; s2++) {
                 Trans from[3], to[3];
                 int cost = 0;
 
-                transitions(stateNum[s1], from);
-                transitions(stateNum[s2], to);
+                transitions(context->stateNum[s1], from);
+                transitions(context->stateNum[s2], to);
 
                 for (int i = 0; i < 3; i++) {
                     if (     (to[i] == ins || to[i] == del)
                           && (to[i] != from[i]) ) {
-                        cost += startInsert_g;
+                        cost += context->startInsert;
                     }
                 }
-                transCost[s1][s2] = cost;
+                context->transCost[s1][s2] = cost;
 
                 { // Determine biggest single step cost
-                    int thisCost = cost + contCost[s2];
+                    int thisCost = cost + context->contCost[s2];
                     Trans st[3];
-                    transitions( stateNum[s2], st );
-                    thisCost += misCost_g * (countTrans(st, match) - 1);
+                    transitions( context->stateNum[s2], st );
+                    thisCost += context->misCost * (countTrans(st, match) - 1);
                     maxCost   = (maxCost < thisCost ? thisCost
                                                     : maxCost);
                 } // biggest single step cost
             }
         }
-        maxSingleStep_g = maxCost;
-        if (DEBUG_3D)   fprintf(stderr, "Maximum single step cost = %d\n", maxSingleStep_g);
+        context->maxSingleStep = maxCost;
+        if (DEBUG_3D)   fprintf(stderr, "Maximum single step cost = %d\n", context->maxSingleStep);
     } // End setup of transition costs
 }
 
 
 /* ---------------------------------------------------------------------- */
 /* Some alignment checking routines */
-void checkAlign( elem_t *al, int alLen, elem_t *str, int strLen )
+void checkAlign( const ukk_context_t *context, elem_t *al, int alLen, elem_t *str, int strLen )
 {
     int i,
         j = 0;
     // char errorMsg[1024]; // for assertion outputs
     for (i = 0; i < alLen; i++) {
-        if (al[i] == gap_char_g)    continue;
+        if (al[i] == context->gap_char)    continue;
         if (DEBUG_3D)    printf( "Element in output alignment equals element in input string. a[i]: %2u, str[j]: %2u\n", al[i], str[j] );
         // assert( al[i] == str[j] );
         j++;
@@ -396,7 +398,8 @@ characters_t *alloc_characters_t( size_t seq_1_number_elems, size_t seq_2_number
 }
 
 
-int alignmentCost(          int  states[]
+int alignmentCost( const ukk_context_t *context
+                 ,          int  states[]
                  , unsigned int *al1
                  , unsigned int *al2
                  , unsigned int *al3
@@ -406,18 +409,18 @@ int alignmentCost(          int  states[]
     int cost = 0;
     Trans last_st[3] = { match, match, match };
 
-    assert( startInsert_g == startDelete_g );
+    assert( context->startInsert == context->startDelete );
 
     for (int i = 0; i < len; i++) {
         int s;
         Trans st[3];
-        transitions(stateNum[states[i]], st);
+        transitions(context->stateNum[states[i]], st);
 
 //    if (i > 0) fprintf(stderr, "% - 2d  ", cost);
 
         // Pay for begining of gaps.
         for (s = 0; s < 3; s++) {
-            if (st[s] != match && st[s] != last_st[s])   cost += startInsert_g;
+            if (st[s] != match && st[s] != last_st[s])   cost += context->startInsert;
         }
 
         for (s = 0; s < 3; s++)   last_st[s] = st[s];
@@ -425,37 +428,37 @@ int alignmentCost(          int  states[]
         // Pay for continuing an insert
         if (countTrans(st, ins) > 0) {
             assert(countTrans(st, ins) == 1);
-            cost += continueInsert_g;
+            cost += context->continueInsert;
             continue;
         }
 
         // Pay for continuing deletes
-        cost += continueDelete_g * countTrans(st, del);
+        cost += context->continueDelete * countTrans(st, del);
 
         // Pay for mismatches
         {
             int ch[3];
             int ci = 0;
             if (st[0] == match) {
-                assert( al1[i] != gap_char_g );
+                assert( al1[i] != context->gap_char );
                 ch[ci++] = al1[i];
             }
             if (st[1] == match) {
-                assert( al2[i] != gap_char_g );
+                assert( al2[i] != context->gap_char );
                 ch[ci++] = al2[i];
             }
             if (st[2] == match) {
-                assert( al3[i] != gap_char_g );
+                assert( al3[i] != context->gap_char );
                 ch[ci++] = al3[i];
             }
             ci--;
             for (; ci > 0; ci--) {
-                if (ch[ci - 1] != ch[ci])    cost += misCost_g;
+                if (ch[ci - 1] != ch[ci])    cost += context->misCost;
             }
             if (     countTrans(st, match) == 3
                   && ch[0] == ch[2]
                   && ch[0] != ch[1]) {
-                cost -= misCost_g;
+                cost -= context->misCost;
             }
         }
 
@@ -469,7 +472,7 @@ void *allocEntry( AllocInfo_t *a )
 {
     void *p;
 
-    long entries     = CellsPerBlock * CellsPerBlock * numStates_g;
+    long entries     = CellsPerBlock * CellsPerBlock * a->numStates;
     a->memAllocated += entries * a->elemSize;
 
     p = calloc(entries, a->elemSize);
@@ -47,32 +47,8 @@
 
 typedef enum {match, del, ins} Trans;  // The 3 possible state-machine states
 
-#ifndef __UKKCOMMON_C__
-
-extern int misCost_g;
-extern int startInsert_g;
-extern int continueInsert_g;
-extern int startDelete_g;
-extern int continueDelete_g;
-
-extern int neighbours[MAX_STATES];
-extern int contCost[MAX_STATES];
-extern int secondCost[MAX_STATES];
-extern int transCost[MAX_STATES][MAX_STATES];
-extern int stateNum[MAX_STATES];
-
-extern int numStates_g;
-extern int maxSingleStep_g;
-
-extern elem_t gap_char_g;
-
-// extern char Astr[MAX_STR];
-// extern char Bstr[MAX_STR];
-// extern char Cstr[MAX_STR];
-// extern int Alen, Blen, Clen;
-#endif // __UKKCOMMON_C_
-
-#define maxSingleCost  (maxSingleStep_g * 2)
+/** All the state of one 3D alignment; see below. */
+typedef struct ukk_context_t ukk_context_t;
 
 
 /** Holds arrays of characters along with their respective weights.
@@ -95,7 +71,7 @@ int whichCharCost( int a, int b, int c );
 int okIndex( int a, int da, int end );
 
 // Setup routines
-int stateTransitionCost( int from, int to );
+int stateTransitionCost( const ukk_context_t *context, int from, int to );
 
 
 /** Mutates a, b, and c such that each is true or false if the least significant first, second or third digit, respectively,
@@ -105,13 +81,19 @@ int stateTransitionCost( int from, int to );
 void exists_neighbor_in_delete_state( int n, int *a, int *b, int *c );
 int neighbourNum( int i, int j, int k );
 void transitions( int s, Trans st[3] );
-char *state2str( int s );
+
+
+/** Writes the three letter name of state s, e.g. "MDI", to str, and returns str. */
+char *state2str( const ukk_context_t *context, int s, char str[4] );
 int countTrans( Trans st[3], Trans t );
-void setup();
+
+
+/** Sets up the finite state machine of context, from its costs. */
+void setup( ukk_context_t *context );
 
 
 // Alignment checking routines
-void checkAlign( elem_t *al, int alLen, elem_t *str, int strLen );
+void checkAlign( const ukk_context_t *context, elem_t *al, int alLen, elem_t *str, int strLen );
 
 
 /** As it says, reverses an array of `int`s */
@@ -137,11 +119,12 @@ characters_t *alloc_characters_t( size_t seq_1_number_elems, size_t seq_2_number
 // void revCharArray( char *arr, int start, int end );
 
 
-int alignmentCost( int     states[]
-                 , elem_t *al1
-                 , elem_t *al2
-                 , elem_t *al3
-                 , int     len );
+int alignmentCost( const ukk_context_t *context
+                 ,       int     states[]
+                 ,       elem_t *al1
+                 ,       elem_t *al2
+                 ,       elem_t *al3
+                 ,       int     len );
 
 
 // typedef struct cost_state_vector_t
@@ -160,7 +143,7 @@ int alignmentCost( int     states[]
              and contains a pointer to the plane for that cost.
 
   A Block is square containing CellsPerBlock x CellsPerBlock cells
-    (note: each cell contains numStates_g states)
+    (note: each cell contains numStates states)
 
   A plane is 2d array of pointers to Blocks.  Enough pointers to cover
   from ab = - |B|..|A| and ac = - |C|..|A|.  Each block is only allocated as needed.
@@ -175,6 +158,7 @@ int alignmentCost( int     states[]
 
 typedef struct allocInfo_t {
     int    elemSize;
+    int    numStates;
     int    abSize;
     int    acSize;
     int    abOffset;
@@ -187,6 +171,72 @@ typedef struct allocInfo_t {
     long   memAllocated;
 } AllocInfo_t;
 
+/** How many cells were computed, and how many times the inner loop extending a run of matches ran. */
+typedef struct counts_t {
+    long cells;
+    long innerLoop;
+} counts_t;
+
+
+/** Holds all the state of one 3D alignment: the costs and finite state machine set up by `setup()`,
+ *  and the Ukkonen and check point matrices and recursion bounds used by `doUkk()` and below.
+ *  `powell_3D_align()` makes one per call, so any number of alignments can run at once.
+ */
+struct ukk_context_t {
+    // Costs, as passed to powell_3D_align().
+    int    misCost;
+    int    startInsert;             // a: w(k) = a + b * k
+    int    continueInsert;          // b:
+    int    startDelete;
+    int    continueDelete;
+    elem_t gap_char;
+    unsigned int costCeiling;       // doUkk() gives up on costs above this.
+
+    // The finite state machine, set up by setup().
+    int    neighbours[MAX_STATES];
+    int    contCost[MAX_STATES];
+    int    secondCost[MAX_STATES];
+    int    transCost[MAX_STATES][MAX_STATES];
+    int    stateNum[MAX_STATES];
+    int    numStates;
+    int    maxSingleStep;
+
+    AllocInfo_t uAllocInfo;         // The Ukkonen matrix.
+    AllocInfo_t cpAllocInfo;        // The check point matrix.
+    counts_t    counts;
+
+    // Added to the `computed` field of each cell. Increased for each recursive step of the check point
+    // algorithm. It's really a hack so I don't have to reinitialize the memory structures.
+    long   costOffset;
+    long   finalCost;
+
+    int    furthestReached;
+    int    CPonDist;                // Flag for whether to use distance of cost as the CP criteria
+                                    // CP on dist is only done for first iteration when then final
+                                    // cost is unknown
+    int    CPwidth;
+    int    CPcost;
+    int    completeFromInfo;        // Set to 1 for base cases, so 'from' info that alignment
+                                    // can be retrieved from is set.
+
+    // Start of the current check point recursion, needed by withinMatrix().
+    int    sab;
+    int    sac;
+    int    sCost;
+    int    sState;
+
+    int    endA;                    // Used to define where to end on the three strings in the
+    int    endB;                    // checkp recursion. So endA contains the distance the recursion
+    int    endC;                    // must finish on + 1.
+
+    // States and costs of the traceback, for checking it. Each has room for the longest alignment.
+    int   *state_vector;
+    int   *cost_vector;
+    int    si;
+    int    costi;
+};
+
+
 //U_cell_type **Umatrix;        /* 2 dimensional */
 
 // aInfo = allocMatrix(sizeof(U_cell_type));
@@ -199,12 +249,13 @@ typedef struct allocInfo_t {
 void *allocEntry( AllocInfo_t *a );
 
 
-static inline AllocInfo_t allocInit( int elemSize, int costSize, characters_t *inputs )
+static inline AllocInfo_t allocInit( int elemSize, int costSize, int numStates, characters_t *inputs )
 {
     AllocInfo_t a;
 
     a.memAllocated = 0;
     a.elemSize     = elemSize;
+    a.numStates    = numStates;
 
     a.abSize   = inputs->lenSeq1 + inputs->lenSeq2 + 1;
     a.acSize   = inputs->lenSeq1 + inputs->lenSeq3 + 1;
@@ -243,10 +294,10 @@ static inline long allocGetSubIndex( AllocInfo_t *a, int ab, int ac, int s )
 
     assert( abAdjusted >= 0 && abAdjusted < CellsPerBlock );
     assert( acAdjusted >= 0 && acAdjusted < CellsPerBlock );
-    assert( s >= 0  && s < numStates_g );
+    assert( s >= 0  && s < a->numStates );
 
     index = (index + abAdjusted) * CellsPerBlock;
-    index = (index + acAdjusted) * numStates_g;
+    index = (index + acAdjusted) * a->numStates;
     index = (index + s);
 
     return index;
@@ -356,14 +407,14 @@ static inline void allocFinal(AllocInfo_t *a, void *flag, void *top)
                 if (!block) continue;
                 blocksUsed++;
                 tblocksUsed++;
-                for (int cIndex = 0; cIndex < CellsPerBlock * CellsPerBlock * numStates_g; cIndex++) {
+                for (int cIndex = 0; cIndex < CellsPerBlock * CellsPerBlock * a->numStates; cIndex++) {
                     cellsTotal++;
                     if ( *(int *) ( ((char *) block) + (cIndex * a->elemSize) + usedFlag) ) {
                         cellsUsed++;
                         tcellsUsed++;
                     }
                 }
-                if (OUTPUT_FINAL_ALLOC)  printf("Block %zu. Cells = %d Used = %ld\n", j, CellsPerBlock * CellsPerBlock * numStates_g, tcellsUsed);
+                if (OUTPUT_FINAL_ALLOC)  printf("Block %zu. Cells = %d Used = %ld\n", j, CellsPerBlock * CellsPerBlock * a->numStates, tcellsUsed);
             }
             if (OUTPUT_FINAL_ALLOC)  printf("Plane %zu. Blocks = %ld Used = %ld\n", i, a->abBlocks * a->acBlocks, tblocksUsed);
         }
@@ -372,7 +423,7 @@ static inline void allocFinal(AllocInfo_t *a, void *flag, void *top)
                    planesUsed * a->abBlocks * a->acBlocks * sizeof(void*));
             printf("Total blocks %ld, used %ld (%.2f%%) (used %ld bytes)\n",
                    blocksTotal, blocksUsed, (100.0 * blocksUsed / blocksTotal),
-                   blocksUsed * CellsPerBlock * CellsPerBlock * numStates_g * a->elemSize);
+                   blocksUsed * CellsPerBlock * CellsPerBlock * a->numStates * a->elemSize);
             printf("Total cells %ld, used %ld (%.2f%%)\n",
                    cellsTotal, cellsUsed, (100.0 * cellsUsed / cellsTotal));
             printf("Total memory allocated = %ld bytes\n", a->memAllocated);
@@ -381,12 +432,40 @@ static inline void allocFinal(AllocInfo_t *a, void *flag, void *top)
         }
     }
 }
+
+
+/** Frees every plane and block allocated through a, and the base array. */
+static inline void allocFree(AllocInfo_t *a)
+{
+    for (long i = 0; i < a->baseAlloc; i++) {
+        void **p = a->basePtr[i];
+        if (!p) continue;
+
+        for (long j = 0; j < a->abBlocks * a->acBlocks; j++) {
+            if (p[j]) free(p[j]);
+        }
+        free(p);
+    }
+    free(a->basePtr);
+    a->basePtr   = NULL;
+    a->baseAlloc = 0;
+}
 // #endif // NO_ALLOC_ROUTINES
 
 
 /** This is entrance fn for Powell's 3d alignment code.
+ *
+ *  LEGACY REFERENCE IMPLEMENTATION. align3d() no longer calls this: it aligns with
+ *  ukk_tcm_3D_align(), whose costs are those of the 3D cost matrix. This is kept, single mismatch
+ *  cost and all, only as the reference that test_tcm_3d times ukk_tcm_3D_align() against. Do not
+ *  call it from new code.
  *
  *  Note that alphabet size does not include gap.
+ *
+ *  All state is held in a context local to the call, so this may be called from many threads at once.
+ *
+ *  If no alignment costs costCeiling or less, stops as soon as the Ukkonen band has been searched to
+ *  that cost, and returns costCeiling + 1 without filling outputSeqs. Pass UINT_MAX for no ceiling.
  */
 int powell_3D_align ( characters_t *inputSeqs     // lengths set correctly; idices set to 0
                     , characters_t *outputSeqs    // lengths set correctly; idices set to 0
@@ -394,6 +473,7 @@ int powell_3D_align ( characters_t *inputSeqs     // lengths set correctly; idic
                     , int           mm            // mismatch cost, must be > 0
                     , int           go            // gap open cost, must be >= 0
                     , int           ge            // gap extension cost, must be > 0
+                    , unsigned int  costCeiling
                     );
 
 #endif // __UKK_COMMON_H__
@@ -16,6 +16,7 @@ module Bio.Character.Exportable
   ( -- * Datatypes
     ExportableCharacterBuffer(..)
   , ExportableCharacterElements(..)
+  , ExportableCharacterSequence(..)
   , ReImportableCharacterElements(..)
   , Subcomponent
     -- * Classes
@@ -23,6 +23,7 @@ module Bio.Character.Exportable.Class
   ( -- * Datatypes
     ExportableCharacterBuffer(..)
   , ExportableCharacterElements(..)
+  , ExportableCharacterSequence(..)
   , ReImportableCharacterElements(..)
   , Subcomponent
     -- * Classes
@@ -34,6 +35,7 @@ module Bio.Character.Exportable.Class
 
 import Control.Lens         (Lens', lens)
 import Data.MonoTraversable
+import Data.Vector.Storable (Vector)
 import Foreign.C.Types
 
 
@@ -77,6 +79,28 @@ data  ReImportableCharacterElements
     deriving stock (Eq, Show)
 
 
+-- |
+-- A structure used for FFI calls--
+-- the integral value of each character element's median, left and right
+-- context, each context in its own pinned, contiguous buffer. Foreign code can
+-- read and write these in place, so nothing is copied into or out of foreign
+-- memory.
+--
+-- A character that stores its contexts this way, as a dynamic character of a
+-- small alphabet does, is converted to and from it without copying.
+--
+-- The contexts are not strict, so that one never used is never built.
+data  ExportableCharacterSequence
+    = ExportableCharacterSequence
+    { exportedElementCountSequence :: {-# UNPACK #-} !Word
+    , exportedElementWidthSequence :: {-# UNPACK #-} !Word
+    , exportedMedianContexts       :: Vector CUInt
+    , exportedLeftContexts         :: Vector CUInt
+    , exportedRightContexts        :: Vector CUInt
+    }
+    deriving stock (Eq, Show)
+
+
 -- |
 -- Represents a sequence of fixed width characters packed into a bitwise form
 -- consumable by lower level functions.
@@ -96,6 +120,10 @@ class ExportableElements c where
 
     fromExportableElements :: ReImportableCharacterElements -> c
 
+    toExportableSequence   :: c -> Maybe ExportableCharacterSequence
+
+    fromExportableSequence :: ExportableCharacterSequence -> c
+
 
 -- |
 -- A 'Control.Lens.Type.Lens' for the 'exportedElementCount' field
@@ -123,6 +151,11 @@ instance HasExportedElementCount ExportableCharacterElements Word where
     exportedElementCount = lens exportedElementCountElements (\e x -> e { exportedElementCountElements = x })
 
 
+instance HasExportedElementCount ExportableCharacterSequence Word where
+
+    exportedElementCount = lens exportedElementCountSequence (\e x -> e { exportedElementCountSequence = x })
+
+
 instance HasExportedElementCount ReImportableCharacterElements Word where
 
     exportedElementCount = lens reimportableElementCountElements (\e x -> e { reimportableElementCountElements = x })
@@ -138,6 +171,11 @@ instance HasExportedElementWidth ExportableCharacterElements Word where
     exportedElementWidth = lens exportedElementWidthElements (\e x -> e { exportedElementWidthElements = x })
 
 
+instance HasExportedElementWidth ExportableCharacterSequence Word where
+
+    exportedElementWidth = lens exportedElementWidthSequence (\e x -> e { exportedElementWidthSequence = x })
+
+
 instance HasExportedElementWidth ReImportableCharacterElements Word where
 
     exportedElementWidth = lens reimportableElementWidthElements (\e x -> e { reimportableElementWidthElements = x })
@@ -0,0 +1,635 @@
+/** ConcurrentMemo object to provide a thread-safe, insert-once memoization table for the
+ *  CostMatrix_2d and CostMatrix_3d lookup tables.
+ *
+ *  The table is split into a fixed number of shards ("lock striping"), each of which is an
+ *  independent hash table guarded by its own reader/writer lock. A key is assigned to a shard
+ *  by its hash, so concurrent lookups of different keys rarely contend on the same lock, and
+ *  concurrent lookups of the same key only ever take a shared (read) lock.
+ *
+ *  Entries are insert-once: once a key has a value, that value is never replaced. If two threads
+ *  compute the value of the same missing key at the same time, the first to take the shard's
+ *  write lock inserts its value and the second discards its own result and uses the stored one.
+ *  Since the stored cost and median of a key are a pure function of the key and the TCM, both
+ *  threads will always have computed identical values.
+ *
+ *  Storage is flat: each shard keeps all of its entries inline in one contiguous arena of
+ *  `uint64_t` words, one fixed-width record per entry:
+ *
+ *      [ key 1 | ... | key KeyCount | median | cost ]
+ *
+ *  where each key and the median are `elementSize` words wide and the cost takes one word.
+ *  Keys are located through an open-addressed, linearly probed slot array. Each slot packs the
+ *  upper 32 bits of the key's hash alongside (record index + 1), so most failed probes are
+ *  rejected without touching the arena. Nothing is heap allocated per entry; the arena and slot
+ *  array only grow geometrically.
+ *
+ *  Because the arena may be reallocated as it grows, stored records are only ever exposed to
+ *  callers while the owning shard's lock is held.
+ *
+ *  A table may be given a capacity, in entries. Each shard then holds at most its share of that
+ *  capacity and, once full, replaces a victim chosen by the CLOCK ("second chance") policy: every
+ *  hit sets the record's reference bit, and the shard's clock hand clears set bits as it passes,
+ *  evicting the first record found unreferenced. This approximates LRU while a hit remains a
+ *  single relaxed byte store under the shared lock. Unbounded tables carry no reference bits.
+ *  Hits, misses and evictions are counted per shard, so the counters do not add contention.
+ *
+ *  A table can be saved to a file and, in a later run, that file attached as a read-only base
+ *  layer (see memoFile.hpp): the file is memory mapped and probed in place, without locking, and
+ *  keys missing from it are inserted into the shards as usual, as a private overlay.
+ */
+
+#ifndef _CONCURRENT_MEMO_H
+#define _CONCURRENT_MEMO_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "memoFile.hpp"
+
+extern "C" {
+#include "dynamicCharacterOperations.h"
+}
+
+
+template < size_t KeyCount
+         , size_t ShardBits = 6
+         >
+class ConcurrentMemo
+{
+    public:
+
+        /** Number of independently locked shards. Always a power of two. */
+        static constexpr size_t shardCount = static_cast<size_t>(1) << ShardBits;
+
+        /** A key is KeyCount pointers to packed elements, each elementSize words long. The
+         *  pointed-to buffers are only read, and only for the duration of a call.
+         */
+        typedef const packedChar* key_t[KeyCount];
+
+        /** @elementSize is the number of `packedChar` words in each key element and the median.
+         *  @capacity is the greatest number of entries to keep, or 0 for no limit. Bounded tables
+         *  round it up to a whole number of entries per shard.
+         */
+        explicit ConcurrentMemo(size_t elementSize, size_t capacity = 0)
+          : elementSize(elementSize)
+          , recordWidth((KeyCount + 1) * elementSize + 1)
+          , shardCapacity(capacity == 0 ? 0 : std::max<size_t>(1, (capacity + shardCount - 1) / shardCount))
+        { }
+
+        ConcurrentMemo(const ConcurrentMemo&)            = delete;
+        ConcurrentMemo& operator=(const ConcurrentMemo&) = delete;
+
+        /** Look up @key. If present, calls @onFound with the stored cost and a pointer to the
+         *  stored median while the shard's read lock is held, then returns true. Otherwise
+         *  returns false.
+         */
+        template <typename OnFound>
+        bool lookup(const key_t& key, OnFound&& onFound) const
+        {
+            const auto  hash  = hashKey(key);
+            const auto& shard = shardFor(hash);
+            if (findInBase(key, hash, onFound)) {
+                shard.hits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            std::shared_lock<std::shared_timed_mutex> guard(shard.lock);
+
+            const auto record = find(shard, key, hash);
+            if (record == nullptr) {
+                shard.misses.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            shard.hits.fetch_add(1, std::memory_order_relaxed);
+            markReferenced(shard, record);
+            onFound(recordCost(record), recordMedian(record));
+            return true;
+        }
+
+        /** Insert @cost and @median for @key if and only if no value is already present.
+         *  The key and median words are copied into the shard's arena, replacing the CLOCK victim
+         *  if the shard is full.
+         *
+         *  In either case @onStored is then called, still under the write lock, with the cost and
+         *  a pointer to the median now stored for @key.
+         *
+         *  Returns true if this call inserted the value, false if another thread got there first
+         *  (or the key is in the attached base).
+         */
+        template <typename OnStored>
+        bool insertOnce(const key_t& key, unsigned int cost, const packedChar* median, OnStored&& onStored)
+        {
+            const auto hash = hashKey(key);
+            if (findInBase(key, hash, onStored)) return false;
+
+            auto& shard = shardFor(hash);
+            std::unique_lock<std::shared_timed_mutex> guard(shard.lock);
+
+            auto record = find(shard, key, hash);
+            if (record != nullptr) {
+                markReferenced(shard, record);
+                onStored(recordCost(record), recordMedian(record));
+                return false;
+            }
+
+            record = (shardCapacity != 0 && shard.count == shardCapacity)
+                   ? replaceVictim(shard, key, hash, cost, median)
+                   : insert(shard, key, hash, cost, median);
+            onStored(recordCost(record), recordMedian(record));
+            return true;
+        }
+
+        /** Apply @f to each stored entry, as f(keyWords, cost, medianWords), where keyWords holds
+         *  the KeyCount key elements back to back. Entries of an attached base come first.
+         *
+         *  NOT thread-safe: intended for debugging output and save() only.
+         */
+        template <typename F>
+        void forEach(F&& f) const
+        {
+            for (size_t i = 0; i < baseCount; ++i) {
+                const auto record = baseRecords + i * recordWidth;
+                f(record, recordCost(record), recordMedian(record));
+            }
+            for (const auto& shard : shards) {
+                for (size_t i = 0; i < shard.count; ++i) {
+                    const auto record = shard.arena.data() + i * recordWidth;
+                    f(record, recordCost(record), recordMedian(record));
+                }
+            }
+        }
+
+        /** Total number of stored entries. Takes each shard's read lock in turn, so the result is
+         *  only a snapshot when other threads are inserting.
+         */
+        size_t size() const
+        {
+            size_t total = baseCount;
+            for (const auto& shard : shards) {
+                std::shared_lock<std::shared_timed_mutex> guard(shard.lock);
+                total += shard.count;
+            }
+            return total;
+        }
+
+        /** Bytes of arena and slot storage currently reserved by the table, not counting the
+         *  shared pages of an attached base. Snapshot, as size().
+         */
+        size_t reservedBytes() const
+        {
+            size_t total = 0;
+            for (const auto& shard : shards) {
+                std::shared_lock<std::shared_timed_mutex> guard(shard.lock);
+                total += shard.arena.capacity() * sizeof(uint64_t)
+                       + shard.slots.capacity() * sizeof(uint64_t);
+            }
+            return total;
+        }
+
+        /** Hit, miss and eviction counts, with the current number of entries (including an
+         *  attached base) and the capacity. A snapshot, as size().
+         */
+        memo_stats_t stats() const
+        {
+            memo_stats_t result = { 0, 0, 0, baseCount, shardCapacity * shardCount };
+            for (const auto& shard : shards) {
+                std::shared_lock<std::shared_timed_mutex> guard(shard.lock);
+                result.hits      += shard.hits.load(std::memory_order_relaxed);
+                result.misses    += shard.misses.load(std::memory_order_relaxed);
+                result.evictions += shard.evictions;
+                result.entries   += shard.count;
+            }
+            return result;
+        }
+
+        /** Map the table saved at @path as a read-only base layer, if it was saved with the same
+         *  @tag (identifying the TCM), key count and element size, by a build that hashes keys the
+         *  same way, and whose slots each name one of its records. Returns whether it was attached.
+         *  Replaces any previously attached base.
+         *
+         *  NOT thread-safe: call before the table is shared between threads.
+         */
+        bool attach(const std::string& path, uint64_t tag)
+        {
+            auto file = MappedFile::open(path);
+            if (file == nullptr || file->wordCount() < memoFileHeaderWords) return false;
+
+            const auto header      = file->words();
+            const auto slotCount   = header[MEMO_FILE_SLOT_COUNT];
+            const auto recordCount = header[MEMO_FILE_RECORD_COUNT];
+            const bool valid = header[MEMO_FILE_MAGIC]        == memoFileMagic
+                            && header[MEMO_FILE_KEY_COUNT]    == KeyCount
+                            && header[MEMO_FILE_ELEMENT_SIZE] == elementSize
+                            && header[MEMO_FILE_TAG]          == tag
+                            && header[MEMO_FILE_HASH_CHECK]   == hashCheck()
+                            && slotCount != 0 && (slotCount & (slotCount - 1)) == 0
+                            && 2 * recordCount <= slotCount
+                            && file->wordCount() == memoFileHeaderWords + slotCount + recordCount * recordWidth;
+            if (!valid) return false;
+
+            // findIn() trusts the slots: each must name a record, and some must be empty to end a probe.
+            const auto slots = header + memoFileHeaderWords;
+            size_t     used  = 0;
+            for (size_t i = 0; i < slotCount; ++i) {
+                if (slots[i] == emptySlot) continue;
+                const auto index = slots[i] & 0xFFFFFFFF;
+                if (index == 0 || index > recordCount) return false;
+                ++used;
+            }
+            if (used != recordCount) return false;
+
+            baseSlots     = slots;
+            baseSlotCount = slotCount;
+            baseRecords   = baseSlots + slotCount;
+            baseCount     = recordCount;
+            baseFile      = std::move(file);
+            return true;
+        }
+
+        /** Write every entry, from both the attached base and the overlay, to @path in a form
+         *  attach() can map, tagged with @tag. Returns whether the file was written.
+         *
+         *  NOT thread-safe: as forEach().
+         */
+        bool save(const std::string& path, uint64_t tag) const
+        {
+            const auto count = size();
+            size_t slotCount = initialSlotCount;
+            while (slotCount < 2 * count) slotCount *= 2;
+
+            std::vector<uint64_t> words( memoFileHeaderWords + slotCount, emptySlot );
+            words.reserve( words.size() + count * recordWidth );
+
+            const auto slots = [&words]() { return words.data() + memoFileHeaderWords; };
+            const auto mask  = slotCount - 1;
+            size_t     saved = 0;
+
+            forEach( [&]( const uint64_t* record, unsigned int, const packedChar* ) {
+                key_t recordKey;
+                for (size_t k = 0; k < KeyCount; ++k) recordKey[k] = record + k * elementSize;
+                const auto hash = hashKey(recordKey);
+
+                // An overlay entry may duplicate a base entry if the base was attached late.
+                auto i = hash & mask;
+                for (; slots()[i] != emptySlot; i = (i + 1) & mask) {
+                    const auto stored = words.data() + memoFileHeaderWords + slotCount
+                                      + ((slots()[i] & 0xFFFFFFFF) - 1) * recordWidth;
+                    if (slotTag(slots()[i]) == slotTag(hash) && recordMatches(stored, recordKey)) return;
+                }
+                slots()[i] = slotTag(hash) | (saved++ + 1);
+                words.insert( words.end(), record, record + recordWidth );
+            });
+
+            words[MEMO_FILE_MAGIC]        = memoFileMagic;
+            words[MEMO_FILE_KEY_COUNT]    = KeyCount;
+            words[MEMO_FILE_ELEMENT_SIZE] = elementSize;
+            words[MEMO_FILE_TAG]          = tag;
+            words[MEMO_FILE_HASH_CHECK]   = hashCheck();
+            words[MEMO_FILE_SLOT_COUNT]   = slotCount;
+            words[MEMO_FILE_RECORD_COUNT] = saved;
+            words[MEMO_FILE_RESERVED]     = 0;
+            return writeFileAtomically(path, words);
+        }
+
+    private:
+
+        static constexpr size_t   initialSlotCount = 16;
+        static constexpr uint64_t emptySlot        = 0;
+
+        struct Shard {
+            mutable std::shared_timed_mutex lock;
+            std::vector<uint64_t>           arena;  // count * recordWidth words
+            std::vector<uint64_t>           slots;  // (hash >> 32) << 32 | (record index + 1)
+            size_t                          count = 0;
+
+            // Bounded tables only: a CLOCK reference bit per record, set by readers under the
+            // shared lock (hence atomic), and the clock hand, moved under the write lock.
+            std::unique_ptr<std::atomic<uint8_t>[]> referenced;
+            size_t                                  hand = 0;
+
+            mutable std::atomic<uint64_t> hits{0};
+            mutable std::atomic<uint64_t> misses{0};
+            uint64_t                      evictions = 0;  // Only changed under the write lock.
+        };
+
+        /** Number of words in each key element and in the median. */
+        const size_t elementSize;
+
+        /** Number of words in each arena record. */
+        const size_t recordWidth;
+
+        /** Greatest number of records in each shard, or 0 if unbounded. */
+        const size_t shardCapacity;
+
+        Shard shards[shardCount];
+
+        /** Read-only base layer mapped by attach(), with the same slot and record layout as a
+         *  shard. Never modified once attached, so it is read without locking.
+         */
+        std::unique_ptr<MappedFile> baseFile;
+        const uint64_t*             baseSlots     = nullptr;
+        size_t                      baseSlotCount = 0;
+        const uint64_t*             baseRecords   = nullptr;
+        size_t                      baseCount     = 0;
+
+        /** Following hash_combine code modified from here (seems to be based on Boost):
+         *  http://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
+         *
+         *  Order dependent, as is necessary for a non-symmetric tcm: each key element is hashed
+         *  with its own seed before the element seeds are combined.
+         */
+        uint64_t hashKey(const key_t& key) const
+        {
+            static constexpr uint64_t seeds[] = { 3141592653   // π used as arbitrary random seed
+                                                , 2718281828   // e used as arbitrary random seed
+                                                , 6022140857   // Avogadro's # used as arbitrary random seed
+                                                };
+            static_assert(KeyCount <= sizeof(seeds) / sizeof(seeds[0]), "Too many key elements to hash.");
+
+            std::hash<uint64_t> hasher;
+            uint64_t combined = 0;
+            for (size_t k = 0; k < KeyCount; ++k) {
+                auto seed = seeds[k];
+                for (size_t i = 0; i < elementSize; ++i) {
+                    seed ^= hasher(key[k][i]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+                }
+                combined ^= hasher(seed) + 0x9e3779b9 + (combined << 6) + (combined >> 2);
+            }
+            // Fibonacci mix, so that both the shard bits and the slot bits are well distributed.
+            return combined * UINT64_C(0x9E3779B97F4A7C15);
+        }
+
+        /** Hash of a fixed key, saved with a table so that attach() can reject a file written by a
+         *  build whose std::hash differs.
+         */
+        uint64_t hashCheck() const
+        {
+            const std::vector<packedChar> probe( elementSize, UINT64_C(0x0123456789ABCDEF) );
+            key_t key;
+            for (size_t k = 0; k < KeyCount; ++k) key[k] = probe.data();
+            return hashKey(key);
+        }
+
+        /** Select the shard from the top bits of the mixed hash. Slots use the low bits. */
+        const Shard& shardFor(uint64_t hash) const { return shards[hash >> (64 - ShardBits)]; }
+              Shard& shardFor(uint64_t hash)       { return shards[hash >> (64 - ShardBits)]; }
+
+        static uint64_t slotTag(uint64_t hash) { return hash & UINT64_C(0xFFFFFFFF00000000); }
+
+        const packedChar* recordMedian(const uint64_t* record) const { return record + KeyCount * elementSize; }
+
+        unsigned int recordCost(const uint64_t* record) const
+        {
+            return static_cast<unsigned int>(record[recordWidth - 1]);
+        }
+
+        bool recordMatches(const uint64_t* record, const key_t& key) const
+        {
+            for (size_t k = 0; k < KeyCount; ++k) {
+                if (std::memcmp(record + k * elementSize, key[k], elementSize * sizeof(uint64_t)) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /** Returns the record stored for @key in a slot array and its records, or nullptr. */
+        const uint64_t* findIn( const uint64_t* slots, size_t slotCount, const uint64_t* records
+                              , const key_t& key, uint64_t hash ) const
+        {
+            if (slotCount == 0) return nullptr;
+
+            const auto mask = slotCount - 1;
+            const auto tag  = slotTag(hash);
+            for (auto i = hash & mask; ; i = (i + 1) & mask) {
+                const auto slot = slots[i];
+                if (slot == emptySlot) return nullptr;
+                if (slotTag(slot) == tag) {
+                    const auto record = records + ((slot & 0xFFFFFFFF) - 1) * recordWidth;
+                    if (recordMatches(record, key)) return record;
+                }
+            }
+        }
+
+        /** Returns the record stored for @key, or nullptr. Caller must hold the shard's lock. */
+        const uint64_t* find(const Shard& shard, const key_t& key, uint64_t hash) const
+        {
+            return findIn(shard.slots.data(), shard.slots.size(), shard.arena.data(), key, hash);
+        }
+
+        /** If @key is in the attached base, call @onFound with its cost and median and return true. */
+        template <typename OnFound>
+        bool findInBase(const key_t& key, uint64_t hash, OnFound& onFound) const
+        {
+            const auto record = findIn(baseSlots, baseSlotCount, baseRecords, key, hash);
+            if (record == nullptr) return false;
+
+            onFound(recordCost(record), recordMedian(record));
+            return true;
+        }
+
+        /** Place record @index in the first free slot for @hash. Caller must hold the write lock. */
+        static void placeSlot(std::vector<uint64_t>& slots, uint64_t hash, size_t index)
+        {
+            const auto mask = slots.size() - 1;
+            auto i = hash & mask;
+            while (slots[i] != emptySlot) i = (i + 1) & mask;
+            slots[i] = slotTag(hash) | (index + 1);
+        }
+
+        /** Double the slot array, rehashing the stored keys. Caller must hold the write lock. */
+        void growSlots(Shard& shard)
+        {
+            std::vector<uint64_t> grown( shard.slots.empty() ? initialSlotCount : 2 * shard.slots.size(), emptySlot );
+            for (size_t index = 0; index < shard.count; ++index) {
+                placeSlot(grown, recordHash(shard.arena.data() + index * recordWidth), index);
+            }
+            shard.slots.swap(grown);
+        }
+
+        /** Copy @key, @median and @cost into @record. */
+        void writeRecord(uint64_t* record, const key_t& key, unsigned int cost, const packedChar* median) const
+        {
+            for (size_t k = 0; k < KeyCount; ++k) {
+                std::memcpy(record + k * elementSize, key[k], elementSize * sizeof(uint64_t));
+            }
+            std::memcpy(record + KeyCount * elementSize, median, elementSize * sizeof(uint64_t));
+            record[recordWidth - 1] = cost;
+        }
+
+        /** The hash of the key stored in @record. */
+        uint64_t recordHash(const uint64_t* record) const
+        {
+            key_t recordKey;
+            for (size_t k = 0; k < KeyCount; ++k) recordKey[k] = record + k * elementSize;
+            return hashKey(recordKey);
+        }
+
+        /** Set the CLOCK reference bit of @record, if the table is bounded. Safe under the shared
+         *  lock; the bit is only written if clear, so repeated hits do not dirty the cache line.
+         */
+        void markReferenced(const Shard& shard, const uint64_t* record) const
+        {
+            if (shardCapacity == 0) return;
+            auto& bit = shard.referenced[(record - shard.arena.data()) / recordWidth];
+            if (bit.load(std::memory_order_relaxed) == 0) bit.store(1, std::memory_order_relaxed);
+        }
+
+        /** Append a record to the arena and index it. Caller must hold the write lock. */
+        const uint64_t* insert(Shard& shard, const key_t& key, uint64_t hash, unsigned int cost, const packedChar* median)
+        {
+            // Keep the load factor at or below one half, so that linear probes stay short.
+            if (2 * (shard.count + 1) > shard.slots.size()) growSlots(shard);
+
+            if (shardCapacity != 0 && shard.referenced == nullptr) {
+                shard.referenced.reset(new std::atomic<uint8_t>[shardCapacity]());
+            }
+
+            const auto index = shard.count++;
+            shard.arena.resize(shard.count * recordWidth);
+
+            const auto record = shard.arena.data() + index * recordWidth;
+            writeRecord(record, key, cost, median);
+            if (shardCapacity != 0) shard.referenced[index].store(1, std::memory_order_relaxed);
+
+            placeSlot(shard.slots, hash, index);
+            return record;
+        }
+
+        /** Advance the clock hand of a full shard to the first unreferenced record, clearing the
+         *  reference bits it passes, and return that record's index. Caller must hold the write lock.
+         */
+        size_t clockVictim(Shard& shard) const
+        {
+            for (;;) {
+                const auto index = shard.hand;
+                shard.hand = (shard.hand + 1) % shard.count;
+
+                auto& bit = shard.referenced[index];
+                if (bit.load(std::memory_order_relaxed) == 0) return index;
+                bit.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        /** Remove the slot at @position, shifting later members of its probe run back so that
+         *  every key stays reachable from its home slot. Caller must hold the write lock.
+         */
+        void eraseSlot(Shard& shard, size_t position) const
+        {
+            auto&      slots = shard.slots;
+            const auto mask  = slots.size() - 1;
+
+            for (auto next = (position + 1) & mask; slots[next] != emptySlot; next = (next + 1) & mask) {
+                const auto record = shard.arena.data() + ((slots[next] & 0xFFFFFFFF) - 1) * recordWidth;
+                const auto home   = recordHash(record) & mask;
+
+                // Move the slot back unless its home lies cyclically within (position, next].
+                const bool reachable = position <= next ? (position < home && home <= next)
+                                                        : (position < home || home <= next);
+                if (!reachable) {
+                    slots[position] = slots[next];
+                    position        = next;
+                }
+            }
+            slots[position] = emptySlot;
+        }
+
+        /** Overwrite the CLOCK victim of a full shard with a new record. Caller must hold the
+         *  write lock.
+         */
+        const uint64_t* replaceVictim(Shard& shard, const key_t& key, uint64_t hash, unsigned int cost, const packedChar* median)
+        {
+            const auto index  = clockVictim(shard);
+            const auto record = shard.arena.data() + index * recordWidth;
+
+            // Find and remove the victim's slot.
+            const auto mask = shard.slots.size() - 1;
+            auto position   = recordHash(record) & mask;
+            while ((shard.slots[position] & 0xFFFFFFFF) != index + 1) position = (position + 1) & mask;
+            eraseSlot(shard, position);
+
+            writeRecord(record, key, cost, median);
+            shard.referenced[index].store(1, std::memory_order_relaxed);
+            placeSlot(shard.slots, hash, index);
+            ++shard.evictions;
+            return record;
+        }
+
+};
+
+
+template <size_t KeyCount, size_t ShardBits>
+constexpr size_t ConcurrentMemo<KeyCount, ShardBits>::shardCount;
+
+template <size_t KeyCount, size_t ShardBits>
+constexpr size_t ConcurrentMemo<KeyCount, ShardBits>::initialSlotCount;
+
+template <size_t KeyCount, size_t ShardBits>
+constexpr uint64_t ConcurrentMemo<KeyCount, ShardBits>::emptySlot;
+
+
+/** Visit each of the @count keys of a batch in order, calling f(index, firstIndex) where
+ *  firstIndex is the index of the first key in the batch equal to key @index. So firstIndex ==
+ *  index exactly once per distinct key, and callers need only do real work for those.
+ *
+ *  Key i of the batch is made of the KeyCount elements columns[k] + i * elementSize.
+ *
+ *  Uses a private open-addressed table of batch indices, sized to the batch, so repeated keys
+ *  are detected without touching (or locking) any shared memo.
+ */
+template <size_t KeyCount, typename F>
+void forEachDistinctKey( size_t count, size_t elementSize, const packedChar* const (&columns)[KeyCount], F&& f )
+{
+    size_t slotCount = 16;
+    while (slotCount < 2 * count) slotCount *= 2;
+    const auto mask = slotCount - 1;
+
+    // (batch index + 1), or zero for an empty slot.
+    std::vector<size_t> slots( slotCount, 0 );
+
+    const auto keyWord = [&]( size_t k, size_t index, size_t word ) {
+        return columns[k][index * elementSize + word];
+    };
+
+    for (size_t index = 0; index < count; ++index) {
+        uint64_t hash = 0;
+        for (size_t k = 0; k < KeyCount; ++k) {
+            for (size_t word = 0; word < elementSize; ++word) {
+                hash = (hash ^ keyWord(k, index, word)) * UINT64_C(0x9E3779B97F4A7C15);
+            }
+        }
+
+        auto i = (hash >> 32) & mask;
+        for (;; i = (i + 1) & mask) {
+            if (slots[i] == 0) {
+                slots[i] = index + 1;
+                f(index, index);
+                break;
+            }
+
+            const auto other = slots[i] - 1;
+            bool equal = true;
+            for (size_t k = 0; k < KeyCount && equal; ++k) {
+                for (size_t word = 0; word < elementSize && equal; ++word) {
+                    equal = keyWord(k, index, word) == keyWord(k, other, word);
+                }
+            }
+            if (equal) {
+                f(index, other);
+                break;
+            }
+        }
+    }
+}
+
+
+#endif // _CONCURRENT_MEMO_H
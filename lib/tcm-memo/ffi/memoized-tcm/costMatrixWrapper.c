@@ -7,7 +7,13 @@
 
 costMatrix_p matrixInit(size_t alphSize, unsigned int *tcm)
 {
-   return (costMatrix_p) construct_CostMatrix_C(alphSize, tcm);
+   return (costMatrix_p) construct_CostMatrix_C(alphSize, tcm, 0);
+}
+
+
+costMatrix_p matrixInitBounded(size_t alphSize, unsigned int *tcm, size_t capacity)
+{
+   return (costMatrix_p) construct_CostMatrix_C(alphSize, tcm, capacity);
 }
 
 
@@ -17,6 +23,24 @@ void matrixDestroy(costMatrix_p untyped_ptr)
 }
 
 
+void matrixStats(costMatrix_p untyped_ptr, memo_stats_t *stats2D, memo_stats_t *stats3D)
+{
+    stats_CostMatrix_C(untyped_ptr, stats2D, stats3D);
+}
+
+
+int matrixLoadMemo(costMatrix_p untyped_ptr, const char *directory)
+{
+    return loadMemo_CostMatrix_C(untyped_ptr, directory);
+}
+
+
+int matrixSaveMemo(costMatrix_p untyped_ptr, const char *directory)
+{
+    return saveMemo_CostMatrix_C(untyped_ptr, directory);
+}
+
+
 unsigned int getCostAndMedian2D( dcElement_t *elem1
                                , dcElement_t *elem2
                                , dcElement_t *retElem
@@ -35,3 +59,63 @@ unsigned int getCostAndMedian3D( dcElement_t *elem1
 {
     return call_costAndMedian3D_C(tcm, elem1, elem2, elem3, retElem);
 }
+
+
+unsigned int getCostAndMedianBuffer2D( const packedChar *elem1
+                                     , const packedChar *elem2
+                                     , packedChar       *retMedian
+                                     , costMatrix_p      tcm
+                                     )
+{
+    return call_costAndMedianBuffer2D_C(tcm, elem1, elem2, retMedian);
+}
+
+
+unsigned int getCostAndMedianBuffer3D( const packedChar *elem1
+                                     , const packedChar *elem2
+                                     , const packedChar *elem3
+                                     , packedChar       *retMedian
+                                     , costMatrix_p      tcm
+                                     )
+{
+    return call_costAndMedianBuffer3D_C(tcm, elem1, elem2, elem3, retMedian);
+}
+
+
+void getCostAndMedianBatch2D( size_t            count
+                            , const packedChar *elems1
+                            , const packedChar *elems2
+                            , unsigned int     *retCosts
+                            , packedChar       *retMedians
+                            , costMatrix_p      tcm
+                            )
+{
+    call_costAndMedianBatch2D_C(tcm, count, elems1, elems2, retCosts, retMedians);
+}
+
+
+void getCostAndMedianBatch3D( size_t            count
+                            , const packedChar *elems1
+                            , const packedChar *elems2
+                            , const packedChar *elems3
+                            , unsigned int     *retCosts
+                            , packedChar       *retMedians
+                            , costMatrix_p      tcm
+                            )
+{
+    call_costAndMedianBatch3D_C(tcm, count, elems1, elems2, elems3, retCosts, retMedians);
+}
+
+
+unsigned int memoizedAlign2D( size_t            firstLength
+                            , const packedChar *first
+                            , size_t            secondLength
+                            , const packedChar *second
+                            , packedChar       *retMedians
+                            , unsigned char    *retColumns
+                            , size_t           *retLength
+                            , costMatrix_p      tcm
+                            )
+{
+    return call_alignPair2D_C(tcm, firstLength, first, secondLength, second, retMedians, retColumns, retLength);
+}
@@ -12,10 +12,41 @@
 costMatrix_p matrixInit(size_t alphSize, unsigned int *tcm);
 
 
+/** As matrixInit, but keeping at most capacity entries in each of the 2D and 3D memos, so that
+ *  memory use stays bounded over long analyses. When a memo is full, an approximately least
+ *  recently used entry (by the CLOCK policy) is evicted. A capacity of 0 means no bound.
+ */
+costMatrix_p matrixInitBounded(size_t alphSize, unsigned int *tcm, size_t capacity);
+
+
 /** C wrapper for cpp destructor */
 void matrixDestroy(costMatrix_p untyped_ptr);
 
 
+/** Copy the hit, miss and eviction counters, entry count and capacity of the 2D and 3D memos
+ *  into stats2D and stats3D. For alphabets small enough to be precomputed there is no 2D memo,
+ *  and its counters stay zero.
+ */
+void matrixStats(costMatrix_p untyped_ptr, memo_stats_t *stats2D, memo_stats_t *stats3D);
+
+
+/** Start from the cost/median memos saved by matrixSaveMemo() in directory for the same TCM, so
+ *  that a warm run starts with a hot cache. The saved files are memory mapped read-only and
+ *  shared between processes; entries computed afterwards are kept privately.
+ *
+ *  Call right after matrixInit, before the matrix is used from several threads.
+ *  Returns 1 if saved memos were found and attached, 0 otherwise (which is harmless).
+ */
+int matrixLoadMemo(costMatrix_p untyped_ptr, const char *directory);
+
+
+/** Save every cost and median computed so far, including any loaded with matrixLoadMemo(), to
+ *  directory, for later runs with the same TCM. Must not run concurrently with lookups.
+ *  Returns 1 on success, 0 otherwise.
+ */
+int matrixSaveMemo(costMatrix_p untyped_ptr, const char *directory);
+
+
 unsigned int getCostAndMedian2D( dcElement_t *elem1
                                , dcElement_t *elem2
                                , dcElement_t *retElem
@@ -31,13 +62,94 @@ unsigned int getCostAndMedian3D( dcElement_t *elem1
                                );
 
 
-/** Following three fns are C references to cpp functions found in costMatrix.cpp */
-costMatrix_p construct_CostMatrix_C(size_t alphSize, unsigned int *tcm);
+/** As getCostAndMedian2D, but operates on the bare packed element buffers: each input is
+ *  dcElemSize(alphSize) words long, and the median is written into retMedian, a buffer of the
+ *  same length owned by the caller. Neither frees nor allocates anything, so a memoized hit
+ *  costs no heap allocation at all.
+ */
+unsigned int getCostAndMedianBuffer2D( const packedChar *elem1
+                                     , const packedChar *elem2
+                                     , packedChar       *retMedian
+                                     , costMatrix_p      tcm
+                                     );
+
+
+/** As getCostAndMedianBuffer2D, for three elements. */
+unsigned int getCostAndMedianBuffer3D( const packedChar *elem1
+                                     , const packedChar *elem2
+                                     , const packedChar *elem3
+                                     , packedChar       *retMedian
+                                     , costMatrix_p      tcm
+                                     );
+
+
+/** Batched getCostAndMedianBuffer2D over @count aligned columns, so a whole character can be
+ *  sent across the FFI at once.
+ *
+ *  elems1 and elems2 each hold count elements of dcElemSize(alphSize) words apiece (one element
+ *  per word for alphabets of at most 64 symbols; elements are not bit-packed across words).
+ *  The cost of column i is written to retCosts[i] and its median to retMedians at the same
+ *  offset as the inputs, unless retMedians is NULL. Repeated columns are looked up only once.
+ */
+void getCostAndMedianBatch2D( size_t            count
+                            , const packedChar *elems1
+                            , const packedChar *elems2
+                            , unsigned int     *retCosts
+                            , packedChar       *retMedians
+                            , costMatrix_p      tcm
+                            );
+
+
+/** As getCostAndMedianBatch2D, for three elements per column. */
+void getCostAndMedianBatch3D( size_t            count
+                            , const packedChar *elems1
+                            , const packedChar *elems2
+                            , const packedChar *elems3
+                            , unsigned int     *retCosts
+                            , packedChar       *retMedians
+                            , costMatrix_p      tcm
+                            );
+
+
+/** Align two dynamic characters of any alphabet size, with the costs and medians of ambiguous
+ *  elements from the memoized matrix, and return the cost of the alignment.
+ *
+ *  first and second hold firstLength and secondLength elements, bit-packed as in dynChar_t.
+ *  The number of aligned columns is written to retLength, the kind of each to retColumns, one
+ *  byte per column (0 for an alignment, 1 for a deletion of an element of second, 2 for an
+ *  insertion of one of first), and the median of each, bit-packed, to retMedians. The caller
+ *  allocates firstLength + secondLength bytes for retColumns and
+ *  dynCharSize(alphSize, firstLength + secondLength) words for retMedians.
+ *
+ *  See pairwiseAlignment.hpp.
+ */
+unsigned int memoizedAlign2D( size_t            firstLength
+                            , const packedChar *first
+                            , size_t            secondLength
+                            , const packedChar *second
+                            , packedChar       *retMedians
+                            , unsigned char    *retColumns
+                            , size_t           *retLength
+                            , costMatrix_p      tcm
+                            );
+
+
+/** Following fns are C references to cpp functions found in costMatrix.cpp */
+costMatrix_p construct_CostMatrix_C(size_t alphSize, unsigned int *tcm, size_t capacity);
 
 
 void destruct_CostMatrix_C(costMatrix_p mytype);
 
 
+void stats_CostMatrix_C(costMatrix_p untyped_self, memo_stats_t* stats2D, memo_stats_t* stats3D);
+
+
+int loadMemo_CostMatrix_C(costMatrix_p untyped_self, const char* directory);
+
+
+int saveMemo_CostMatrix_C(costMatrix_p untyped_self, const char* directory);
+
+
 unsigned int call_costAndMedian2D_C( costMatrix_p untyped_self
                                    , dcElement_t* first
                                    , dcElement_t* second
@@ -53,4 +165,49 @@ unsigned int call_costAndMedian3D_C( costMatrix_p untyped_self
                                    );
 
 
+unsigned int call_costAndMedianBuffer2D_C( costMatrix_p      untyped_self
+                                         , const packedChar* first
+                                         , const packedChar* second
+                                         , packedChar*       retMedian
+                                         );
+
+
+unsigned int call_costAndMedianBuffer3D_C( costMatrix_p      untyped_self
+                                         , const packedChar* first
+                                         , const packedChar* second
+                                         , const packedChar* third
+                                         , packedChar*       retMedian
+                                         );
+
+
+void call_costAndMedianBatch2D_C( costMatrix_p      untyped_self
+                                , size_t            count
+                                , const packedChar* firsts
+                                , const packedChar* seconds
+                                , unsigned int*     retCosts
+                                , packedChar*       retMedians
+                                );
+
+
+void call_costAndMedianBatch3D_C( costMatrix_p      untyped_self
+                                , size_t            count
+                                , const packedChar* firsts
+                                , const packedChar* seconds
+                                , const packedChar* thirds
+                                , unsigned int*     retCosts
+                                , packedChar*       retMedians
+                                );
+
+
+unsigned int call_alignPair2D_C( costMatrix_p      untyped_self
+                               , size_t            firstLength
+                               , const packedChar* first
+                               , size_t            secondLength
+                               , const packedChar* second
+                               , packedChar*       retMedians
+                               , unsigned char*    retColumns
+                               , size_t*           retLength
+                               );
+
+
 #endif // _COST_MATRIX_WRAPPER_H
@@ -1,5 +1,7 @@
+#include <cstdio>
 #include <cstring> //for memcpy;
 #include <inttypes.h>
+#include <vector>
 
 #include "costMatrix_2d.hpp"
 #include "dynamicCharacterOperations.h"
@@ -11,6 +13,7 @@
 constexpr unsigned int CostMatrix_2d::defaultExtraGapCostMetric[25];
 constexpr unsigned int CostMatrix_2d::defaultDiscreteMetric[25];
 constexpr unsigned int CostMatrix_2d::defaultL1NormMetric[25];
+constexpr size_t       CostMatrix_2d::denseAlphabetLimit;
 
 
 costMatrix_p construct_CostMatrix_2d_C( size_t alphSize, unsigned int* tcm )
@@ -36,69 +39,54 @@ unsigned int call_getSetCost_2d_C( costMatrix_p untyped_self
 }
 
 
-void freeCostMedian_t ( costMedian_t* toFree )
+unsigned int call_getSetCostBuffer_2d_C( costMatrix_p      untyped_self
+                                       , const packedChar* first
+                                       , const packedChar* second
+                                       , packedChar*       retMedian
+                                       )
 {
-    if (std::get<1>(*toFree) == NULL)
-      return;
-
-    std::free( std::get<1>(*toFree) );
-    std::get<1>(*toFree) = NULL;
-}
-
-
-keys_2d_t* allocKeys_2d_t( size_t alphabetSize )
-{
-    auto toReturn = new keys_2d_t;
-
-    // jump through these hoops because I'm dereferencing the two elements,
-    // and I couldn't free the pointers otherwise.
-    auto firstElement  = allocateDCElement(alphabetSize);
-    auto secondElement = allocateDCElement(alphabetSize);
-
-    std::get<0>(*toReturn) = *firstElement;
-    std::get<1>(*toReturn) = *secondElement;
-
-    std::free( firstElement );
-    std::free( secondElement );
-
-    std::get<0>(*toReturn).alphSize = std::get<1>(*toReturn).alphSize
-                                    = alphabetSize;
-
-    return toReturn;
+    CostMatrix_2d* thisMtx = static_cast<CostMatrix_2d*> (untyped_self);
+    return thisMtx->getSetCostMedian(first, second, retMedian);
 }
 
 
-void freeKeys_2d_t( const keys_2d_t* toFree )
+void call_getSetCostBatch_2d_C( costMatrix_p      untyped_self
+                              , size_t            count
+                              , const packedChar* firsts
+                              , const packedChar* seconds
+                              , unsigned int*     retCosts
+                              , packedChar*       retMedians
+                              )
 {
-    freeDCElem( &std::get<0>(*toFree) );
-    freeDCElem( &std::get<1>(*toFree) );
+    CostMatrix_2d* thisMtx = static_cast<CostMatrix_2d*> (untyped_self);
+    thisMtx->getSetCostMedianBatch(count, firsts, seconds, retCosts, retMedians);
 }
 
 
 CostMatrix_2d::CostMatrix_2d()
   : alphabetSize(5)
   , elementSize(1)
+  , myMatrix(1)
 {
     initializeTCM(defaultExtraGapCostMetric);
+    initializeDenseTables();
 }
 
 
-CostMatrix_2d::CostMatrix_2d( size_t alphSize, unsigned int* inTcm )
+CostMatrix_2d::CostMatrix_2d( size_t alphSize, unsigned int* inTcm, size_t capacity )
   : alphabetSize(alphSize)
   , elementSize(dcElemSize(alphSize))
+  , myMatrix(dcElemSize(alphSize), capacity)
 {
     initializeTCM(inTcm);
+    initializeDenseTables();
 }
 
 
 CostMatrix_2d::~CostMatrix_2d()
 {
-    for ( auto iterator = myMatrix.begin(); iterator != myMatrix.end(); iterator++ ) {
-        freeCostMedian_t( &std::get<1>(*iterator) );
-        freeKeys_2d_t( &std::get<0>(*iterator) );
-    }
+    // Keys and medians live inline in the memo's arena, which frees itself.
     std::free(tcm);
-    myMatrix.clear();
 }
 
 
@@ -107,23 +95,25 @@ unsigned int CostMatrix_2d::getCostMedian( dcElement_t* first
                                          , dcElement_t* retMedian
                                          )
 {
-    const auto toLookup = std::make_tuple(*first, *second);
-    auto foundCost{0};
-
-    const auto found = myMatrix.find(toLookup);
-
-    if ( found == myMatrix.end() ) {
-        return -1;
-    } else {
-        const auto foundValue = std::get<1>(*found);
-        if (retMedian->element != NULL) std::free(retMedian->element);
-        retMedian->element = makePackedCharCopy( std::get<1>(foundValue), alphabetSize, 1 );
-        foundCost          = std::get<0>(foundValue);
+    if (isDense()) {
+        const auto index = denseIndex( first->element, second->element );
+        if (retMedian->element == NULL) retMedian->element = allocatePackedChar( alphabetSize, 1 );
+        retMedian->element[0] = denseMedian[index];
+        return denseCost[index];
     }
 
+    const memo_2d_t::key_t toLookup = { first->element, second->element };
+    unsigned int foundCost{0};
+
+    const auto found = myMatrix.lookup( toLookup, [&]( unsigned int storedCost, const packedChar* storedMedian ) {
+        if (retMedian->element == NULL) retMedian->element = allocatePackedChar( alphabetSize, 1 );
+        std::memcpy( retMedian->element, storedMedian, elementSize * sizeof(packedChar) );
+        foundCost = storedCost;
+    });
+
     // don't need to free toLookup because it only contains pointers to incoming dc_Elements which
     // will be dealloc'ed elsewhere
-    return foundCost;
+    return found ? foundCost : -1;
 }
 
 
@@ -132,129 +122,156 @@ unsigned int CostMatrix_2d::getSetCostMedian( dcElement_t* first
                                             , dcElement_t* retMedian
                                             )
 {
-    const auto toLookup = std::make_tuple(*first, *second);
-    const auto found    = myMatrix.find(toLookup);
-    auto foundCost{0};
-
-    if(DEBUG) {
-        printf("1st: {%zu}: %" PRIu64 "\n", std::get<0>(toLookup).alphSize, *std::get<0>(toLookup).element ), fflush(stdout);
-        printf("2nd: {%zu}: %" PRIu64 "\n", std::get<1>(toLookup).alphSize, *std::get<1>(toLookup).element), fflush(stdout);
-    }
-
-    if ( found == myMatrix.end() ) {
-        if(DEBUG) printf( "\ngetSetCost didn't find %" PRIu64 " %" PRIu64 ".\n"
-                        , first->element[0], second->element[0] );
+    if (retMedian->element == NULL) retMedian->element = allocatePackedChar( alphabetSize, 1 );
+    return getSetCostMedian( first->element, second->element, retMedian->element );
+}
 
-        const auto computedCostMed = computeCostMedian(toLookup);
 
-        if(DEBUG) printf( "computed cost, median: %2i %" PRIu64 "\n"
-                        , std::get<0>(*computedCostMed), std::get<1>(*computedCostMed)[0] );
+unsigned int CostMatrix_2d::getSetCostMedian( const packedChar* first
+                                            , const packedChar* second
+                                            , packedChar*       retMedian
+                                            )
+{
+    // Small alphabets: one array load, no hashing or locking.
+    if (isDense()) {
+        const auto index = denseIndex( first, second );
+        if (retMedian != NULL) retMedian[0] = denseMedian[index];
+        return denseCost[index];
+    }
 
-        foundCost = std::get<0>(*computedCostMed);
+    const memo_2d_t::key_t toLookup = { first, second };
+    unsigned int foundCost{0};
 
-        if(retMedian->element != NULL) std::free(retMedian->element);
-        retMedian->element = makePackedCharCopy( std::get<1>(*computedCostMed), alphabetSize, 1 );
+    if(DEBUG) {
+        printf("1st: {%zu}: %" PRIu64 "\n", alphabetSize, *first ), fflush(stdout);
+        printf("2nd: {%zu}: %" PRIu64 "\n", alphabetSize, *second), fflush(stdout);
+    }
 
-        setValue(first, second, computedCostMed);
-        freeCostMedian_t(computedCostMed);
-        delete computedCostMed;
-    } else {
-        // because in the next two lines, I get back a tuple<keys_2d_t, costMedian_t>
-        foundCost = std::get<0>(std::get<1>(*found));
-        if(retMedian->element != NULL) std::free(retMedian->element);
-        retMedian->element = makePackedCharCopy( std::get<1>(std::get<1>(*found)), alphabetSize, 1 );
+    // Fast path: only takes a shared lock on one shard of the table, and copies the stored
+    // median straight into the caller's buffer.
+    const auto found = myMatrix.lookup( toLookup, [&]( unsigned int storedCost, const packedChar* storedMedian ) {
+        foundCost = storedCost;
+        if (retMedian != NULL) std::memcpy( retMedian, storedMedian, elementSize * sizeof(packedChar) );
+    });
+
+    if ( !found ) {
+        if(DEBUG) printf( "\ngetSetCost didn't find %" PRIu64 " %" PRIu64 ".\n", first[0], second[0] );
+
+        // Computed outside of any lock; the result depends only on the key and the tcm.
+        // The median is computed in place when the caller wants it. Otherwise alphabets of up
+        // to 256 symbols compute the median on the stack.
+        packedChar              stackMedian[4];
+        std::vector<packedChar> heapMedian( retMedian == NULL && elementSize > 4 ? elementSize : 0 );
+        const auto computedMedian = retMedian   != NULL ? retMedian
+                                  : elementSize >    4  ? heapMedian.data()
+                                  : stackMedian;
+        const auto computedCost   = computeCostMedian(first, second, computedMedian);
+
+        if(DEBUG) printf( "computed cost, median: %2i %" PRIu64 "\n", computedCost, computedMedian[0] );
+
+        foundCost = setValue(first, second, computedCost, computedMedian, retMedian);
     }
-    // don't need to free toLookup because it only contains pointers to input dc_Elements which will be dealloc'ed elsewhere
     if(DEBUG) printf("Matrix Value Count: %lu\n", myMatrix.size());
 
     return foundCost;
 }
 
 
-costMedian_t* CostMatrix_2d::computeCostMedian(keys_2d_t keys)
+void CostMatrix_2d::getSetCostMedianBatch( size_t                  count
+                                          , const packedChar* const firsts
+                                          , const packedChar* const seconds
+                                          , unsigned int*     const retCosts
+                                          , packedChar*       const retMedians
+                                          )
 {
-    auto curCost{UINT_MAX},
-         minCost{UINT_MAX};
-
-    const auto firstKey  = &std::get<0>(keys);
-    const auto secondKey = &std::get<1>(keys);
-    const auto curMedian = allocatePackedChar(alphabetSize, 1);   // don't free, it's going into toReturn
-
-    if(DEBUG) {
-        for ( auto& thing: myMatrix ) {
-            printf( "%" PRIu64 " %" PRIu64 "\n"
-                  , std::get<0>(std::get<0>(thing)).element[0]
-                  , std::get<1>(std::get<0>(thing)).element[0]
-                  );
-            printElemBits( &std::get<0>(std::get<0>(thing)) );
-            printElemBits( &std::get<1>(std::get<0>(thing)) );
+    // Small alphabets: each column is already one array load, so don't bother deduplicating.
+    if (isDense()) {
+        for (size_t i = 0; i < count; ++i) {
+            const auto index = denseIndex( firsts + i, seconds + i );
+            retCosts[i] = denseCost[index];
+            if (retMedians != NULL) retMedians[i] = denseMedian[index];
         }
+        return;
     }
 
-    for (size_t symbolIndex = 0; symbolIndex < alphabetSize; ++symbolIndex) {
-        curCost = findDistance(symbolIndex, firstKey)
-                + findDistance(symbolIndex, secondKey);
-
-        if (DEBUG) {
-            printf("Before Minimization Logic:\n");
-            printf("  Symbol Index: %" PRIu64 " \n", symbolIndex);
-            printf("  Current Cost: %d\n", curCost);
-            printf("  Minimal Cost: %d\n", minCost);
-            printPackedChar( curMedian, 1, alphabetSize);
-            printf("\n\n");
+    const packedChar* const columns[] = { firsts, seconds };
+    forEachDistinctKey( count, elementSize, columns, [&]( size_t i, size_t firstIndex ) {
+        const auto offset      = i          * elementSize;
+        const auto firstOffset = firstIndex * elementSize;
+        if (i == firstIndex) {
+            retCosts[i] = getSetCostMedian( firsts + offset, seconds + offset
+                                          , retMedians == NULL ? NULL : retMedians + offset );
+        } else {
+            retCosts[i] = retCosts[firstIndex];
+            if (retMedians != NULL) {
+                std::memcpy( retMedians + offset, retMedians + firstOffset, elementSize * sizeof(packedChar) );
+            }
         }
+    });
+}
 
-        // now seemingly recreating logic in findDistance(). However, that was to get the cost for the
-        // ambElem on each child; now we're combining those costs get overall cost and median
-        if (curCost < minCost) {
-            /*
-            printf("\n--computeCostMedian: New low cost.\n");
-            printf("    current nucleotide: %" PRIu64 " \n", *std::get<1>(searchKey).element);
-            printf("    found cost:      %d\n", curCost);
-          */
-            minCost = curCost;
-            ClearAll(curMedian, elementSize);
-            SetBit(curMedian, symbolIndex);
-        } else if (curCost == minCost) {
-      /*
-            printf("\nSame cost, new median.\n");
-            printf("current nucleotide: %" PRIu64 " \n", *std::get<1>(searchKey).element);
-            printf("median: %" PRIu64 "\n", *curMedian);
-            printf("found cost:      %d\n", curCost);
-      */
-            SetBit(curMedian, symbolIndex);
-
-            // printf("new median: %" PRIu64 "\n", *curMedian);
-        }
 
-        if (DEBUG) {
-          printf("After Minimization Logic:\n");
-          printf("  Minimal Cost: %d\n", minCost);
-          printPackedChar( curMedian, 1, alphabetSize);
-          printf("\n\n");
-          fflush(stdout);
-        }
+bool CostMatrix_2d::loadMemo(const char* directory)
+{
+    return isDense() || myMatrix.attach( memoFilePath(directory, tcmHash(), 2), tcmHash() );
+}
+
+
+bool CostMatrix_2d::saveMemo(const char* directory) const
+{
+    return isDense() || myMatrix.save( memoFilePath(directory, tcmHash(), 2), tcmHash() );
+}
 
+
+unsigned int CostMatrix_2d::computeCostMedian( const packedChar* const first
+                                             , const packedChar* const second
+                                             ,       packedChar* const curMedian
+                                             ) const
+{
+    if(DEBUG) {
+        myMatrix.forEach( [this]( const packedChar* keyWords, unsigned int, const packedChar* ) {
+            printf( "%" PRIu64 " %" PRIu64 "\n", keyWords[0], keyWords[elementSize] );
+            printPackedChar( keyWords,               1, alphabetSize );
+            printPackedChar( keyWords + elementSize, 1, alphabetSize );
+        });
     }
 
-    const auto toReturn  = new costMedian_t;
-    std::get<0>(*toReturn) = minCost;
-    std::get<1>(*toReturn) = curMedian;
+    // Distance vectors of each input, then their sums. One buffer per thread, so a miss allocates
+    // only the first time a thread sees a larger alphabet.
+    static thread_local std::vector<unsigned int> scratch;
+    const auto width = distanceWidth();
+    if (scratch.size() < 3 * width) scratch.resize( 3 * width );
+
+    const unsigned int* const distances[] = { scratch.data(), scratch.data() + width };
+    symbolDistances( first,  scratch.data()         );
+    symbolDistances( second, scratch.data() + width );
+
+    // Same minimization as findDistance(), but over the per-symbol costs to both inputs; a symbol
+    // might therefore appear in the median that is not present in either input.
+    const auto minCost = medianKernel().sumMinMedian( distances, 2, alphabetSize, scratch.data() + 2 * width, curMedian );
+
+    if (DEBUG) {
+        printf("After Minimization Logic:\n");
+        printf("  Minimal Cost: %d\n", minCost);
+        printPackedChar( curMedian, 1, alphabetSize);
+        printf("\n\n");
+        fflush(stdout);
+    }
 
-    return toReturn;
+    return minCost;
 }
 
 
 /** Find minimum substitution cost from one nucleotide (searchKey->second) to ambElem.
  *  Does so by setting a bit in searchKey->first, then doing a lookup in the cost matrix.
  */
-unsigned int CostMatrix_2d::findDistance (const size_t fixedSymbolIndex, const dcElement_t* const ambElem)
+unsigned int CostMatrix_2d::findDistance (const size_t fixedSymbolIndex, const packedChar* const ambElem) const
 {
     auto minCost{UINT_MAX},
          curCost{UINT_MAX};
 
     for (size_t ambiguitySymbolIndex = 0; ambiguitySymbolIndex < alphabetSize; ++ambiguitySymbolIndex) {
-        if (TestBit( ambElem->element, ambiguitySymbolIndex )) {
+        if (TestBit( ambElem, ambiguitySymbolIndex )) {
             curCost = tcm[fixedSymbolIndex * alphabetSize + ambiguitySymbolIndex];
             if ( curCost < minCost ) {
                 minCost = curCost;
@@ -271,41 +288,78 @@ void CostMatrix_2d::initializeTCM(const unsigned int* const inputBuffer)
     const auto bufferSize = alphabetSize * alphabetSize * sizeof(*tcm);
     tcm = (unsigned int*) std::malloc( bufferSize );
     std::memcpy( tcm, inputBuffer, bufferSize );
+
+    const auto width = distanceWidth();
+    tcmColumns.assign( alphabetSize * width, UINT_MAX );
+    for (size_t from = 0; from < alphabetSize; ++from) {
+        for (size_t to = 0; to < alphabetSize; ++to) {
+            tcmColumns[to * width + from] = tcm[from * alphabetSize + to];
+        }
+    }
 }
 
 
-void CostMatrix_2d::setValue( const dcElement_t*  const first
-                            , const dcElement_t*  const second
-                            , const costMedian_t* const toInsert
-                            )
+void CostMatrix_2d::initializeDenseTables()
 {
-    // Making a deep copy of key & median here to help with memory management in calling fns.
-
-    // Create a deep copy of the toInsert value to insert.
-    const auto value = std::make_tuple( std::get<0>(*toInsert)
-                                      , makePackedCharCopy( std::get<1>(*toInsert), alphabetSize, 1 )
-                                      );
-
-    // Create a new 2-tuple key to insert.
-    const auto key = new keys_2d_t;
-
-    // Copy the first element into key.
-    const auto firstElem       = new dcElement_t;
-    std::get<0>(*key)          = *firstElem;
-    std::get<0>(*key).alphSize = alphabetSize;
-    std::get<0>(*key).element  = makePackedCharCopy(first->element, alphabetSize, 1);
-
-    // Copy the second element into key.
-    const auto secondElem      = new dcElement_t;
-    std::get<1>(*key)          = *secondElem;
-    std::get<1>(*key).alphSize = alphabetSize;
-    std::get<1>(*key).element  = makePackedCharCopy(second->element, alphabetSize, 1);
-
-    // Add the copied key-value pair to the matrix.
-    // This has to be a pair!
-    // Clang is okay with make_tuple() or forward_as_tuple(), but gcc doesn't like it.
-    myMatrix.insert(std::make_pair(*key, value));
-    delete key;
-    delete firstElem;
-    delete secondElem;
+    if (alphabetSize == 0 || alphabetSize > denseAlphabetLimit) return;
+
+    const size_t elementCount = static_cast<size_t>(1) << alphabetSize;
+
+    // distances[element * alphabetSize + symbol] == findDistance(symbol, element)
+    std::vector<unsigned int> distances( elementCount * alphabetSize );
+    for (packedChar element = 0; element < elementCount; ++element) {
+        for (size_t symbolIndex = 0; symbolIndex < alphabetSize; ++symbolIndex) {
+            distances[element * alphabetSize + symbolIndex] = findDistance(symbolIndex, &element);
+        }
+    }
+
+    denseCost.resize  ( elementCount * elementCount );
+    denseMedian.resize( elementCount * elementCount );
+
+    // Same minimization as computeCostMedian(), over the precomputed distances.
+    for (size_t first = 0; first < elementCount; ++first) {
+        const auto firstDistances = distances.data() + first * alphabetSize;
+
+        for (size_t second = 0; second < elementCount; ++second) {
+            const auto secondDistances = distances.data() + second * alphabetSize;
+
+            auto minCost{UINT_MAX};
+            packedChar median = CANONICAL_ZERO;
+            for (size_t symbolIndex = 0; symbolIndex < alphabetSize; ++symbolIndex) {
+                const auto curCost = firstDistances[symbolIndex] + secondDistances[symbolIndex];
+                if (curCost < minCost) {
+                    minCost = curCost;
+                    median  = CANONICAL_ONE << symbolIndex;
+                } else if (curCost == minCost) {
+                    median |= CANONICAL_ONE << symbolIndex;
+                }
+            }
+
+            denseCost  [(first << alphabetSize) | second] = minCost;
+            denseMedian[(first << alphabetSize) | second] = median;
+        }
+    }
+}
+
+
+unsigned int CostMatrix_2d::setValue( const packedChar* const first
+                                    , const packedChar* const second
+                                    , const unsigned int       cost
+                                    , const packedChar* const median
+                                    ,       packedChar*       retMedian
+                                    )
+{
+    const memo_2d_t::key_t toInsert = { first, second };
+    unsigned int storedCost{0};
+
+    // The key and median words are copied into the table only if no other thread has inserted
+    // this key in the meantime.
+    myMatrix.insertOnce( toInsert, cost, median, [&]( unsigned int stored, const packedChar* storedMedian ) {
+        storedCost = stored;
+        if (retMedian != NULL && retMedian != median) {
+            std::memcpy( retMedian, storedMedian, elementSize * sizeof(packedChar) );
+        }
+    });
+
+    return storedCost;
 }
@@ -3,6 +3,10 @@
  *  is passed in by reference, and the median value of the two input elements is placed there.
  *  The getCost function is designed to interface directly with C.
  *
+ *  For small alphabets (at most denseAlphabetLimit symbols, which includes DNA with gaps) every
+ *  ambiguous pair is precomputed on construction into a dense cost/median table indexed directly
+ *  by the element bits, and the memoized table is never used. Larger alphabets are memoized.
+ *
  *  The key lookup is an ordered pair, so when looking up transition a -> b, a must go in as
  *  first in pair
  *
@@ -20,7 +24,10 @@
 // #include <pair>
 #include <climits>
 #include <cstdlib>
-#include <unordered_map>
+#include <vector>
+
+#include "concurrentMemo.hpp"
+#include "medianKernel.hpp"
 
 #ifdef __cplusplus
 extern "C" {
@@ -28,10 +35,13 @@ extern "C" {
 
 #include "dynamicCharacterOperations.h"
 
-/** Next three fns defined here to use on C side. */
+/** Next five fns defined here to use on C side. */
 costMatrix_p construct_CostMatrix_2d_C (size_t alphSize, unsigned int* tcm);
 void destruct_CostMatrix_2d_C (costMatrix_p mytype);
 unsigned int call_getSetCost_2d_C (costMatrix_p untyped_self, dcElement_t* left, dcElement_t* right, dcElement_t* retMedian);
+unsigned int call_getSetCostBuffer_2d_C (costMatrix_p untyped_self, const packedChar* left, const packedChar* right, packedChar* retMedian);
+void call_getSetCostBatch_2d_C ( costMatrix_p untyped_self, size_t count, const packedChar* lefts, const packedChar* rights
+                               , unsigned int* retCosts, packedChar* retMedians );
     // extern "C" costMatrix_p get_CostMatrix_Ptr_2d_C(costMatrix_p untyped_self);
 
 #ifdef __cplusplus
@@ -40,109 +50,15 @@ unsigned int call_getSetCost_2d_C (costMatrix_p untyped_self, dcElement_t* left,
 
 /******************************** End of C interface fns ********************************/
 
-typedef std::tuple< dcElement_t,  dcElement_t> keys_2d_t;
-typedef std::tuple<unsigned int,  packedChar*> costMedian_t;
-typedef std::tuple<   keys_2d_t, costMedian_t> mapAccessTuple_2d_t;
-
 /** Used to send 2d and 3d cost matrices through the C interface where they're statically cast to the two matrix types. */
 typedef void* costMatrix_p;
 
 
-/** Allocate room for a costMedian_t. Assumes alphabetSize is already initialized. */
-costMedian_t* allocCostMedian_t( size_t alphabetSize );
-
-
-/** dealloc costMedian_t. */
-void freeCostMedian_t( costMedian_t* toFree );
-
-
-/** Allocate room for a keys_2d_t. */
-keys_2d_t* allocKeys_2d_t( size_t alphSize );
-
-
-/** dealloc keys_2d_t. Calls various other free fns. */
-void freeKeys_2d_t( const keys_2d_t* toFree );
-
-
-/** dealloc mapAccessTuple_2d_t. Calls various other free fns. */
-void freemapAccessTuple_2d_t( const mapAccessTuple_2d_t* toFree );
-
-
-/** Hashes two `dcElement`s, and returns an order-dependent hash value. In this case
- *  "order dependent" means that the order of the arrays within the `dcElement`s matter,
- *  and the order that the `dcElement`s are sent in also matters, as is necessary for a
- *  non-symmetric tcm.
- *
- *  First loops through each `dcElement` and combines all of the element values (recall that a
- *  `dcElement` has two fields, the second of which is the element, and is an array of `uint64_t`s)
- *  using two different seeds, then combines the two resulting values.
+/** Flat, lock-striped memo keyed by an ordered pair of packed elements. The key lookup is an
+ *  ordered pair, so the order of the two elements matters, as is necessary for a non-symmetric
+ *  tcm.
  */
-struct KeyHash_2d {
-    /** Following hash_combine code modified from here (seems to be based on Boost):
-     *  http://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
-     */
-    std::size_t hash_combine (const dcElement_t lhs, const dcElement_t rhs) const {
-        std::size_t left_seed  = 3141592653; // PI used as arbitrarily random seed
-        std::size_t right_seed = 2718281828; // E  used as arbitrarily random seed
-
-        std::hash<uint64_t> hasher;
-        auto elemArrCount = dcElemSize(lhs.alphSize);
-        //printf("alphabetSize: %d\n", lhs.alphSize);
-        //printf("elemArrCount: %d\n", elemArrCount);
-        for (size_t i = 0; i < elemArrCount; i++) {
-            left_seed  ^= hasher(lhs.element[i]) + 0x9e3779b9 + (left_seed  << 6) + (left_seed  >> 2);
-            right_seed ^= hasher(rhs.element[i]) + 0x9e3779b9 + (right_seed << 6) + (right_seed >> 2);
-        }
-        left_seed ^= hasher(right_seed) + 0x9e3779b9 + (left_seed << 6) + (left_seed >> 2);
-        //printf("%lu\n", left_seed);
-        return left_seed;
-    }
-
-    std::size_t operator()(const keys_2d_t& k) const
-    {
-        // printf("operator hash ()\n");
-        // printPackedChar(k.first.element, 1, k.first.alphSize);
-        // printPackedChar(k.second.element, 1, k.second.alphSize);
-        return hash_combine (std::get<0>(k), std::get<1>(k));
-    }
-};
-
-
-struct KeyEqual_2d {
-    // Return true if every `uint64_t` in lhs->element and rhs->element is equal, else false.
-    bool operator()(const keys_2d_t& lhs, const keys_2d_t& rhs) const
-    {
-      // Assert that all key components share the same alphSize value
-      if (   std::get<0>(lhs).alphSize  != std::get<0>(rhs).alphSize
-          || std::get<0>(lhs).alphSize  != std::get<1>(lhs).alphSize
-          || std::get<1>(lhs).alphSize != std::get<1>(rhs).alphSize) {
-          return false;
-      }
-
-      //Assert that the left key elements match the right key elements
-      auto elemArrWidth = dcElemSize(std::get<0>(lhs).alphSize);
-        // printf("operator equal ()\n");
-        // printPackedChar(std::get<0>(lhs).element, 1, std::get<0>(lhs).alphSize);
-        // printPackedChar(std::get<0>(rhs).element, 1, std::get<0>(rhs).alphSize);
-        // printPackedChar(std::get<1>(lhs).element, 1, std::get<1>(lhs).alphSize);
-        // printPackedChar(std::get<1>(rhs).element, 1, std::get<1>(rhs).alphSize);
-        for (size_t i = 0; i < elemArrWidth; i++) {
-            if (std::get<0>(lhs).element[i] != std::get<0>(rhs).element[i]) {
-                // printf("equal: false\n");
-                return false;
-            }
-            if (std::get<1>(lhs).element[i] != std::get<1>(rhs).element[i]) {
-                // printf("equal: false\n");
-                return false;
-            }
-        }
-        //printf("FAILED!!!!\n");
-        return true;
-    }
-};
-
-
-// typedef std::unordered_map<keys_2d_t, costMedian_t, KeyHash_2, KeyEqual_2>::const_iterator mapIterator;
+typedef ConcurrentMemo<2> memo_2d_t;
 
 
 class CostMatrix_2d
@@ -152,10 +68,16 @@ class CostMatrix_2d
         /** Default constructor. Settings: alphabet size: 5, indel cost: 2, substitution cost: 1 */
         CostMatrix_2d();
 
-        CostMatrix_2d(size_t alphSize, unsigned int* tcm);
+        /** @capacity bounds the number of memoized entries, evicting the least recently used
+         *  (approximately) when full; 0 for no bound. Unused by dense matrices, which memoize nothing.
+         */
+        CostMatrix_2d(size_t alphSize, unsigned int* tcm, size_t capacity = 0);
 
         ~CostMatrix_2d();
 
+        CostMatrix_2d(const CostMatrix_2d&)            = delete;
+        CostMatrix_2d& operator=(const CostMatrix_2d&) = delete;
+
         /** Find distance between an ambiguous nucleotide and an unambiguous ambElem. Return that value and the median.
          *  @param ambElem is ambiguous input.
          *  @param nucleotide is unambiguous.
@@ -167,7 +89,41 @@ class CostMatrix_2d
          *
          *  Public because gets called in CostMatrix_3d
          */
-        unsigned int findDistance(const size_t fixedElemIndex, const dcElement_t* const ambElem);
+        unsigned int findDistance(const size_t fixedElemIndex, const packedChar* const ambElem) const;
+
+        /** findDistance() for every symbol at once: sets @distances[s] to findDistance(s, ambElem),
+         *  using the vectorized medianKernel(). @distances must hold distanceWidth() words; those
+         *  past alphabetSize are padding.
+         *
+         *  Public because gets called in CostMatrix_3d
+         */
+        void symbolDistances(const packedChar* const ambElem, unsigned int* const distances) const
+        {
+            medianKernel().rowMinima( tcmColumns.data(), distanceWidth(), alphabetSize, ambElem, distances );
+        }
+
+        /** Attach the memo saved by saveMemo() in @directory for this matrix's TCM, if there is
+         *  one, as a read-only, shared base; entries computed from now on go to a private overlay.
+         *  Returns whether a saved memo was attached. Call before sharing the matrix between
+         *  threads.
+         *
+         *  Dense matrices have nothing to persist: both calls succeed without touching the disk.
+         */
+        bool loadMemo(const char* directory);
+
+        /** Save the memo, including any attached base, to @directory, under a name derived from
+         *  tcmHash(). Returns whether the file was written. Not safe while other threads query.
+         */
+        bool saveMemo(const char* directory) const;
+
+        /** Hit, miss and eviction counters of the memo. Always zero for dense matrices. */
+        memo_stats_t memoStats() const { return myMatrix.stats(); }
+
+        /** Identifies this matrix's alphabet size and TCM, and so its saved memos. */
+        uint64_t tcmHash() const { return hashTCM( alphabetSize, tcm ); }
+
+        /** Length of a distance vector for symbolDistances(). */
+        size_t distanceWidth() const { return medianKernelWidth(alphabetSize); }
 
         /** Getter only for cost. Necessary for testing, to insure that particular
          *  key pair has, in fact, already been inserted into lookup table.
@@ -175,19 +131,51 @@ class CostMatrix_2d
         unsigned int getCostMedian(dcElement_t* left, dcElement_t* right, dcElement_t* retMedian);
 
         /** Acts as both a setter and getter, mutating myMap.
+         *
+         *  Thread-safe: may be called concurrently from any number of threads on the same matrix.
          *
          *  Receives two dcElements and computes the transformation cost as well as
-         *  the median for the two. Puts the median and alphabet size into retMedian,
-         *  which must therefore by necessity be allocated elsewhere.
+         *  the median for the two. Puts the median into retMedian, which must therefore
+         *  by necessity be allocated elsewhere. The median is written into the existing
+         *  retMedian->element buffer, which is only allocated here if it is NULL.
          *
          *  This function allocates _if necessary_. So freeing inputs after a call is necessary and will not
          *  cause invalid reads from the cost matrix.
          */
         unsigned int getSetCostMedian(dcElement_t* left, dcElement_t* right, dcElement_t* retMedian);
 
+        /** As above, but on bare packed elements of elementSize words each.
+         *
+         *  The median is copied into @retMedian, a caller-owned buffer of elementSize words,
+         *  unless @retMedian is NULL. A cache hit performs no heap allocation at all.
+         */
+        unsigned int getSetCostMedian(const packedChar* left, const packedChar* right, packedChar* retMedian);
+
+        /** Batched getSetCostMedian over @count columns, e.g. a whole aligned character.
+         *
+         *  @lefts and @rights each hold @count elements of elementSize words apiece, element i at
+         *  words [i * elementSize, (i + 1) * elementSize). The cost of column i is written to
+         *  @retCosts[i] and its median to @retMedians at the same offset as its inputs, unless
+         *  @retMedians is NULL.
+         *
+         *  Repeated columns within the batch are detected up front, so each distinct column is
+         *  looked up (and, on a miss, computed) only once.
+         */
+        void getSetCostMedianBatch( size_t                  count
+                                  , const packedChar* const lefts
+                                  , const packedChar* const rights
+                                  , unsigned int*     const retCosts
+                                  , packedChar*       const retMedians
+                                  );
+
         // Required to be public as they are referenced from CostMatrix_3d.
         // These can safely be public members because they are constant.
 
+        /** Largest alphabet for which all (2^alphabetSize)^2 ambiguous pairs are precomputed into
+         *  the dense tables. At the limit the tables hold 2^16 entries, or 768 KiB.
+         */
+        static constexpr size_t denseAlphabetLimit = 8;
+
         /** Number of symbol in the alphabet for the cost matrix.
          */
         const size_t alphabetSize;
@@ -224,33 +212,75 @@ class CostMatrix_2d
             , 4, 3, 2, 1, 0
             };
 
-        std::unordered_map <keys_2d_t, costMedian_t, KeyHash_2d, KeyEqual_2d> myMatrix;
+        /** Lock-striped, insert-once memoization of every key pair queried so far. Keys and
+         *  medians are stored inline, so a lookup never chases a pointer out of the table.
+         */
+        memo_2d_t myMatrix;
 
         /** Stored unambiguous tcm, necessary to do first calls to findDistance() without having to rewrite
          *  findDistance() and computeCostMedian()
          */
         unsigned int* tcm;
 
-        /** Takes in two `dcElement_t` and a `costMedian_t` and updates myMap to store the new values,
-         *  with @{lhs, rhs} as a key, and @median as the value.
-         *
-         * Makes a deep copy of the arguments before inserting them into the map.
+        /** The transpose of @tcm, each row padded to distanceWidth(): tcmColumns[a * width + s] is
+         *  the cost of s -> a. So the rows of an element's set bits are contiguous and can be
+         *  minimized element-wise by symbolDistances().
+         */
+        std::vector<unsigned int> tcmColumns;
+
+        /** Dense tables for small alphabets, indexed by (first << alphabetSize) | second, where
+         *  first and second are the element bits. Empty when the alphabet is too large, in which
+         *  case myMatrix is used instead. Read-only after construction, so need no locking.
+         */
+        std::vector<unsigned int> denseCost;
+        std::vector<packedChar>   denseMedian;
+
+        /** Whether this matrix answers every query from denseCost and denseMedian. */
+        bool isDense() const { return !denseCost.empty(); }
+
+        /** Index into denseCost and denseMedian. Bits beyond the alphabet are ignored, as they
+         *  are by computeCostMedian().
          */
-         void setValue(const dcElement_t* const first, const dcElement_t* const second, const costMedian_t* const median);
+        size_t denseIndex(const packedChar* const first, const packedChar* const second) const
+        {
+            const packedChar mask = (CANONICAL_ONE << alphabetSize) - 1;
+            return ((first[0] & mask) << alphabetSize) | (second[0] & mask);
+        }
 
-        /** Takes in a pair of keys_2d_t (each of which is a single `dcElement`) and computes their lowest-cost median.
+        /** Fill denseCost and denseMedian with every ambiguous pair, if the alphabet is small
+         *  enough. The distance from each symbol to each possible ambiguous element is computed
+         *  once, so each pair then costs alphabetSize additions rather than findDistance() scans.
+         */
+        void initializeDenseTables();
+
+        /** Takes in two packed elements and their computed cost and median and updates myMap to
+         *  store the new values, with @{lhs, rhs} as a key, and @median as the value, unless another
+         *  thread has already stored a value for that key. Either way, copies the stored median into
+         *  @retMedian (if it is not NULL) and returns the stored cost.
+         *
+         * The key and median words are copied into the table's arena.
+         */
+         unsigned int setValue( const packedChar* const first
+                              , const packedChar* const second
+                              , const unsigned int       cost
+                              , const packedChar* const median
+                              ,       packedChar*       retMedian
+                              );
+
+        /** Takes in a pair of packed elements and computes their lowest-cost median, which is
+         *  written into @median (elementSize words, allocated by the caller). Returns the cost.
          *  Uses a Sankoff-like algorithm, where all bases are considered, and the lowest cost bases are included in the
          *  cost and median calculations. That means a base might appear in the median that is not present in either of
          *  the two elements being compared.
          */
-        costMedian_t* computeCostMedian(keys_2d_t key);
+        unsigned int computeCostMedian(const packedChar* const first, const packedChar* const second, packedChar* const median) const;
 
         /** Takes an input buffer and assigns a malloc'ed copy to @tcm.
          *  Uses the @alphabetSize of the matrix to determine the required space.
          *  Because @alphabetSize is a const member, it will always be initialized
          *  before this call, making the allocation and copy safe so long as the
          *  input buffer is equal to or greater than @alphabetSize squared in
-         *  length.
+         *  length. Also fills @tcmColumns.
          */
         void initializeTCM(const unsigned int* const inputBuffer);
 
@@ -1,5 +1,7 @@
+#include <cstdio>
 #include <cstring> //for memcpy;
 #include <inttypes.h>
+#include <vector>
 
 #include "costMatrix_2d.hpp"
 #include "costMatrix_3d.hpp"
@@ -9,9 +11,9 @@
 
 // TODO: I'll need this for the Haskell side of things: https://hackage.haskell.org/package/base-4.9.0.0/docs/Foreign-StablePtr.html
 
-costMatrix_p construct_CostMatrix_C( size_t alphSize, unsigned int* tcm )
+costMatrix_p construct_CostMatrix_C( size_t alphSize, unsigned int* tcm, size_t capacity )
 {
-    return new CostMatrix_3d( alphSize, tcm );
+    return new CostMatrix_3d( alphSize, tcm, capacity );
 }
 
 
@@ -44,60 +46,94 @@ unsigned int call_costAndMedian3D_C( costMatrix_p untyped_self
 }
 
 
-keys_3d_t* allocKeys_3d_t( size_t alphabetSize )
+unsigned int call_costAndMedianBuffer2D_C( costMatrix_p      untyped_self
+                                         , const packedChar* first
+                                         , const packedChar* second
+                                         , packedChar*       retMedian
+                                         )
 {
-    auto toReturn = new keys_3d_t;
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    return thisMtx->costAndMedian2D(first, second, retMedian);
+}
 
-    // jump through these hoops because I'm dereferencing the two elements,
-    // and I couldn't free the pointers otherwise.
-    auto firstElement  = allocateDCElement(alphabetSize);
-    auto secondElement = allocateDCElement(alphabetSize);
-    auto thirdElement  = allocateDCElement(alphabetSize);
 
-    std::get<0>(*toReturn) = *firstElement;
-    std::get<1>(*toReturn) = *secondElement;
-    std::get<2>(*toReturn) = *thirdElement;
+unsigned int call_costAndMedianBuffer3D_C( costMatrix_p      untyped_self
+                                         , const packedChar* first
+                                         , const packedChar* second
+                                         , const packedChar* third
+                                         , packedChar*       retMedian
+                                         )
+{
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    return thisMtx->costAndMedian3D(first, second, third, retMedian);
+}
 
-    std::free( firstElement );
-    std::free( secondElement );
-    std::free( thirdElement );
 
-    std::get<0>(*toReturn).alphSize = std::get<1>(*toReturn).alphSize
-                                    = std::get<2>(*toReturn).alphSize
-                                    = alphabetSize;
+void call_costAndMedianBatch2D_C( costMatrix_p      untyped_self
+                                , size_t            count
+                                , const packedChar* firsts
+                                , const packedChar* seconds
+                                , unsigned int*     retCosts
+                                , packedChar*       retMedians
+                                )
+{
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    thisMtx->costAndMedianBatch2D(count, firsts, seconds, retCosts, retMedians);
+}
+
 
-    return toReturn;
+void call_costAndMedianBatch3D_C( costMatrix_p      untyped_self
+                                , size_t            count
+                                , const packedChar* firsts
+                                , const packedChar* seconds
+                                , const packedChar* thirds
+                                , unsigned int*     retCosts
+                                , packedChar*       retMedians
+                                )
+{
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    thisMtx->costAndMedianBatch3D(count, firsts, seconds, thirds, retCosts, retMedians);
 }
 
 
-void freeKeys_3d_t( const keys_3d_t* toFree )
+void stats_CostMatrix_C( costMatrix_p untyped_self, memo_stats_t* stats2D, memo_stats_t* stats3D )
 {
-    freeDCElem( &std::get<0>(*toFree) );
-    freeDCElem( &std::get<1>(*toFree) );
-    freeDCElem( &std::get<2>(*toFree) );
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    *stats2D = thisMtx->memoStats2D();
+    *stats3D = thisMtx->memoStats3D();
 }
 
 
-CostMatrix_3d::CostMatrix_3d()
+int loadMemo_CostMatrix_C(costMatrix_p untyped_self, const char* directory)
 {
-    twoD_matrix = new CostMatrix_2d();
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    return thisMtx->loadMemo(directory);
 }
 
 
-CostMatrix_3d::CostMatrix_3d( size_t alphSize, unsigned int* inTcm )
+int saveMemo_CostMatrix_C(costMatrix_p untyped_self, const char* directory)
 {
-    twoD_matrix = new CostMatrix_2d(alphSize, inTcm);
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    return thisMtx->saveMemo(directory);
 }
 
 
+CostMatrix_3d::CostMatrix_3d()
+  : twoD_matrix(new CostMatrix_2d())
+  , myMatrix(twoD_matrix->elementSize)
+{ }
+
+
+CostMatrix_3d::CostMatrix_3d( size_t alphSize, unsigned int* inTcm, size_t capacity )
+  : twoD_matrix(new CostMatrix_2d(alphSize, inTcm, capacity))
+  , myMatrix(twoD_matrix->elementSize, capacity)
+{ }
+
+
 CostMatrix_3d::~CostMatrix_3d()
 {
-    for ( auto iterator = myMatrix.begin(); iterator != myMatrix.end(); iterator++ ) {
-        freeCostMedian_t( &std::get<1>(*iterator) );
-        freeKeys_3d_t( &std::get<0>(*iterator) );
-    }
+    // Keys and medians live inline in the memo's arena, which frees itself.
     delete twoD_matrix;
-    myMatrix.clear();
 }
 
 
@@ -110,52 +146,71 @@ unsigned int CostMatrix_3d::costAndMedian2D( dcElement_t* first
 }
 
 
+unsigned int CostMatrix_3d::costAndMedian2D( const packedChar* first
+                                           , const packedChar* second
+                                           , packedChar*       retMedian
+                                           )
+{
+  return twoD_matrix->getSetCostMedian(first, second, retMedian);
+}
+
+
 unsigned int CostMatrix_3d::costAndMedian3D( dcElement_t* first
                                            , dcElement_t* second
                                            , dcElement_t* third
                                            , dcElement_t* retMedian
                                            )
 {
-    const auto toLookup = std::make_tuple(*first, *second, *third);
-    const auto found    = myMatrix.find(toLookup);
-    auto foundCost{0};
-
-    if(DEBUG) {
-        printf("1st: {%zu}: %" PRIu64 "\n", std::get<0>(toLookup).alphSize, *std::get<0>(toLookup).element), fflush(stdout);
-        printf("2nd: {%zu}: %" PRIu64 "\n", std::get<1>(toLookup).alphSize, *std::get<1>(toLookup).element), fflush(stdout);
-        printf("3rd: {%zu}: %" PRIu64 "\n", std::get<2>(toLookup).alphSize, *std::get<2>(toLookup).element), fflush(stdout);
+    // If retMedian is NULL, we do not return the median result.
+    if (retMedian == NULL) {
+        return costAndMedian3D( first->element, second->element, third->element, NULL );
     }
+    if (retMedian->element == NULL) retMedian->element = allocatePackedChar( twoD_matrix->alphabetSize, 1 );
+    return costAndMedian3D( first->element, second->element, third->element, retMedian->element );
+}
 
-    if ( found == myMatrix.end() ) {
-        if(DEBUG) printf( "\nCostAndMedian didn't find %" PRIu64 " %" PRIu64 " %" PRIu64 ".\n"
-                         , first->element[0], second->element[0], third->element[0] );
 
-        const auto computedCostMed = computeCostMedian(toLookup);
+unsigned int CostMatrix_3d::costAndMedian3D( const packedChar* first
+                                           , const packedChar* second
+                                           , const packedChar* third
+                                           , packedChar*       retMedian
+                                           )
+{
+    const memo_3d_t::key_t toLookup = { first, second, third };
+    const auto symbolCount = twoD_matrix->alphabetSize; // For efficiency, dereference less.
+    const auto elementSize = twoD_matrix->elementSize;
+    unsigned int foundCost{0};
+
+    if(DEBUG) {
+        printf("1st: {%zu}: %" PRIu64 "\n", symbolCount, *first ), fflush(stdout);
+        printf("2nd: {%zu}: %" PRIu64 "\n", symbolCount, *second), fflush(stdout);
+        printf("3rd: {%zu}: %" PRIu64 "\n", symbolCount, *third ), fflush(stdout);
+    }
 
-        if(DEBUG) printf( "computed cost, median: %2i %" PRIu64 "\n"
-                        , std::get<0>(*computedCostMed), std::get<1>(*computedCostMed)[0] );
+    // Fast path: only takes a shared lock on one shard of the table, and copies the stored
+    // median straight into the caller's buffer.
+    const auto found = myMatrix.lookup( toLookup, [&]( unsigned int storedCost, const packedChar* storedMedian ) {
+        foundCost = storedCost;
+        if (retMedian != NULL) std::memcpy( retMedian, storedMedian, elementSize * sizeof(packedChar) );
+    });
 
-        foundCost = std::get<0>(*computedCostMed);
+    if ( !found ) {
+        if(DEBUG) printf( "\nCostAndMedian didn't find %" PRIu64 " %" PRIu64 " %" PRIu64 ".\n"
+                         , first[0], second[0], third[0] );
 
-        // If retMedian is NULL, we do not return the median result.
-        if (retMedian != NULL) {
-            if (retMedian->element != NULL) std::free(retMedian->element);
-            retMedian->element = makePackedCharCopy( std::get<1>(*computedCostMed), twoD_matrix->alphabetSize, 1 );
-        }
+        // Computed outside of any lock; the result depends only on the key and the tcm.
+        // The median is computed in place when the caller wants it. Otherwise alphabets of up
+        // to 256 symbols compute the median on the stack.
+        packedChar              stackMedian[4];
+        std::vector<packedChar> heapMedian( retMedian == NULL && elementSize > 4 ? elementSize : 0 );
+        const auto computedMedian = retMedian   != NULL ? retMedian
+                                  : elementSize >    4  ? heapMedian.data()
+                                  : stackMedian;
+        const auto computedCost   = computeCostMedian( first, second, third, computedMedian );
 
-        setValue(first, second, third, computedCostMed);
-        freeCostMedian_t(computedCostMed);
-        delete computedCostMed;
-    }
-    else {
-        // I get back a tuple<keys_3d_t, costMedian_t>
-        foundCost = std::get<0>(std::get<1>(*found));
+        if(DEBUG) printf( "computed cost, median: %2i %" PRIu64 "\n", computedCost, computedMedian[0] );
 
-        // If retMedian is NULL, we do not return the median result.
-        if (retMedian != NULL) {
-            if (retMedian->element != NULL) std::free(retMedian->element);
-            retMedian->element = makePackedCharCopy( std::get<1>(std::get<1>(*found)), twoD_matrix->alphabetSize, 1 );
-        }
+        foundCost = setValue(first, second, third, computedCost, computedMedian, retMedian);
     }
 
     if(DEBUG) printf("Matrix Value Count: %lu\n", myMatrix.size());
@@ -164,95 +219,114 @@ unsigned int CostMatrix_3d::costAndMedian3D( dcElement_t* first
 }
 
 
-costMedian_t* CostMatrix_3d::computeCostMedian(keys_3d_t keys)
+bool CostMatrix_3d::loadMemo(const char* directory)
 {
-    auto curCost{UINT_MAX},
-         minCost{UINT_MAX};
+    const auto tag    = twoD_matrix->tcmHash();
+    const auto loaded = twoD_matrix->loadMemo(directory);
+    return myMatrix.attach( memoFilePath(directory, tag, 3), tag ) && loaded;
+}
 
-    const auto symbolCount = twoD_matrix->alphabetSize; // For efficiency, dereference less.
-    const auto firstKey    = &std::get<0>(keys);
-    const auto secondKey   = &std::get<1>(keys);
-    const auto thirdKey    = &std::get<2>(keys);
-    const auto curMedian   = allocatePackedChar(symbolCount, 1);   // don't free, it's going into toReturn
 
-    if(DEBUG) {
-        for ( auto& thing: myMatrix ) {
-            printf( "%" PRIu64 " %" PRIu64 "\n"
-                  , std::get<0>(std::get<0>(thing)).element[0]
-                  , std::get<1>(std::get<0>(thing)).element[0]
-                  );
-            printElemBits( &std::get<0>(std::get<0>(thing)) );
-            printElemBits( &std::get<1>(std::get<0>(thing)) );
-        }
-    }
+bool CostMatrix_3d::saveMemo(const char* directory) const
+{
+    const auto tag   = twoD_matrix->tcmHash();
+    const auto saved = twoD_matrix->saveMemo(directory);
+    return myMatrix.save( memoFilePath(directory, tag, 3), tag ) && saved;
+}
 
-    for (size_t symbolIndex = 0; symbolIndex < symbolCount; ++symbolIndex) {
 
-        curCost = twoD_matrix->findDistance(symbolIndex, firstKey)
-                + twoD_matrix->findDistance(symbolIndex, secondKey)
-                + twoD_matrix->findDistance(symbolIndex, thirdKey);
+void CostMatrix_3d::costAndMedianBatch2D( size_t                  count
+                                         , const packedChar* const firsts
+                                         , const packedChar* const seconds
+                                         , unsigned int*     const retCosts
+                                         , packedChar*       const retMedians
+                                         )
+{
+    twoD_matrix->getSetCostMedianBatch(count, firsts, seconds, retCosts, retMedians);
+}
 
-        if (curCost < minCost) {
-            minCost = curCost;
-            ClearAll(curMedian, twoD_matrix->elementSize);
-            SetBit(curMedian, symbolIndex);
-        }
-        else if (curCost == minCost) {
-            SetBit(curMedian, symbolIndex);
+
+void CostMatrix_3d::costAndMedianBatch3D( size_t                  count
+                                         , const packedChar* const firsts
+                                         , const packedChar* const seconds
+                                         , const packedChar* const thirds
+                                         , unsigned int*     const retCosts
+                                         , packedChar*       const retMedians
+                                         )
+{
+    const auto elementSize = twoD_matrix->elementSize;
+    const packedChar* const columns[] = { firsts, seconds, thirds };
+
+    forEachDistinctKey( count, elementSize, columns, [&]( size_t i, size_t firstIndex ) {
+        const auto offset      = i          * elementSize;
+        const auto firstOffset = firstIndex * elementSize;
+        if (i == firstIndex) {
+            retCosts[i] = costAndMedian3D( firsts + offset, seconds + offset, thirds + offset
+                                         , retMedians == NULL ? NULL : retMedians + offset );
+        } else {
+            retCosts[i] = retCosts[firstIndex];
+            if (retMedians != NULL) {
+                std::memcpy( retMedians + offset, retMedians + firstOffset, elementSize * sizeof(packedChar) );
+            }
         }
+    });
+}
+
+
+unsigned int CostMatrix_3d::computeCostMedian( const packedChar* const first
+                                             , const packedChar* const second
+                                             , const packedChar* const third
+                                             ,       packedChar* const curMedian
+                                             ) const
+{
+    const auto symbolCount = twoD_matrix->alphabetSize; // For efficiency, dereference less.
+    const auto elementSize = twoD_matrix->elementSize;
+
+    if(DEBUG) {
+        myMatrix.forEach( [elementSize, symbolCount]( const packedChar* keyWords, unsigned int, const packedChar* ) {
+            printf( "%" PRIu64 " %" PRIu64 "\n", keyWords[0], keyWords[elementSize] );
+            printPackedChar( keyWords,               1, symbolCount );
+            printPackedChar( keyWords + elementSize, 1, symbolCount );
+        });
     }
 
-    const auto toReturn = new costMedian_t;
-    std::get<0>(*toReturn) = minCost;
-    std::get<1>(*toReturn) = curMedian;
+    // One buffer per thread for the three distance vectors and their sums.
+    static thread_local std::vector<unsigned int> scratch;
+    const auto width = twoD_matrix->distanceWidth();
+    if (scratch.size() < 4 * width) scratch.resize( 4 * width );
 
-    return toReturn;
+    const unsigned int* const distances[] = { scratch.data(), scratch.data() + width, scratch.data() + 2 * width };
+    twoD_matrix->symbolDistances( first,  scratch.data()             );
+    twoD_matrix->symbolDistances( second, scratch.data() + width     );
+    twoD_matrix->symbolDistances( third,  scratch.data() + 2 * width );
+
+    return medianKernel().sumMinMedian( distances, 3, symbolCount, scratch.data() + 3 * width, curMedian );
 }
 
 
-void CostMatrix_3d::setValue( const dcElement_t*  const first
-                            , const dcElement_t*  const second
-                            , const dcElement_t*  const third
-                            , const costMedian_t* const toInsert
-                            )
+unsigned int CostMatrix_3d::setValue( const packedChar* const first
+                                    , const packedChar* const second
+                                    , const packedChar* const third
+                                    , const unsigned int       cost
+                                    , const packedChar* const median
+                                    ,       packedChar*       retMedian
+                                    )
 {
     // For efficiency, dereference less.
-    const auto symbolCount = twoD_matrix->alphabetSize;
-
-    // Making a deep copy of key & median here to help with memory management in calling fns.
-
-    // Create a deep copy of the toInsert value to insert.
-    const auto value = std::make_tuple( std::get<0>(*toInsert)
-                                      , makePackedCharCopy( std::get<1>(*toInsert), symbolCount, 1 )
-                                      );
-
-    // Create a new 3-tuple key to insert.
-    const auto key = new keys_3d_t;
-
-    // Copy the first element into key.
-    const auto firstElem       = new dcElement_t;
-    std::get<0>(*key)          = *firstElem;
-    std::get<0>(*key).alphSize = twoD_matrix->alphabetSize;
-    std::get<0>(*key).element  = makePackedCharCopy(first->element, symbolCount, 1);
-
-    // Copy the second element into key.
-    const auto secondElem      = new dcElement_t;
-    std::get<1>(*key)          = *secondElem;
-    std::get<1>(*key).alphSize = twoD_matrix->alphabetSize;
-    std::get<1>(*key).element  = makePackedCharCopy(second->element, symbolCount, 1);
-
-    // Copy the third element into key.
-    const auto thirdElem       = new dcElement_t;
-    std::get<2>(*key)          = *thirdElem;
-    std::get<2>(*key).alphSize = twoD_matrix->alphabetSize;
-    std::get<2>(*key).element  = makePackedCharCopy(third->element, symbolCount, 1);
-
-    // Add the copied key-value pair to the matrix.
-    // This has to be a pair!
-    // Clang is okay with make_tuple() or forward_as_tuple(), but gcc doesn't like it.
-    myMatrix.insert(std::make_pair(*key, value));
-    delete key;
-    delete firstElem;
-    delete secondElem;
-    delete thirdElem;
+    const auto elementSize = twoD_matrix->elementSize;
+    const memo_3d_t::key_t toInsert = { first, second, third };
+    unsigned int storedCost{0};
+
+    // The key and median words are copied into the table only if no other thread has inserted
+    // this key in the meantime.
+    myMatrix.insertOnce( toInsert, cost, median, [&]( unsigned int stored, const packedChar* storedMedian ) {
+        storedCost = stored;
+
+        // If retMedian is NULL, we do not return the median result.
+        if (retMedian != NULL && retMedian != median) {
+            std::memcpy( retMedian, storedMedian, elementSize * sizeof(packedChar) );
+        }
+    });
+
+    return storedCost;
 }
@@ -20,18 +20,20 @@
 // #include <pair>
 #include <climits>
 #include <cstdlib>
-#include <unordered_map>
+
+#include "concurrentMemo.hpp"
 #include "costMatrix_2d.hpp"
 
 
-/********************* Next three fns defined here to use on C side. *********************/
+/******************** Next eleven fns defined here to use on C side. ********************/
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #include "dynamicCharacterOperations.h"
 
-costMatrix_p construct_CostMatrix_C (size_t alphSize, unsigned int* tcm);
+/** @capacity bounds the number of entries in each of the 2D and 3D memos; 0 for no bound. */
+costMatrix_p construct_CostMatrix_C (size_t alphSize, unsigned int* tcm, size_t capacity);
 
 void destruct_CostMatrix_C (costMatrix_p mytype);
 
@@ -48,6 +50,50 @@ unsigned int call_costAndMedian3D_C ( costMatrix_p untyped_self
                                     , dcElement_t* retMedian
                                     );
 
+/** As call_costAndMedian2D_C and call_costAndMedian3D_C, but on bare packed elements, writing
+ *  the median into a caller-owned buffer of dcElemSize(alphSize) words. Never allocates on a hit.
+ */
+unsigned int call_costAndMedianBuffer2D_C ( costMatrix_p      untyped_self
+                                          , const packedChar* first
+                                          , const packedChar* second
+                                          , packedChar*       retMedian
+                                          );
+
+unsigned int call_costAndMedianBuffer3D_C ( costMatrix_p      untyped_self
+                                          , const packedChar* first
+                                          , const packedChar* second
+                                          , const packedChar* third
+                                          , packedChar*       retMedian
+                                          );
+
+/** Batched versions of the above, over whole columns; see CostMatrix_3d::costAndMedianBatch3D. */
+void call_costAndMedianBatch2D_C ( costMatrix_p      untyped_self
+                                 , size_t            count
+                                 , const packedChar* firsts
+                                 , const packedChar* seconds
+                                 , unsigned int*     retCosts
+                                 , packedChar*       retMedians
+                                 );
+
+void call_costAndMedianBatch3D_C ( costMatrix_p      untyped_self
+                                 , size_t            count
+                                 , const packedChar* firsts
+                                 , const packedChar* seconds
+                                 , const packedChar* thirds
+                                 , unsigned int*     retCosts
+                                 , packedChar*       retMedians
+                                 );
+
+/** Attach, or save, the memos persisted in @directory; see CostMatrix_3d::loadMemo. Return 1 on
+ *  success, 0 otherwise.
+ */
+int loadMemo_CostMatrix_C (costMatrix_p untyped_self, const char* directory);
+
+int saveMemo_CostMatrix_C (costMatrix_p untyped_self, const char* directory);
+
+/** Copy the usage counters of the 2D and 3D memos into @stats2D and @stats3D. */
+void stats_CostMatrix_C (costMatrix_p untyped_self, memo_stats_t* stats2D, memo_stats_t* stats3D);
+
 // extern "C" costMatrix_p get_CostMatrix_2dPtr_C(costMatrix_p untyped_self);
 
 #ifdef __cplusplus
@@ -56,120 +102,12 @@ unsigned int call_costAndMedian3D_C ( costMatrix_p untyped_self
 
 /******************************** End of C interface fns ********************************/
 
-typedef std::tuple<dcElement_t, dcElement_t, dcElement_t> keys_3d_t;
-typedef std::tuple<keys_3d_t,   costMedian_t>             mapAccessTuple_3d_t;
-// The stored cost & median type is defined in 2d matrix.
-
-
-/** Allocate room for a keys_3d_t. */
-keys_3d_t* allocKeys_3d_t (size_t alphSize);
-
-
-/** dealloc keys_3d_t. Calls various other free fns. */
-void freekeys_3d_t (const keys_3d_t* toFree);
-
-
-/***************************************************************************************** *
- * Functions for 3d matrix lookup. Note that these functions rely on 2d lookup operations. *
- *******************************************************************************************/
-
-
-/** Hashes three `dcElement`s, and returns an order-dependent hash value. In this case
- *  "order dependent" means that the order of the arrays within the `dcElement`s matters,
- *  and the order that the `dcElement`s are sent in also matters, as is necessary for a
- *  non-symmetric tcm.
+/** Flat, lock-striped memo keyed by an ordered triple of packed elements. The order of the three
+ *  elements matters, as is necessary for a non-symmetric tcm.
  *
- *  First loops through each `dcElement` and combines all of the element values (recall that a
- *  `dcElement` has two fields, the second of which is the element, and is an array of `uint64_t`s)
- *  using two different seeds, then combines the two resulting values.
+ *  The stored cost & median layout is shared with the 2d matrix; see concurrentMemo.hpp.
  */
-struct KeyHash_3d
-{
-    /** Following hash_combine code modified from here (seems to be based on Boost):
-     *  http://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
-     */
-    std::size_t hash_combine ( const dcElement_t first
-                             , const dcElement_t second
-                             , const dcElement_t third ) const
-    {
-        std::size_t first_seed  = 3141592653; // π used as arbitrary random seed
-        std::size_t second_seed = 2718281828; // e used as arbitrary random seed
-        std::size_t third_seed  = 6022140857; // Avogadro's # used as arbitrary random seed
-
-        std::hash<uint64_t> hasher;
-        size_t elemArrCount = dcElemSize(first.alphSize);
-        //printf("alphabetSize: %d\n", first.alphSize);
-        //printf("elemArrCount: %d\n", elemArrCount);
-        for (size_t i = 0; i < elemArrCount; i++) {
-            first_seed  ^=   hasher(first.element[i])
-                           + 0x9e3779b9
-                           + (first_seed  << 6)
-                           + (first_seed  >> 2);
-
-            second_seed ^=   hasher(second.element[i])
-                           + 0x9e3779b9
-                           + (second_seed << 6)
-                           + (second_seed >> 2);
-
-            third_seed  ^=   hasher(third.element[i])
-                           + 0x9e3779b9
-                           + (third_seed << 6)
-                           + (third_seed >> 2);
-        }
-        third_seed ^= hasher(first_seed) + hasher(second_seed) + 0x9e3779b9 + (third_seed << 6) + (third_seed >> 2);
-        //printf("%lu\n", third_seed);
-        return third_seed;
-    }
-
-    std::size_t operator()(const keys_3d_t& k) const
-    {
-        // printf("operator hash ()\n");
-        // printPackedChar(k.first.element, 1, k.first.alphSize);
-        // printPackedChar(k.second.element, 1, k.second.alphSize);
-        return hash_combine( std::get<0>(k), std::get<1>(k), std::get<2>(k) );
-    }
-};
-
-
-struct KeyEqual_3d
-{
-    // Return true if every `uint64_t` in key1->element and key2->element and key3->element
-    // is equal, else false.
-    bool operator()(const keys_3d_t& key1, const keys_3d_t& key2) const
-    {
-        // Assert that all key components share the same alphSize value.
-        // There are two keys, with three values in each. They all need to have the same size alphabet.
-        if (   std::get<0>(key1).alphSize != std::get<1>(key1).alphSize
-            || std::get<1>(key1).alphSize != std::get<2>(key1).alphSize     // key1 is consistent
-            || std::get<0>(key2).alphSize != std::get<1>(key2).alphSize
-            || std::get<1>(key2).alphSize != std::get<2>(key2).alphSize     // key2 is consistent
-
-            || std::get<0>(key1).alphSize != std::get<0>(key2).alphSize ) { // the keys match each other
-          return false;
-        }
-
-        //Assert that the left key elements match the right key elements
-        size_t elemArrWidth = dcElemSize(std::get<0>(key1).alphSize);
-        // printf("operator equal ()\n");
-        // printPackedChar(key1.first.element, 1, key1.first.alphSize);
-        // printPackedChar(key2.first.element, 1, key2.first.alphSize);
-        // printPackedChar(key1.second.element, 1, key1.second.alphSize);
-        // printPackedChar(key2.second.element, 1, key2.second.alphSize);
-        for (size_t i = 0; i < elemArrWidth; i++) {
-            if (   std::get<0>(key1).element[i] != std::get<0>(key2).element[i]
-                || std::get<1>(key1).element[i] != std::get<1>(key2).element[i]
-                || std::get<2>(key1).element[i] != std::get<2>(key2).element[i] ) {
-                // printf("equal: false\n");
-                return false;
-            }
-        }
-        //printf("FAILED!!!!\n");
-        return true;
-    }
-};
-
-
-typedef std::unordered_map<keys_3d_t, costMedian_t, KeyHash_3d, KeyEqual_3d>::const_iterator mapIterator_3d;
+typedef ConcurrentMemo<3> memo_3d_t;
 
 
 class CostMatrix_3d
@@ -177,10 +115,16 @@ class CostMatrix_3d
     public:
         CostMatrix_3d();
 
-        CostMatrix_3d( size_t alphSize, unsigned int* tcm );
+        /** @capacity bounds the number of entries in each of the 2D and 3D memos, evicting the
+         *  least recently used (approximately) when full; 0 for no bound.
+         */
+        CostMatrix_3d( size_t alphSize, unsigned int* tcm, size_t capacity = 0 );
 
         ~CostMatrix_3d();
 
+        CostMatrix_3d(const CostMatrix_3d&)            = delete;
+        CostMatrix_3d& operator=(const CostMatrix_3d&) = delete;
+
 
         /** Returns the cost to transition between the *two* input elements and
          *  sets retMedian to be the median value between the *two* input
@@ -202,6 +146,14 @@ class CostMatrix_3d
                                     , dcElement_t* retMedian
                                       );
 
+        /** As above, but on bare packed elements of elementSize words each. The median is
+         *  copied into @retMedian, a caller-owned buffer, unless it is NULL.
+         */
+        unsigned int costAndMedian2D( const packedChar* first
+                                    , const packedChar* second
+                                    , packedChar*       retMedian
+                                    );
+
 
         /** Returns the cost to transition between the *three* input elements and
          *  sets retMedian to be the median value between the *two* input
@@ -216,6 +168,9 @@ class CostMatrix_3d
          *  This function performs deep copies of the inputs _when necessary_.
          *  Freeing inputs after a call will _never_ cause invalid reads from
          *  the cost matrix.
+         *
+         *  Both this function and costAndMedian2D are thread-safe: they may be
+         *  called concurrently from any number of threads on the same matrix.
          */
         unsigned int costAndMedian3D( dcElement_t* first
                                     , dcElement_t* second
@@ -223,29 +178,95 @@ class CostMatrix_3d
                                     , dcElement_t* retMedian
                                     );
 
-    private:
+        /** As above, but on bare packed elements of elementSize words each. The median is
+         *  copied into @retMedian, a caller-owned buffer, unless it is NULL. A cache hit
+         *  performs no heap allocation at all.
+         */
+        unsigned int costAndMedian3D( const packedChar* first
+                                    , const packedChar* second
+                                    , const packedChar* third
+                                    , packedChar*       retMedian
+                                    );
+
+        /** The 2D matrix that costAndMedian2D() queries. */
+        CostMatrix_2d& costMatrix2D() const { return *twoD_matrix; }
+
+        /** Hit, miss and eviction counters of the 2D and 3D memos. */
+        memo_stats_t memoStats2D() const { return twoD_matrix->memoStats(); }
+        memo_stats_t memoStats3D() const { return myMatrix.stats(); }
+
+        /** Attach the 2D and 3D memos saved by saveMemo() in @directory for this TCM, as read-only
+         *  bases shared by every process mapping them; new entries go to each table's private
+         *  overlay. Returns true only if both were attached. Call before sharing the matrix
+         *  between threads.
+         */
+        bool loadMemo(const char* directory);
+
+        /** Save the 2D and 3D memos to @directory, replacing any saved before. Returns true only if
+         *  both were written. Not safe while other threads query.
+         */
+        bool saveMemo(const char* directory) const;
 
-        std::unordered_map <keys_3d_t, costMedian_t, KeyHash_3d, KeyEqual_3d> myMatrix;
+        /** Batched costAndMedian2D over @count columns; see CostMatrix_2d::getSetCostMedianBatch. */
+        void costAndMedianBatch2D( size_t                  count
+                                 , const packedChar* const firsts
+                                 , const packedChar* const seconds
+                                 , unsigned int*     const retCosts
+                                 , packedChar*       const retMedians
+                                 );
+
+        /** Batched costAndMedian3D over @count columns, e.g. a whole aligned character.
+         *
+         *  @firsts, @seconds and @thirds each hold @count elements of elementSize words apiece,
+         *  element i at words [i * elementSize, (i + 1) * elementSize). The cost of column i is
+         *  written to @retCosts[i] and its median to @retMedians at the same offset as its inputs,
+         *  unless @retMedians is NULL.
+         *
+         *  Repeated columns within the batch are detected up front, so each distinct column is
+         *  looked up (and, on a miss, computed) only once.
+         */
+        void costAndMedianBatch3D( size_t                  count
+                                 , const packedChar* const firsts
+                                 , const packedChar* const seconds
+                                 , const packedChar* const thirds
+                                 , unsigned int*     const retCosts
+                                 , packedChar*       const retMedians
+                                 );
+
+    private:
 
         CostMatrix_2d* twoD_matrix;
 
-        /** Takes in a `keys_3d_t` and a `costMedian_t` and updates myMap to store the new values,
-         *  with @key as a key, and @median as the value.
+        /** Lock-striped, insert-once memoization of every key triple queried so far. Keys and
+         *  medians are stored inline, so a lookup never chases a pointer out of the table.
+         */
+        memo_3d_t myMatrix;
+
+        /** Takes in three packed elements and their computed cost and median and updates myMap to
+         *  store the new values, with the three elements as a key, and @median as the value, unless
+         *  another thread has already stored a value for that key. Either way, copies the stored
+         *  median into @retMedian (if it is not NULL) and returns the stored cost.
          */
-        void setValue( const dcElement_t* const first
-                     , const dcElement_t* const second
-                     , const dcElement_t* const third
-                     , const costMedian_t* const median
-                     );
+        unsigned int setValue( const packedChar* const first
+                             , const packedChar* const second
+                             , const packedChar* const third
+                             , const unsigned int       cost
+                             , const packedChar* const median
+                             ,       packedChar*       retMedian
+                             );
 
 
-        /** Takes in a pair of keys_3d_t (each of which is a single `dcElement`) and computes their
-         *  lowest-cost median.
+        /** Takes in a triple of packed elements and computes their lowest-cost median, which is
+         *  written into @median (elementSize words, allocated by the caller). Returns the cost.
          *  Uses a Sankoff-like algorithm, where all bases are considered, and the lowest cost
          *  bases are included in the cost and median calculations. That means a base might appear
          *  in the median that is not present in either of the two elements being compared.
          */
-        costMedian_t* computeCostMedian(keys_3d_t keys);
+        unsigned int computeCostMedian( const packedChar* const first
+                                      , const packedChar* const second
+                                      , const packedChar* const third
+                                      ,       packedChar* const median
+                                      ) const;
 
 };
 
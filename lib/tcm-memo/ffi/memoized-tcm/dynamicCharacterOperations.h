@@ -117,6 +117,18 @@ typedef struct costMtx_t {
 } costMtx_t;
 
 
+/** Usage counters of one memoized cost matrix table (2D or 3D). Hits include hits in a loaded,
+ *  memory-mapped memo. capacity is 0 for an unbounded table.
+ */
+typedef struct memo_stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t capacity;
+} memo_stats_t;
+
+
 /**
  *  The following three functions taken from
  *  http://www.mathcs.emory.edu/~cheung/Courses/255/Syllabus/1-C-intro/bit-array.html
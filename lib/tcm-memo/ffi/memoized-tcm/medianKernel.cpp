@@ -0,0 +1,253 @@
+#include <climits>
+#include <cstdint>
+
+#include "medianKernel.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MEDIAN_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+
+/** Iterates the set bits a < alphabetSize of an element, in increasing order.
+ *
+ *  A plain loop rather than a callback, as lambdas do not inherit the target attribute of the SIMD
+ *  kernels below and so could not inline their intrinsics.
+ */
+struct set_bits_t {
+    const packedChar* ambElem;
+    size_t            alphabetSize;
+    size_t            elementSize;
+    size_t            word;
+    packedChar        bits;
+
+    set_bits_t(size_t alphSize, const packedChar* const elem)
+      : ambElem(elem), alphabetSize(alphSize), elementSize(dcElemSize(alphSize)), word(0), bits(elem[0])
+    {}
+
+    /** Store the next set bit in @symbol, or return false if there are no more. */
+    inline bool next(size_t& symbol)
+    {
+        while (bits == 0) {
+            if (++word >= elementSize) return false;
+            bits = ambElem[word];
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        const size_t bit = __builtin_ctzll(bits);
+#else
+        size_t bit = 0;
+        while (((bits >> bit) & 1) == 0) ++bit;
+#endif
+        bits  &= bits - 1;
+        symbol = word * 64 + bit;
+        return symbol < alphabetSize;
+    }
+};
+
+
+/************************************ Portable kernels ************************************/
+
+static void rowMinimaScalar( const unsigned int* const columns
+                           , const size_t              width
+                           , const size_t              alphabetSize
+                           , const packedChar* const   ambElem
+                           ,       unsigned int* const distances
+                           )
+{
+    for (size_t s = 0; s < width; ++s) distances[s] = UINT_MAX;
+
+    set_bits_t bits( alphabetSize, ambElem );
+    for (size_t symbol; bits.next(symbol); ) {
+        const auto row = columns + symbol * width;
+        for (size_t s = 0; s < width; ++s) {
+            if (row[s] < distances[s]) distances[s] = row[s];
+        }
+    }
+}
+
+
+static unsigned int sumMinMedianScalar( const unsigned int* const* const rows
+                                      , const size_t                     rowCount
+                                      , const size_t                     alphabetSize
+                                      ,       unsigned int* const        sums
+                                      ,       packedChar* const          median
+                                      )
+{
+    ClearAll(median, dcElemSize(alphabetSize));
+
+    auto minCost{UINT_MAX};
+    for (size_t s = 0; s < alphabetSize; ++s) {
+        unsigned int sum = rows[0][s];
+        for (size_t k = 1; k < rowCount; ++k) sum += rows[k][s];
+        sums[s] = sum;
+        if (sum < minCost) minCost = sum;
+    }
+    for (size_t s = 0; s < alphabetSize; ++s) {
+        if (sums[s] == minCost) SetBit(median, s);
+    }
+    return minCost;
+}
+
+
+#ifdef MEDIAN_KERNEL_X86
+
+/** Movemask bits of the first @remaining lanes of a block. The padding lanes past the alphabet
+ *  hold UINT_MAX, so they would otherwise join a UINT_MAX median.
+ */
+static inline packedChar laneMask(size_t remaining)
+{
+    return remaining >= 8 ? 0xFF : (CANONICAL_ONE << remaining) - 1;
+}
+
+
+/************************************ SSE4.1 kernels **************************************/
+
+__attribute__((target("sse4.1")))
+static void rowMinimaSSE41( const unsigned int* const columns
+                          , const size_t              width
+                          , const size_t              alphabetSize
+                          , const packedChar* const   ambElem
+                          ,       unsigned int* const distances
+                          )
+{
+    for (size_t s = 0; s < width; s += 4) {
+        auto       acc = _mm_set1_epi32(-1);
+        set_bits_t bits( alphabetSize, ambElem );
+        for (size_t symbol; bits.next(symbol); ) {
+            const auto row = reinterpret_cast<const __m128i*>(columns + symbol * width + s);
+            acc = _mm_min_epu32(acc, _mm_loadu_si128(row));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(distances + s), acc);
+    }
+}
+
+
+__attribute__((target("sse4.1")))
+static unsigned int sumMinMedianSSE41( const unsigned int* const* const rows
+                                     , const size_t                     rowCount
+                                     , const size_t                     alphabetSize
+                                     ,       unsigned int* const        sums
+                                     ,       packedChar* const          median
+                                     )
+{
+    ClearAll(median, dcElemSize(alphabetSize));
+
+    const auto laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+    auto       minimum   = _mm_set1_epi32(-1);
+
+    for (size_t s = 0; s < alphabetSize; s += 4) {
+        auto sum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[0] + s));
+        for (size_t k = 1; k < rowCount; ++k) {
+            sum = _mm_add_epi32(sum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + s)));
+        }
+        // Force lanes past the alphabet to UINT_MAX so they never win the minimum.
+        const auto valid = _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(alphabetSize - s)), laneIndex);
+        sum     = _mm_or_si128(sum, _mm_andnot_si128(valid, _mm_set1_epi32(-1)));
+        minimum = _mm_min_epu32(minimum, sum);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + s), sum);
+    }
+
+    minimum = _mm_min_epu32(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+    minimum = _mm_min_epu32(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+    const auto minCost = static_cast<unsigned int>(_mm_cvtsi128_si32(minimum));
+
+    for (size_t s = 0; s < alphabetSize; s += 4) {
+        const auto equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + s)), minimum);
+        const auto bits  = static_cast<packedChar>(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+        median[s / 64] |= (bits & laneMask(alphabetSize - s)) << (s % 64);
+    }
+    return minCost;
+}
+
+
+/************************************* AVX2 kernels ***************************************/
+
+__attribute__((target("avx2")))
+static void rowMinimaAVX2( const unsigned int* const columns
+                         , const size_t              width
+                         , const size_t              alphabetSize
+                         , const packedChar* const   ambElem
+                         ,       unsigned int* const distances
+                         )
+{
+    for (size_t s = 0; s < width; s += 8) {
+        auto       acc = _mm256_set1_epi32(-1);
+        set_bits_t bits( alphabetSize, ambElem );
+        for (size_t symbol; bits.next(symbol); ) {
+            const auto row = reinterpret_cast<const __m256i*>(columns + symbol * width + s);
+            acc = _mm256_min_epu32(acc, _mm256_loadu_si256(row));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(distances + s), acc);
+    }
+}
+
+
+__attribute__((target("avx2")))
+static unsigned int sumMinMedianAVX2( const unsigned int* const* const rows
+                                    , const size_t                     rowCount
+                                    , const size_t                     alphabetSize
+                                    ,       unsigned int* const        sums
+                                    ,       packedChar* const          median
+                                    )
+{
+    ClearAll(median, dcElemSize(alphabetSize));
+
+    const auto laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    auto       minimum   = _mm256_set1_epi32(-1);
+
+    for (size_t s = 0; s < alphabetSize; s += 8) {
+        auto sum = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[0] + s));
+        for (size_t k = 1; k < rowCount; ++k) {
+            sum = _mm256_add_epi32(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + s)));
+        }
+        // Force lanes past the alphabet to UINT_MAX so they never win the minimum.
+        const auto valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(alphabetSize - s)), laneIndex);
+        sum     = _mm256_or_si256(sum, _mm256_andnot_si256(valid, _mm256_set1_epi32(-1)));
+        minimum = _mm256_min_epu32(minimum, sum);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + s), sum);
+    }
+
+    auto half = _mm_min_epu32(_mm256_castsi256_si128(minimum), _mm256_extracti128_si256(minimum, 1));
+    half = _mm_min_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_min_epu32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    const auto minCost = static_cast<unsigned int>(_mm_cvtsi128_si32(half));
+
+    minimum = _mm256_broadcastd_epi32(half);
+    for (size_t s = 0; s < alphabetSize; s += 8) {
+        const auto equal = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(sums + s)), minimum);
+        const auto bits  = static_cast<packedChar>(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+        median[s / 64] |= (bits & laneMask(alphabetSize - s)) << (s % 64);
+    }
+    return minCost;
+}
+
+#endif // MEDIAN_KERNEL_X86
+
+
+/************************************* Dispatch *******************************************/
+
+static const median_kernel_t scalarKernel = { "scalar", rowMinimaScalar, sumMinMedianScalar };
+
+#ifdef MEDIAN_KERNEL_X86
+static const median_kernel_t sse41Kernel  = { "sse4.1", rowMinimaSSE41,  sumMinMedianSSE41  };
+static const median_kernel_t avx2Kernel   = { "avx2",   rowMinimaAVX2,   sumMinMedianAVX2   };
+#endif
+
+
+std::vector<const median_kernel_t*> availableMedianKernels()
+{
+    std::vector<const median_kernel_t*> kernels = { &scalarKernel };
+#ifdef MEDIAN_KERNEL_X86
+    if (__builtin_cpu_supports("sse4.1")) kernels.push_back( &sse41Kernel );
+    if (__builtin_cpu_supports("avx2"))   kernels.push_back( &avx2Kernel  );
+#endif
+    return kernels;
+}
+
+
+const median_kernel_t& medianKernel()
+{
+    // Initialized once, thread-safely, on first use.
+    static const median_kernel_t& selected = *availableMedianKernels().back();
+    return selected;
+}
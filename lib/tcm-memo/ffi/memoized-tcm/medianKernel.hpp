@@ -0,0 +1,83 @@
+/** Vectorized kernels for the Sankoff-like cost and median computation done on a memo miss in
+ *  CostMatrix_2d and CostMatrix_3d.
+ *
+ *  The computation is split in two:
+ *
+ *    rowMinima:    for one ambiguous element, the distance from every symbol s to the element,
+ *                  i.e. the minimum over the element's set bits a of tcm[s][a]. Working from a
+ *                  transposed tcm, this is an element-wise minimum of one contiguous row per set
+ *                  bit, rather than a TestBit() of every bit for every symbol.
+ *
+ *    sumMinMedian: sums two or three such distance vectors, finds the minimum sum, and sets a
+ *                  median bit for every symbol at that minimum, using a vector compare and a
+ *                  movemask in place of a branch per symbol.
+ *
+ *  Each kernel is provided as portable scalar code and, on x86-64, as SSE4.1 and AVX2 code. The
+ *  best kernel the running CPU supports is chosen once, at first use, so no special compiler flags
+ *  are needed.
+ *
+ *  Distance vectors are medianKernelWidth(alphabetSize) words long; the lanes past alphabetSize
+ *  are padding, and are ignored by sumMinMedian.
+ */
+
+#ifndef _MEDIAN_KERNEL_H
+#define _MEDIAN_KERNEL_H
+
+#include <cstddef>
+#include <vector>
+
+extern "C" {
+#include "dynamicCharacterOperations.h"
+}
+
+
+typedef struct median_kernel_t {
+
+    /** For benchmarks and diagnostics. */
+    const char* name;
+
+    /** Set distances[s] to the minimum of columns[a * width + s] over the set bits a < alphabetSize
+     *  of @ambElem, for every s < width. @columns is the transposed tcm, one row of width words
+     *  per symbol a, and @width is medianKernelWidth(alphabetSize).
+     *
+     *  distances[s] is UINT_MAX if @ambElem is empty.
+     */
+    void (*rowMinima)( const unsigned int* columns
+                     , size_t              width
+                     , size_t              alphabetSize
+                     , const packedChar*   ambElem
+                     , unsigned int*       distances
+                     );
+
+    /** Sum the @rowCount distance vectors of @rows into @sums (width words, used as scratch), then
+     *  write the symbols of minimum sum into @median (dcElemSize(alphabetSize) words, cleared
+     *  first) and return that minimum.
+     *
+     *  Sums wrap as unsigned ints, as in the scalar loop this replaces.
+     */
+    unsigned int (*sumMinMedian)( const unsigned int* const* rows
+                                , size_t                     rowCount
+                                , size_t                     alphabetSize
+                                , unsigned int*              sums
+                                , packedChar*                median
+                                );
+
+} median_kernel_t;
+
+
+/** Length of a distance vector, alphabetSize rounded up to a whole number of 8-lane blocks. */
+inline size_t medianKernelWidth(size_t alphabetSize)
+{
+    return (alphabetSize + 7) & ~static_cast<size_t>(7);
+}
+
+
+/** The fastest kernel supported by this CPU. */
+const median_kernel_t& medianKernel();
+
+
+/** Every kernel supported by this CPU, scalar first. For tests and benchmarks. */
+std::vector<const median_kernel_t*> availableMedianKernels();
+
+
+#endif // _MEDIAN_KERNEL_H
@@ -0,0 +1,94 @@
+#include <cinttypes>
+#include <cstdio>
+
+#include "memoFile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MEMO_FILE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef MEMO_FILE_MMAP
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+    const auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 || info.st_size % sizeof(uint64_t) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    const auto length  = static_cast<size_t>(info.st_size);
+    const auto address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);    // The mapping keeps the file open.
+    if (address == MAP_FAILED) return nullptr;
+
+    return std::unique_ptr<MappedFile>( new MappedFile(address, length) );
+}
+
+
+MappedFile::~MappedFile()
+{
+    munmap(address, length);
+}
+
+
+bool writeFileAtomically(const std::string& path, const std::vector<uint64_t>& words)
+{
+    const auto temporary = path + ".tmp." + std::to_string(getpid());
+
+    auto file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) return false;
+
+    auto written = std::fwrite(words.data(), sizeof(uint64_t), words.size(), file) == words.size();
+    written      = std::fclose(file) == 0 && written;
+
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+#else
+
+// No memory mapping: nothing is ever loaded, and so nothing is saved either.
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string&) { return nullptr; }
+
+MappedFile::~MappedFile() { }
+
+bool writeFileAtomically(const std::string&, const std::vector<uint64_t>&) { return false; }
+
+#endif // MEMO_FILE_MMAP
+
+
+std::string memoFilePath(const char* directory, uint64_t tcmHash, size_t dimension)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "/tcm-%016" PRIx64 "-%zud.memo", tcmHash, dimension);
+    return std::string(directory) + name;
+}
+
+
+uint64_t hashTCM(size_t alphabetSize, const unsigned int* tcm)
+{
+    auto hash = UINT64_C(14695981039346656037);
+    const auto mix = [&hash](uint64_t value) {
+        for (size_t byte = 0; byte < sizeof(value); ++byte) {
+            hash ^= (value >> (8 * byte)) & 0xFF;
+            hash *= UINT64_C(1099511628211);
+        }
+    };
+
+    mix(alphabetSize);
+    for (size_t i = 0; i < alphabetSize * alphabetSize; ++i) mix(tcm[i]);
+    return hash;
+}
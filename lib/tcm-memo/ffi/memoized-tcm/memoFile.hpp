@@ -0,0 +1,87 @@
+/** File handling for persisted memo tables: see ConcurrentMemo::attach() and ConcurrentMemo::save().
+ *
+ *  A persisted table is one file of native-endian 64-bit words, laid out exactly as the memo's own
+ *  slot array and arena, so that it can be memory mapped and probed in place, with no parsing:
+ *
+ *      [ header (memoFileHeaderWords) | slots (slotCount) | records (recordCount * recordWidth) ]
+ *
+ *  Files are mapped read-only and shared, so every process using the same TCM on a node shares
+ *  one copy of the pages. Files are replaced by renaming a complete new file over the old one, so
+ *  a process that still has the old file mapped is unaffected.
+ */
+
+#ifndef _MEMO_FILE_H
+#define _MEMO_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/** Header words, in order. */
+enum memo_file_header_t {
+    MEMO_FILE_MAGIC = 0,
+    MEMO_FILE_KEY_COUNT,
+    MEMO_FILE_ELEMENT_SIZE,
+    MEMO_FILE_TAG,            // Identifies the TCM the values were computed from.
+    MEMO_FILE_HASH_CHECK,     // Hash of a fixed key, to reject files written by a differently hashing build.
+    MEMO_FILE_SLOT_COUNT,
+    MEMO_FILE_RECORD_COUNT,
+    MEMO_FILE_RESERVED,
+    memoFileHeaderWords
+};
+
+/** "PCGMEMO1", read as a native-endian word, so a file from a machine of the other endianness
+ *  is rejected too.
+ */
+static constexpr uint64_t memoFileMagic = UINT64_C(0x314F4D454D474350);
+
+
+/** A read-only, shared memory mapping of a whole file. Unmapped on destruction. */
+class MappedFile
+{
+    public:
+
+        /** Map all of @path, or return nullptr if it cannot be opened or mapped, or its length is
+         *  not a whole number of words.
+         */
+        static std::unique_ptr<MappedFile> open(const std::string& path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile&)            = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint64_t* words()     const { return static_cast<const uint64_t*>(address); }
+        size_t          wordCount() const { return length / sizeof(uint64_t); }
+
+    private:
+
+        MappedFile(void* address, size_t length) : address(address), length(length) { }
+
+        void*  address;
+        size_t length;
+};
+
+
+/** Write @words to @path by writing a temporary file beside it and renaming that over @path.
+ *  Returns false, leaving @path as it was, on any failure.
+ */
+bool writeFileAtomically(const std::string& path, const std::vector<uint64_t>& words);
+
+
+/** The file within @directory holding the memo of @dimension-element keys for the TCM with hash
+ *  @tcmHash.
+ */
+std::string memoFilePath(const char* directory, uint64_t tcmHash, size_t dimension);
+
+
+/** FNV-1a hash of an alphabet size and its alphabetSize * alphabetSize TCM, naming the memo files
+ *  of that TCM.
+ */
+uint64_t hashTCM(size_t alphabetSize, const unsigned int* tcm);
+
+
+#endif // _MEMO_FILE_H
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "costMatrix_3d.hpp"
+#include "pairwiseAlignment.hpp"
+
+
+/** Cells either side of the diagonals that a band starts with. */
+static const size_t BAND_INITIAL_BARRIER = 8;
+
+/** The cost of a cell outside the band. Small enough that adding a step cost cannot wrap. */
+static const unsigned int OUTSIDE_BAND = UINT_MAX / 2;
+
+
+unsigned int call_alignPair2D_C( costMatrix_p      untyped_self
+                               , size_t            firstLength
+                               , const packedChar* first
+                               , size_t            secondLength
+                               , const packedChar* second
+                               , packedChar*       retMedians
+                               , unsigned char*    retColumns
+                               , size_t*           retLength
+                               )
+{
+    CostMatrix_3d* thisMtx = static_cast<CostMatrix_3d*> (untyped_self);
+    return alignPair2D( thisMtx->costMatrix2D(), firstLength, first, secondLength, second, retMedians, retColumns, retLength );
+}
+
+
+/** @count <= 64 bits of a bit-packed buffer, from bit @start. */
+static inline packedChar readBits( const packedChar* const packed, const size_t start, const size_t count )
+{
+    const size_t word   = start / WORD_WIDTH,
+                 offset = start % WORD_WIDTH;
+    packedChar   bits   = packed[word] >> offset;
+    if (offset && offset + count > WORD_WIDTH) bits |= packed[word + 1] << (WORD_WIDTH - offset);
+    return count == WORD_WIDTH ? bits : bits & ((CANONICAL_ONE << count) - 1);
+}
+
+
+/** Or @count bits into a bit-packed buffer, from bit @start. */
+static inline void orBits( packedChar* const packed, const size_t start, const size_t count, const packedChar bits )
+{
+    const size_t word   = start / WORD_WIDTH,
+                 offset = start % WORD_WIDTH;
+    packed[word] |= bits << offset;
+    if (offset && offset + count > WORD_WIDTH) packed[word + 1] |= bits >> (WORD_WIDTH - offset);
+}
+
+
+/** The distinct elements of a bit-packed character, each unpacked to elementSize words, and the
+ *  number of the distinct element at each position.
+ */
+struct distinct_elements_t {
+    size_t                  count;
+    std::vector<packedChar> elements;
+    std::vector<uint32_t>   ids;
+
+    distinct_elements_t( const packedChar* const packed, const size_t length, const size_t alphabetSize )
+      : count(0), ids(length)
+    {
+        const size_t elementSize = dcElemSize(alphabetSize);
+
+        std::vector<packedChar> unpacked( length * elementSize );
+        for (size_t i = 0; i < length; ++i) {
+            for (size_t w = 0; w < elementSize; ++w) {
+                const size_t bits = std::min( WORD_WIDTH, alphabetSize - w * WORD_WIDTH );
+                unpacked[i * elementSize + w] = readBits( packed, i * alphabetSize + w * WORD_WIDTH, bits );
+            }
+        }
+
+        // Sort the positions by element, so that equal elements are adjacent.
+        std::vector<uint32_t> order( length );
+        std::iota( order.begin(), order.end(), 0 );
+        const auto element = [&]( uint32_t i ) { return unpacked.data() + i * elementSize; };
+        std::sort( order.begin(), order.end(), [&]( uint32_t lhs, uint32_t rhs ) {
+            return std::lexicographical_compare( element(lhs), element(lhs) + elementSize
+                                               , element(rhs), element(rhs) + elementSize );
+        });
+
+        for (size_t k = 0; k < length; ++k) {
+            if (k == 0 || !std::equal( element(order[k]), element(order[k]) + elementSize, element(order[k - 1]) )) {
+                elements.insert( elements.end(), element(order[k]), element(order[k]) + elementSize );
+                ++count;
+            }
+            ids[order[k]] = count - 1;
+        }
+    }
+};
+
+
+/** The costs of one alignment's pairs of distinct elements, and of each against a gap. The
+ *  costs of aligning a distinct element of the first character are looked up in the memoized
+ *  matrix the first time a row of the first character holds it.
+ */
+class local_costs_t
+{
+    public:
+
+        std::vector<packedChar> gap;
+        std::vector<unsigned int> inserts;   // Of each distinct element of the first character.
+        std::vector<unsigned int> deletes;   // Of each distinct element of the second.
+
+        local_costs_t( CostMatrix_2d& matrix, const distinct_elements_t& first, const distinct_elements_t& second )
+          : gap(matrix.elementSize, 0)
+          , inserts(first.count)
+          , deletes(second.count)
+          , costMatrix(matrix)
+          , firsts(first)
+          , seconds(second)
+          , aligns(first.count * second.count)
+          , filled(first.count, false)
+        {
+            SetBit( gap.data(), matrix.alphabetSize - 1 );
+            for (size_t a = 0; a < first.count; ++a) {
+                inserts[a] = costMatrix.getSetCostMedian( firstElement(a), gap.data(), nullptr );
+            }
+            for (size_t b = 0; b < second.count; ++b) {
+                deletes[b] = costMatrix.getSetCostMedian( gap.data(), secondElement(b), nullptr );
+            }
+        }
+
+        const packedChar* firstElement(size_t a)  const { return firsts.elements.data()  + a * costMatrix.elementSize; }
+        const packedChar* secondElement(size_t b) const { return seconds.elements.data() + b * costMatrix.elementSize; }
+
+        /** The cost of aligning distinct element @a of the first character with each of the second. */
+        const unsigned int* alignRow(size_t a)
+        {
+            unsigned int* const row = aligns.data() + a * seconds.count;
+            if (!filled[a]) {
+                for (size_t b = 0; b < seconds.count; ++b) {
+                    row[b] = costMatrix.getSetCostMedian( firstElement(a), secondElement(b), nullptr );
+                }
+                filled[a] = true;
+            }
+            return row;
+        }
+
+    private:
+
+        CostMatrix_2d&             costMatrix;
+        const distinct_elements_t& firsts;
+        const distinct_elements_t& seconds;
+        std::vector<unsigned int>  aligns;
+        std::vector<bool>          filled;
+};
+
+
+/** The cells (i, j) with lower <= j - i <= upper, and what filling them found. Row i of the
+ *  directions holds its cells from column rowStart(i), stride bytes to a row.
+ */
+struct band_t {
+    size_t    firstLength;
+    size_t    secondLength;
+    ptrdiff_t lower;
+    ptrdiff_t upper;
+    size_t    stride;
+
+    band_t( size_t firstLen, size_t secondLen, size_t barrier )
+      : firstLength(firstLen), secondLength(secondLen)
+    {
+        const ptrdiff_t diff = static_cast<ptrdiff_t>(secondLen) - static_cast<ptrdiff_t>(firstLen);
+        lower  = std::min<ptrdiff_t>( 0, diff ) - static_cast<ptrdiff_t>(barrier);
+        upper  = std::max<ptrdiff_t>( 0, diff ) + static_cast<ptrdiff_t>(barrier);
+        stride = std::min<size_t>( secondLen + 1, upper - lower + 1 );
+    }
+
+    size_t rowStart(size_t i) const { return static_cast<size_t>( std::max<ptrdiff_t>( 0, i + lower ) ); }
+    size_t rowEnd(size_t i)   const { return static_cast<size_t>( std::min<ptrdiff_t>( secondLength, i + upper ) ); }
+
+    /** The least cost of a path that leaves the band. One past its upper edge has made
+     *  upper + 1 more deletions than insertions, and ends secondLength - firstLength ahead, so
+     *  has at least upper + 1 deletions and upper + 1 - that difference insertions; likewise
+     *  below.
+     */
+    unsigned long long exitBound( unsigned int leastInsert, unsigned int leastDelete ) const
+    {
+        const long long diff  = static_cast<long long>(secondLength) - static_cast<long long>(firstLength),
+                        above = upper + 1,
+                        below = 1 - lower;
+        const unsigned long long
+            pastUpper = static_cast<unsigned long long>(above) * leastDelete + static_cast<unsigned long long>(above - diff) * leastInsert,
+            pastLower = static_cast<unsigned long long>(below) * leastInsert + static_cast<unsigned long long>(below + diff) * leastDelete;
+        return std::min( pastUpper, pastLower );
+    }
+};
+
+
+/** Fill @band into @directions, two rows of costs at a time, and set @cost to that of its last
+ *  cell. Returns false, leaving the band unfinished, as soon as every cell of a row costs
+ *  @bound or more.
+ */
+static bool fillBand( const band_t&                    band
+                    , const distinct_elements_t&       first
+                    , const distinct_elements_t&       second
+                    , local_costs_t&                   costs
+                    , const std::vector<unsigned int>& columnDeletes
+                    , unsigned long long               bound
+                    , std::vector<unsigned char>&      directions
+                    , unsigned int&                    cost
+                    )
+{
+    std::vector<unsigned int> rowA( band.secondLength + 1, OUTSIDE_BAND ),
+                              rowB( band.secondLength + 1, OUTSIDE_BAND );
+    unsigned int *prev = rowA.data(),
+                 *cur  = rowB.data();
+
+    prev[0] = 0;
+    for (size_t j = 1, end = band.rowEnd(0); j <= end; ++j) {
+        prev[j]       = prev[j - 1] + columnDeletes[j - 1];
+        directions[j] = DELETE_COLUMN;
+    }
+
+    for (size_t i = 1; i <= band.firstLength; ++i) {
+        const size_t        start  = band.rowStart(i),
+                            end    = band.rowEnd(i);
+        const uint32_t      a      = first.ids[i - 1];
+        const unsigned int  insert = costs.inserts[a],
+                           *align  = costs.alignRow(a);
+        const uint32_t     *ids    = second.ids.data();
+        unsigned char      *dirRow = directions.data() + i * band.stride - start;
+
+        // The first cell has no neighbour to its left in the band.
+        unsigned int left;
+        if (start == 0) {
+            left = prev[0] + insert;
+            dirRow[0] = INSERT_COLUMN;
+        } else {
+            const unsigned int diag = prev[start - 1] + align[ids[start - 1]],
+                               up   = prev[start] + insert;
+            left = diag <= up ? diag : up;
+            dirRow[start] = diag <= up ? ALIGN_COLUMN : INSERT_COLUMN;
+        }
+        cur[start] = left;
+        unsigned int least = left;
+
+        for (size_t j = start + 1; j <= end; ++j) {
+            const unsigned int diag = prev[j - 1] + align[ids[j - 1]],
+                               del  = left + columnDeletes[j - 1],
+                               up   = prev[j] + insert;
+            unsigned int  best = diag;
+            unsigned char dir  = ALIGN_COLUMN;
+            if (del < best) { best = del; dir = DELETE_COLUMN; }
+            if (up  < best) { best = up;  dir = INSERT_COLUMN; }
+            cur[j]    = best;
+            dirRow[j] = dir;
+            left      = best;
+            if (best < least) least = best;
+        }
+        if (least >= bound) return false;
+
+        std::swap( prev, cur );
+    }
+    cost = prev[band.secondLength];
+    return true;
+}
+
+
+unsigned int alignPair2D( CostMatrix_2d&          costMatrix
+                        , size_t                  firstLength
+                        , const packedChar* const first
+                        , size_t                  secondLength
+                        , const packedChar* const second
+                        , packedChar*       const retMedians
+                        , unsigned char*    const retColumns
+                        , size_t*           const retLength
+                        )
+{
+    const size_t        alphabetSize = costMatrix.alphabetSize,
+                        elementSize  = costMatrix.elementSize;
+    distinct_elements_t firsts( first, firstLength, alphabetSize ),
+                        seconds( second, secondLength, alphabetSize );
+    local_costs_t       costs( costMatrix, firsts, seconds );
+
+    std::vector<unsigned int> columnDeletes( secondLength );
+    for (size_t j = 0; j < secondLength; ++j) columnDeletes[j] = costs.deletes[seconds.ids[j]];
+
+    const unsigned int leastInsert = firstLength  ? *std::min_element( costs.inserts.begin(), costs.inserts.end() ) : 0,
+                       leastDelete = secondLength ? *std::min_element( costs.deletes.begin(), costs.deletes.end() ) : 0;
+
+    // Double the band until its cost is certified, or it would cover nearly the whole plane.
+    const size_t fullBarrier = std::min( firstLength, secondLength );
+    std::vector<unsigned char> directions;
+    unsigned int cost = 0;
+    band_t band( firstLength, secondLength, fullBarrier );
+    for (size_t barrier = BAND_INITIAL_BARRIER; ; barrier *= 2) {
+        band = band_t( firstLength, secondLength, barrier );
+        unsigned long long bound = band.exitBound( leastInsert, leastDelete );
+        if (2 * barrier >= fullBarrier || bound == 0) {
+            band  = band_t( firstLength, secondLength, fullBarrier );
+            bound = ULLONG_MAX;
+        }
+
+        directions.resize( (firstLength + 1) * band.stride );
+        if (fillBand( band, firsts, seconds, costs, columnDeletes, bound, directions, cost ) && cost < bound) break;
+    }
+
+    // Trace back from the last cell, writing the columns from the end of the outputs.
+    const size_t capacity = firstLength + secondLength;
+    std::vector<uint32_t> firstIds( capacity ), secondIds( capacity );
+    size_t i = firstLength,
+           j = secondLength,
+           k = capacity;
+    while (i > 0 || j > 0) {
+        const unsigned char dir = i == 0 ? DELETE_COLUMN
+                                : j == 0 ? INSERT_COLUMN
+                                : directions[i * band.stride + j - band.rowStart(i)];
+        --k;
+        retColumns[k] = dir;
+        if (dir != DELETE_COLUMN) firstIds[k]  = firsts.ids[--i];
+        if (dir != INSERT_COLUMN) secondIds[k] = seconds.ids[--j];
+    }
+
+    const size_t length = capacity - k;
+    std::memmove( retColumns, retColumns + k, length );
+    std::memset( retMedians, 0, dynCharSize( alphabetSize, length ) * sizeof(packedChar) );
+
+    // The medians of all the columns are looked up in one batch, which looks up each distinct column once.
+    std::vector<packedChar>   lefts( length * elementSize ), rights( length * elementSize ), medians( length * elementSize );
+    std::vector<unsigned int> columnCosts( length );
+    for (size_t c = 0; c < length; ++c) {
+        const unsigned char      dir   = retColumns[c];
+        const packedChar* const  lhs   = dir == DELETE_COLUMN ? costs.gap.data() : costs.firstElement( firstIds[k + c] ),
+                        * const  rhs   = dir == INSERT_COLUMN ? costs.gap.data() : costs.secondElement( secondIds[k + c] );
+        std::copy( lhs, lhs + elementSize, lefts.begin()  + c * elementSize );
+        std::copy( rhs, rhs + elementSize, rights.begin() + c * elementSize );
+    }
+    costMatrix.getSetCostMedianBatch( length, lefts.data(), rights.data(), columnCosts.data(), medians.data() );
+
+    for (size_t c = 0; c < length; ++c) {
+        for (size_t w = 0; w < elementSize; ++w) {
+            const size_t bits = std::min( WORD_WIDTH, alphabetSize - w * WORD_WIDTH );
+            orBits( retMedians, c * alphabetSize + w * WORD_WIDTH, bits, medians[c * elementSize + w] );
+        }
+    }
+
+    *retLength = length;
+    return cost;
+}
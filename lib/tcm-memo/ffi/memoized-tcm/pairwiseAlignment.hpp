@@ -0,0 +1,82 @@
+/** Pairwise direct optimization of two dynamic characters over alphabets of any size, with the
+ *  costs and medians of ambiguous elements taken from a memoized CostMatrix_2d.
+ *
+ *  The C alignment code stores an element in a single unsigned int, so it serves alphabets of
+ *  at most 8 symbols; larger ones, such as proteins, are aligned here. Characters are bit-packed
+ *  as in dynChar_t: element i holds bits [i * alphabetSize, (i + 1) * alphabetSize) of the
+ *  buffer. The gap is the last symbol of the alphabet.
+ *
+ *  The alignment is a Needleman-Wunsch alignment with the first character down the rows and the
+ *  second across the columns, preferring, between equal costs, an alignment, then a deletion of
+ *  an element of the second character, then an insertion of one of the first. Each cell is
+ *  reached by exactly one of these, so the result is that of the Haskell traceback.
+ *
+ *  Two things keep it fast:
+ *
+ *    A local cost cache. Characters have few distinct elements, so each is numbered, and the
+ *    cost of every pair of distinct elements is looked up in the memoized matrix once per
+ *    alignment, a row of the cache at a time, when first needed. Filling a cell then costs an
+ *    array read rather than a hash and a lock in the shared memo.
+ *
+ *    Ukkonen's band doubling. Only a band of cells either side of the diagonals an alignment
+ *    must cross is filled, and its cost is accepted only if it is less than that of any path
+ *    that leaves the band. Otherwise the band doubles, until it would cover nearly the whole
+ *    plane, which is then filled. Directions are kept for the band only.
+ */
+
+#ifndef _PAIRWISE_ALIGNMENT_H
+#define _PAIRWISE_ALIGNMENT_H
+
+#include <cstddef>
+
+#include "costMatrix_2d.hpp"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dynamicCharacterOperations.h"
+
+/** The kind of each aligned column, numbered as the Haskell Direction. */
+#define ALIGN_COLUMN  0   /** An element of each character. */
+#define DELETE_COLUMN 1   /** An element of the second character against a gap. */
+#define INSERT_COLUMN 2   /** An element of the first character against a gap. */
+
+/** alignPair2D() on the 2D matrix of a CostMatrix_3d, as made by construct_CostMatrix_C(). */
+unsigned int call_alignPair2D_C( costMatrix_p      untyped_self
+                               , size_t            firstLength
+                               , const packedChar* first
+                               , size_t            secondLength
+                               , const packedChar* second
+                               , packedChar*       retMedians
+                               , unsigned char*    retColumns
+                               , size_t*           retLength
+                               );
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/** Align @first, of @firstLength elements, with @second, of @secondLength, both bit-packed, and
+ *  return the cost of the alignment.
+ *
+ *  The number of aligned columns is written to @retLength, the kind of each column, in order,
+ *  to @retColumns, and the median of each, bit-packed, to @retMedians. The caller allocates
+ *  firstLength + secondLength bytes for @retColumns and
+ *  dynCharSize(alphabetSize, firstLength + secondLength) words for @retMedians.
+ *
+ *  Thread-safe, as is the matrix: any number of alignments may share it.
+ */
+unsigned int alignPair2D( CostMatrix_2d&          costMatrix
+                        , size_t                  firstLength
+                        , const packedChar* const first
+                        , size_t                  secondLength
+                        , const packedChar* const second
+                        , packedChar*       const retMedians
+                        , unsigned char*    const retColumns
+                        , size_t*           const retLength
+                        );
+
+
+#endif // _PAIRWISE_ALIGNMENT_H
@@ -0,0 +1,192 @@
+/** Microbenchmark of the median kernels against the original scalar loop of
+ *  CostMatrix_2d::computeCostMedian() and findDistance(), which TestBit() every symbol of every
+ *  element for every symbol of the alphabet.
+ *
+ *  Every kernel is first checked against that loop on the same random, ambiguous elements, so this
+ *  doubles as a test: returns 1 on any mismatch.
+ */
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../medianKernel.hpp"
+
+
+/** The original findDistance(). */
+static unsigned int referenceDistance( const unsigned int* tcm, size_t alphabetSize, size_t fixedSymbol, const packedChar* ambElem )
+{
+    auto minCost{UINT_MAX};
+    for (size_t ambiguitySymbol = 0; ambiguitySymbol < alphabetSize; ++ambiguitySymbol) {
+        if (TestBit( (packedChar*) ambElem, ambiguitySymbol )) {
+            const auto curCost = tcm[fixedSymbol * alphabetSize + ambiguitySymbol];
+            if (curCost < minCost) minCost = curCost;
+        }
+    }
+    return minCost;
+}
+
+
+/** The original computeCostMedian(), over two or three elements. */
+static unsigned int referenceCostMedian( const unsigned int* tcm, size_t alphabetSize
+                                       , const packedChar* const* elements, size_t elementCount
+                                       , packedChar* median )
+{
+    auto minCost{UINT_MAX};
+    ClearAll( median, dcElemSize(alphabetSize) );
+
+    for (size_t symbol = 0; symbol < alphabetSize; ++symbol) {
+        unsigned int curCost = 0;
+        for (size_t k = 0; k < elementCount; ++k) {
+            curCost += referenceDistance( tcm, alphabetSize, symbol, elements[k] );
+        }
+        if (curCost < minCost) {
+            minCost = curCost;
+            ClearAll( median, dcElemSize(alphabetSize) );
+            SetBit( median, symbol );
+        } else if (curCost == minCost) {
+            SetBit( median, symbol );
+        }
+    }
+    return minCost;
+}
+
+
+/** As CostMatrix_2d::computeCostMedian() now does it. */
+static unsigned int kernelCostMedian( const median_kernel_t& kernel, const unsigned int* columns, size_t alphabetSize
+                                    , const packedChar* const* elements, size_t elementCount
+                                    , std::vector<unsigned int>& scratch, packedChar* median )
+{
+    const auto width = medianKernelWidth( alphabetSize );
+    const unsigned int* rows[3];
+    for (size_t k = 0; k < elementCount; ++k) {
+        kernel.rowMinima( columns, width, alphabetSize, elements[k], scratch.data() + k * width );
+        rows[k] = scratch.data() + k * width;
+    }
+    return kernel.sumMinMedian( rows, elementCount, alphabetSize, scratch.data() + 3 * width, median );
+}
+
+
+struct fixture_t {
+    size_t                  alphabetSize;
+    size_t                  elementSize;
+    std::vector<unsigned>   tcm;
+    std::vector<unsigned>   columns;     // Transposed and padded, as CostMatrix_2d::tcmColumns.
+    std::vector<packedChar> elements;    // elementCount elements of elementSize words.
+    size_t                  elementCount;
+};
+
+
+static fixture_t makeFixture( size_t alphabetSize, size_t elementCount, std::mt19937& rng )
+{
+    fixture_t f;
+    f.alphabetSize = alphabetSize;
+    f.elementSize  = dcElemSize( alphabetSize );
+    f.elementCount = elementCount;
+
+    auto costDist = std::uniform_int_distribution<unsigned>( 1, 9 );
+    f.tcm.resize( alphabetSize * alphabetSize );
+    for (size_t i = 0; i < alphabetSize; ++i) {
+        for (size_t j = 0; j < alphabetSize; ++j) {
+            f.tcm[i * alphabetSize + j] = i == j ? 0 : costDist(rng);
+        }
+    }
+
+    const auto width = medianKernelWidth( alphabetSize );
+    f.columns.assign( alphabetSize * width, UINT_MAX );
+    for (size_t from = 0; from < alphabetSize; ++from) {
+        for (size_t to = 0; to < alphabetSize; ++to) {
+            f.columns[to * width + from] = f.tcm[from * alphabetSize + to];
+        }
+    }
+
+    // Mostly unambiguous, some heavily ambiguous, as in real data.
+    auto symbolDist = std::uniform_int_distribution<size_t>( 0, alphabetSize - 1 );
+    auto bitsDist   = std::geometric_distribution<size_t>( 0.5 );
+    f.elements.assign( elementCount * f.elementSize, 0 );
+    for (size_t e = 0; e < elementCount; ++e) {
+        const auto bits = 1 + bitsDist(rng);
+        for (size_t b = 0; b < bits; ++b) SetBit( f.elements.data() + e * f.elementSize, symbolDist(rng) );
+    }
+    return f;
+}
+
+
+/** Queries per microsecond for @query(i, median) over every triple of consecutive elements. */
+template <typename Query>
+static double timeQueries( const fixture_t& f, size_t rounds, Query query, unsigned long long& checksum )
+{
+    std::vector<packedChar> median( f.elementSize );
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i + 2 < f.elementCount; ++i) {
+            checksum += query( i, median.data() ) + median[0];
+        }
+    }
+    const auto elapsed = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count();
+    return rounds * (f.elementCount - 2) / elapsed;
+}
+
+
+int main()
+{
+    std::mt19937 rng( 2017 );
+    const auto   kernels  = availableMedianKernels();
+    size_t       failures = 0;
+
+    printf("\n\n\n******* Median kernel benchmark, queries per microsecond (higher is better). ******\n");
+    printf("  %8s %4s %12s", "alphabet", "dim", "reference");
+    for (auto kernel : kernels) printf( " %12s", kernel->name );
+    printf("\n");
+
+    for (size_t alphabetSize : { 5, 21, 45, 64, 70, 130 }) {
+        const auto f       = makeFixture( alphabetSize, 4096, rng );
+        const auto rounds  = std::max<size_t>( 1, 20000 / (alphabetSize * alphabetSize / 8 + 1) );
+        const auto element = [&]( size_t i ) { return f.elements.data() + i * f.elementSize; };
+        std::vector<unsigned int> scratch( 4 * medianKernelWidth(alphabetSize) );
+        std::vector<packedChar>   expected( f.elementSize ), actual( f.elementSize );
+
+        for (size_t dimension : { 2, 3 }) {
+            // Correctness first, on every query the timings will make.
+            for (auto kernel : kernels) {
+                for (size_t i = 0; i + 2 < f.elementCount; ++i) {
+                    const packedChar* elements[] = { element(i), element(i + 1), element(i + 2) };
+                    const auto wantCost = referenceCostMedian( f.tcm.data(), alphabetSize, elements, dimension, expected.data() );
+                    const auto gotCost  = kernelCostMedian( *kernel, f.columns.data(), alphabetSize, elements, dimension, scratch, actual.data() );
+                    if (wantCost != gotCost || expected != actual) {
+                        if (failures++ < 10) {
+                            printf( "  MISMATCH: %s, alphabet %zu, %zuD, query %zu: cost %u vs %u\n"
+                                  , kernel->name, alphabetSize, dimension, i, gotCost, wantCost );
+                        }
+                    }
+                }
+            }
+
+            unsigned long long checksum = 0;
+            const auto reference = timeQueries( f, rounds, [&]( size_t i, packedChar* median ) {
+                const packedChar* elements[] = { element(i), element(i + 1), element(i + 2) };
+                return referenceCostMedian( f.tcm.data(), alphabetSize, elements, dimension, median );
+            }, checksum );
+            printf( "  %8zu %3zuD %12.2f", alphabetSize, dimension, reference );
+
+            for (auto kernel : kernels) {
+                const auto rate = timeQueries( f, rounds, [&]( size_t i, packedChar* median ) {
+                    const packedChar* elements[] = { element(i), element(i + 1), element(i + 2) };
+                    return kernelCostMedian( *kernel, f.columns.data(), alphabetSize, elements, dimension, scratch, median );
+                }, checksum );
+                printf( " %12.2f", rate );
+            }
+            printf( "   (checksum %llu)\n", checksum );
+        }
+    }
+    printf( "  Selected kernel: %s\n", medianKernel().name );
+
+    if (failures) {
+        printf("Failed! %zu mismatches.\n\n\n", failures);
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -41,6 +41,54 @@ int main() {
         ClearBit(firstKey->element, key1);
     }
 
+    // The caller-owned buffer entry points must agree with the dcElement_t entry points,
+    // for both memoized hits and fresh, ambiguous misses.
+    packedChar bufferMedian[1];
+    int        mismatches = 0;
+    for (packedChar elem1 = 1; elem1 < (1 << ALPH_SIZE); elem1 += 3) {
+        for (packedChar elem2 = 1; elem2 < (1 << ALPH_SIZE); elem2 += 5) {
+            packedChar elem3 = (elem1 ^ elem2) ? (elem1 ^ elem2) : 1;
+
+            *firstKey->element  = elem1;
+            *secondKey->element = elem2;
+            *thirdKey->element  = elem3;
+
+            unsigned int bufferCost = getCostAndMedianBuffer2D(&elem1, &elem2, bufferMedian, myMatrix);
+            foundCost = getCostAndMedian2D(firstKey, secondKey, retMedian, myMatrix);
+            mismatches += foundCost != bufferCost || *retMedian->element != *bufferMedian;
+
+            foundCost  = getCostAndMedian3D(firstKey, secondKey, thirdKey, retMedian, myMatrix);
+            bufferCost = getCostAndMedianBuffer3D(&elem1, &elem2, &elem3, bufferMedian, myMatrix);
+            mismatches += foundCost != bufferCost || *retMedian->element != *bufferMedian;
+        }
+    }
+    printf("Buffer interface mismatches: %d\n", mismatches);
+
+    // The batched entry points must agree with the single-column ones, including on repeated columns.
+    #define BATCH_SIZE 64
+    packedChar   batch1[BATCH_SIZE], batch2[BATCH_SIZE], batch3[BATCH_SIZE], batchMedians[BATCH_SIZE];
+    unsigned int batchCosts[BATCH_SIZE];
+    int          batchMismatches = 0;
+    for (size_t i = 0; i < BATCH_SIZE; ++i) {
+        batch1[i] = 1 + (i * 7)  % ((1 << ALPH_SIZE) - 1);
+        batch2[i] = 1 + (i * 11) % 13;
+        batch3[i] = 1 + (i * 3)  % ((1 << ALPH_SIZE) - 1);
+    }
+
+    getCostAndMedianBatch2D(BATCH_SIZE, batch1, batch2, batchCosts, batchMedians, myMatrix);
+    for (size_t i = 0; i < BATCH_SIZE; ++i) {
+        unsigned int bufferCost = getCostAndMedianBuffer2D(batch1 + i, batch2 + i, bufferMedian, myMatrix);
+        batchMismatches += batchCosts[i] != bufferCost || batchMedians[i] != *bufferMedian;
+    }
+
+    getCostAndMedianBatch3D(BATCH_SIZE, batch1, batch2, batch3, batchCosts, batchMedians, myMatrix);
+    for (size_t i = 0; i < BATCH_SIZE; ++i) {
+        unsigned int bufferCost = getCostAndMedianBuffer3D(batch1 + i, batch2 + i, batch3 + i, bufferMedian, myMatrix);
+        batchMismatches += batchCosts[i] != bufferCost || batchMedians[i] != *bufferMedian;
+    }
+    printf("Batch interface mismatches: %d\n", batchMismatches);
+    mismatches += batchMismatches;
+
     matrixDestroy(myMatrix);
 
     freeDCElem(firstKey );
@@ -52,4 +100,6 @@ int main() {
     free(secondKey);
     free(thirdKey);
     free(retMedian);
+
+    return mismatches != 0;
 }
@@ -0,0 +1,354 @@
+/** Multi-threaded stress test for the memoized cost matrices.
+ *
+ *  Builds a set of random, possibly ambiguous, key pairs and key triples, computes their costs
+ *  and medians serially on one matrix, then hammers a second, shared matrix with the same queries
+ *  from many threads at once (each thread in a different order, so that threads race to insert
+ *  the same missing keys). Every concurrent result must match the serial result.
+ *
+ *  Run under -fsanitize=thread for the strongest check.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../costMatrix_2d.hpp"
+#include "../costMatrix_3d.hpp"
+#include "../dynamicCharacterOperations.h"
+
+
+struct expected_t {
+    unsigned int            cost;
+    std::vector<packedChar> median;
+};
+
+
+/** Allocate a random, non-empty, possibly ambiguous element. */
+static dcElement_t* randomElement( size_t alphabetSize, std::mt19937& rng )
+{
+    auto element    = allocateDCElement( alphabetSize );
+    auto symbolDist = std::uniform_int_distribution<size_t>( 0, alphabetSize - 1 );
+    auto bitCount   = std::uniform_int_distribution<size_t>( 1, std::min<size_t>(alphabetSize, 4) )(rng);
+
+    for (size_t i = 0; i < bitCount; ++i) {
+        SetBit( element->element, symbolDist(rng) );
+    }
+    return element;
+}
+
+
+static void freeElements( std::vector<dcElement_t*>& elements )
+{
+    for (auto element : elements) {
+        freeDCElem( element );
+        free( element );
+    }
+}
+
+
+static unsigned int* makeTCM( size_t alphabetSize )
+{
+    auto tcm = new unsigned int[alphabetSize * alphabetSize];
+    for (size_t i = 0; i < alphabetSize; ++i) {
+        for (size_t j = 0; j < alphabetSize; ++j) {
+            // Non-symmetric, with a more expensive gap (last symbol).
+            tcm[i * alphabetSize + j] = (i == j) ? 0
+                                      : (i == alphabetSize - 1 || j == alphabetSize - 1) ? 2 + (i % 3)
+                                      : 1 + ((i + 2 * j) % 4);
+        }
+    }
+    return tcm;
+}
+
+
+/** Each thread queries every key index in its own shuffled order, comparing against the serial
+ *  results. Returns the number of mismatches found across all threads.
+ */
+template <typename Query>
+static size_t runThreads( size_t threadCount, size_t keyCount, size_t rounds, Query query )
+{
+    std::atomic<size_t> mismatches{0};
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threadCount; ++t) {
+        workers.emplace_back( [&, t]() {
+            std::mt19937 rng( 1000 + t );
+            std::vector<size_t> order( keyCount );
+            for (size_t i = 0; i < keyCount; ++i) order[i] = i;
+
+            for (size_t round = 0; round < rounds; ++round) {
+                std::shuffle( order.begin(), order.end(), rng );
+                for (auto i : order) {
+                    if (!query(i)) mismatches++;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    return mismatches;
+}
+
+
+static bool medianMatches( const dcElement_t* median, const expected_t& expected )
+{
+    return std::equal( expected.median.begin(), expected.median.end(), median->element );
+}
+
+
+/** Flatten each key's element into one array, repeating the whole list, as a batch call sees a
+ *  character whose columns recur.
+ */
+static std::vector<packedChar> flattenTwice( const std::vector<dcElement_t*>& elements, size_t elementWidth )
+{
+    std::vector<packedChar> flat;
+    for (size_t copy = 0; copy < 2; ++copy) {
+        for (auto element : elements) {
+            flat.insert( flat.end(), element->element, element->element + elementWidth );
+        }
+    }
+    return flat;
+}
+
+
+/** Check a batch result over a twice-repeated key list against the serial results. */
+static size_t batchMismatches( const std::vector<unsigned int>& costs
+                             , const std::vector<packedChar>&   medians
+                             , const std::vector<expected_t>&   expected
+                             , size_t                           elementWidth
+                             )
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < costs.size(); ++i) {
+        auto& want = expected[i % expected.size()];
+        mismatches += costs[i] != want.cost
+                   || !std::equal( want.median.begin(), want.median.end(), medians.begin() + i * elementWidth );
+    }
+    return mismatches;
+}
+
+
+static size_t test2d( size_t alphabetSize, size_t keyCount, size_t threadCount )
+{
+    std::mt19937 rng( 42 );
+    auto tcm          = makeTCM( alphabetSize );
+    auto elementWidth = dcElemSize( alphabetSize );
+
+    std::vector<dcElement_t*> lefts, rights;
+    for (size_t i = 0; i < keyCount; ++i) {
+        lefts.push_back ( randomElement(alphabetSize, rng) );
+        rights.push_back( randomElement(alphabetSize, rng) );
+    }
+
+    // Serial reference results.
+    std::vector<expected_t> expected( keyCount );
+    {
+        CostMatrix_2d serial( alphabetSize, tcm );
+        auto median = allocateDCElement( alphabetSize );
+        for (size_t i = 0; i < keyCount; ++i) {
+            expected[i].cost   = serial.getSetCostMedian( lefts[i], rights[i], median );
+            expected[i].median = std::vector<packedChar>( median->element, median->element + elementWidth );
+        }
+        freeDCElem( median );
+        free( median );
+    }
+
+    CostMatrix_2d shared( alphabetSize, tcm );
+    const auto mismatches = runThreads( threadCount, keyCount, 4, [&]( size_t i ) {
+        // Each query has its own median buffer, as each Haskell call does.
+        auto median = allocateDCElement( alphabetSize );
+        auto cost   = shared.getSetCostMedian( lefts[i], rights[i], median );
+        auto ok     = cost == expected[i].cost && medianMatches( median, expected[i] );
+        freeDCElem( median );
+        free( median );
+        return ok;
+    });
+
+    printf( "  2D alphabet %3zu, %5zu keys, %2zu threads: %zu mismatches\n"
+          , alphabetSize, keyCount, threadCount, mismatches );
+
+    // Batched lookups on a fresh matrix, so that repeated columns are misses the first time.
+    size_t batchErrors;
+    {
+        CostMatrix_2d batched( alphabetSize, tcm );
+        auto flatLefts  = flattenTwice( lefts,  elementWidth );
+        auto flatRights = flattenTwice( rights, elementWidth );
+        std::vector<unsigned int> costs( 2 * keyCount );
+        std::vector<packedChar>   medians( flatLefts.size() );
+        batched.getSetCostMedianBatch( costs.size(), flatLefts.data(), flatRights.data(), costs.data(), medians.data() );
+        batchErrors = batchMismatches( costs, medians, expected, elementWidth );
+    }
+    printf( "  2D alphabet %3zu, %5zu keys, batched:    %zu mismatches\n"
+          , alphabetSize, 2 * keyCount, batchErrors );
+
+    freeElements( lefts );
+    freeElements( rights );
+    delete[] tcm;
+    return mismatches + batchErrors;
+}
+
+
+static size_t test3d( size_t alphabetSize, size_t keyCount, size_t threadCount )
+{
+    std::mt19937 rng( 1337 );
+    auto tcm          = makeTCM( alphabetSize );
+    auto elementWidth = dcElemSize( alphabetSize );
+
+    std::vector<dcElement_t*> firsts, seconds, thirds;
+    for (size_t i = 0; i < keyCount; ++i) {
+        firsts.push_back ( randomElement(alphabetSize, rng) );
+        seconds.push_back( randomElement(alphabetSize, rng) );
+        thirds.push_back ( randomElement(alphabetSize, rng) );
+    }
+
+    std::vector<expected_t> expected2d( keyCount ), expected3d( keyCount );
+    {
+        CostMatrix_3d serial( alphabetSize, tcm );
+        auto median = allocateDCElement( alphabetSize );
+        for (size_t i = 0; i < keyCount; ++i) {
+            expected3d[i].cost   = serial.costAndMedian3D( firsts[i], seconds[i], thirds[i], median );
+            expected3d[i].median = std::vector<packedChar>( median->element, median->element + elementWidth );
+            expected2d[i].cost   = serial.costAndMedian2D( firsts[i], thirds[i], median );
+            expected2d[i].median = std::vector<packedChar>( median->element, median->element + elementWidth );
+        }
+        freeDCElem( median );
+        free( median );
+    }
+
+    // Interleave 2D and 3D queries on the same object, as the postorder and preorder passes would.
+    CostMatrix_3d shared( alphabetSize, tcm );
+    const auto mismatches = runThreads( threadCount, keyCount, 4, [&]( size_t i ) {
+        auto median = allocateDCElement( alphabetSize );
+        auto cost   = shared.costAndMedian3D( firsts[i], seconds[i], thirds[i], median );
+        auto ok     = cost == expected3d[i].cost && medianMatches( median, expected3d[i] );
+
+        cost = shared.costAndMedian2D( firsts[i], thirds[i], median );
+        ok   = ok && cost == expected2d[i].cost && medianMatches( median, expected2d[i] );
+
+        freeDCElem( median );
+        free( median );
+        return ok;
+    });
+
+    printf( "  3D alphabet %3zu, %5zu keys, %2zu threads: %zu mismatches\n"
+          , alphabetSize, keyCount, threadCount, mismatches );
+
+    size_t batchErrors;
+    {
+        CostMatrix_3d batched( alphabetSize, tcm );
+        auto flatFirsts  = flattenTwice( firsts,  elementWidth );
+        auto flatSeconds = flattenTwice( seconds, elementWidth );
+        auto flatThirds  = flattenTwice( thirds,  elementWidth );
+        std::vector<unsigned int> costs( 2 * keyCount );
+        std::vector<packedChar>   medians( flatFirsts.size() );
+        batched.costAndMedianBatch3D( costs.size(), flatFirsts.data(), flatSeconds.data(), flatThirds.data()
+                                    , costs.data(), medians.data() );
+        batchErrors = batchMismatches( costs, medians, expected3d, elementWidth );
+
+        batched.costAndMedianBatch2D( costs.size(), flatFirsts.data(), flatThirds.data(), costs.data(), medians.data() );
+        batchErrors += batchMismatches( costs, medians, expected2d, elementWidth );
+    }
+    printf( "  3D alphabet %3zu, %5zu keys, batched:    %zu mismatches\n"
+          , alphabetSize, 2 * keyCount, batchErrors );
+
+    freeElements( firsts );
+    freeElements( seconds );
+    freeElements( thirds );
+    delete[] tcm;
+    return mismatches + batchErrors;
+}
+
+
+/** As test3d, but on a matrix bounded to far fewer entries than there are keys, so that entries
+ *  are evicted and recomputed while other threads are reading. Results must be unaffected, and
+ *  the memos must stay within their capacity.
+ */
+static size_t testBounded( size_t alphabetSize, size_t keyCount, size_t capacity, size_t threadCount )
+{
+    std::mt19937 rng( 4242 );
+    auto tcm          = makeTCM( alphabetSize );
+    auto elementWidth = dcElemSize( alphabetSize );
+
+    std::vector<dcElement_t*> firsts, seconds, thirds;
+    for (size_t i = 0; i < keyCount; ++i) {
+        firsts.push_back ( randomElement(alphabetSize, rng) );
+        seconds.push_back( randomElement(alphabetSize, rng) );
+        thirds.push_back ( randomElement(alphabetSize, rng) );
+    }
+
+    std::vector<expected_t> expected2d( keyCount ), expected3d( keyCount );
+    {
+        CostMatrix_3d serial( alphabetSize, tcm );
+        auto median = allocateDCElement( alphabetSize );
+        for (size_t i = 0; i < keyCount; ++i) {
+            expected3d[i].cost   = serial.costAndMedian3D( firsts[i], seconds[i], thirds[i], median );
+            expected3d[i].median = std::vector<packedChar>( median->element, median->element + elementWidth );
+            expected2d[i].cost   = serial.costAndMedian2D( firsts[i], thirds[i], median );
+            expected2d[i].median = std::vector<packedChar>( median->element, median->element + elementWidth );
+        }
+        freeDCElem( median );
+        free( median );
+    }
+
+    CostMatrix_3d bounded( alphabetSize, tcm, capacity );
+    auto mismatches = runThreads( threadCount, keyCount, 4, [&]( size_t i ) {
+        auto median = allocateDCElement( alphabetSize );
+        auto cost   = bounded.costAndMedian3D( firsts[i], seconds[i], thirds[i], median );
+        auto ok     = cost == expected3d[i].cost && medianMatches( median, expected3d[i] );
+
+        cost = bounded.costAndMedian2D( firsts[i], thirds[i], median );
+        ok   = ok && cost == expected2d[i].cost && medianMatches( median, expected2d[i] );
+
+        freeDCElem( median );
+        free( median );
+        return ok;
+    });
+
+    const auto stats2d = bounded.memoStats2D(),
+               stats3d = bounded.memoStats3D();
+    if (stats2d.entries > stats2d.capacity || stats3d.entries > stats3d.capacity) mismatches++;
+    // Every query is a lookup; the table is too small for most to be hits.
+    if (stats3d.hits + stats3d.misses != 4 * threadCount * keyCount || stats3d.evictions == 0) mismatches++;
+
+    printf( "  Bounded to %4zu, alphabet %3zu, %5zu keys, %2zu threads: %zu mismatches"
+            " (3D: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions)\n"
+          , capacity, alphabetSize, keyCount, threadCount, mismatches
+          , stats3d.hits, stats3d.misses, stats3d.evictions );
+
+    freeElements( firsts );
+    freeElements( seconds );
+    freeElements( thirds );
+    delete[] tcm;
+    return mismatches;
+}
+
+
+int main()
+{
+    const size_t threadCount = std::max<size_t>( 4, std::min<size_t>( 16, std::thread::hardware_concurrency() ) );
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing concurrent get/set of ambiguous characters. ******\n");
+
+    // Nucleotides, a protein-sized alphabet, and an alphabet spanning two packed words.
+    failures += test2d(  5,  2000, threadCount );
+    failures += test2d( 21,  5000, threadCount );
+    failures += test2d( 70,  2000, threadCount );
+    failures += test3d(  5,  2000, threadCount );
+    failures += test3d( 21,  3000, threadCount );
+    failures += test3d( 70,  1000, threadCount );
+    failures += testBounded( 21, 3000,  256, threadCount );
+    failures += testBounded( 70, 1000, 1000, threadCount );
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -43,7 +43,7 @@ int main() {
     */
 
 
-    CostMatrix_2d myMatrix = CostMatrix_2d(alphabetSize, tcm);
+    CostMatrix_2d myMatrix(alphabetSize, tcm);
 
 
     auto firstKey  = makeDCElement( alphabetSize, 1 );
@@ -109,6 +109,32 @@ int main() {
         ClearAll(secondKey->element, dynCharSize(alphabetSize, 1) );
     }
 
+    printf("\n\n\n******* Testing dense small-alphabet table against exhaustive search. ******\n");
+    // Every ambiguous pair is answered from the dense table; check each one against a direct
+    // minimization over all symbols and all member symbols of both elements.
+    size_t denseMismatches = 0;
+    for (packedChar left = 1; left < (CANONICAL_ONE << alphabetSize); ++left) {
+        for (packedChar right = 1; right < (CANONICAL_ONE << alphabetSize); ++right) {
+            unsigned int expectedCost   = UINT_MAX;
+            packedChar   expectedMedian = CANONICAL_ZERO;
+            for (size_t symbol = 0; symbol < alphabetSize; ++symbol) {
+                unsigned int leftMin = UINT_MAX, rightMin = UINT_MAX;
+                for (size_t member = 0; member < alphabetSize; ++member) {
+                    if (TestBit(&left,  member) && tcm[symbol * alphabetSize + member] < leftMin ) leftMin  = tcm[symbol * alphabetSize + member];
+                    if (TestBit(&right, member) && tcm[symbol * alphabetSize + member] < rightMin) rightMin = tcm[symbol * alphabetSize + member];
+                }
+                if (leftMin + rightMin <  expectedCost) { expectedCost = leftMin + rightMin; expectedMedian = 0; }
+                if (leftMin + rightMin == expectedCost) SetBit(&expectedMedian, symbol);
+            }
+
+            packedChar median = CANONICAL_ZERO;
+            const auto cost   = myMatrix.getSetCostMedian(&left, &right, &median);
+            if (cost != expectedCost || median != expectedMedian) ++denseMismatches;
+        }
+    }
+    printf("Mismatches: %zu\n", denseMismatches);
+    printf(denseMismatches ? "Failed!\n\n\n" : "Passed!\n\n\n");
+
     // Free everything we have allocated as to not mess with valgrind's leak diagnostics.
     freeDCElem(firstKey);
     freeDCElem(secondKey);
@@ -38,7 +38,7 @@ int main() {
     //     seqC_main[i] = (10 - i) / 2;
     // }
 
-    CostMatrix_3d myMatrix = CostMatrix_3d(alphabetSize, tcm);
+    CostMatrix_3d myMatrix(alphabetSize, tcm);
 
     auto firstKey  = makeDCElement( alphabetSize, 1 );
     auto secondKey = makeDCElement( alphabetSize, 1 );
@@ -0,0 +1,190 @@
+/** Test of persisted memos: populate a matrix, save its memos, and check that a fresh matrix with
+ *  the same TCM loads them (as hits, with the same values), keeps new entries in its overlay, and
+ *  saves base and overlay together. A matrix with a different TCM must not load them, nor any
+ *  matrix a file whose slots name records it does not have.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "../costMatrix_2d.hpp"
+#include "../costMatrix_3d.hpp"
+#include "../dynamicCharacterOperations.h"
+
+
+static size_t failures = 0;
+
+static void check( bool condition, const char* description )
+{
+    printf( "  %-60s %s\n", description, condition ? "ok" : "FAILED" );
+    failures += !condition;
+}
+
+
+static unsigned int* makeTCM( size_t alphabetSize, unsigned int offset )
+{
+    auto tcm = new unsigned int[alphabetSize * alphabetSize];
+    for (size_t i = 0; i < alphabetSize; ++i) {
+        for (size_t j = 0; j < alphabetSize; ++j) {
+            tcm[i * alphabetSize + j] = (i == j) ? 0 : offset + 1 + ((i + 2 * j) % 4);
+        }
+    }
+    return tcm;
+}
+
+
+int main()
+{
+    const size_t alphabetSize = 21;
+    const size_t elementSize  = dcElemSize( alphabetSize );
+    const size_t keyCount     = 3000;
+
+    char directory[] = "/tmp/pcg-memo-XXXXXX";
+    if (mkdtemp( directory ) == NULL) {
+        printf("Could not create a temporary directory.\n");
+        return 1;
+    }
+
+    printf("\n\n\n******* Testing saved and memory mapped memos. ******\n");
+
+    std::mt19937 rng( 7 );
+    auto symbolDist = std::uniform_int_distribution<size_t>( 0, alphabetSize - 1 );
+    std::vector<packedChar> keys( 3 * 2 * keyCount * elementSize, 0 );
+    for (size_t i = 0; i < keys.size() / elementSize; ++i) {
+        SetBit( keys.data() + i * elementSize, symbolDist(rng) );
+        SetBit( keys.data() + i * elementSize, symbolDist(rng) );
+    }
+    // Key i of the first half is saved; the second half is only ever queried after loading.
+    const auto key = [&]( size_t k, size_t i ) { return keys.data() + (k * 2 * keyCount + i) * elementSize; };
+
+    auto tcm   = makeTCM( alphabetSize, 0 );
+    auto other = makeTCM( alphabetSize, 1 );
+
+    std::vector<unsigned int> costs2d( 2 * keyCount ), costs3d( 2 * keyCount );
+    std::vector<packedChar>   medians2d( 2 * keyCount * elementSize ), medians3d( 2 * keyCount * elementSize );
+    {
+        CostMatrix_3d original( alphabetSize, tcm );
+        for (size_t i = 0; i < 2 * keyCount; ++i) {
+            costs2d[i] = original.costAndMedian2D( key(0, i), key(1, i), medians2d.data() + i * elementSize );
+            costs3d[i] = original.costAndMedian3D( key(0, i), key(1, i), key(2, i), medians3d.data() + i * elementSize );
+        }
+    }
+
+    // Save only the first half.
+    {
+        CostMatrix_3d first( alphabetSize, tcm );
+        check( !first.loadMemo( directory ), "nothing to load from an empty directory" );
+        for (size_t i = 0; i < keyCount; ++i) {
+            first.costAndMedian2D( key(0, i), key(1, i), NULL );
+            first.costAndMedian3D( key(0, i), key(1, i), key(2, i), NULL );
+        }
+        check( first.saveMemo( directory ), "save 2D and 3D memos" );
+    }
+
+    std::vector<packedChar> median( elementSize );
+    const auto matches = [&]( unsigned int cost, const std::vector<unsigned int>& costs
+                            , const std::vector<packedChar>& medians, size_t i ) {
+        return cost == costs[i]
+            && std::equal( median.begin(), median.end(), medians.begin() + i * elementSize );
+    };
+
+    // Reload; the first half must be hits, without computing anything.
+    {
+        CostMatrix_2d reloaded( alphabetSize, tcm );
+        check( reloaded.loadMemo( directory ), "load the saved 2D memo" );
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < keyCount; ++i) {
+            dcElement_t left   = { alphabetSize, key(0, i) },
+                        right  = { alphabetSize, key(1, i) },
+                        result = { alphabetSize, median.data() };
+            // getCostMedian() is a getter only: it returns -1 for anything not already stored.
+            wrong += !matches( reloaded.getCostMedian( &left, &right, &result ), costs2d, medians2d, i );
+        }
+        check( wrong == 0, "every saved 2D entry is a hit, with the same value" );
+    }
+
+    // Both halves through the 3D matrix, then save base and overlay together.
+    {
+        CostMatrix_3d reloaded( alphabetSize, tcm );
+        check( reloaded.loadMemo( directory ), "load the saved 2D and 3D memos" );
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < 2 * keyCount; ++i) {
+            wrong += !matches( reloaded.costAndMedian2D( key(0, i), key(1, i), median.data() ), costs2d, medians2d, i );
+            wrong += !matches( reloaded.costAndMedian3D( key(0, i), key(1, i), key(2, i), median.data() ), costs3d, medians3d, i );
+        }
+        check( wrong == 0, "loaded and newly computed entries match" );
+        check( reloaded.saveMemo( directory ), "save the loaded base and new overlay" );
+    }
+
+    {
+        CostMatrix_2d merged( alphabetSize, tcm );
+        check( merged.loadMemo( directory ), "load the merged 2D memo" );
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < 2 * keyCount; ++i) {
+            dcElement_t left   = { alphabetSize, key(0, i) },
+                        right  = { alphabetSize, key(1, i) },
+                        result = { alphabetSize, median.data() };
+            wrong += !matches( merged.getCostMedian( &left, &right, &result ), costs2d, medians2d, i );
+        }
+        check( wrong == 0, "every entry of both runs is a hit after merging" );
+    }
+
+    {
+        CostMatrix_3d different( alphabetSize, other );
+        check( !different.loadMemo( directory ), "a different TCM does not load them" );
+    }
+
+    // A slot naming a record past the last must not be attached, to be followed by findIn().
+    {
+        const auto path = memoFilePath( directory, hashTCM(alphabetSize, tcm), 2 );
+        std::vector<char> bytes;
+        {
+            std::ifstream in( path, std::ios::binary );
+            bytes.assign( std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() );
+        }
+        std::vector<uint64_t> words( bytes.size() / sizeof(uint64_t) );
+        std::memcpy( words.data(), bytes.data(), words.size() * sizeof(uint64_t) );
+
+        auto slot = words.begin() + memoFileHeaderWords;
+        while (*slot == 0) ++slot;
+        *slot |= 0xFFFFFFFF;
+        {
+            std::ofstream out( path, std::ios::binary | std::ios::trunc );
+            out.write( reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t) );
+        }
+
+        CostMatrix_2d corrupt( alphabetSize, tcm );
+        check( !corrupt.loadMemo( directory ), "a slot naming a missing record is not loaded" );
+    }
+
+    // Dense matrices have nothing to save, and write nothing.
+    {
+        CostMatrix_2d dense( 5, tcm );
+        check( dense.saveMemo( directory ) && dense.loadMemo( directory ), "dense matrices need no memo file" );
+    }
+
+    const std::string paths[] = { memoFilePath( directory, hashTCM(alphabetSize, tcm), 2 )
+                                , memoFilePath( directory, hashTCM(alphabetSize, tcm), 3 ) };
+    for (const auto& path : paths) std::remove( path.c_str() );
+    check( rmdir( directory ) == 0, "no other files were left behind" );
+
+    delete[] tcm;
+    delete[] other;
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
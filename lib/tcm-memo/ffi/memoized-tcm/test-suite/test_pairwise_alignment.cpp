@@ -0,0 +1,235 @@
+/** Tests alignPair2D() against a Needleman-Wunsch alignment of the whole plane that looks up every
+ *  cell in the memoized matrix: costs, columns and medians must be identical, for alphabets of
+ *  nucleotide, protein and two-word size, close and distant characters, and ambiguous elements.
+ *  Then times both on protein-sized characters.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../costMatrix_2d.hpp"
+#include "../dynamicCharacterOperations.h"
+#include "../pairwiseAlignment.hpp"
+
+
+struct alignment_t {
+    unsigned int               cost;
+    std::vector<unsigned char> columns;
+    std::vector<packedChar>    medians;   // Unpacked, elementSize words to a column.
+};
+
+
+/** A non-symmetric matrix with a more expensive gap (last symbol), and several substitution costs. */
+static std::vector<unsigned int> makeTCM( size_t alphabetSize )
+{
+    std::vector<unsigned int> tcm( alphabetSize * alphabetSize );
+    for (size_t i = 0; i < alphabetSize; ++i) {
+        for (size_t j = 0; j < alphabetSize; ++j) {
+            tcm[i * alphabetSize + j] = i == j                                         ? 0
+                                      : i == alphabetSize - 1 || j == alphabetSize - 1 ? 3 + (i < j)
+                                      :                                                  1 + (i + 2 * j) % 3;
+        }
+    }
+    return tcm;
+}
+
+
+/** Elements of elementSize words: mostly single symbols other than the gap, some ambiguous. */
+static std::vector<packedChar> randomCharacter( size_t alphabetSize, size_t length, std::mt19937& rng )
+{
+    const size_t elementSize = dcElemSize( alphabetSize );
+    auto symbol = std::uniform_int_distribution<size_t>( 0, alphabetSize - 2 );
+
+    std::vector<packedChar> elements( length * elementSize, 0 );
+    for (size_t i = 0; i < length; ++i) {
+        const size_t bits = rng() % 6 ? 1 : 2 + rng() % 3;
+        for (size_t b = 0; b < bits; ++b) SetBit( elements.data() + i * elementSize, symbol(rng) );
+    }
+    return elements;
+}
+
+
+/** A copy of @elements with about one element in @rate substituted, deleted or duplicated. */
+static std::vector<packedChar> mutate( const std::vector<packedChar>& elements, size_t alphabetSize, size_t rate, std::mt19937& rng )
+{
+    const size_t elementSize = dcElemSize( alphabetSize );
+    std::vector<packedChar> result;
+    for (size_t i = 0; i < elements.size() / elementSize; ++i) {
+        const auto element = elements.begin() + i * elementSize;
+        const size_t change = rng() % (3 * rate);
+        if (change == 2) {
+            const auto other = randomCharacter( alphabetSize, 1, rng );
+            result.insert( result.end(), other.begin(), other.end() );
+        }
+        else if (change != 0) {
+            const size_t copies = change == 1 ? 2 : 1;
+            for (size_t c = 0; c < copies; ++c) result.insert( result.end(), element, element + elementSize );
+        }
+    }
+    return result;
+}
+
+
+static std::vector<packedChar> pack( const std::vector<packedChar>& elements, size_t alphabetSize )
+{
+    const size_t elementSize = dcElemSize( alphabetSize ),
+                 length      = elements.size() / elementSize;
+    std::vector<packedChar> packed( dynCharSize( alphabetSize, length ) + 1, 0 );
+    for (size_t i = 0; i < length; ++i) {
+        for (size_t b = 0; b < alphabetSize; ++b) {
+            if (TestBit( elements.data() + i * elementSize, b )) SetBit( packed.data(), i * alphabetSize + b );
+        }
+    }
+    return packed;
+}
+
+
+static alignment_t alignBanded( CostMatrix_2d& matrix, const std::vector<packedChar>& first, const std::vector<packedChar>& second )
+{
+    const size_t alphabetSize = matrix.alphabetSize,
+                 elementSize  = matrix.elementSize,
+                 firstLength  = first.size()  / elementSize,
+                 secondLength = second.size() / elementSize;
+    const auto   firstPacked  = pack( first,  alphabetSize ),
+                 secondPacked = pack( second, alphabetSize );
+
+    alignment_t result;
+    std::vector<packedChar> packedMedians( dynCharSize( alphabetSize, firstLength + secondLength ) + 1 );
+    result.columns.resize( firstLength + secondLength );
+    size_t length = 0;
+    result.cost = alignPair2D( matrix, firstLength, firstPacked.data(), secondLength, secondPacked.data()
+                             , packedMedians.data(), result.columns.data(), &length );
+    result.columns.resize( length );
+
+    result.medians.assign( length * elementSize, 0 );
+    for (size_t c = 0; c < length; ++c) {
+        for (size_t b = 0; b < alphabetSize; ++b) {
+            if (TestBit( packedMedians.data(), c * alphabetSize + b )) SetBit( result.medians.data() + c * elementSize, b );
+        }
+    }
+    return result;
+}
+
+
+/** Needleman-Wunsch over the whole plane, the first character down the rows, preferring an
+ *  alignment, then a deletion, then an insertion between equal costs.
+ */
+static alignment_t alignFullPlane( CostMatrix_2d& matrix, const std::vector<packedChar>& first, const std::vector<packedChar>& second )
+{
+    const size_t elementSize = matrix.elementSize,
+                 rows        = first.size()  / elementSize + 1,
+                 cols        = second.size() / elementSize + 1;
+    std::vector<packedChar> gap( elementSize, 0 );
+    SetBit( gap.data(), matrix.alphabetSize - 1 );
+
+    const auto firstElem  = [&]( size_t i ) { return first.data()  + i * elementSize; };
+    const auto secondElem = [&]( size_t j ) { return second.data() + j * elementSize; };
+
+    std::vector<unsigned int>  costs( rows * cols );
+    std::vector<unsigned char> dirs ( rows * cols );
+    for (size_t i = 0; i < rows; ++i) {
+        for (size_t j = 0; j < cols; ++j) {
+            unsigned int  best = i == 0 && j == 0 ? 0 : UINT_MAX;
+            unsigned char dir  = ALIGN_COLUMN;
+            if (i > 0 && j > 0) {
+                best = costs[(i - 1) * cols + j - 1] + matrix.getSetCostMedian( firstElem(i - 1), secondElem(j - 1), nullptr );
+            }
+            if (j > 0) {
+                const unsigned int del = costs[i * cols + j - 1] + matrix.getSetCostMedian( gap.data(), secondElem(j - 1), nullptr );
+                if (del < best) { best = del; dir = DELETE_COLUMN; }
+            }
+            if (i > 0) {
+                const unsigned int ins = costs[(i - 1) * cols + j] + matrix.getSetCostMedian( firstElem(i - 1), gap.data(), nullptr );
+                if (ins < best) { best = ins; dir = INSERT_COLUMN; }
+            }
+            costs[i * cols + j] = best;
+            dirs [i * cols + j] = dir;
+        }
+    }
+
+    alignment_t result;
+    result.cost = costs.back();
+    std::vector<packedChar> median( elementSize );
+    for (size_t i = rows - 1, j = cols - 1; i > 0 || j > 0; ) {
+        const unsigned char dir = dirs[i * cols + j];
+        const packedChar *lhs = dir == DELETE_COLUMN ? gap.data() : firstElem(--i),
+                         *rhs = dir == INSERT_COLUMN ? gap.data() : secondElem(--j);
+        matrix.getSetCostMedian( lhs, rhs, median.data() );
+        result.columns.push_back( dir );
+        result.medians.insert( result.medians.begin(), median.begin(), median.end() );
+    }
+    std::reverse( result.columns.begin(), result.columns.end() );
+    return result;
+}
+
+
+static double secondsSince( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+
+int main()
+{
+    std::mt19937 rng( 61 );
+    size_t failures = 0;
+
+    printf("\n\n\n******* Testing pairwise alignment with memoized costs. ******\n");
+
+    // Nucleotides, a protein-sized alphabet, and an alphabet spanning two packed words.
+    for (const size_t alphabetSize : { 5, 21, 70 }) {
+        auto          tcm = makeTCM( alphabetSize );
+        CostMatrix_2d matrix( alphabetSize, tcm.data() );
+
+        size_t wrong = 0;
+        for (size_t k = 0; k < 60; ++k) {
+            // Empty, short and long, close and distant, and the longer first as often as second.
+            const size_t length = k % 10 == 0 ? 0 : rng() % (k % 3 ? 40 : 250) + 1;
+            auto first  = randomCharacter( alphabetSize, length, rng ),
+                 second = k % 4 ? mutate( first, alphabetSize, k % 4 == 3 ? 3 : 12, rng )
+                                : randomCharacter( alphabetSize, rng() % 60, rng );
+            if (k % 2) std::swap( first, second );
+
+            const auto expected = alignFullPlane( matrix, first, second ),
+                       actual   = alignBanded( matrix, first, second );
+            wrong += expected.cost != actual.cost || expected.columns != actual.columns || expected.medians != actual.medians;
+        }
+        printf("  alphabet %3zu  %-50s %s\n", alphabetSize, "the alignment of the whole plane", wrong ? "FAILED" : "ok");
+        failures += wrong;
+    }
+
+    printf("\n******* Timing protein alignments. ******\n");
+    {
+        auto          tcm = makeTCM( 21 );
+        CostMatrix_2d matrix( 21, tcm.data() );
+        for (const size_t length : { 300, 1000 }) {
+            for (const size_t rate : { 10, 2 }) {
+                const auto first  = randomCharacter( 21, length, rng ),
+                           second = mutate( first, 21, rate, rng );
+
+                auto start = std::chrono::steady_clock::now();
+                const auto expected = alignFullPlane( matrix, first, second );
+                const double full = secondsSince( start );
+
+                start = std::chrono::steady_clock::now();
+                const auto actual = alignBanded( matrix, first, second );
+                const double banded = secondsSince( start );
+
+                failures += expected.cost != actual.cost;
+                printf( "  length %5zu  %-8s   whole plane %8.4f s   banded, cached %8.4f s\n"
+                      , length, rate == 10 ? "close" : "distant", full, banded );
+            }
+        }
+    }
+
+    if (failures) {
+        printf("Failed!\n\n\n");
+        return 1;
+    }
+    printf("Passed!\n\n\n");
+    return 0;
+}
@@ -12,9 +12,17 @@
 
 module Data.TCM.Memoized
   ( FFI.MemoizedCostMatrix
+  , FFI.MemoStats(..)
   , generateMemoizedTransitionCostMatrix
+  , generateBoundedMemoizedTransitionCostMatrix
+  , FFI.getMemoizedCostMatrixStats
+  , FFI.loadMemoizedCostMatrix
+  , FFI.saveMemoizedCostMatrix
+  , FFI.getAlignmentAndCost2D
   , FFI.getMedianAndCost2D
   , FFI.getMedianAndCost3D
+  , FFI.getMediansAndCosts2D
+  , FFI.getMediansAndCosts3D
   ) where
 
 import qualified Data.TCM.Memoized.FFI as FFI
@@ -38,3 +46,19 @@ generateMemoizedTransitionCostMatrix
   -> (Word -> Word -> Word) -- ^ Generating function
   -> FFI.MemoizedCostMatrix
 generateMemoizedTransitionCostMatrix = FFI.getMemoizedCostMatrix
+
+
+-- |
+-- /O(n^2)/ where @n@ is the alphabet size.
+--
+-- As 'generateMemoizedTransitionCostMatrix', but keeping at most the given
+-- number of ambiguous transitions memoized in each of the 2D and 3D memos, so
+-- that memory use stays bounded over long analyses. When a memo is full, an
+-- approximately least recently used transition is evicted, and recomputed if
+-- it is needed again. A capacity of 0 means no bound.
+generateBoundedMemoizedTransitionCostMatrix
+  :: Word                   -- ^ Memo capacity
+  -> Word                   -- ^ Alphabet size
+  -> (Word -> Word -> Word) -- ^ Generating function
+  -> FFI.MemoizedCostMatrix
+generateBoundedMemoizedTransitionCostMatrix = FFI.getBoundedMemoizedCostMatrix